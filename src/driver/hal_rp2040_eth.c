@@ -1,5 +1,9 @@
 
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE       /* recvmmsg() */
+#endif
+
 #include "rtapi.h"      /* RTAPI realtime OS API */
 #include "rtapi_app.h"    /* RTAPI realtime module decls */
 
@@ -20,6 +24,18 @@ static int num_joints = 0;
 MODULE_PARM(num_joints, "i");
 MODULE_PARM_DESC(num_joints, "Number of joints configured in LinuxCNC ([KINS]JOINTS)");
 
+static char *ip[MAX_DEVICES] = {"192.168.12.2"};
+RTAPI_MP_ARRAY_STRING(ip, MAX_DEVICES, "IP address of each RP2040 board, comma separated");
+
+static int joints[MAX_DEVICES] = {0};
+RTAPI_MP_ARRAY_INT(joints, MAX_DEVICES, "Joints on each board; a single board defaults to num_joints");
+
+static char *capture = "";
+RTAPI_MP_STRING(capture, "File to record every packet sent and received to; empty = off");
+
+static int capture_records = 16384;
+RTAPI_MP_INT(capture_records, "Packets the capture file keeps, oldest overwritten first");
+
 
 /***********************************************************************
  *                STRUCTURES AND GLOBAL VARIABLES                       *
@@ -33,6 +49,8 @@ MODULE_PARM_DESC(num_joints, "Number of joints configured in LinuxCNC ([KINS]JOI
 
 /* pointer to array of skeleton_t structs in shared memory, 1 per port */
 static skeleton_t *port_data_array;
+static int board_count = 1;
+static int board_joints[MAX_DEVICES];
 
 /* other globals */
 static int component_id;    /* component ID */
@@ -41,6 +59,8 @@ static int component_id;    /* component ID */
  *                  LOCAL FUNCTION DECLARATIONS                         *
  ************************************************************************/
 static void write_port(void *arg, long period);
+static void read_port(void *arg, long period);
+static void update_board_pins(skeleton_t *data);
 
 /***********************************************************************
  *                       INIT AND EXIT CODE                             *
@@ -245,48 +265,42 @@ static const PinDef scalar_pins[] = {
     { FLOAT, HAL_OUT, offsetof(skeleton_t, update_underrun), 0, "update-underrun", -1, 0, NULL }, // EMA of cycles where Core1 found no new update from Core0
     { U32,   HAL_OUT, offsetof(skeleton_t, core1_work_us),   0, "core1-work-us",   -1, 0, NULL }, // µs Core1 spent working last period (excludes time waiting for tick)
     { U32,   HAL_OUT, offsetof(skeleton_t, core0_work_us),   0, "core0-work-us",   -1, 0, NULL }, // µs Core0 spent working last period (packet received → response sent, incl. modbus)
+    { U32,   HAL_OUT, offsetof(skeleton_t, periods_coasted), 0, "periods-coasted", -1, 0, NULL }, // Total missed updates the RP2040 coasted through, see coast-periods
+    { U32,   HAL_OUT, offsetof(skeleton_t, feedback_mode),    0, "feedback-mode",    -1, 0, NULL }, // Receive that delivered this cycle's feedback: 0 none, 1 after send (previous cycle), 2 read funct, 3 same cycle
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, clock_offset_us),  0, "clock-offset-us",  -1, 0, NULL }, // RP2040 clock minus host clock (µs), from the least delayed recent clock sync
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, clock_drift_ppm),  0, "clock-drift-ppm",  -1, 0, NULL }, // Rate the RP2040 clock gains on the host clock (ppm)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, latency_up_us),    0, "latency-up-us",    -1, 0, NULL }, // One-way latency host → RP2040 of the last clock sync (µs)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, latency_down_us),  0, "latency-down-us",  -1, 0, NULL }, // One-way latency RP2040 → host of the last clock sync (µs)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, round_trip_us),    0, "round-trip-us",    -1, 0, NULL }, // Host send to reply receipt of the last clock sync (µs); 0 until measured
+    { S32,   HAL_OUT, offsetof(skeleton_t, tick_phase_error_us), 0, "tick-phase-error-us", -1, 0, NULL }, // How far the RP2040 tick was from the shared timebase before sync-ticks moved it (µs)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, hist_p50_us[HIST_SEND]), 0, "hist.send.p50-us", -1, 0, NULL }, // p50 of composing and sending the packet (µs)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, hist_p99_us[HIST_SEND]), 0, "hist.send.p99-us", -1, 0, NULL }, // p99 of composing and sending the packet (µs)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, hist_max_us[HIST_SEND]), 0, "hist.send.max-us", -1, 0, NULL }, // max of composing and sending the packet (µs)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, hist_p50_us[HIST_RECEIVE]), 0, "hist.receive.p50-us", -1, 0, NULL }, // p50 of receive calls per cycle, less unpacking (µs)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, hist_p99_us[HIST_RECEIVE]), 0, "hist.receive.p99-us", -1, 0, NULL }, // p99 of receive calls per cycle, less unpacking (µs)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, hist_max_us[HIST_RECEIVE]), 0, "hist.receive.max-us", -1, 0, NULL }, // max of receive calls per cycle, less unpacking (µs)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, hist_p50_us[HIST_UNPACK]), 0, "hist.unpack.p50-us", -1, 0, NULL }, // p50 of unpacking replies per cycle (µs)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, hist_p99_us[HIST_UNPACK]), 0, "hist.unpack.p99-us", -1, 0, NULL }, // p99 of unpacking replies per cycle (µs)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, hist_max_us[HIST_UNPACK]), 0, "hist.unpack.max-us", -1, 0, NULL }, // max of unpacking replies per cycle (µs)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, hist_p50_us[HIST_ROUND_TRIP]), 0, "hist.round-trip.p50-us", -1, 0, NULL }, // p50 of MSG_TIMING packed to its echo unpacked (µs)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, hist_p99_us[HIST_ROUND_TRIP]), 0, "hist.round-trip.p99-us", -1, 0, NULL }, // p99 of MSG_TIMING packed to its echo unpacked (µs)
+    { FLOAT, HAL_OUT, offsetof(skeleton_t, hist_max_us[HIST_ROUND_TRIP]), 0, "hist.round-trip.max-us", -1, 0, NULL }, // max of MSG_TIMING packed to its echo unpacked (µs)
+    { PIN,   HAL_IN,  offsetof(skeleton_t, hist_reset),       0, "hist.reset",       -1, 0, NULL }, // Clear the timing histograms while set
+    { U32,   HAL_OUT, offsetof(skeleton_t, tx_class_bytes[TX_CLASS_MOTION]), 0, "tx-bytes-motion", -1, 0, NULL }, // Bytes of timing and joint setpoints sent last cycle
+    { U32,   HAL_OUT, offsetof(skeleton_t, tx_class_bytes[TX_CLASS_GPIO]),   0, "tx-bytes-gpio",   -1, 0, NULL }, // Bytes of GPIO and spindle speed sent last cycle
+    { U32,   HAL_OUT, offsetof(skeleton_t, tx_class_bytes[TX_CLASS_CONFIG]), 0, "tx-bytes-config", -1, 0, NULL }, // Bytes of version and config messages sent last cycle
+    { U32,   HAL_OUT, offsetof(skeleton_t, tx_class_bytes[TX_CLASS_DIAG]),   0, "tx-bytes-diag",   -1, 0, NULL }, // Bytes of clock sync and coast allowance sent last cycle
 };
 
-int rtapi_app_main(void)
+/* Export the pins and params of one board as rp2040_eth.<device_num>.* */
+static int export_board(int device_num, skeleton_t *port)
 {
-  char name[HAL_NAME_LEN + 1];
   int retval;
 
-  /* only one device at the moment */
-  int device_num = 0;
-
-  /* STEP 1: initialise the driver */
-  component_id = hal_init("hal_rp2040_eth");
-  if (component_id < 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR,
-        "RP2040: ERROR: hal_init() failed\n");
-    return -1;
-  }
-
-  printf("RP2040: INFO: driver version %d.%d.%d branch 0x%08x\n",
-      PROTOCOL_VERSION_MAJOR, PROTOCOL_VERSION_MINOR, PROTOCOL_VERSION_PATCH,
-      PROTOCOL_VERSION_BRANCH);
-
-  if (num_joints <= 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR,
-        "RP2040: ERROR: num_joints not set — defaulting to %d. "
-        "Add num_joints=[KINS]JOINTS to your loadrt line: "
-        "loadrt hal_rp2040_eth num_joints=[KINS]JOINTS\n", MAX_JOINT);
-    num_joints = MAX_JOINT;
-  }
-
-  /* STEP 2: allocate shared memory for skeleton data */
-  port_data_array = hal_malloc(sizeof(skeleton_t));
-  if (port_data_array == 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR,
-        "RP2040: ERROR: hal_malloc() failed\n");
-    goto port_error;
-  }
-
   /* Set some default values. */
   for(int gpio_bank = 0; gpio_bank < MAX_GPIO_BANK; gpio_bank++) {
-    port_data_array->gpio_data_received[gpio_bank] = 0;
-    port_data_array->gpio_confirmation_pending[gpio_bank] = true;
+    port->gpio_data_received[gpio_bank] = 0;
+    port->gpio_confirmation_pending[gpio_bank] = true;
   }
 
 
@@ -294,129 +308,270 @@ int rtapi_app_main(void)
   for (int i = 0; i < MAX_GPIO; i++) {
     for (int j = 0; j < ARRAY_SIZE(gpio_pins); j++) {
       const PinDef* def = &gpio_pins[j];
-      void* fp = (void*)((char*)port_data_array + def->offset + i * def->stride);
+      void* fp = (void*)((char*)port + def->offset + i * def->stride);
       if (!init_hal_pin(def->type, def->dir, fp, component_id, device_num,
                         def->io_type, i, def->chan_num_len, def->specific_name)) {
-        goto port_error;
+        return -1;
       }
     }
     for (int j = 0; j < ARRAY_SIZE(gpio_params); j++) {
       const ParamDef* def = &gpio_params[j];
-      void* fp = (void*)((char*)port_data_array + def->offset + i * def->stride);
+      void* fp = (void*)((char*)port + def->offset + i * def->stride);
       if (!init_hal_param(def->type, fp, component_id, device_num,
                           def->io_type, i, def->chan_num_len, def->specific_name)) {
-        goto port_error;
+        return -1;
       }
     }
   }
   /* Default values written after all pins/params are registered. */
   for (int i = 0; i < MAX_GPIO; i++) {
-    *port_data_array->gpio_data_in[i]         = true;
-    *port_data_array->gpio_data_in_not[i]     = false;
-    *port_data_array->gpio_data_out[i]        = false;
-    *port_data_array->gpio_data_out_invert[i] = false;
-    port_data_array->gpio_type[i]    = GPIO_TYPE_NOT_SET;
-    port_data_array->gpio_index[i]   = 0;
-    port_data_array->gpio_address[i] = 0;
+    *port->gpio_data_in[i]         = true;
+    *port->gpio_data_in_not[i]     = false;
+    *port->gpio_data_out[i]        = false;
+    *port->gpio_data_out_invert[i] = false;
+    port->gpio_type[i]    = GPIO_TYPE_NOT_SET;
+    port->gpio_index[i]   = 0;
+    port->gpio_address[i] = 0;
   }
 
   for (int j = 0; j < ARRAY_SIZE(scalar_pins); j++) {
     const PinDef* def = &scalar_pins[j];
-    void* fp = (void*)((char*)port_data_array + def->offset);
+    void* fp = (void*)((char*)port + def->offset);
     if (!init_hal_pin(def->type, def->dir, fp, component_id, device_num,
                       def->io_type, def->chan_num, def->chan_num_len, def->specific_name)) {
-      goto port_error;
+      return -1;
     }
   }
-  *port_data_array->machine_on = false;
+  *port->machine_on = false;
+  *port->periods_coasted = 0;
+  *port->tick_phase_error_us = 0;
+  *port->hist_reset = false;
+  port->hist_refresh = 0;
+  for (int hist = 0; hist < HIST_COUNT; hist++) {
+    histogram_reset(&port->hist[hist]);
+  }
+
+  retval = hal_param_u32_newf(HAL_RW, &(port->coast_periods),
+      component_id, "rp2040_eth.%d.coast-periods", device_num);
+  if (retval < 0) {
+    return -1;
+  }
+  port->coast_periods = 0;
+
+  retval = hal_param_u32_newf(HAL_RW, &(port->reply_wait_us),
+      component_id, "rp2040_eth.%d.reply-wait-us", device_num);
+  if (retval < 0) {
+    return -1;
+  }
+  port->reply_wait_us = 0;
+
+  retval = hal_param_u32_newf(HAL_RW, &(port->sync_ticks),
+      component_id, "rp2040_eth.%d.sync-ticks", device_num);
+  if (retval < 0) {
+    return -1;
+  }
+  port->sync_ticks = 0;
 
   for (int i = 0; i < MAX_JOINT; i++) {
     for (int j = 0; j < ARRAY_SIZE(joint_pins); j++) {
       const PinDef* def = &joint_pins[j];
-      void* fp = (void*)((char*)port_data_array + def->offset + i * def->stride);
+      void* fp = (void*)((char*)port + def->offset + i * def->stride);
       if (!init_hal_pin(def->type, def->dir, fp, component_id, device_num,
                         def->io_type, i, def->chan_num_len, def->specific_name)) {
-        goto port_error;
+        return -1;
       }
     }
     for (int j = 0; j < ARRAY_SIZE(joint_params); j++) {
       const ParamDef* def = &joint_params[j];
-      void* fp = (void*)((char*)port_data_array + def->offset + i * def->stride);
+      void* fp = (void*)((char*)port + def->offset + i * def->stride);
       if (!init_hal_param(def->type, fp, component_id, device_num,
                           def->io_type, i, def->chan_num_len, def->specific_name)) {
-        goto port_error;
+        return -1;
       }
     }
   }
   for (int i = 0; i < MAX_JOINT; i++) {
-    *port_data_array->joint_enable_cmd[i]  = false;
-    port_data_array->joint_gpio_step[i]    = -1;
-    port_data_array->joint_gpio_dir[i]     = -1;
-    port_data_array->joint_cmd_type[i]     = JOINT_CMD_POSITION;
+    *port->joint_enable_cmd[i]  = false;
+    port->joint_gpio_step[i]    = -1;
+    port->joint_gpio_dir[i]     = -1;
+    port->joint_cmd_type[i]     = JOINT_CMD_POSITION;
   }
 
   /* Export spindle pins. */
   for (int i = 0; i < MAX_SPINDLE; i++) {
     for (int j = 0; j < ARRAY_SIZE(spindle_pins); j++) {
       const PinDef* def = &spindle_pins[j];
-      void* fp = (void*)((char*)port_data_array + def->offset + i * def->stride);
+      void* fp = (void*)((char*)port + def->offset + i * def->stride);
       if (!init_hal_pin(def->type, def->dir, fp, component_id, device_num,
                         def->io_type, i, def->chan_num_len, def->specific_name)) {
-        goto port_error;
+        return -1;
       }
     }
 
-    retval = hal_param_u32_newf(HAL_RW, &(port_data_array->spindle_vfd_type[i]),
+    retval = hal_param_u32_newf(HAL_RW, &(port->spindle_vfd_type[i]),
         component_id, "rp2040_eth.%d.spindle.%d.vfd-type", device_num, i);
     if (retval < 0) {
-      goto port_error;
+      return -1;
     }
-    port_data_array->spindle_vfd_type[i] = MODBUS_TYPE_NOT_SET;
+    port->spindle_vfd_type[i] = MODBUS_TYPE_NOT_SET;
 
-    retval = hal_param_u32_newf(HAL_RW, &(port_data_array->spindle_address[i]),
+    retval = hal_param_u32_newf(HAL_RW, &(port->spindle_address[i]),
         component_id, "rp2040_eth.%d.spindle.%d.address", device_num, i);
     if (retval < 0) {
-      goto port_error;
+      return -1;
     }
-    port_data_array->spindle_address[i] = 1;
+    port->spindle_address[i] = 1;
 
-    retval = hal_param_float_newf(HAL_RW, &(port_data_array->spindle_poles[i]),
+    retval = hal_param_float_newf(HAL_RW, &(port->spindle_poles[i]),
         component_id, "rp2040_eth.%d.spindle.%d.poles", device_num, i);
     if (retval < 0) {
-      goto port_error;
+      return -1;
     }
-    port_data_array->spindle_poles[i] = 2;
+    port->spindle_poles[i] = 2;
 
-    retval = hal_param_u32_newf(HAL_RW, &(port_data_array->spindle_bitrate[i]),
+    retval = hal_param_u32_newf(HAL_RW, &(port->spindle_bitrate[i]),
         component_id, "rp2040_eth.%d.spindle.%d.bitrate", device_num, i);
     if (retval < 0) {
+      return -1;
+    }
+    port->spindle_bitrate[i] = 9600;
+  }
+
+  return 0;
+}
+
+int rtapi_app_main(void)
+{
+  char name[HAL_NAME_LEN + 1];
+  int retval = 0;
+  int device_num = 0;
+
+  /* STEP 1: initialise the driver */
+  component_id = hal_init("hal_rp2040_eth");
+  if (component_id < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR,
+        "RP2040: ERROR: hal_init() failed\n");
+    return -1;
+  }
+
+  printf("RP2040: INFO: driver version %d.%d.%d branch 0x%08x\n",
+      PROTOCOL_VERSION_MAJOR, PROTOCOL_VERSION_MINOR, PROTOCOL_VERSION_PATCH,
+      PROTOCOL_VERSION_BRANCH);
+
+  board_count = 0;
+  while (board_count < MAX_DEVICES && ip[board_count] && ip[board_count][0]) {
+    board_count++;
+  }
+  if (board_count == 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "RP2040: ERROR: no board ip given\n");
+    hal_exit(component_id);
+    return -1;
+  }
+
+  if (board_count == 1 && joints[0] <= 0) {
+    if (num_joints <= 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR,
+          "RP2040: ERROR: num_joints not set — defaulting to %d. "
+          "Add num_joints=[KINS]JOINTS to your loadrt line: "
+          "loadrt hal_rp2040_eth num_joints=[KINS]JOINTS\n", MAX_JOINT);
+      num_joints = MAX_JOINT;
+    }
+    joints[0] = num_joints;
+  }
+
+  int total_joints = 0;
+  for (device_num = 0; device_num < board_count; device_num++) {
+    if (joints[device_num] <= 0 || joints[device_num] > MAX_JOINT) {
+      rtapi_print_msg(RTAPI_MSG_ERR,
+          "RP2040: ERROR: joints for board %d must be 1 to %d. "
+          "With more than one board, list the joints on each: "
+          "loadrt hal_rp2040_eth ip=192.168.12.2,192.168.12.3 joints=4,4\n",
+          device_num, MAX_JOINT);
+      hal_exit(component_id);
+      return -1;
+    }
+    board_joints[device_num] = joints[device_num];
+    total_joints += joints[device_num];
+  }
+  if (num_joints > 0 && total_joints != num_joints) {
+    rtapi_print_msg(RTAPI_MSG_ERR,
+        "RP2040: WARN: boards have %d joints between them but num_joints is %d\n",
+        total_joints, num_joints);
+  }
+
+  /* STEP 2: allocate shared memory for skeleton data */
+  port_data_array = hal_malloc(board_count * sizeof(skeleton_t));
+  if (port_data_array == 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR,
+        "RP2040: ERROR: hal_malloc() failed\n");
+    goto port_error;
+  }
+  memset(port_data_array, 0, board_count * sizeof(skeleton_t));
+
+  /* STEP 3: export pins and params, rp2040_eth.N.* for board N */
+  for (device_num = 0; device_num < board_count; device_num++) {
+    if (export_board(device_num, &port_data_array[device_num]) < 0) {
       goto port_error;
     }
-    port_data_array->spindle_bitrate[i] = 9600;
   }
+  device_num = 0;
 
-  /* STEP 4: export write function */
-  rtapi_snprintf(name, sizeof(name), "rp2040_eth.%d.write", device_num);
-  retval = hal_export_funct(name, write_port, &(port_data_array[device_num]), 1, 0,
+  /* STEP 4: export read and write functions. Board 0's service every board
+   * so their packets can go out together. */
+  rtapi_snprintf(name, sizeof(name), "rp2040_eth.%d.read", device_num);
+  retval = hal_export_funct(name, read_port, port_data_array, 1, 0,
       component_id);
   if (retval < 0) {
     rtapi_print_msg(RTAPI_MSG_ERR,
-        "RP2040: ERROR: port %d write funct export failed\n",
+        "RP2040: ERROR: port %d read funct export failed\n",
         device_num);
     goto port_error;
   }
 
-  retval = init_eth(device_num);
-
+  rtapi_snprintf(name, sizeof(name), "rp2040_eth.%d.write", device_num);
+  retval = hal_export_funct(name, write_port, port_data_array, 1, 0,
+      component_id);
   if (retval < 0) {
     rtapi_print_msg(RTAPI_MSG_ERR,
-        "RP2040: ERROR: Failed to find device %d on the network.\n",
+        "RP2040: ERROR: port %d write funct export failed\n",
         device_num);
     goto port_error;
   }
 
+  for (device_num = 0; device_num < board_count; device_num++) {
+    retval = init_eth(device_num, ip[device_num]);
+
+    if (retval < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR,
+          "RP2040: ERROR: Failed to find device %d on the network.\n",
+          device_num);
+      goto port_error;
+    }
+  }
+  eth_state_reset();
+
+  if (capture && capture[0] != '\0') {
+    retval = capture_start(capture, capture_records > 0 ? capture_records : 0);
+    if (retval != 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR,
+          "RP2040: WARNING: packet capture to %s failed: %s\n", capture, strerror(retval));
+    } else {
+      rtapi_print_msg(RTAPI_MSG_INFO,
+          "RP2040: capturing the last %d packets to %s\n", capture_records, capture);
+    }
+  }
+
+  /* From here on the servo thread queues its messages for a drain thread
+   * rather than printing them itself. */
+  retval = rtlog_start();
+  if (retval != 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR,
+        "RP2040: WARNING: deferred logging failed, printing directly: %s\n",
+        strerror(retval));
+  }
+
   rtapi_print_msg(RTAPI_MSG_INFO,
-      "RP2040: installed driver.\n");
+      "RP2040: installed driver for %d board(s).\n", board_count);
   hal_ready(component_id);
   return 0;
 
@@ -431,6 +586,24 @@ port_error:
 void rtapi_app_exit(void)
 {
   hal_exit(component_id);
+  capture_stop();
+  rtlog_stop();
+}
+
+/**************************************************************
+ * REALTIME PORT READ FUNCTION                                 *
+ **************************************************************/
+
+/* Optional; addf at the start of the servo thread so motion sees the replies
+ * that arrived since the last write in this cycle rather than the next. */
+static void read_port(void *arg, long period)
+{
+  skeleton_t *boards = arg;
+  (void)period;
+
+  for (int device = 0; device < board_count; device++) {
+    eth_state_read(&boards[device], device);
+  }
 }
 
 /**************************************************************
@@ -440,10 +613,23 @@ void rtapi_app_exit(void)
 static void write_port(void *arg, long period)
 {
   static size_t count = 0;
-  skeleton_t *data = arg;
+  skeleton_t *boards = arg;
+
+  for (int device = 0; device < board_count; device++) {
+    boards[device].period_ns = period;
+  }
+  eth_state_update_boards(boards, board_count, count, (uint32_t)rtapi_get_time(), board_joints);
 
-  eth_state_update(data, 0, count, (uint32_t)rtapi_get_time(), num_joints);
+  for (int device = 0; device < board_count; device++) {
+    update_board_pins(&boards[device]);
+  }
+
+  count++;
+}
 
+/* Pins derived from the feedback once the cycle's replies are in. */
+static void update_board_pins(skeleton_t *data)
+{
   /* Sync position: if joint not enabled, track RP position so LinuxCNC
    * resumes from the right place after enabling. */
   for(uint32_t joint = 0; joint < MAX_JOINT; joint++) {
@@ -454,10 +640,20 @@ static void write_port(void *arg, long period)
 
   /* Compute per-joint suggested FERROR: vel-limit × round-trip-latency.
    * Velocity mode uses 2× because a full reversal swings f-error by
-   * 2×latency×vel.  Zero when eth is down or packet-interval is not valid. */
+   * 2×latency×vel.  Once clock sync has measured the round trip, latency is
+   * that plus the period the RP2040 takes to step to a setpoint.  The round
+   * trip ends at the kernel's receive stamp, not when the reply is unpacked,
+   * so it holds no servo period of its own and the period is counted once.
+   * Until then latency is counted in whole cycles.  Zero when eth is down or
+   * packet-interval is not valid. */
   hal_s32_t latency_cycles = (hal_s32_t)*data->seq_out - (hal_s32_t)*data->seq_in;
-  if (*data->eth_up && *data->packet_interval > 0 && latency_cycles > 0) {
-    double latency_s = (double)latency_cycles * (double)*data->packet_interval * 1e-9;
+  double latency_s = 0.0;
+  if (*data->round_trip_us > 0.0) {
+    latency_s = (double)*data->packet_interval * 1e-9 + *data->round_trip_us * 1e-6;
+  } else if (latency_cycles > 0) {
+    latency_s = (double)latency_cycles * (double)*data->packet_interval * 1e-9;
+  }
+  if (*data->eth_up && *data->packet_interval > 0 && latency_s > 0.0) {
     for (uint32_t joint = 0; joint < MAX_JOINT; joint++) {
       double vl = fabs((double)*data->joint_vel_limit[joint]);
       double multiplier = (data->joint_cmd_type[joint] == JOINT_CMD_VELOCITY) ? 2.0 : 1.0;
@@ -468,7 +664,5 @@ static void write_port(void *arg, long period)
       *data->joint_ferror_suggest[joint] = 0.0f;
     }
   }
-
-  count++;
 }
 
@@ -0,0 +1,252 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rp2040_capture.h"
+#include "rp2040_defines.h"
+
+/* Packet capture.
+ * The servo thread copies each packet into a bounded lock-free queue with
+ * capture_packet(); it never blocks or allocates, and drops
+ * the record (counted in the file header) if the queue is full.
+ * A writer thread empties the queue into a memory mapped file holding the
+ * last capacity records, which can be read while LinuxCNC is still running or
+ * after it has crashed. */
+
+/* Must be a power of two. At 1kHz with one board this is ~0.5s of traffic
+ * the writer may fall behind by before records are dropped. */
+#define CAPTURE_RING_LEN        1024
+#define CAPTURE_WRITER_SLEEP_NS 1000000
+
+static_assert((CAPTURE_RING_LEN & (CAPTURE_RING_LEN - 1)) == 0,
+              "CAPTURE_RING_LEN must be a power of two");
+
+/* Bounded queue after Vyukov: a slot's sequence says whether it is free for
+ * the producer at that position or holds a record for the consumer. Safe with
+ * more than one producer, so the read and write functs may sit on different
+ * threads. */
+struct CaptureSlot {
+  _Atomic uint32_t sequence;
+  struct CaptureRecord record;
+};
+
+struct CaptureRing {
+  _Atomic uint32_t head;      // Next position to write.
+  _Atomic uint32_t dropped;   // Records lost because the ring was full.
+  uint32_t tail;              // Next position to read. Consumer only.
+  struct CaptureSlot slots[CAPTURE_RING_LEN];
+};
+
+/* Writer side of the mapped file. */
+struct CaptureFile {
+  int fd;
+  struct CaptureFileHeader* header;
+  size_t size;
+};
+
+static struct CaptureRing* capture_ring = NULL;
+static _Atomic bool capture_active = false;
+
+static struct CaptureFile capture_file = {.fd = -1};
+static pthread_t capture_thread;
+static _Atomic bool capture_thread_run = false;
+
+/* Allocate the ring. Not RT safe. Returns false if out of memory. */
+bool capture_ring_init(void) {
+  if(capture_ring == NULL) {
+    capture_ring = malloc(sizeof(*capture_ring));
+    if(capture_ring == NULL) {
+      return false;
+    }
+  }
+  atomic_store_explicit(&capture_ring->head, 0, memory_order_relaxed);
+  atomic_store_explicit(&capture_ring->dropped, 0, memory_order_relaxed);
+  capture_ring->tail = 0;
+  for(uint32_t pos = 0; pos < CAPTURE_RING_LEN; pos++) {
+    atomic_store_explicit(&capture_ring->slots[pos].sequence, pos, memory_order_relaxed);
+  }
+  atomic_store_explicit(&capture_active, true, memory_order_release);
+  return true;
+}
+
+void capture_ring_free(void) {
+  atomic_store_explicit(&capture_active, false, memory_order_release);
+  free(capture_ring);
+  capture_ring = NULL;
+}
+
+/* Record one packet. RT safe; does nothing unless capture is running.
+ * length is the number of bytes of packet sent or received. */
+void capture_packet(
+    uint8_t direction, int device, uint32_t seq_out,
+    const struct NWBuffer* packet, size_t length
+) {
+  if(!atomic_load_explicit(&capture_active, memory_order_acquire)) {
+    return;
+  }
+  struct CaptureRing* ring = capture_ring;
+  uint32_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  struct CaptureSlot* slot;
+  for(;;) {
+    slot = &ring->slots[pos & (CAPTURE_RING_LEN - 1)];
+    uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    int32_t diff = (int32_t)(sequence - pos);
+    if(diff == 0) {
+      if(atomic_compare_exchange_weak_explicit(
+            &ring->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+        break;
+      }
+    } else if(diff < 0) {
+      atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+      return;
+    } else {
+      pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    }
+  }
+
+  if(length > sizeof(struct NWBuffer)) {
+    length = sizeof(struct NWBuffer);
+  }
+  slot->record.time_ns = host_time_ns();
+  slot->record.seq_out = seq_out;
+  slot->record.device = (uint8_t)device;
+  slot->record.direction = direction;
+  slot->record.length = (uint16_t)length;
+  memcpy(&slot->record.packet, packet, length);
+  atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+}
+
+/* Take the oldest record off the ring. Single consumer.
+ * Returns false if the ring is empty. */
+bool capture_pop(struct CaptureRecord* record) {
+  struct CaptureRing* ring = capture_ring;
+  if(ring == NULL) {
+    return false;
+  }
+  uint32_t pos = ring->tail;
+  struct CaptureSlot* slot = &ring->slots[pos & (CAPTURE_RING_LEN - 1)];
+  uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+  if(sequence != pos + 1) {
+    return false;
+  }
+  memcpy(record, &slot->record, sizeof(*record));
+  atomic_store_explicit(&slot->sequence, pos + CAPTURE_RING_LEN, memory_order_release);
+  ring->tail = pos + 1;
+  return true;
+}
+
+/* Create path holding capacity records and map it. Returns 0 or errno. */
+int capture_file_open(struct CaptureFile* file, const char* path, uint32_t capacity) {
+  if(capacity == 0) {
+    return EINVAL;
+  }
+  file->size = capture_file_size(capacity);
+  file->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(file->fd < 0) {
+    return errno;
+  }
+  if(ftruncate(file->fd, file->size) != 0) {
+    int error = errno;
+    close(file->fd);
+    file->fd = -1;
+    return error;
+  }
+  void* map = mmap(NULL, file->size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+  if(map == MAP_FAILED) {
+    int error = errno;
+    close(file->fd);
+    file->fd = -1;
+    return error;
+  }
+  file->header = map;
+  file->header->magic = CAPTURE_MAGIC;
+  file->header->version = CAPTURE_VERSION;
+  file->header->record_size = sizeof(struct CaptureRecord);
+  file->header->capacity = capacity;
+  file->header->dropped = 0;
+  file->header->written = 0;
+  return 0;
+}
+
+/* Move everything queued on the ring into the file.
+ * Returns the number of records written. */
+size_t capture_file_drain(struct CaptureFile* file) {
+  struct CaptureFileHeader* header = file->header;
+  size_t count = 0;
+  if(capture_ring == NULL) {
+    return 0;
+  }
+  while(capture_pop(capture_file_records(header) + header->written % header->capacity)) {
+    /* A reader of the live file sees written move only after the record is
+     * complete. */
+    atomic_thread_fence(memory_order_release);
+    header->written++;
+    count++;
+  }
+  header->dropped = atomic_load_explicit(&capture_ring->dropped, memory_order_relaxed);
+  return count;
+}
+
+void capture_file_close(struct CaptureFile* file) {
+  if(file->fd < 0) {
+    return;
+  }
+  msync(file->header, file->size, MS_SYNC);
+  munmap(file->header, file->size);
+  close(file->fd);
+  file->fd = -1;
+  file->header = NULL;
+}
+
+static void* capture_writer(void* arg) {
+  (void)arg;
+  const struct timespec pause = {.tv_sec = 0, .tv_nsec = CAPTURE_WRITER_SLEEP_NS};
+  while(atomic_load_explicit(&capture_thread_run, memory_order_acquire)) {
+    if(capture_file_drain(&capture_file) == 0) {
+      nanosleep(&pause, NULL);
+    }
+  }
+  return NULL;
+}
+
+/* Start recording every packet to path, which keeps the last capacity.
+ * Not RT safe; call before the servo thread starts. Returns 0 or errno. */
+int capture_start(const char* path, uint32_t capacity) {
+  if(!capture_ring_init()) {
+    return ENOMEM;
+  }
+  int error = capture_file_open(&capture_file, path, capacity);
+  if(error != 0) {
+    capture_ring_free();
+    return error;
+  }
+  atomic_store_explicit(&capture_thread_run, true, memory_order_release);
+  error = pthread_create(&capture_thread, NULL, capture_writer, NULL);
+  if(error != 0) {
+    atomic_store_explicit(&capture_thread_run, false, memory_order_release);
+    capture_file_close(&capture_file);
+    capture_ring_free();
+  }
+  return error;
+}
+
+/* Stop the writer, flush what is left on the ring and close the file.
+ * Call once the servo thread no longer runs. */
+void capture_stop(void) {
+  if(!atomic_load_explicit(&capture_thread_run, memory_order_acquire)) {
+    return;
+  }
+  atomic_store_explicit(&capture_active, false, memory_order_release);
+  atomic_store_explicit(&capture_thread_run, false, memory_order_release);
+  pthread_join(capture_thread, NULL);
+  capture_file_drain(&capture_file);
+  capture_file_close(&capture_file);
+  capture_ring_free();
+}
@@ -0,0 +1,74 @@
+#ifndef RP2040_CAPTURE__H
+#define RP2040_CAPTURE__H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include "../shared/buffer.h"
+
+/* Packet capture: every packet the driver sends or receives, as recorded by
+ * rp2040_capture.c and written to a file for src/tools/replay_*.c. */
+
+#define CAPTURE_TX  0   /* Driver to RP2040. */
+#define CAPTURE_RX  1   /* RP2040 to driver. */
+
+struct CaptureRecord {
+  uint64_t time_ns;           // Host CLOCK_MONOTONIC when captured.
+  uint32_t seq_out;           // The board's seq-out at the time.
+  uint8_t  device;
+  uint8_t  direction;         // CAPTURE_TX or CAPTURE_RX
+  uint16_t length;            // Bytes of packet on the wire.
+  struct NWBuffer packet;     // Only the first length bytes are meaningful.
+};
+
+static_assert(sizeof(struct CaptureRecord) % 8 == 0, "CaptureRecord must keep records aligned");
+
+/* File layout: this header, then capacity CaptureRecords used as a ring.
+ * Record i of the capture is at (i % capacity). */
+#define CAPTURE_MAGIC    0x31435052u  // "RPC1"
+#define CAPTURE_VERSION  1
+
+struct CaptureFileHeader {
+  uint32_t magic;             // CAPTURE_MAGIC
+  uint16_t version;           // CAPTURE_VERSION
+  uint16_t record_size;       // sizeof(struct CaptureRecord)
+  uint32_t capacity;          // Records the file holds.
+  uint32_t dropped;           // Records lost because the writer fell behind.
+  uint64_t written;           // Records written since capture started.
+  uint64_t _reserved;
+};
+
+static_assert(sizeof(struct CaptureFileHeader) == 32, "CaptureFileHeader layout changed");
+
+static inline struct CaptureRecord* capture_file_records(struct CaptureFileHeader* header) {
+  return (struct CaptureRecord*)(header + 1);
+}
+
+static inline size_t capture_file_size(uint32_t capacity) {
+  return sizeof(struct CaptureFileHeader) + (size_t)capacity * sizeof(struct CaptureRecord);
+}
+
+/* Index of the oldest record still in the file. Records
+ * capture_file_first() to header->written - 1 can be read in order. */
+static inline uint64_t capture_file_first(const struct CaptureFileHeader* header) {
+  return header->written > header->capacity ? header->written - header->capacity : 0;
+}
+
+static inline const struct CaptureRecord* capture_file_record(
+    const struct CaptureFileHeader* header, uint64_t index
+) {
+  return capture_file_records((struct CaptureFileHeader*)header) + index % header->capacity;
+}
+
+/* True if header describes a file of file_size bytes this build can read. */
+static inline int capture_file_valid(const struct CaptureFileHeader* header, size_t file_size) {
+  return file_size >= sizeof(*header)
+      && header->magic == CAPTURE_MAGIC
+      && header->version == CAPTURE_VERSION
+      && header->record_size == sizeof(struct CaptureRecord)
+      && header->capacity > 0
+      && file_size >= capture_file_size(header->capacity);
+}
+
+#endif  // RP2040_CAPTURE__H
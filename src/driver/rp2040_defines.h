@@ -2,8 +2,47 @@
 #define RP2040_DEFINES__H
 
 
-#define MAX_DEVICES 1 /* Maximum number of RP2040 boards that can be connected. */
+#define MAX_DEVICES 4 /* Maximum number of RP2040 boards that can be connected. */
+
+/* Replies read per recvmmsg() call, and calls per servo cycle, when draining
+ * the socket. */
+#define NW_RX_BATCH        16
+#define NW_RX_MAX_BATCHES  4
+/* Socket buffer the kernel charges a queued reply (its skb truesize). Replies
+ * are a few hundred bytes, so this is the buffer the NIC driver allocated
+ * plus the sk_buff itself, not the payload: typically 768 to 2304 bytes
+ * depending on the driver. */
+#define NW_RX_REPLY_TRUESIZE  1024
+
+/* Classes of message sent to the RP2040, highest priority first.
+ * eth_state_update() packs them in this order; lower classes get whatever
+ * room is left and are deferred to a later cycle if they do not fit. */
+#define TX_CLASS_MOTION  0  /* Timing, feedback ack and joint setpoints. */
+#define TX_CLASS_GPIO    1  /* GPIO banks and spindle speed. */
+#define TX_CLASS_CONFIG  2  /* Version request and joint/GPIO/spindle config. */
+#define TX_CLASS_DIAG    3  /* Clock sync and the coast allowance. */
+#define TX_CLASS_COUNT   4
+
+/* Which receive delivered the joint feedback, as shown on the feedback-mode pin. */
+#define FEEDBACK_NONE        0  /* No reply this cycle. */
+#define FEEDBACK_PREVIOUS    1  /* Drained after sending; the reply to an earlier packet. */
+#define FEEDBACK_READ        2  /* Drained by the read funct at the start of the thread. */
+#define FEEDBACK_SAME_CYCLE  3  /* The reply to the packet just sent, caught by the spin-wait. */
+
+/* Servo thread timings kept as histograms, per board. Values are ns. */
+#define HIST_SEND        0  /* Composing and sending the packet. */
+#define HIST_RECEIVE     1  /* Receive calls this cycle, less unpacking; includes reply-wait-us. */
+#define HIST_UNPACK      2  /* Unpacking this cycle's replies. */
+#define HIST_ROUND_TRIP  3  /* Packet composed to its REPLY_TIMING echo unpacked. */
+#define HIST_COUNT       4
+/* Cycles between percentile refreshes. One histogram is walked per refresh,
+ * round-robin, so each pin set updates every HIST_COUNT * this many cycles. */
+#define HIST_REFRESH_CYCLES  16
 
 uint8_t get_detected_joint_count(void);
 
+/* Host CLOCK_MONOTONIC, defined in rp2040_network.c. */
+uint64_t host_time_ns(void);
+uint64_t host_time_us(void);
+
 #endif  // RP2040_DEFINES__H
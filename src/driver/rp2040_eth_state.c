@@ -20,88 +20,239 @@
 #include <stdint.h>
 
 #include "../rp2040/modbus.h"    /* MODBUS_TYPE_NOT_SET */
+#include "../shared/config_hash.h"
 
 #define MAX_SKIPPED_PACKETS 10
 
+/* Config items: every joint, then every GPIO, then every spindle. */
+#define CONFIG_ITEM_GPIO     MAX_JOINT
+#define CONFIG_ITEM_SPINDLE  (MAX_JOINT + MAX_GPIO)
+#define CONFIG_ITEM_COUNT    (MAX_JOINT + MAX_GPIO + MAX_SPINDLE)
+#define CONFIG_ITEM_WORDS    ((CONFIG_ITEM_COUNT + 31) / 32)
+
+/* Servo cycles to wait for REPLY_*_CONFIG before sending an item again.
+ * The reply normally arrives within a cycle or two. */
+#define CONFIG_RESEND_CYCLES 8
+
 /* reset_rp_config is defined below on_eth_down but called from it. */
 static void reset_rp_config(skeleton_t *data);
 
 /* ---- module-level state (moved from write_port() static locals) ---- */
 
-/* configure() diffs against these before sending. Initialised to {0} so the
- * first cycle always resends full config. On LinuxCNC restart the driver
+/* State for one RP2040. eth_state_select() points eth at the board being
+ * serviced.
+ *
+ * update_config_state() diffs against last_*_config before sending. Zeroed so
+ * the first cycle always resends full config. On LinuxCNC restart the driver
  * process also restarts, reinitialising these to {0} — no RP2040-side action
  * required. On Ethernet-down, reset_rp_config() clears them to force resend
- * (including enable=false) when the link recovers. */
-static struct Message_joint_config   last_joint_config[MAX_JOINT]   = {0};
-static struct Message_gpio_config    last_gpio_config[MAX_GPIO]      = {0};
-static struct Message_spindle_config last_spindle_config[MAX_SPINDLE]= {0};
-
-static uint32_t last_update_id   = 0;
-static int      last_errno       = 0;
-static int      cooloff          = 0;
-static int      send_fail_count  = 0;
-static bool     waiting_logged   = false;
-static size_t   last_confirmed   = (size_t)-1;
-
-
-/* Reset all module state. Called from eth_state_reset() and indirectly by
- * on_eth_down() via reset_rp_config().  Must be kept in sync with the static
- * initialisers above. */
+ * (including enable=false) when the link recovers.
+ *
+ * config_dirty, config_unconfirmed and config_in_flight are bitmaps over
+ * config items. update_config_state() keeps the first two in step with the
+ * HAL pins and last_*_config, rechecking an item only when its HAL inputs
+ * change or its REPLY_*_CONFIG arrives. config_unconfirmed ignores joint
+ * enable, and unconfirmed_count counts it over the first counted_joints
+ * joints, every GPIO and every spindle, for config-complete.
+ * config_in_flight marks items sent but not yet confirmed, with
+ * config_sent_at holding the cycle they went out. */
+struct JointConfigInputs {
+  hal_bit_t   enable;
+  hal_s32_t   gpio_step;
+  hal_s32_t   gpio_dir;
+  hal_u32_t   cmd_type;
+  hal_float_t vel_limit;
+  hal_float_t accel_limit;
+  hal_float_t scale;
+};
+
+struct SpindleConfigInputs {
+  hal_u32_t vfd_type;
+  hal_u32_t address;
+  hal_u32_t bitrate;
+};
+
+struct EthState {
+  struct Message_joint_config   last_joint_config[MAX_JOINT];
+  struct Message_gpio_config    last_gpio_config[MAX_GPIO];
+  struct Message_spindle_config last_spindle_config[MAX_SPINDLE];
+
+  uint32_t last_update_id;
+  int      last_errno;
+  int      cooloff;
+  uint64_t flash_hold_until_us; /* Board writing flash until host_time_us() reaches this. */
+  int      send_fail_count;
+  bool     waiting_logged;
+  size_t   last_confirmed;
+  size_t   config_slot;         /* First item to try; held at the first deferred one. */
+  bool     spindle_speed_due;
+
+  uint32_t config_dirty[CONFIG_ITEM_WORDS];
+  uint32_t config_unconfirmed[CONFIG_ITEM_WORDS];
+  uint32_t config_in_flight[CONFIG_ITEM_WORDS];
+  size_t   config_sent_at[CONFIG_ITEM_COUNT];
+  size_t   unconfirmed_count;
+
+  /* HAL inputs as config_dirty was last evaluated from them. Cleared
+   * config_evaluated forces every item to be rechecked. */
+  bool     config_evaluated;
+  size_t   active_joints;
+  size_t   counted_joints;
+  struct JointConfigInputs   joint_inputs[MAX_JOINT];
+  hal_u32_t gpio_type[MAX_GPIO];
+  hal_u32_t gpio_index[MAX_GPIO];
+  hal_u32_t gpio_address[MAX_GPIO];
+  struct SpindleConfigInputs spindle_inputs[MAX_SPINDLE];
+};
+
+static struct EthState eth_states[MAX_DEVICES];
+static struct EthState* eth = &eth_states[0];
+
+/* Timebase shared by every board with sync-ticks set, in host µs.
+ * tick_target_us is the tick they are all asked to make this cycle; 0 when
+ * no board is synced. */
+#define TICK_GRID_SLEW_SHIFT 4      // Follow the servo thread with weight 1/16.
+static bool     tick_grid_valid = false;
+static uint64_t tick_target_us  = 0;
+
+/* Service board device from here on, here and in rp2040_network.c. */
+static void eth_state_select(int device) {
+  eth = &eth_states[device];
+  select_device(device);
+}
+
+
+/* Reset all module state, for every board. Called once at load; must run
+ * before the first eth_state_update(). */
 void eth_state_reset(void) {
-    memset(last_joint_config,   0, sizeof(last_joint_config));
-    memset(last_gpio_config,    0, sizeof(last_gpio_config));
-    memset(last_spindle_config, 0, sizeof(last_spindle_config));
-    last_update_id  = 0;
-    last_errno      = 0;
-    cooloff         = 0;
-    send_fail_count = 0;
-    waiting_logged  = false;
-    last_confirmed  = (size_t)-1;
+  for(int device = MAX_DEVICES - 1; device >= 0; device--) {
+    eth_state_select(device);
+    memset(eth, 0, sizeof(*eth));
+    eth->last_confirmed = (size_t)-1;
     reset_version_check();
+  }
+  tick_grid_valid = false;
+  tick_target_us  = 0;
+}
+
+/* Step the shared tick one servo period on, pulled gently towards the time
+ * the slowest synced board gets this cycle's packet plus a quarter period,
+ * the margin recover_clock() leaves without sync. A step of more than half a
+ * period, as after a servo thread stall, restarts the grid. */
+static void update_tick_grid(skeleton_t *data, int board_count) {
+  double latency_us = -1.0;
+  for(int device = 0; device < board_count; device++) {
+    if(data[device].sync_ticks && *data[device].round_trip_us > 0.0) {
+      double up = *data[device].latency_up_us > 0.0 ? *data[device].latency_up_us : 0.0;
+      latency_us = up > latency_us ? up : latency_us;
+    }
+  }
+  int64_t period_us = data[0].period_ns / 1000;
+  if(latency_us < 0.0 || period_us <= 0) {
+    tick_grid_valid = false;
+    tick_target_us  = 0;
+    return;
+  }
+
+  uint64_t due_us = host_time_us() + (uint64_t)latency_us + period_us / 4;
+  if(!tick_grid_valid) {
+    tick_grid_valid = true;
+    tick_target_us  = due_us;
+    return;
+  }
+  tick_target_us += period_us;
+  int64_t error = (int64_t)(due_us - tick_target_us);
+  if(error > period_us / 2 || error < -period_us / 2) {
+    tick_target_us = due_us;
+  } else {
+    tick_target_us += error / (1 << TICK_GRID_SLEW_SHIFT);
+  }
 }
 
 
 /* ---- configure helpers (HAL-free; call serialize_* from rp2040_network.c) ---- */
 
-static bool configure_joint(
-    struct NWBuffer* tx_buffer,
-    uint8_t joint,
-    skeleton_t *data
-) {
-    bool pack_success = true;
+/* Send if anything differs from the last config the firmware confirmed.
+ * last_*_config only update on receipt of the matching REPLY_*_CONFIG, so a
+ * lost packet leaves the diff intact and the item is resent. */
+static bool joint_config_confirmed(uint8_t joint, skeleton_t *data) {
     float max_velocity_ticks =
       (float)((*data->joint_vel_limit[joint]) * (*data->joint_scale[joint]));
     float max_accel_ticks =
       (float)((*data->joint_accel_limit[joint]) * (*data->joint_scale[joint]));
-    /* Send if anything changed, or if no reply has arrived yet (last_joint_config
-     * only updates in unpack_joint_config on receipt of REPLY_JOINT_CONFIG, so a
-     * lost packet leaves the diff intact and causes an automatic retry). */
-    if(
-        last_joint_config[joint].enable != *data->joint_enable_cmd[joint]
+    return !(
+        eth->last_joint_config[joint].gpio_step != data->joint_gpio_step[joint]
+        ||
+        eth->last_joint_config[joint].gpio_dir != data->joint_gpio_dir[joint]
         ||
-        last_joint_config[joint].gpio_step != data->joint_gpio_step[joint]
+        eth->last_joint_config[joint].max_velocity != max_velocity_ticks
         ||
-        last_joint_config[joint].gpio_dir != data->joint_gpio_dir[joint]
+        eth->last_joint_config[joint].max_accel != max_accel_ticks
         ||
-        last_joint_config[joint].max_velocity != max_velocity_ticks
+        eth->last_joint_config[joint].cmd_type != data->joint_cmd_type[joint]);
+}
+
+static bool joint_config_dirty(uint8_t joint, skeleton_t *data) {
+    return eth->last_joint_config[joint].enable != *data->joint_enable_cmd[joint]
+        || !joint_config_confirmed(joint, data);
+}
+
+static bool gpio_config_dirty(uint8_t gpio, skeleton_t *data) {
+    return
+        eth->last_gpio_config[gpio].gpio_type != data->gpio_type[gpio]
         ||
-        last_joint_config[joint].max_accel != max_accel_ticks
+        eth->last_gpio_config[gpio].index != data->gpio_index[gpio]
         ||
-        last_joint_config[joint].cmd_type != data->joint_cmd_type[joint]
-      ) {
-      pack_success = pack_success && serialize_joint_config(
-          tx_buffer,
-          joint,
-          *data->joint_enable_cmd[joint],
-          data->joint_gpio_step[joint],
-          data->joint_gpio_dir[joint],
-          max_velocity_ticks,
-          max_accel_ticks,
-          data->joint_cmd_type[joint]
-          );
+        eth->last_gpio_config[gpio].address != data->gpio_address[gpio];
+}
+
+/* Spindles with no VFD count as confirmed. */
+static bool spindle_config_confirmed(uint8_t spindle, skeleton_t *data) {
+    return data->spindle_vfd_type[spindle] == MODBUS_TYPE_NOT_SET
+        || (eth->last_spindle_config[spindle].vfd_type       == data->spindle_vfd_type[spindle]
+         && eth->last_spindle_config[spindle].modbus_address == data->spindle_address[spindle]
+         && eth->last_spindle_config[spindle].bitrate        == data->spindle_bitrate[spindle]);
+}
+
+static bool spindle_config_dirty(uint8_t spindle, skeleton_t *data) {
+    if(data->spindle_vfd_type[spindle] == MODBUS_TYPE_NOT_SET) {
+      return false;
+    }
+    if(spindle > 0) {
+      static bool warned = false;
+      if(!warned) {
+        rtlog_printf("ERROR: More than one spindle not yet implemented.\n");
+        warned = true;
+      }
+      return false;
     }
-    return pack_success;
+    return
+        eth->last_spindle_config[spindle].vfd_type != data->spindle_vfd_type[spindle]
+        ||
+        eth->last_spindle_config[spindle].modbus_address != data->spindle_address[spindle]
+        ||
+        eth->last_spindle_config[spindle].bitrate != data->spindle_bitrate[spindle];
+}
+
+static bool configure_joint(
+    struct NWBuffer* tx_buffer,
+    uint8_t joint,
+    skeleton_t *data
+) {
+    float max_velocity_ticks =
+      (float)((*data->joint_vel_limit[joint]) * (*data->joint_scale[joint]));
+    float max_accel_ticks =
+      (float)((*data->joint_accel_limit[joint]) * (*data->joint_scale[joint]));
+    return serialize_joint_config(
+        tx_buffer,
+        joint,
+        *data->joint_enable_cmd[joint],
+        data->joint_gpio_step[joint],
+        data->joint_gpio_dir[joint],
+        max_velocity_ticks,
+        max_accel_ticks,
+        data->joint_cmd_type[joint]
+        );
 }
 
 static bool configure_gpio(
@@ -109,26 +260,13 @@ static bool configure_gpio(
     uint8_t gpio,
     skeleton_t *data
 ) {
-    bool pack_success = true;
-    /* Send if anything changed, or if no reply has arrived yet (last_gpio_config
-     * only updates in unpack_gpio_config on receipt of REPLY_GPIO_CONFIG, so a
-     * lost packet leaves the diff intact and causes an automatic retry). */
-    if(
-        last_gpio_config[gpio].gpio_type != data->gpio_type[gpio]
-        ||
-        last_gpio_config[gpio].index != data->gpio_index[gpio]
-        ||
-        last_gpio_config[gpio].address != data->gpio_address[gpio]
-    ) {
-      pack_success = pack_success && serialize_gpio_config(
-          tx_buffer,
-          gpio,
-          data->gpio_type[gpio],
-          data->gpio_index[gpio],
-          data->gpio_address[gpio]
-        );
-    }
-    return pack_success;
+    return serialize_gpio_config(
+        tx_buffer,
+        gpio,
+        data->gpio_type[gpio],
+        data->gpio_index[gpio],
+        data->gpio_address[gpio]
+      );
 }
 
 static bool configure_spindle(
@@ -136,75 +274,75 @@ static bool configure_spindle(
     uint8_t spindle,
     skeleton_t *data
 ) {
-    if(data->spindle_vfd_type[spindle] == MODBUS_TYPE_NOT_SET) {
-      return true;
-    }
-    if(spindle > 0) {
-      printf("ERROR: More than one spindle not yet implemented.\n");
-      return false;
-    }
+    return serialise_spindle_config(
+        tx_buffer,
+        spindle,
+        data->spindle_vfd_type[spindle],
+        data->spindle_address[spindle],
+        data->spindle_bitrate[spindle]
+    );
+}
 
-    bool pack_success = true;
-    /* Send if anything changed, or if no reply has arrived yet (last_spindle_config
-     * only updates in unpack_spindle_config on receipt of REPLY_SPINDLE_CONFIG, so a
-     * lost packet leaves the diff intact and causes an automatic retry). */
-    if(
-        last_spindle_config[spindle].vfd_type != data->spindle_vfd_type[spindle]
-        ||
-        last_spindle_config[spindle].modbus_address != data->spindle_address[spindle]
-        ||
-        last_spindle_config[spindle].bitrate != data->spindle_bitrate[spindle]
-    ) {
-      pack_success = pack_success && serialise_spindle_config(
-          tx_buffer,
-          spindle,
-          data->spindle_vfd_type[spindle],
-          data->spindle_address[spindle],
-          data->spindle_bitrate[spindle]
-      );
-    }
-    return pack_success;
-}
-
-static size_t count_confirmed_configs(skeleton_t *data, int num_joints) {
-  size_t confirmed = 0;
-  for(int j = 0; j < num_joints; j++) {
-    float vel = (float)((*data->joint_vel_limit[j]) * (*data->joint_scale[j]));
-    float acc = (float)((*data->joint_accel_limit[j]) * (*data->joint_scale[j]));
-    if(last_joint_config[j].gpio_step == data->joint_gpio_step[j]
-    && last_joint_config[j].gpio_dir  == data->joint_gpio_dir[j]
-    && last_joint_config[j].max_velocity == vel
-    && last_joint_config[j].max_accel    == acc
-    && last_joint_config[j].cmd_type  == data->joint_cmd_type[j]) {
-      confirmed++;
-    }
+/* The config the HAL pins ask for, as firmware would record it for
+ * FEATURE_CONFIG_CACHE: joint enable is left at 0. */
+static struct Message_joint_config hal_joint_config(uint8_t joint, skeleton_t *data) {
+  struct Message_joint_config message = {0};
+  message.type         = MSG_SET_JOINT_CONFIG;
+  message.joint        = joint;
+  message.gpio_step    = data->joint_gpio_step[joint];
+  message.gpio_dir     = data->joint_gpio_dir[joint];
+  message.cmd_type     = data->joint_cmd_type[joint];
+  message.max_velocity =
+    (float)((*data->joint_vel_limit[joint]) * (*data->joint_scale[joint]));
+  message.max_accel    =
+    (float)((*data->joint_accel_limit[joint]) * (*data->joint_scale[joint]));
+  return message;
+}
+
+static struct Message_gpio_config hal_gpio_config(uint8_t gpio, skeleton_t *data) {
+  struct Message_gpio_config message = {0};
+  message.type       = MSG_SET_GPIO_CONFIG;
+  message.gpio_type  = data->gpio_type[gpio];
+  message.gpio_count = gpio;
+  message.index      = data->gpio_index[gpio];
+  message.address    = data->gpio_address[gpio];
+  return message;
+}
+
+static struct Message_spindle_config hal_spindle_config(uint8_t spindle, skeleton_t *data) {
+  struct Message_spindle_config message = {0};
+  message.type           = MSG_SET_SPINDLE_CONFIG;
+  message.spindle_index  = spindle;
+  message.modbus_address = data->spindle_address[spindle];
+  message.vfd_type       = data->spindle_vfd_type[spindle];
+  message.bitrate        = data->spindle_bitrate[spindle];
+  return message;
+}
+
+/* Same walk as the firmware's config cache: every joint configure() would
+ * send, then every GPIO and spindle that is set. Only spindle 0 is
+ * supported. */
+static uint32_t hal_config_hash(skeleton_t *data, size_t active_joints) {
+  uint32_t hash = CONFIG_HASH_INIT;
+  for(size_t joint = 0; joint < active_joints; joint++) {
+    struct Message_joint_config message = hal_joint_config(joint, data);
+    hash = config_hash_joint(hash, &message);
   }
-  for(int g = 0; g < MAX_GPIO; g++) {
-    if(last_gpio_config[g].gpio_type == data->gpio_type[g]
-    && last_gpio_config[g].index     == data->gpio_index[g]
-    && last_gpio_config[g].address   == data->gpio_address[g]) {
-      confirmed++;
+  for(size_t gpio = 0; gpio < MAX_GPIO; gpio++) {
+    if(data->gpio_type[gpio] != GPIO_TYPE_NOT_SET) {
+      struct Message_gpio_config message = hal_gpio_config(gpio, data);
+      hash = config_hash_gpio(hash, &message);
     }
   }
-  for(int s = 0; s < MAX_SPINDLE; s++) {
-    if(data->spindle_vfd_type[s] == MODBUS_TYPE_NOT_SET
-    || (last_spindle_config[s].vfd_type        == data->spindle_vfd_type[s]
-     && last_spindle_config[s].modbus_address  == data->spindle_address[s]
-     && last_spindle_config[s].bitrate         == data->spindle_bitrate[s])) {
-      confirmed++;
-    }
+  if(data->spindle_vfd_type[0] != MODBUS_TYPE_NOT_SET) {
+    struct Message_spindle_config message = hal_spindle_config(0, data);
+    hash = config_hash_spindle(hash, &message);
   }
-  return confirmed;
+  return hash;
 }
 
-/* Only try to configure one parameter per 1ms cycle since they change infrequently
- * and don't need low latency when they do. */
-static bool configure(
-    struct NWBuffer* tx_buffer,
-    size_t count,
-    skeleton_t *data,
-    int num_joints
-) {
+/* Joints the firmware will accept config for. */
+static size_t active_joint_count(int num_joints) {
   uint8_t fw_joints = get_detected_joint_count();
   if(fw_joints > 0 && fw_joints < (uint8_t)num_joints) {
     static bool warned = false;
@@ -216,20 +354,319 @@ static bool configure(
       warned = true;
     }
   }
-  size_t active_joints = (fw_joints > 0) ? fw_joints : (size_t)num_joints;
-  size_t total_things = active_joints + MAX_GPIO + MAX_SPINDLE;
-  size_t joint_or_gpio_or_spindle = count % total_things;
+  return (fw_joints > 0) ? fw_joints : (size_t)num_joints;
+}
+
+static void set_config_bit(uint32_t* bitmap, size_t item, bool set) {
+  if(set) {
+    bitmap[item / 32] |= (1u << (item % 32));
+  } else {
+    bitmap[item / 32] &= ~(1u << (item % 32));
+  }
+}
+
+static bool config_bit(const uint32_t* bitmap, size_t item) {
+  return bitmap[item / 32] & (1u << (item % 32));
+}
+
+/* Recheck one item against the HAL pins and the last confirmed config.
+ * An item that has become clean also leaves config_in_flight. */
+static void evaluate_config_item(skeleton_t *data, size_t item) {
+  bool dirty;
+  bool confirmed;
+  bool counted = true;
+  if(item < CONFIG_ITEM_GPIO) {
+    dirty = item < eth->active_joints && joint_config_dirty(item, data);
+    confirmed = joint_config_confirmed(item, data);
+    counted = item < eth->counted_joints;
+  } else if(item < CONFIG_ITEM_SPINDLE) {
+    dirty = gpio_config_dirty(item - CONFIG_ITEM_GPIO, data);
+    confirmed = !dirty;
+  } else {
+    dirty = spindle_config_dirty(item - CONFIG_ITEM_SPINDLE, data);
+    confirmed = spindle_config_confirmed(item - CONFIG_ITEM_SPINDLE, data);
+  }
+
+  set_config_bit(eth->config_dirty, item, dirty);
+  if(!dirty) {
+    set_config_bit(eth->config_in_flight, item, false);
+  }
+  bool was_unconfirmed = config_bit(eth->config_unconfirmed, item);
+  set_config_bit(eth->config_unconfirmed, item, counted && !confirmed);
+  eth->unconfirmed_count += (counted && !confirmed) - was_unconfirmed;
+}
+
+static struct JointConfigInputs joint_config_inputs(uint8_t joint, skeleton_t *data) {
+  struct JointConfigInputs inputs = {
+    .enable      = *data->joint_enable_cmd[joint],
+    .gpio_step   = data->joint_gpio_step[joint],
+    .gpio_dir    = data->joint_gpio_dir[joint],
+    .cmd_type    = data->joint_cmd_type[joint],
+    .vel_limit   = *data->joint_vel_limit[joint],
+    .accel_limit = *data->joint_accel_limit[joint],
+    .scale       = *data->joint_scale[joint],
+  };
+  return inputs;
+}
 
-  if(joint_or_gpio_or_spindle < active_joints) {
-    uint8_t joint = joint_or_gpio_or_spindle;
-    return configure_joint(tx_buffer, joint, data);
-  } else if(joint_or_gpio_or_spindle < active_joints + MAX_GPIO) {
-    uint8_t gpio = joint_or_gpio_or_spindle - active_joints;
-    return configure_gpio(tx_buffer, gpio, data);
-  } else if(joint_or_gpio_or_spindle < active_joints + MAX_GPIO + MAX_SPINDLE) {
-    uint8_t spindle = joint_or_gpio_or_spindle - active_joints - MAX_GPIO;
-    return configure_spindle(tx_buffer, spindle, data);
+static struct SpindleConfigInputs spindle_config_inputs(uint8_t spindle, skeleton_t *data) {
+  struct SpindleConfigInputs inputs = {
+    .vfd_type = data->spindle_vfd_type[spindle],
+    .address  = data->spindle_address[spindle],
+    .bitrate  = data->spindle_bitrate[spindle],
+  };
+  return inputs;
+}
+
+static bool joint_inputs_equal(const struct JointConfigInputs* a, const struct JointConfigInputs* b) {
+  return a->enable == b->enable && a->gpio_step == b->gpio_step
+      && a->gpio_dir == b->gpio_dir && a->cmd_type == b->cmd_type
+      && a->vel_limit == b->vel_limit && a->accel_limit == b->accel_limit
+      && a->scale == b->scale;
+}
+
+static bool spindle_inputs_equal(const struct SpindleConfigInputs* a, const struct SpindleConfigInputs* b) {
+  return a->vfd_type == b->vfd_type && a->address == b->address && a->bitrate == b->bitrate;
+}
+
+/* Recheck any GPIO whose type, index or address param changed. The
+ * params have no change hook, so this is a word compare of each array,
+ * stepping into the words that differ. */
+static void update_gpio_inputs(skeleton_t *data) {
+  if(memcmp(eth->gpio_type, data->gpio_type, sizeof(eth->gpio_type)) == 0
+      && memcmp(eth->gpio_index, data->gpio_index, sizeof(eth->gpio_index)) == 0
+      && memcmp(eth->gpio_address, data->gpio_address, sizeof(eth->gpio_address)) == 0) {
+    return;
   }
+  for(size_t gpio = 0; gpio < MAX_GPIO; gpio++) {
+    if(eth->gpio_type[gpio] != data->gpio_type[gpio]
+        || eth->gpio_index[gpio] != data->gpio_index[gpio]
+        || eth->gpio_address[gpio] != data->gpio_address[gpio]) {
+      eth->gpio_type[gpio]    = data->gpio_type[gpio];
+      eth->gpio_index[gpio]   = data->gpio_index[gpio];
+      eth->gpio_address[gpio] = data->gpio_address[gpio];
+      evaluate_config_item(data, CONFIG_ITEM_GPIO + gpio);
+    }
+  }
+}
+
+/* Bring config_dirty, config_unconfirmed and unconfirmed_count up to date.
+ * Only items whose HAL inputs changed or that had a REPLY_*_CONFIG are
+ * rechecked; everything is after a reset, or when the joint counts change. */
+static void update_config_state(skeleton_t *data, int num_joints) {
+  size_t active_joints = active_joint_count(num_joints);
+  uint32_t joints_replied;
+  uint32_t gpio_replied[MAX_GPIO_BANK];
+  uint32_t spindles_replied;
+  take_config_replies(&joints_replied, gpio_replied, &spindles_replied);
+
+  if(!eth->config_evaluated
+      || eth->active_joints != active_joints
+      || eth->counted_joints != (size_t)num_joints) {
+    eth->config_evaluated = true;
+    eth->active_joints = active_joints;
+    eth->counted_joints = num_joints;
+    for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+      eth->joint_inputs[joint] = joint_config_inputs(joint, data);
+    }
+    memcpy(eth->gpio_type, data->gpio_type, sizeof(eth->gpio_type));
+    memcpy(eth->gpio_index, data->gpio_index, sizeof(eth->gpio_index));
+    memcpy(eth->gpio_address, data->gpio_address, sizeof(eth->gpio_address));
+    for(size_t spindle = 0; spindle < MAX_SPINDLE; spindle++) {
+      eth->spindle_inputs[spindle] = spindle_config_inputs(spindle, data);
+    }
+    for(size_t item = 0; item < CONFIG_ITEM_COUNT; item++) {
+      evaluate_config_item(data, item);
+    }
+    return;
+  }
+
+  for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+    struct JointConfigInputs inputs = joint_config_inputs(joint, data);
+    if(!joint_inputs_equal(&inputs, &eth->joint_inputs[joint])
+        || (joints_replied & (1u << joint))) {
+      eth->joint_inputs[joint] = inputs;
+      evaluate_config_item(data, joint);
+    }
+  }
+
+  update_gpio_inputs(data);
+  for(size_t bank = 0; bank < MAX_GPIO_BANK; bank++) {
+    for(uint32_t bits = gpio_replied[bank]; bits; bits &= bits - 1) {
+      evaluate_config_item(data, CONFIG_ITEM_GPIO + bank * 32 + __builtin_ctz(bits));
+    }
+  }
+
+  for(size_t spindle = 0; spindle < MAX_SPINDLE; spindle++) {
+    struct SpindleConfigInputs inputs = spindle_config_inputs(spindle, data);
+    if(!spindle_inputs_equal(&inputs, &eth->spindle_inputs[spindle])
+        || (spindles_replied & (1u << spindle))) {
+      eth->spindle_inputs[spindle] = inputs;
+      evaluate_config_item(data, CONFIG_ITEM_SPINDLE + spindle);
+    }
+  }
+}
+
+/* If firmware reports it is already running the HAL config, treat every
+ * item as confirmed with joints disabled (firmware disables them before
+ * replying), so nothing needs sending. */
+static void adopt_cached_config(skeleton_t *data, int num_joints) {
+  uint32_t firmware_hash;
+  if(!take_firmware_config_hash(&firmware_hash)) {
+    return;
+  }
+  size_t active_joints = active_joint_count(num_joints);
+  if(firmware_hash != hal_config_hash(data, active_joints)) {
+    rtlog_printf("INFO: firmware config cache %08x does not match; sending config\n",
+                 firmware_hash);
+    return;
+  }
+  for(size_t joint = 0; joint < active_joints; joint++) {
+    eth->last_joint_config[joint] = hal_joint_config(joint, data);
+  }
+  for(size_t gpio = 0; gpio < MAX_GPIO; gpio++) {
+    if(data->gpio_type[gpio] != GPIO_TYPE_NOT_SET) {
+      eth->last_gpio_config[gpio] = hal_gpio_config(gpio, data);
+    }
+  }
+  if(data->spindle_vfd_type[0] != MODBUS_TYPE_NOT_SET) {
+    eth->last_spindle_config[0] = hal_spindle_config(0, data);
+  }
+  memset(eth->config_in_flight, 0, sizeof(eth->config_in_flight));
+  eth->config_evaluated = false;
+  rtlog_printf("INFO: firmware config cache %08x matches; skipping config\n", firmware_hash);
+}
+
+/* Dirty, and not sent within the last CONFIG_RESEND_CYCLES. */
+static bool config_due(size_t item, size_t count) {
+  if(!(eth->config_dirty[item / 32] & (1u << (item % 32)))) {
+    return false;
+  }
+  return !(eth->config_in_flight[item / 32] & (1u << (item % 32)))
+      || count - eth->config_sent_at[item] >= CONFIG_RESEND_CYCLES;
+}
+
+static bool configure_item(struct NWBuffer* tx_buffer, size_t item, skeleton_t *data) {
+  if(item < CONFIG_ITEM_GPIO) {
+    return configure_joint(tx_buffer, item, data);
+  } else if(item < CONFIG_ITEM_SPINDLE) {
+    return configure_gpio(tx_buffer, item - CONFIG_ITEM_GPIO, data);
+  }
+  return configure_spindle(tx_buffer, item - CONFIG_ITEM_SPINDLE, data);
+}
+
+
+/* ---- packet composer ---- */
+
+/* Packs one cycle's messages by TX_CLASS_* priority within budget bytes.
+ * Each item is a transaction: tx_begin() marks the buffer and tx_commit()
+ * either keeps what was packed or rolls the buffer back to the mark. */
+struct TxComposer {
+  struct NWBuffer* buffer;
+  size_t budget;
+  uint16_t mark_length;
+  uint16_t mark_checksum;
+  uint32_t bytes[TX_CLASS_COUNT];
+};
+
+static void tx_begin(struct TxComposer* tx) {
+  tx->mark_length   = tx->buffer->length;
+  tx->mark_checksum = tx->buffer->checksum;
+}
+
+/* Keep the item if packed is set and the packet is still within budget.
+ * Otherwise undo it so it can be retried next cycle. Returns true if kept. */
+static bool tx_commit(struct TxComposer* tx, int tx_class, bool packed) {
+  if(packed && tx->buffer->length <= tx->budget) {
+    tx->bytes[tx_class] += tx->buffer->length - tx->mark_length;
+    return true;
+  }
+  tx->buffer->length   = tx->mark_length;
+  tx->buffer->checksum = tx->mark_checksum;
+  return false;
+}
+
+/* Compose this cycle's packet. Returns false if the motion class did not fit,
+ * in which case the packet is not worth sending. Lower classes that do not
+ * fit are deferred: GPIO banks are recomputed every cycle, the spindle
+ * speed stays due and config items stay dirty until confirmed. */
+static bool compose_packet(
+    struct TxComposer* tx,
+    skeleton_t *data,
+    size_t count,
+    uint32_t now,
+    int num_joints
+) {
+  struct NWBuffer* buffer = tx->buffer;
+
+  tx_begin(tx);
+  bool pack_success = serialize_timing(buffer, count, now);
+  if (get_negotiated_features() & FEATURE_COMPACT_FEEDBACK)
+    pack_success = pack_success && serialize_feedback_ack(buffer);
+  pack_success = pack_success && serialize_joint_pos(buffer, data);
+  if (!tx_commit(tx, TX_CLASS_MOTION, pack_success)) {
+    return false;
+  }
+
+  /* Without it this cycle the board phase locks to packet arrival instead. */
+  if(data->sync_ticks && tick_target_us != 0
+      && (get_negotiated_features() & FEATURE_TICK_SYNC)) {
+    tx_begin(tx);
+    tx_commit(tx, TX_CLASS_MOTION, serialize_tick_sync(buffer, tick_target_us));
+  }
+
+  /* serialize_gpio() packs whichever banks fit; the rest are still pending
+   * next cycle. */
+  tx_begin(tx);
+  serialize_gpio(buffer, data);
+  tx_commit(tx, TX_CLASS_GPIO, true);
+
+  if(count % 100 == 0) {
+    eth->spindle_speed_due = true;
+  }
+  if(eth->spindle_speed_due) {
+    tx_begin(tx);
+    eth->spindle_speed_due = !tx_commit(tx, TX_CLASS_GPIO, serialise_spindle_speed_in(buffer, data));
+  }
+
+  /* Config waits for the version reply, which may carry REPLY_CONFIG_HASH
+   * and make sending it unnecessary. */
+  if (!get_version_checked()) {
+    tx_begin(tx);
+    tx_commit(tx, TX_CLASS_CONFIG, serialize_version_request(buffer));
+  } else {
+    adopt_cached_config(data, num_joints);
+
+    /* Pack as many due config items as fit, starting where the last burst
+     * ran out of room so every item gets its turn. */
+    update_config_state(data, num_joints);
+    for(size_t i = 0; i < CONFIG_ITEM_COUNT; i++) {
+      size_t item = (eth->config_slot + i) % CONFIG_ITEM_COUNT;
+      if(!config_due(item, count)) {
+        continue;
+      }
+      tx_begin(tx);
+      if(!tx_commit(tx, TX_CLASS_CONFIG, configure_item(buffer, item, data))) {
+        eth->config_slot = item;
+        break;
+      }
+      eth->config_in_flight[item / 32] |= (1u << (item % 32));
+      eth->config_sent_at[item] = count;
+    }
+  }
+
+  if(get_negotiated_features() & FEATURE_CLOCK_SYNC) {
+    tx_begin(tx);
+    tx_commit(tx, TX_CLASS_DIAG, serialize_clock_sync(buffer));
+  }
+
+  if(data->coast_periods > 0
+      && (get_negotiated_features() & FEATURE_COMPACT_JOINT_POS)
+      && (get_negotiated_features() & FEATURE_JOINT_COAST)) {
+    tx_begin(tx);
+    tx_commit(tx, TX_CLASS_DIAG, serialize_joint_coast(buffer, data));
+  }
+
   return true;
 }
 
@@ -250,7 +687,7 @@ void log_network_error(const char *operation, int device, int error) {
 /* Put things in a sensible condition when communication between LinuxCNC and
  * the RP has been lost then re-established. */
 void on_eth_up(skeleton_t *data, uint count) {
-  printf("Ethernet up. Packet count: %u\n", count);
+  rtlog_printf("Ethernet up. Packet count: %u\n", count);
   *data->eth_up = true;
   *data->machine_on = true;
 }
@@ -262,7 +699,7 @@ void on_eth_down(
     return;
   }
 
-  printf("WARN: Ethernet down. Packet count: %u\n", count);
+  rtlog_printf("WARN: Ethernet down. Packet count: %u\n", count);
   *data->eth_up = false;
   *data->machine_on = false;
 
@@ -274,23 +711,76 @@ void on_eth_down(
 static void reset_rp_config(skeleton_t *data) {
   for(size_t joint = 0; joint < MAX_JOINT; joint++) {
     *data->joint_enable_cmd[joint] = false;
-    last_joint_config[joint].gpio_step = -1;
-    last_joint_config[joint].gpio_dir = -1;
+    eth->last_joint_config[joint].gpio_step = -1;
+    eth->last_joint_config[joint].gpio_dir = -1;
   }
 
   for(size_t gpio = 0; gpio < MAX_GPIO; gpio++) {
-    last_gpio_config[gpio].gpio_type = GPIO_TYPE_NOT_SET;
+    eth->last_gpio_config[gpio].gpio_type = GPIO_TYPE_NOT_SET;
   }
 
   for(size_t spindle = 0; spindle < MAX_SPINDLE; spindle++) {
-    last_spindle_config[spindle].vfd_type = MODBUS_TYPE_NOT_SET;
+    eth->last_spindle_config[spindle].vfd_type = MODBUS_TYPE_NOT_SET;
   }
+  memset(eth->config_in_flight, 0, sizeof(eth->config_in_flight));
+  eth->config_evaluated = false;
 
   reset_version_check();
 }
 
-void eth_state_update(skeleton_t *data, int device_num, size_t count, uint32_t now, int num_joints) {
+/* Time since start_ns, for the histograms. */
+static uint32_t ns_since(uint64_t start_ns) {
+  uint64_t elapsed = host_time_ns() - start_ns;
+  return elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+}
+
+/* Fold this cycle's receive and unpack times into the histograms and show
+ * p50, p99 and max of each on the hist pins. Unpack time is only counted on
+ * cycles that had a reply to unpack. The max is shown every cycle; walking
+ * the buckets for the percentiles is spread out, one histogram every
+ * HIST_REFRESH_CYCLES cycles, so the servo thread never walks them all. */
+static void update_histograms(skeleton_t *data, size_t reply_count) {
+  uint64_t unpack_ns = data->cycle_unpack_ns;
+  uint64_t receive_ns = data->cycle_receive_ns > unpack_ns ? data->cycle_receive_ns - unpack_ns : 0;
+  histogram_add(&data->hist[HIST_RECEIVE], receive_ns > UINT32_MAX ? UINT32_MAX : (uint32_t)receive_ns);
+  if(reply_count > 0) {
+    histogram_add(&data->hist[HIST_UNPACK], unpack_ns > UINT32_MAX ? UINT32_MAX : (uint32_t)unpack_ns);
+  }
+  data->cycle_receive_ns = 0;
+  data->cycle_unpack_ns  = 0;
+
+  for(int hist = 0; hist < HIST_COUNT; hist++) {
+    if(*data->hist_reset) {
+      histogram_reset(&data->hist[hist]);
+      *data->hist_p50_us[hist] = 0;
+      *data->hist_p99_us[hist] = 0;
+    }
+    *data->hist_max_us[hist] = data->hist[hist].max / 1000.0;
+  }
+
+  uint32_t cycle = data->hist_refresh++;
+  if(cycle % HIST_REFRESH_CYCLES != 0) {
+    return;
+  }
+  static const uint32_t permille[2] = {500, 990};
+  int hist = (cycle / HIST_REFRESH_CYCLES) % HIST_COUNT;
+  uint32_t value_ns[2];
+  histogram_percentiles(&data->hist[hist], permille, value_ns, 2);
+  *data->hist_p50_us[hist] = value_ns[0] / 1000.0;
+  *data->hist_p99_us[hist] = value_ns[1] / 1000.0;
+}
+
+/* The board announced a flash write in REPLY_FLASH_WRITE and is not
+ * listening until it ends. */
+static bool flash_write_held(void) {
+  return eth->flash_hold_until_us && host_time_us() < eth->flash_hold_until_us;
+}
+
+/* Build and send this cycle's packet. Returns true if it was sent. */
+static bool eth_state_send(skeleton_t *data, int device_num, size_t count, uint32_t now, int num_joints) {
   struct NWBuffer buffer;
+  bool sent = false;
+  uint64_t start_ns = host_time_ns();
 
   /* While eth is down, hold joint_enable_cmd=false so the RP2040 keeps
    * decelerating.  LinuxCNC may write enable=true to this HAL pin every
@@ -301,66 +791,94 @@ void eth_state_update(skeleton_t *data, int device_num, size_t count, uint32_t n
     }
   }
 
-  /* Send — skipped during cooloff, but receive/eth-tracking always runs so
-   * that rx_miss_count and eth_up reflect reality even when we cannot send
-   * (e.g. interface administratively down). */
-  if (cooloff > 0) {
-    cooloff--;
+  /* Send — skipped during cooloff or a flash write, but receive/eth-tracking
+   * always runs so that rx_miss_count and eth_up reflect reality even when we
+   * cannot send (e.g. interface administratively down). */
+  if (eth->cooloff > 0 || flash_write_held()) {
+    if (eth->cooloff > 0) {
+      eth->cooloff--;
+    }
+    for (int tx_class = 0; tx_class < TX_CLASS_COUNT; tx_class++) {
+      *data->tx_class_bytes[tx_class] = 0;
+    }
   } else {
     reset_nw_buf(&buffer);
-    bool pack_success = true;
-
-    *data->seq_out = (uint32_t)count;
-    pack_success = pack_success && serialize_timing(&buffer, count, now);
 
-    if (!get_version_checked())
-      serialize_version_request(&buffer);
-
-    /* serialize_gpio() return value not checked: a failed pack still allows
-     * the rest of the buffer to be sent with whatever was packed. */
-    serialize_gpio(&buffer, data);
+    struct TxComposer tx = {.buffer = &buffer};
+    tx.budget = nw_buff_limit();
+    if (get_negotiated_features() & FEATURE_CRC32) {
+      tx.budget -= NW_CRC32_LEN;
+    }
 
-    pack_success = pack_success && configure(&buffer, count, data, num_joints);
+    *data->seq_out = (uint32_t)count;
+    bool pack_success = compose_packet(&tx, data, count, now, num_joints);
+    for (int tx_class = 0; tx_class < TX_CLASS_COUNT; tx_class++) {
+      *data->tx_class_bytes[tx_class] = tx.bytes[tx_class];
+    }
 
-    pack_success = pack_success && serialize_joint_pos(&buffer, data);
+    if(pack_success && (get_negotiated_features() & FEATURE_CRC32)) {
+      seal_nw_buff_crc32(&buffer);
+    }
 
-    if(count % 100 == 0) {
-      pack_success = pack_success && serialise_spindle_speed_in(&buffer, data);
+    if(pack_success) {
+      capture_packet(CAPTURE_TX, device_num, *data->seq_out, &buffer, nw_buff_wire_len(&buffer));
     }
 
     if(!pack_success) {
-      printf("WARN: TX packet dropped — buffer overflow packing servo cycle %u\n",
-             (unsigned)count);
+      rtlog_printf("WARN: TX packet dropped — no room for motion messages in servo cycle %u\n",
+                   (unsigned)count);
     } else if (send_data(device_num, &buffer) != 0) {
-      cooloff = 2000;
-      if (errno != last_errno) {
-        last_errno = errno;
+      eth->cooloff = 2000;
+      if (errno != eth->last_errno) {
+        eth->last_errno = errno;
         log_network_error("send", device_num, errno);
       }
-      send_fail_count++;
-      if (!(send_fail_count % 10)) {
-        last_errno = 0;
+      eth->send_fail_count++;
+      if (!(eth->send_fail_count % 10)) {
+        eth->last_errno = 0;
       }
     } else {
-      send_fail_count = 0;
+      eth->send_fail_count = 0;
+      sent = true;
     }
+    histogram_add(&data->hist[HIST_SEND], ns_since(start_ns));
   }
 
-  /* Receive data and check packets all completed round trip. */
-  reset_nw_buf(&buffer);
-  size_t data_length = get_reply_non_block(device_num, &buffer);
-  if(data_length > 0) {
-    size_t mess_received_count = 0;
-    process_data(
-        &buffer,
+  return sent;
+}
+
+
+/* Drain the replies queued on the socket. With deadline_us set, keep polling
+ * until the reply to the packet just sent has arrived or host_time_us()
+ * reaches deadline_us. Returns the number of replies received. */
+static size_t eth_state_receive(skeleton_t *data, int device_num, uint64_t deadline_us) {
+  uint64_t start_ns = host_time_ns();
+  size_t mess_received_count = 0;
+  size_t reply_count = receive_replies(
+      device_num,
+      data,
+      &mess_received_count,
+      eth->last_joint_config,
+      eth->last_gpio_config,
+      eth->last_spindle_config
+  );
+  while(deadline_us && *data->seq_in != *data->seq_out && host_time_us() < deadline_us) {
+    reply_count += receive_replies(
+        device_num,
         data,
         &mess_received_count,
-        data_length,
-        last_joint_config,
-        last_gpio_config,
-        last_spindle_config
+        eth->last_joint_config,
+        eth->last_gpio_config,
+        eth->last_spindle_config
     );
+  }
+  data->cycle_receive_ns += host_time_ns() - start_ns;
+  return reply_count;
+}
 
+/* Track the link from the number of replies received this cycle. */
+static void eth_state_track(skeleton_t *data, int device_num, size_t count, int num_joints, size_t reply_count) {
+  if(reply_count > 0) {
     if(! *data->eth_up) {
       /* Don't signal recovery to LinuxCNC until all joints have stopped moving
        * AND the RP2040 has confirmed (via REPLY_JOINT_CONFIG) that it has
@@ -373,44 +891,53 @@ void eth_state_update(skeleton_t *data, int device_num, size_t count, uint32_t n
 
       bool all_stopped = true;
       for (uint32_t joint = 0; joint < (uint32_t)num_joints; joint++) {
-        if (*data->joint_vel_fb[joint] != 0.0 || last_joint_config[joint].enable) {
+        if (*data->joint_vel_fb[joint] != 0.0 || eth->last_joint_config[joint].enable) {
           all_stopped = false;
         }
       }
       if (all_stopped) {
-        waiting_logged = false;
+        eth->waiting_logged = false;
         on_eth_up(data, count);
       } else {
-        if (!waiting_logged) {
-          printf("INFO: waiting for joints to stop before recovery"
-                 " (vel_fb[0]=%g)\n", (double)*data->joint_vel_fb[0]);
-          waiting_logged = true;
+        if (!eth->waiting_logged) {
+          rtlog_printf("INFO: waiting for joints to stop before recovery"
+                       " (vel_fb[0]=%g)\n", (double)*data->joint_vel_fb[0]);
+          eth->waiting_logged = true;
         }
       }
     }
 
     size_t total_configs = (size_t)num_joints + MAX_GPIO + MAX_SPINDLE;
-    size_t confirmed = count_confirmed_configs(data, num_joints);
+    update_config_state(data, num_joints);
+    size_t confirmed = total_configs - eth->unconfirmed_count;
     *data->config_complete = (confirmed == total_configs);
 
-    if(confirmed != last_confirmed) {
+    if(confirmed != eth->last_confirmed) {
       if(*data->config_complete) {
-        printf("INFO: all %zu config updates have completed\n", total_configs);
+        rtlog_printf("INFO: all %zu config updates have completed\n", total_configs);
       } else {
-        printf("INFO: %zu of %zu config updates have completed\n", confirmed, total_configs);
+        rtlog_printf("INFO: %zu of %zu config updates have completed\n", confirmed, total_configs);
       }
-      last_confirmed = confirmed;
+      eth->last_confirmed = confirmed;
     }
 
-    if(*data->config_complete && last_update_id + 1 != *data->seq_in && last_update_id != 0) {
-      printf("WARN: %i missing updates (seq %u -> %u)\n",
-          *data->seq_in - last_update_id - 1, last_update_id, *data->seq_in);
+    if(*data->config_complete && eth->last_update_id + 1 != *data->seq_in && eth->last_update_id != 0) {
+      rtlog_printf("WARN: %i missing updates (seq %u -> %u)\n",
+          *data->seq_in - eth->last_update_id - 1, eth->last_update_id, *data->seq_in);
     }
-    last_update_id = *data->seq_in;
+    eth->last_update_id = *data->seq_in;
     *data->rx_miss_count = 0;
+
+    uint16_t hold_ms;
+    if(take_flash_write_hold(&hold_ms)) {
+      rtlog_printf("INFO: board writing config to flash; holding off for %u ms\n", hold_ms);
+      eth->flash_hold_until_us = host_time_us() + hold_ms * 1000ull;
+    }
+  } else if(flash_write_held()) {
+    /* Silence is expected until the write ends. */
   } else {
-    if(errno != EAGAIN && last_errno != errno) {
-      last_errno = errno;
+    if(errno != EAGAIN && eth->last_errno != errno) {
+      eth->last_errno = errno;
       log_network_error("receive", device_num, errno);
     }
     if(*data->eth_up) {
@@ -418,7 +945,97 @@ void eth_state_update(skeleton_t *data, int device_num, size_t count, uint32_t n
     }
     (*data->rx_miss_count)++;
     if (*data->rx_miss_count == 5000 || !(*data->rx_miss_count % 10000)) {
-      printf("WARN: Still no connection over Ethernet link.\n");
+      rtlog_printf("WARN: Still no connection over Ethernet link.\n");
+    }
+  }
+}
+
+/* Replies that arrived since the last write, drained by the read funct at the
+ * start of the servo thread so this cycle's motion sees them. */
+void eth_state_read(skeleton_t *data, int device_num) {
+  eth_state_select(device_num);
+  data->read_replies += eth_state_receive(data, device_num, 0);
+}
+
+/* When to stop spinning for the reply to a packet sent now: reply-wait-us
+ * from now, capped at half the servo period so the rest of the thread still
+ * has time to run. 0 for no spin. */
+static uint64_t reply_deadline_us(const skeleton_t *data) {
+  uint32_t wait_us = data->reply_wait_us;
+  if(wait_us > data->period_ns / 2000) {
+    wait_us = data->period_ns / 2000;
+  }
+  return wait_us ? host_time_us() + wait_us : 0;
+}
+
+/* Account for this cycle's replies once they have been collected: how fresh
+ * the feedback is, the link, and the timing histograms. */
+static void eth_state_finish(skeleton_t *data, int device_num, size_t count, int num_joints,
+                             bool sent, size_t reply_count) {
+  if(sent && reply_count > 0 && *data->seq_in == *data->seq_out) {
+    *data->feedback_mode = FEEDBACK_SAME_CYCLE;
+  } else if(reply_count > 0) {
+    *data->feedback_mode = FEEDBACK_PREVIOUS;
+  } else if(data->read_replies > 0) {
+    *data->feedback_mode = FEEDBACK_READ;
+  } else {
+    *data->feedback_mode = FEEDBACK_NONE;
+  }
+
+  eth_state_track(data, device_num, count, num_joints, reply_count + data->read_replies);
+  update_histograms(data, reply_count + data->read_replies);
+  data->read_replies = 0;
+}
+
+/* Send this cycle's packet to one board and collect its replies. */
+void eth_state_update(skeleton_t *data, int device_num, size_t count, uint32_t now, int num_joints) {
+  eth_state_select(device_num);
+  update_tick_grid(data, 1);
+  bool sent = eth_state_send(data, device_num, count, now, num_joints);
+  size_t reply_count = eth_state_receive(data, device_num, sent ? reply_deadline_us(data) : 0);
+  eth_state_finish(data, device_num, count, num_joints, sent, reply_count);
+}
+
+/* Service boards 0 to board_count - 1, data[] and num_joints[] indexed by
+ * board. Every packet goes out before any reply is collected, so the round
+ * trips overlap and each extra board adds little servo thread time. The
+ * reply spin shares one deadline for the cycle, polling the boards in turn,
+ * so however many boards are silent it never takes over half the period. */
+void eth_state_update_boards(
+    skeleton_t *data, int board_count, size_t count, uint32_t now, const int *num_joints
+) {
+  bool sent[MAX_DEVICES];
+  size_t reply_count[MAX_DEVICES];
+  update_tick_grid(data, board_count);
+  for(int device = 0; device < board_count; device++) {
+    eth_state_select(device);
+    sent[device] = eth_state_send(&data[device], device, count, now, num_joints[device]);
+  }
+  uint64_t deadline_us = 0;
+  for(int device = 0; device < board_count; device++) {
+    uint64_t board_deadline_us = sent[device] ? reply_deadline_us(&data[device]) : 0;
+    deadline_us = board_deadline_us > deadline_us ? board_deadline_us : deadline_us;
+  }
+
+  for(int device = 0; device < board_count; device++) {
+    eth_state_select(device);
+    reply_count[device] = eth_state_receive(&data[device], device, 0);
+  }
+  bool waiting = deadline_us != 0;
+  while(waiting && host_time_us() < deadline_us) {
+    waiting = false;
+    for(int device = 0; device < board_count; device++) {
+      if(sent[device] && *data[device].seq_in != *data[device].seq_out) {
+        eth_state_select(device);
+        reply_count[device] += eth_state_receive(&data[device], device, 0);
+        waiting = true;
+      }
     }
   }
+
+  for(int device = 0; device < board_count; device++) {
+    eth_state_select(device);
+    eth_state_finish(&data[device], device, count, num_joints[device],
+                     sent[device], reply_count[device]);
+  }
 }
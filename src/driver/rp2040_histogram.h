@@ -0,0 +1,86 @@
+#ifndef RP2040_HISTOGRAM__H
+#define RP2040_HISTOGRAM__H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Fixed-bucket histogram of 32 bit values, cheap enough to update from the
+ * servo thread. Values below HISTOGRAM_SUB each get a bucket; above that,
+ * every power of two is split into HISTOGRAM_SUB buckets, so a bucket is at
+ * most 1/HISTOGRAM_SUB of its value wide (12.5%). The maximum is kept
+ * exactly. */
+#define HISTOGRAM_SUB_BITS  3
+#define HISTOGRAM_SUB       (1u << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS   ((32 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB)
+
+/* Counts are halved when total reaches this, so a long run cannot overflow
+ * and old samples slowly lose weight. */
+#define HISTOGRAM_MAX_TOTAL (1u << 30)
+
+struct Histogram {
+  uint32_t count[HISTOGRAM_BUCKETS];
+  uint32_t total;
+  uint32_t max;
+};
+
+static inline void histogram_reset(struct Histogram* hist) {
+  memset(hist, 0, sizeof(*hist));
+}
+
+static inline size_t histogram_bucket(uint32_t value) {
+  if(value < HISTOGRAM_SUB) {
+    return value;
+  }
+  int msb = 31 - __builtin_clz(value);
+  return (size_t)(msb - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB
+         + ((value >> (msb - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB - 1));
+}
+
+/* Largest value that falls in bucket. */
+static inline uint32_t histogram_bucket_top(size_t bucket) {
+  if(bucket < HISTOGRAM_SUB) {
+    return (uint32_t)bucket;
+  }
+  size_t shift = bucket / HISTOGRAM_SUB - 1;
+  uint64_t low = (uint64_t)(HISTOGRAM_SUB + bucket % HISTOGRAM_SUB) << shift;
+  return (uint32_t)(low + ((uint64_t)1 << shift) - 1);
+}
+
+static inline void histogram_add(struct Histogram* hist, uint32_t value) {
+  if(hist->total >= HISTOGRAM_MAX_TOTAL) {
+    hist->total = 0;
+    for(size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+      hist->count[bucket] -= hist->count[bucket] / 2;
+      hist->total += hist->count[bucket];
+    }
+  }
+  hist->count[histogram_bucket(value)]++;
+  hist->total++;
+  if(value > hist->max) {
+    hist->max = value;
+  }
+}
+
+/* Values at or below which permille/1000 of the samples fall, for each of
+ * count permilles in ascending order, written to out[]. Each is the top of
+ * its bucket but never more than the maximum. All 0 while empty. */
+static inline void histogram_percentiles(
+    const struct Histogram* hist, const uint32_t* permille, uint32_t* out, size_t count
+) {
+  size_t next = 0;
+  uint64_t seen = 0;
+  for(size_t bucket = 0; bucket < HISTOGRAM_BUCKETS && next < count; bucket++) {
+    seen += hist->count[bucket];
+    while(next < count && hist->total > 0
+        && seen * 1000 >= (uint64_t)hist->total * permille[next]) {
+      uint32_t top = histogram_bucket_top(bucket);
+      out[next++] = top < hist->max ? top : hist->max;
+    }
+  }
+  while(next < count) {
+    out[next++] = hist->total > 0 ? hist->max : 0;
+  }
+}
+
+#endif  // RP2040_HISTOGRAM__H
@@ -2,11 +2,16 @@
 #include <stdio.h>
 #include <netdb.h>
 #include <string.h>
+#include <time.h>
 
 #include "rp2040_defines.h"
 #include "../shared/messages.h"
 #include "../shared/buffer.c"
 #include "../shared/checksum.c"
+#include "../shared/dispatch.c"
+#include "../shared/config_hash.c"
+#include "rp2040_capture.c"
+#include "rp2040_rtlog.c"
 #include "../rp2040/modbus.h"
 
 #ifdef BUILD_TESTS
@@ -15,23 +20,107 @@
 
 #endif  // BUILD_TESTS
 
-/* Declare and null-check an unpacked message. Must be used at the top of a
- * function body, not inside a bare if/else — it expands to two statements. */
-#define UNPACK_MSG(T, var, buf, offset) \
-    T* var = unpack_nw_buff((buf), *(offset), (offset), NULL, sizeof(T)); \
-    if (!(var)) return false;
+/* Passed to every REPLY_* handler by process_data(). */
+struct ReplyContext {
+  skeleton_t* data;
+  struct Message_joint_config* last_joint_config;
+  struct Message_gpio_config* last_gpio_config;
+  struct Message_spindle_config* last_spindle_config;
+  bool newest;  /* Last reply queued; only this one updates joint feedback. */
+  uint64_t rx_ns;  /* host_time_ns() when the kernel received the reply. */
+};
+
+/* NTP style estimate of the RP clock against the host clock.
+ * Queueing only ever adds delay, so the sample with the least round trip delay
+ * in the last CLOCK_FILTER_LEN (the newest on a tie) is taken as having a
+ * symmetric path and gives the offset. Drift is the slope of that offset over at least
+ * CLOCK_DRIFT_BASELINE_US. Per-direction latency is then each leg of the
+ * newest exchange corrected by the offset. */
+#define CLOCK_FILTER_LEN        8
+#define CLOCK_DRIFT_BASELINE_US 1000000
+#define CLOCK_DRIFT_EMA_SHIFT   3       // Drift EMA weight is 1/8.
+
+struct ClockSample {
+  int64_t host_us;      // Host time mid way through the exchange.
+  int64_t offset_us;    // RP clock minus host clock.
+  int64_t delay_us;     // Round trip less RP processing time.
+};
+
+struct ClockSync {
+  struct ClockSample samples[CLOCK_FILTER_LEN];
+  size_t sample_count;
+  struct ClockSample best;        // Least delayed of samples[].
+  struct ClockSample reference;   // Start of the current drift baseline.
+  bool have_reference;
+  bool have_drift;
+  double drift;                   // RP µs gained per host µs.
+  double offset_us;
+  double latency_up_us;
+  double latency_down_us;
+  double round_trip_us;
+};
+
+/* Joint feedback as decoded from either form of the movement reply. */
+struct MovementState {
+  uint16_t id;
+  bool valid;
+  uint8_t enabled;                        /* bit j set when joint j is enabled */
+  int32_t abs_pos_achieved[WIRE_MAX_JOINT];
+  int32_t velocity_achieved[WIRE_MAX_JOINT];
+  float velocity_cmd[WIRE_MAX_JOINT];
+};
+
+/* Decoded REPLY_JOINT_MOVEMENT_V2 states are kept, indexed by reply id, so a
+ * reply coded against any recently acknowledged id can be rebuilt. */
+#define MOVEMENT_HISTORY 16
+
+/* MSG_TIMING send times kept for matching echoes; replies older than this
+ * many cycles are not timed. */
+#define TIMING_SENT_LEN 16
+
+/* Protocol state for one RP2040. select_device() points rp at the board
+ * being serviced; everything below acts on that board. */
+struct DeviceState {
+  uint8_t detected_joint_count;   /* set from first Reply_joint_movement.count */
+  bool version_checked;           /* set when REPLY_VERSION received */
+  bool version_match;             /* set when version + branch both matched */
+  uint16_t negotiated_features;   /* FEATURE_* bits from REPLY_FEATURES */
+  size_t nw_buf_limit;            /* Payload limit negotiated with this board. */
+  uint32_t firmware_config_hash;  /* From REPLY_CONFIG_HASH */
+  bool config_hash_pending;       /* firmware_config_hash not yet taken */
+  uint16_t flash_hold_ms;         /* From REPLY_FLASH_WRITE; 0 once taken. */
+  /* REPLY_*_CONFIG received since take_config_replies(), a bit per item. */
+  uint32_t joint_config_replied;
+  uint32_t gpio_config_replied[MAX_GPIO_BANK];
+  uint32_t spindle_config_replied;
+  struct ClockSync clock_sync;
+  struct MovementState movement_history[MOVEMENT_HISTORY];
+  uint16_t movement_ack_id;
+  bool movement_ack_valid;
+  /* When each recent MSG_TIMING was packed, indexed by update_id, for the
+   * round trip to its echo. */
+  struct {
+    uint32_t update_id;
+    uint64_t packed_ns;
+  } timing_sent[TIMING_SENT_LEN];
+};
 
 /* Network globals. */
-static uint8_t detected_joint_count = 0;  /* set from first Reply_joint_movement.count */
-static bool version_checked = false;     /* set when REPLY_VERSION received */
-static bool version_match   = false;     /* set when version + branch both matched */
+static struct DeviceState device_state[MAX_DEVICES];
+static struct DeviceState* rp = &device_state[0];
 struct sockaddr_in remote_addr[MAX_DEVICES];
 int sockfd[MAX_DEVICES] = {-1};
 
+void select_device(int device) {
+  rp = &device_state[device];
+  nw_buff_set_limit(rp->nw_buf_limit);
+  nw_buff_set_crc32(rp->negotiated_features & FEATURE_CRC32);
+}
+
 
-/* Initialise network for UDP. */
-int init_eth(int device) {
-  char *hostname = "192.168.12.2";
+/* Initialise network for UDP to the board at hostname. Each board gets its own
+ * local port; the firmware replies to whichever port the packet came from. */
+int init_eth(int device, const char* hostname) {
   int portno = 5002;
 
   /* socket: create the NW socket */
@@ -60,11 +149,21 @@ int init_eth(int device) {
     return -1;
   }
 
-  /* Small receive buffer to prevent stale replies accumulating at startup.
-   * Kernel doubles the value internally; 2048 bytes holds ~7 packets (260 bytes each).
-   * Without this the default ~200KB buffer can queue hundreds of replies, causing
-   * a large steady-state gap between seq-out and seq-in. */
-  int rcvbuf = 2048;
+  /* Have the kernel stamp each reply as it arrives. Replies can wait in the
+   * queue for most of a cycle before they are unpacked, which would otherwise
+   * count towards the clock sync round trip. */
+  rc = setsockopt(sockfd[device], SOL_SOCKET, SO_TIMESTAMPNS, &option, sizeof(option));
+  if (rc < 0) {
+    rtapi_print_msg(RTAPI_MSG_WARN,
+        "RP2040: WARN: SO_TIMESTAMPNS not supported; clock sync uses unpack time\n");
+  }
+
+  /* receive_replies() drains the queue every cycle, so the buffer only has to
+   * hold the replies that arrive between two cycles after a hiccup: as many
+   * as one cycle can drain (64). Queued replies are charged by truesize, not
+   * length, and the kernel doubles the value asked for, hence the halving.
+   * Anything deeper would only be stale feedback. */
+  int rcvbuf = NW_RX_BATCH * NW_RX_MAX_BATCHES * NW_RX_REPLY_TRUESIZE / 2;
   rc = setsockopt(sockfd[device], SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
   if (rc < 0) {
     rtapi_print_msg(RTAPI_MSG_ERR, "ERROR setting SOL_SOCKET, SO_RCVBUF\n");
@@ -76,7 +175,7 @@ int init_eth(int device) {
   struct sockaddr_in local_addr = {0};
   local_addr.sin_family = AF_INET;
   local_addr.sin_addr.s_addr = INADDR_ANY;
-  local_addr.sin_port = htons(portno);
+  local_addr.sin_port = htons(portno + device);
   rc = bind(sockfd[device], (struct sockaddr*)&local_addr, sizeof(local_addr));
   if (rc < 0) {
     rtapi_print_msg(RTAPI_MSG_ERR, "ERROR binding socket to local port\n");
@@ -106,7 +205,7 @@ int send_data(int device, struct NWBuffer* buffer) {
   int n = sendto(
       sockfd[device],
       (void*)buffer,
-      sizeof(buffer->length) + sizeof(buffer->checksum) + buffer->length,
+      nw_buff_wire_len(buffer),
       MSG_DONTROUTE,
       (struct sockaddr *)&remote_addr[device],
       addr_len);
@@ -133,6 +232,76 @@ size_t get_reply_non_block(int device, struct NWBuffer* receive_buffer) {
   return receive_count;
 }
 
+/* Get up to max replies queued on the socket, oldest first, in one syscall.
+ * lengths[i] is set to the size of buffers[i] and rx_ns[i] to when the kernel
+ * received it, on the host_time_ns() clock, or to now if the kernel did not
+ * say. Returns the number received. */
+size_t get_replies_non_block(
+    int device, struct NWBuffer* buffers, size_t* lengths, uint64_t* rx_ns, size_t max
+) {
+  struct mmsghdr messages[NW_RX_BATCH];
+  struct iovec iovecs[NW_RX_BATCH];
+  union {
+    char buf[CMSG_SPACE(sizeof(struct timespec))];
+    struct cmsghdr align;
+  } control[NW_RX_BATCH];
+  if(max > NW_RX_BATCH) {
+    max = NW_RX_BATCH;
+  }
+  memset(messages, 0, sizeof(messages[0]) * max);
+  for(size_t i = 0; i < max; i++) {
+    iovecs[i].iov_base = &buffers[i];
+    iovecs[i].iov_len  = sizeof(struct NWBuffer);
+    messages[i].msg_hdr.msg_iov    = &iovecs[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+    messages[i].msg_hdr.msg_control    = control[i].buf;
+    messages[i].msg_hdr.msg_controllen = sizeof(control[i].buf);
+  }
+
+  int receive_count = recvmmsg(
+      sockfd[device], messages, max, MSG_DONTWAIT, NULL);
+  if (receive_count < 0) {
+    return 0;
+  }
+
+  /* SCM_TIMESTAMPNS is CLOCK_REALTIME; move it onto CLOCK_MONOTONIC. */
+  struct timespec real_now;
+  clock_gettime(CLOCK_REALTIME, &real_now);
+  uint64_t now_ns = host_time_ns();
+  int64_t real_to_host_ns = (int64_t)now_ns
+      - ((int64_t)real_now.tv_sec * 1000000000 + real_now.tv_nsec);
+
+  for(int i = 0; i < receive_count; i++) {
+    lengths[i] = messages[i].msg_len;
+    rx_ns[i] = now_ns;
+    struct msghdr* header = &messages[i].msg_hdr;
+    for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(header); cmsg; cmsg = CMSG_NXTHDR(header, cmsg)) {
+      if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+        struct timespec stamp;
+        memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+        int64_t stamp_ns = (int64_t)stamp.tv_sec * 1000000000 + stamp.tv_nsec + real_to_host_ns;
+        /* Never later than now, whatever the realtime clock did meanwhile. */
+        if(stamp_ns > 0 && (uint64_t)stamp_ns < now_ns) {
+          rx_ns[i] = (uint64_t)stamp_ns;
+        }
+      }
+    }
+  }
+  return receive_count;
+}
+
+/* Host clock for MSG_CLOCK_SYNC and the timing histograms. The same
+ * CLOCK_MONOTONIC rtapi_get_time() reads in uspace. */
+uint64_t host_time_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+uint64_t host_time_us(void) {
+  return host_time_ns() / 1000;
+}
+
 size_t serialize_timing(
     struct NWBuffer* buffer,
     uint32_t update_id,
@@ -143,16 +312,138 @@ size_t serialize_timing(
   message.timing.update_id = update_id;
   message.timing.time = time;
 
+  rp->timing_sent[update_id % TIMING_SENT_LEN].update_id = update_id;
+  rp->timing_sent[update_id % TIMING_SENT_LEN].packed_ns = host_time_ns();
+
   return pack_nw_buff(buffer, &message, sizeof(struct Message_timing));
 }
 
+
+size_t serialize_clock_sync(struct NWBuffer* buffer) {
+  union MessageAny message = {0};
+  message.clock_sync.type = MSG_CLOCK_SYNC;
+  message.clock_sync.host_tx_us = host_time_us();
+
+  return pack_nw_buff(buffer, &message, sizeof(struct Message_clock_sync));
+}
+
+
+/* RP clock minus host clock at host time host_us, extrapolated from the best
+ * sample by the drift. */
+double clock_sync_offset_at(const struct ClockSync* sync, uint64_t host_us) {
+  return sync->best.offset_us + sync->drift * (double)((int64_t)host_us - sync->best.host_us);
+}
+
+/* Fold in one exchange: t1 host send, t2 RP receive, t3 RP send, t4 host
+ * receive. Returns false if the timestamps are inconsistent. */
+bool clock_sync_update(
+    struct ClockSync* sync, uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4
+) {
+  int64_t round_trip = (int64_t)(t4 - t1);
+  int64_t rp_time = (int64_t)(t3 - t2);
+  if(round_trip < 0 || rp_time < 0 || rp_time > round_trip) {
+    return false;
+  }
+
+  struct ClockSample sample = {
+    .host_us = (int64_t)(t1 + (t4 - t1) / 2),
+    .offset_us = ((int64_t)(t2 - t1) + (int64_t)(t3 - t4)) / 2,
+    .delay_us = round_trip - rp_time,
+  };
+  sync->samples[sync->sample_count % CLOCK_FILTER_LEN] = sample;
+  sync->sample_count++;
+
+  size_t filled = sync->sample_count < CLOCK_FILTER_LEN ? sync->sample_count : CLOCK_FILTER_LEN;
+  struct ClockSample best = sync->samples[0];
+  for(size_t i = 1; i < filled; i++) {
+    if(sync->samples[i].delay_us < best.delay_us
+        || (sync->samples[i].delay_us == best.delay_us
+            && sync->samples[i].host_us > best.host_us)) {
+      best = sync->samples[i];
+    }
+  }
+
+  if(!sync->have_reference) {
+    sync->reference = best;
+    sync->have_reference = true;
+  } else if(best.host_us - sync->reference.host_us >= CLOCK_DRIFT_BASELINE_US) {
+    double drift = (double)(best.offset_us - sync->reference.offset_us)
+                   / (double)(best.host_us - sync->reference.host_us);
+    if(sync->have_drift) {
+      sync->drift += (drift - sync->drift) / (1 << CLOCK_DRIFT_EMA_SHIFT);
+    } else {
+      sync->drift = drift;
+      sync->have_drift = true;
+    }
+    sync->reference = best;
+  }
+
+  sync->best = best;
+  double offset_t1 = clock_sync_offset_at(sync, t1);
+  double offset_t4 = clock_sync_offset_at(sync, t4);
+  sync->offset_us       = offset_t4;
+  sync->latency_up_us   = (double)(int64_t)(t2 - t1) - offset_t1;
+  sync->latency_down_us = (double)(int64_t)(t4 - t3) + offset_t4;
+  sync->round_trip_us   = (double)round_trip;
+  return true;
+}
+
+/* Convert a tick time on the host timebase into this board's clock. Packs
+ * nothing until a REPLY_CLOCK_SYNC has given an offset. */
+size_t serialize_tick_sync(struct NWBuffer* buffer, uint64_t host_target_us) {
+  if(rp->clock_sync.sample_count == 0) {
+    return 0;
+  }
+  union MessageAny message = {0};
+  message.tick_sync.type = MSG_TICK_SYNC;
+  message.tick_sync.rp_target_us =
+    host_target_us + (int64_t)llround(clock_sync_offset_at(&rp->clock_sync, host_target_us));
+
+  return pack_nw_buff(buffer, &message, sizeof(struct Message_tick_sync));
+}
+
+/* Servo period assumed until write_port() has reported the real one. */
+#define DEFAULT_SERVO_PERIOD_NS 1000000
+
+/* Compact setpoints: Q32.32 steps and Q16.16 velocity, only for the joints
+ * the firmware reported. Truncated as Core0 truncates MSG_SET_JOINT_ABS_POS,
+ * so either message leaves Core1 with the same command. */
+static size_t serialize_joint_pos_q(
+    struct NWBuffer* buffer,
+    skeleton_t* data
+) {
+  struct Message_set_joints_pos_q message;
+  message.type   = MSG_SET_JOINT_POS_Q;
+  message.count  = rp->detected_joint_count < MAX_JOINT ? rp->detected_joint_count : MAX_JOINT;
+  message._pad[0] = 0;
+  message._pad[1] = 0;
+
+  /* Velocity in the unit Core0 derives from MSG_SET_JOINT_ABS_POS: steps/s
+   * over the period in µs, steps per period only at 1000µs. */
+  double period_us =
+    (data->period_ns > 0 ? data->period_ns : DEFAULT_SERVO_PERIOD_NS) / 1000.0;
+
+  for(size_t joint = 0; joint < message.count; joint++) {
+    double position = *data->joint_scale[joint] * *data->joint_pos_cmd[joint];
+    double velocity = *data->joint_scale[joint] * *data->joint_vel_cmd[joint] / period_us;
+    message.joint[joint].position = (int64_t)(position * 4294967296.0);
+    message.joint[joint].velocity = (int32_t)(velocity * 65536.0);
+  }
+
+  return pack_nw_buff(buffer, &message, MESSAGE_SET_JOINTS_POS_Q_LEN(message.count));
+}
+
 size_t serialize_joint_pos(
     struct NWBuffer* buffer,
     skeleton_t* data
 ) {
+  if(rp->negotiated_features & FEATURE_COMPACT_JOINT_POS) {
+    return serialize_joint_pos_q(buffer, data);
+  }
+
   struct Message_set_joints_pos message = {0};
   message.type  = MSG_SET_JOINT_ABS_POS;
-  message.count = detected_joint_count;  /* firmware reads only this many */
+  message.count = rp->detected_joint_count;  /* firmware reads only this many */
 
   for(size_t joint = 0; joint < MAX_JOINT; joint++) {
     double position = *data->joint_scale[joint] * *data->joint_pos_cmd[joint];
@@ -164,6 +455,18 @@ size_t serialize_joint_pos(
   return pack_nw_buff(buffer, &message, sizeof(struct Message_set_joints_pos));
 }
 
+/* Let the board coast through up to data->coast_periods missed updates
+ * before the next packet's setpoints. */
+size_t serialize_joint_coast(struct NWBuffer* buffer, skeleton_t* data) {
+  struct Message_set_joint_coast message;
+  message.type    = MSG_SET_JOINT_COAST;
+  message.periods = data->coast_periods < MAX_COAST_PERIODS ?
+    data->coast_periods : MAX_COAST_PERIODS;
+  memset(message._pad, 0, sizeof(message._pad));
+
+  return pack_nw_buff(buffer, &message, sizeof(message));
+}
+
 bool serialise_spindle_config(
     struct NWBuffer* tx_buf,
     uint8_t spindle,
@@ -264,81 +567,97 @@ size_t serialize_gpio_config(
   return pack_nw_buff(buffer, &message, sizeof(struct Message_gpio_config));
 }
 
-uint16_t serialize_gpio(struct NWBuffer* buffer, skeleton_t* data) {
-  uint16_t return_val = 0;
-  bool confirmation_pending[MAX_GPIO_BANK];
-  uint32_t to_send[MAX_GPIO_BANK];
-
-  for(size_t bank = 0; bank < MAX_GPIO_BANK; bank++) {
-    to_send[bank] = 0;
-    confirmation_pending[bank] = false;
+/* Rebuild the per bank masks if any gpio_type param changed since last time. */
+static void update_gpio_masks(skeleton_t* data) {
+  struct GpioMasks* masks = &data->gpio_masks;
+  if(memcmp(masks->type, data->gpio_type, sizeof(masks->type)) == 0) {
+    return;
   }
+  memcpy(masks->type, data->gpio_type, sizeof(masks->type));
+  memset(masks->in, 0, sizeof(masks->in));
+  memset(masks->out, 0, sizeof(masks->out));
+  memset(masks->debug, 0, sizeof(masks->debug));
 
   for(size_t gpio = 0; gpio < MAX_GPIO; gpio++) {
     size_t bank = gpio / 32;
-    size_t gpio_per_bank = (gpio % 32);
-
-    bool current_value = false;
+    uint32_t bit = 1u << (gpio % 32);
     switch(data->gpio_type[gpio]) {
       case GPIO_TYPE_NATIVE_IN_DEBUG:
+        masks->debug[bank] |= bit;
+        // Note: no break here.
       case GPIO_TYPE_NATIVE_IN:
       case GPIO_TYPE_I2C_MCP_IN:
       case GPIO_TYPE_I2C_MCP_IN_PULLUP:
-        current_value = *data->gpio_data_in[gpio];
+        masks->in[bank] |= bit;
         break;
-      case GPIO_TYPE_NATIVE_OUT:
       case GPIO_TYPE_NATIVE_OUT_DEBUG:
+        masks->debug[bank] |= bit;
+        // Note: no break here.
+      case GPIO_TYPE_NATIVE_OUT:
       case GPIO_TYPE_I2C_MCP_OUT:
-        current_value = *data->gpio_data_out_invert[gpio] ? ! *data->gpio_data_out[gpio] : *data->gpio_data_out[gpio];
+        masks->out[bank] |= bit;
         break;
       default:
         break;
     }
+  }
+}
+
+uint16_t serialize_gpio(struct NWBuffer* buffer, skeleton_t* data) {
+  uint16_t return_val = 0;
+  update_gpio_masks(data);
+  const struct GpioMasks* masks = &data->gpio_masks;
+
+  for(size_t bank = 0; bank < MAX_GPIO_BANK; bank++) {
+    uint32_t in_mask = masks->in[bank];
+    uint32_t out_mask = masks->out[bank];
+    hal_bit_t** gpio_in = &data->gpio_data_in[bank * 32];
+    hal_bit_t** gpio_out = &data->gpio_data_out[bank * 32];
+    hal_bit_t** gpio_invert = &data->gpio_data_out_invert[bank * 32];
+
+    // Gather the HAL side of the configured pins only.
+    uint32_t current = 0;
+    for(uint32_t bits = in_mask; bits; bits &= bits - 1) {
+      int pin = __builtin_ctz(bits);
+      current |= (uint32_t)(*gpio_in[pin] != 0) << pin;
+    }
+    for(uint32_t bits = out_mask; bits; bits &= bits - 1) {
+      int pin = __builtin_ctz(bits);
+      current |= (uint32_t)((*gpio_out[pin] != 0) ^ (*gpio_invert[pin] != 0)) << pin;
+    }
+
+    // The values last received over the network.
+    uint32_t received = data->gpio_data_received[bank];
+    uint32_t changed = (current ^ received) & (in_mask | out_mask);
 
-    // The value last received over the network.
-    bool received_value = data->gpio_data_received[bank] & (0x1 << gpio_per_bank);
-
-    if(current_value != received_value) {
-      switch(data->gpio_type[gpio]) {
-        case GPIO_TYPE_NATIVE_IN_DEBUG:
-          printf("DBG: GPIO IN: %u  val: %u\n", gpio, current_value);
-          // Note: no break here.
-        case GPIO_TYPE_NATIVE_IN:
-        case GPIO_TYPE_I2C_MCP_IN:
-        case GPIO_TYPE_I2C_MCP_IN_PULLUP:
-          // Network update to apply.
-          *data->gpio_data_in[gpio] = received_value;
-          *data->gpio_data_in_not[gpio] = !received_value;
-          current_value = received_value;
-          // Confirmation of HAL update to send on network.
-          confirmation_pending[bank] = true;
-          break;
-        case GPIO_TYPE_NATIVE_OUT_DEBUG:
-          printf("DBG: GPIO OUT: %u  val: %u\n", gpio, current_value);
-          // Note: no break here.
-        case GPIO_TYPE_NATIVE_OUT:
-        case GPIO_TYPE_I2C_MCP_OUT:
-          // HAL update to send on network.
-          confirmation_pending[bank] = true;
-          break;
-        default:
-          current_value = received_value;
-          break;
+    // Network updates to apply to HAL inputs.
+    for(uint32_t bits = changed & in_mask; bits; bits &= bits - 1) {
+      int pin = __builtin_ctz(bits);
+      bool value = received & (1u << pin);
+      if(masks->debug[bank] & (1u << pin)) {
+        rtlog_printf("DBG: GPIO IN: %u  val: %u\n", (unsigned)(bank * 32 + pin), !value);
       }
+      *gpio_in[pin] = value;
+      *data->gpio_data_in_not[bank * 32 + pin] = !value;
+    }
+    for(uint32_t bits = changed & out_mask & masks->debug[bank]; bits; bits &= bits - 1) {
+      int pin = __builtin_ctz(bits);
+      rtlog_printf("DBG: GPIO OUT: %u  val: %u\n",
+                   (unsigned)(bank * 32 + pin), (unsigned)((current >> pin) & 1));
     }
 
-    to_send[bank] |= ((uint32_t)current_value << gpio_per_bank);
-  }
+    // Inputs now match what was received; unconfigured pins echo it back.
+    uint32_t to_send = (current & out_mask) | (received & ~out_mask);
+    bool confirmation_pending = changed != 0;
 
-  for(int bank = 0; bank < MAX_GPIO_BANK; bank++) {
-    if(confirmation_pending[bank] || data->gpio_confirmation_pending[bank]) {
+    if(confirmation_pending || data->gpio_confirmation_pending[bank]) {
       // Values differ from those received in the last NW update
       // or the last network update requested confirmation.
       struct Message_gpio message = {
         .type = MSG_SET_GPIO,
         .bank = bank,
-        .values = to_send[bank],
-        .confirmation_pending=confirmation_pending[bank]
+        .values = to_send,
+        .confirmation_pending=confirmation_pending
       };
       return_val += pack_nw_buff(buffer, &message, sizeof(struct Message_gpio));
     }
@@ -348,93 +667,259 @@ uint16_t serialize_gpio(struct NWBuffer* buffer, skeleton_t* data) {
 }
 
 /* Process received update documenting current the last packet received by the RP. */
-bool unpack_timing(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    size_t* received_count,
-    skeleton_t* data
-) {
-  UNPACK_MSG(struct Reply_timing, reply, rx_buf, rx_offset);
+bool unpack_timing(const void* view, void* context) {
+  skeleton_t* data = ((struct ReplyContext*)context)->data;
+  const struct Reply_timing* reply = view;
   *data->seq_in = reply->update_id;
   *data->packet_interval = reply->time_diff;
 
-  (*received_count)++;
+  /* Each echo is timed once; a stale slot has another update_id. */
+  size_t slot = reply->update_id % TIMING_SENT_LEN;
+  if(rp->timing_sent[slot].update_id == reply->update_id && rp->timing_sent[slot].packed_ns) {
+    uint64_t round_trip_ns = host_time_ns() - rp->timing_sent[slot].packed_ns;
+    histogram_add(&data->hist[HIST_ROUND_TRIP],
+        round_trip_ns > UINT32_MAX ? UINT32_MAX : (uint32_t)round_trip_ns);
+    rp->timing_sent[slot].packed_ns = 0;
+  }
+
   return true;
 }
 
-/* Process received update documenting current joint position and velocity. */
-bool unpack_joint_movement(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    size_t* received_count,
-    skeleton_t* data
-) {
-  UNPACK_MSG(struct Reply_joint_movement, reply, rx_buf, rx_offset);
 
-  if(detected_joint_count == 0) {
-    detected_joint_count = reply->count;
-    printf("INFO: firmware reports %u joints\n", detected_joint_count);
-  } else if(detected_joint_count != reply->count) {
-    printf("WARN: joint count changed %u -> %u; reflash firmware and reinstall driver\n",
-        detected_joint_count, reply->count);
-    detected_joint_count = reply->count;
+
+static void update_detected_joint_count(uint8_t count) {
+  if(rp->detected_joint_count == 0) {
+    rp->detected_joint_count = count;
+    rtlog_printf("INFO: firmware reports %u joints\n", rp->detected_joint_count);
+  } else if(rp->detected_joint_count != count) {
+    rtlog_printf("WARN: joint count changed %u -> %u; reflash firmware and reinstall driver\n",
+        rp->detected_joint_count, count);
+    rp->detected_joint_count = count;
   }
+}
 
-  size_t n = reply->count < MAX_JOINT ? reply->count : MAX_JOINT;
+/* Write decoded joint feedback to the HAL pins. */
+static void apply_joint_movement(
+    skeleton_t* data,
+    const struct MovementState* state,
+    uint8_t count,
+    uint32_t update_period_us,
+    uint32_t core1_tick
+) {
+  size_t n = count < MAX_JOINT ? count : MAX_JOINT;
   for(size_t joint = 0; joint < n; joint++) {
     *data->joint_pos_fb[joint] =
-      ((double)reply->abs_pos_achieved[joint]) / *data->joint_scale[joint];
+      ((double)state->abs_pos_achieved[joint]) / *data->joint_scale[joint];
 
     /* velocity_achieved is Q16.16 steps/period (exact internal value);
      * divide by 65536 to get steps/period as a float. */
     *data->joint_vel_fb[joint] =
-      (double)reply->velocity_achieved[joint] / 65536.0;
+      (double)state->velocity_achieved[joint] / 65536.0;
 
     *data->joint_pos_error_fb[joint] = (int32_t)round(
         (*data->joint_pos_cmd[joint] - *data->joint_pos_fb[joint])
         * *data->joint_scale[joint]);
 
-    *data->joint_enable_fb[joint]       = reply->enabled[joint];
-    *data->joint_vel_calculated[joint]  = reply->velocity_cmd[joint];
+    *data->joint_enable_fb[joint]       = (state->enabled >> joint) & 0x1;
+    *data->joint_vel_calculated[joint]  = state->velocity_cmd[joint];
   }
 
-  *data->core1_period = reply->update_period_us;
-  *data->core1_tick   = reply->core1_tick;
+  *data->core1_period = update_period_us;
+  *data->core1_tick   = core1_tick;
+}
+
+/* Process received update documenting current joint position and velocity. */
+bool unpack_joint_movement(const void* view, void* context) {
+  skeleton_t* data = ((struct ReplyContext*)context)->data;
+  const struct Reply_joint_movement* reply = view;
+
+  update_detected_joint_count(reply->count);
+
+  struct MovementState state = {0};
+  size_t n = reply->count < WIRE_MAX_JOINT ? reply->count : WIRE_MAX_JOINT;
+  for(size_t joint = 0; joint < n; joint++) {
+    state.abs_pos_achieved[joint]  = reply->abs_pos_achieved[joint];
+    state.velocity_achieved[joint] = reply->velocity_achieved[joint];
+    state.enabled |= (reply->enabled[joint] ? 1u : 0u) << joint;
+    state.velocity_cmd[joint]      = reply->velocity_cmd[joint];
+  }
+  if(((struct ReplyContext*)context)->newest) {
+    apply_joint_movement(data, &state, reply->count, reply->update_period_us, reply->core1_tick);
+  }
 
-  (*received_count)++;
   return true;
 }
 
+static size_t read_field(const uint8_t* buf, size_t offset, void* value, size_t len) {
+  memcpy(value, buf + offset, len);
+  return offset + len;
+}
+
+/* Length of a REPLY_JOINT_MOVEMENT_V2 from the masks in its header. */
+size_t joint_movement_v2_length(const void* view) {
+  const struct Reply_joint_movement_v2* reply = view;
+  if(reply->count > WIRE_MAX_JOINT) {
+    return 0;
+  }
+  return sizeof(*reply)
+    + __builtin_popcount(reply->pos_present) * sizeof(int16_t)
+    + __builtin_popcount(reply->pos_present & reply->pos_wide) * sizeof(int16_t)
+    + __builtin_popcount(reply->vel_present) * sizeof(int32_t)
+    + __builtin_popcount(reply->vcmd_present) * sizeof(float);
+}
+
+/* Rebuild the full joint state from a REPLY_JOINT_MOVEMENT_V2 and the earlier
+ * reply it was coded against. A reply whose base is no longer held is consumed
+ * but not applied; the next ack lets the firmware pick a base we still have
+ * (or send a keyframe). */
+bool unpack_joint_movement_v2(const void* view, void* context) {
+  skeleton_t* data = ((struct ReplyContext*)context)->data;
+  const struct Reply_joint_movement_v2* reply = view;
+  const uint8_t* buf = view;
+
+  update_detected_joint_count(reply->count);
+
+  bool keyframe = (reply->id == reply->base_id);
+  const struct MovementState* base = &rp->movement_history[reply->base_id % MOVEMENT_HISTORY];
+  if(!keyframe && (!base->valid || base->id != reply->base_id)) {
+    rtlog_printf("WARN: movement reply %u coded against unknown reply %u\n",
+        reply->id, reply->base_id);
+    return true;
+  }
+
+  struct MovementState state = {.id = reply->id, .valid = true, .enabled = reply->enabled};
+  if(!keyframe) {
+    memcpy(state.abs_pos_achieved, base->abs_pos_achieved, sizeof(state.abs_pos_achieved));
+    memcpy(state.velocity_achieved, base->velocity_achieved, sizeof(state.velocity_achieved));
+    memcpy(state.velocity_cmd, base->velocity_cmd, sizeof(state.velocity_cmd));
+  }
+
+  size_t offset = sizeof(*reply);
+  for(size_t joint = 0; joint < reply->count; joint++) {
+    if(!(reply->pos_present & (1u << joint))) {
+      continue;
+    }
+    int32_t delta;
+    if(reply->pos_wide & (1u << joint)) {
+      offset = read_field(buf, offset, &delta, sizeof(int32_t));
+    } else {
+      int16_t narrow;
+      offset = read_field(buf, offset, &narrow, sizeof(int16_t));
+      delta = narrow;
+    }
+    state.abs_pos_achieved[joint] = keyframe ? delta :
+      (int32_t)((uint32_t)state.abs_pos_achieved[joint] + (uint32_t)delta);
+  }
+  for(size_t joint = 0; joint < reply->count; joint++) {
+    if(reply->vel_present & (1u << joint)) {
+      offset = read_field(buf, offset, &state.velocity_achieved[joint], sizeof(int32_t));
+    }
+  }
+  for(size_t joint = 0; joint < reply->count; joint++) {
+    if(reply->vcmd_present & (1u << joint)) {
+      offset = read_field(buf, offset, &state.velocity_cmd[joint], sizeof(float));
+    }
+  }
+
+  rp->movement_history[reply->id % MOVEMENT_HISTORY] = state;
+  if(!rp->movement_ack_valid || (int16_t)(reply->id - rp->movement_ack_id) > 0) {
+    rp->movement_ack_id    = reply->id;
+    rp->movement_ack_valid = true;
+  }
+
+  /* Stale replies still go in the history; later ones may be coded against
+   * them. */
+  if(((struct ReplyContext*)context)->newest) {
+    apply_joint_movement(data, &state, reply->count, reply->update_period_us, reply->core1_tick);
+  }
+  return true;
+}
+
+/* Acknowledge the newest decoded REPLY_JOINT_MOVEMENT_V2. */
+size_t serialize_feedback_ack(struct NWBuffer* buffer) {
+  union MessageAny message;
+  message.feedback_ack.type  = MSG_FEEDBACK_ACK;
+  message.feedback_ack.valid = rp->movement_ack_valid;
+  message.feedback_ack.id    = rp->movement_ack_id;
+  return pack_nw_buff(buffer, &message, sizeof(struct Message_feedback_ack));
+}
+
 uint8_t get_detected_joint_count(void) {
-  return detected_joint_count;
+  return rp->detected_joint_count;
 }
 
 size_t serialize_version_request(struct NWBuffer* buffer) {
   union MessageAny message;
-  message.version_request.type = MSG_VERSION_REQUEST;
+  message.version_request.type     = MSG_VERSION_REQUEST;
+  message.version_request._pad     = 0;
+  message.version_request.features = PROTOCOL_FEATURES;
   return pack_nw_buff(buffer, &message, sizeof(struct Message_version_request));
 }
 
 bool get_version_checked(void) {
-  return version_checked;
+  return rp->version_checked;
 }
 
 bool get_version_match(void) {
-  return version_match;
+  return rp->version_match;
+}
+
+uint16_t get_negotiated_features(void) {
+  return rp->negotiated_features;
+}
+
+/* The hash from the latest REPLY_CONFIG_HASH, once per reply. */
+bool take_firmware_config_hash(uint32_t* hash) {
+  if (!rp->config_hash_pending) {
+    return false;
+  }
+  rp->config_hash_pending = false;
+  *hash = rp->firmware_config_hash;
+  return true;
+}
+
+/* How long the board said it will be writing flash, once per
+ * REPLY_FLASH_WRITE. */
+bool take_flash_write_hold(uint16_t* hold_ms) {
+  if (!rp->flash_hold_ms) {
+    return false;
+  }
+  *hold_ms = rp->flash_hold_ms;
+  rp->flash_hold_ms = 0;
+  return true;
+}
+
+/* Which joints, GPIO and spindles have had a REPLY_*_CONFIG since the last
+ * call, so the caller need only recheck those. gpio has MAX_GPIO_BANK words. */
+void take_config_replies(uint32_t* joints, uint32_t* gpio, uint32_t* spindles) {
+  *joints = rp->joint_config_replied;
+  memcpy(gpio, rp->gpio_config_replied, sizeof(rp->gpio_config_replied));
+  *spindles = rp->spindle_config_replied;
+  rp->joint_config_replied = 0;
+  memset(rp->gpio_config_replied, 0, sizeof(rp->gpio_config_replied));
+  rp->spindle_config_replied = 0;
 }
 
 void reset_version_check(void) {
-  version_checked = false;
-  version_match   = false;
+  rp->version_checked     = false;
+  rp->version_match       = false;
+  rp->negotiated_features = 0;
+  rp->config_hash_pending = false;
+  rp->flash_hold_ms       = 0;
+  /* The RP may have rebooted, restarting its clock. */
+  memset(&rp->clock_sync, 0, sizeof(rp->clock_sync));
+  rp->nw_buf_limit = nw_buff_set_limit(NW_BUF_LEN_LEGACY);
+  nw_buff_set_crc32(false);
+  /* Firmware restarts its reply ids after renegotiation. */
+  memset(rp->movement_history, 0, sizeof(rp->movement_history));
+  rp->movement_ack_id    = 0;
+  rp->movement_ack_valid = false;
 }
 
-bool unpack_version_reply(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    size_t* received_count
-) {
-  UNPACK_MSG(struct Reply_version, reply, rx_buf, rx_offset);
-  if (!version_checked) {
+bool unpack_version_reply(const void* view, void* context) {
+  (void) context; /* unused */
+  const struct Reply_version* reply = view;
+  if (!rp->version_checked) {
     bool ver_ok = (reply->version_major == PROTOCOL_VERSION_MAJOR &&
                    reply->version_minor == PROTOCOL_VERSION_MINOR &&
                    reply->version_patch == PROTOCOL_VERSION_PATCH);
@@ -456,32 +941,92 @@ bool unpack_version_reply(
           reply->version_major, reply->version_minor, reply->version_patch,
           reply->version_branch);
     }
-    version_match   = ver_ok && branch_ok;
-    version_checked = true;
+    rp->version_match   = ver_ok && branch_ok;
+    rp->version_checked = true;
   }
-  (*received_count)++;
+  return true;
+}
+
+/* Firmware that understands feature negotiation answers the version request
+ * with the FEATURE_* bits both ends support. Older firmware never sends this,
+ * leaving rp->negotiated_features at 0 and the original messages in use. */
+bool unpack_features_reply(const void* view, void* context) {
+  (void) context; /* unused */
+  const struct Reply_features* reply = view;
+  uint16_t features = reply->features & PROTOCOL_FEATURES;
+  if (features != rp->negotiated_features) {
+    rtapi_print_msg(RTAPI_MSG_INFO,
+        "RP2040: INFO: protocol features 0x%04x\n", features);
+    rp->negotiated_features = features;
+  }
+  rp->nw_buf_limit = nw_buff_set_limit(
+      (features & FEATURE_LARGE_NW_BUF) ? NW_BUF_LEN : NW_BUF_LEN_LEGACY);
+  nw_buff_set_crc32(features & FEATURE_CRC32);
+  return true;
+}
+
+/* Sent with the version when FEATURE_CONFIG_CACHE is negotiated. The state
+ * machine compares it with the HAL config before sending any config. */
+bool unpack_config_hash_reply(const void* view, void* context) {
+  (void) context; /* unused */
+  const struct Reply_config_hash* reply = view;
+  rp->firmware_config_hash = reply->hash;
+  rp->config_hash_pending  = true;
+  return true;
+}
+
+/* The board is about to stop answering while it caches its config. The
+ * state machine holds off rather than call the link down. */
+bool unpack_flash_write_reply(const void* view, void* context) {
+  (void) context; /* unused */
+  const struct Reply_flash_write* reply = view;
+  rp->flash_hold_ms = reply->hold_ms;
+  return true;
+}
+
+bool unpack_clock_sync(const void* view, void* context) {
+  skeleton_t* data = ((struct ReplyContext*)context)->data;
+  const struct Reply_clock_sync* reply = view;
+  if(!clock_sync_update(
+        &rp->clock_sync, reply->host_tx_us, reply->rp_rx_us, reply->rp_tx_us,
+        ((struct ReplyContext*)context)->rx_ns / 1000)) {
+    return true;
+  }
+  *data->clock_offset_us  = rp->clock_sync.offset_us;
+  *data->clock_drift_ppm  = rp->clock_sync.drift * 1e6;
+  *data->latency_up_us    = rp->clock_sync.latency_up_us;
+  *data->latency_down_us  = rp->clock_sync.latency_down_us;
+  *data->round_trip_us    = rp->clock_sync.round_trip_us;
+  return true;
+}
+
+bool unpack_tick_sync(const void* view, void* context) {
+  skeleton_t* data = ((struct ReplyContext*)context)->data;
+  const struct Reply_tick_sync* reply = view;
+  *data->tick_phase_error_us = reply->phase_error_us;
   return true;
 }
 
 /* Update last_joint_config with the values the RP confirmed — this stops
  * configure_joint() from retransmitting (diff disappears). If the reply never
  * arrives the diff persists and the config is resent next rotation. */
-bool unpack_joint_config(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    size_t* received_count,
-    struct Message_joint_config* last_joint_config
-) {
-  UNPACK_MSG(struct Reply_joint_config, reply, rx_buf, rx_offset);
+bool unpack_joint_config(const void* view, void* context) {
+  struct Message_joint_config* last_joint_config = ((struct ReplyContext*)context)->last_joint_config;
+  const struct Reply_joint_config* reply = view;
   size_t joint = reply->joint;
+  if(joint >= MAX_JOINT) {
+    return false;
+  }
 
-  printf("INFO: Received confirmation of config received by RP for joint: %u\n", joint);
-  printf("      enable:       %u\n", reply->enable);
-  printf("      gpio_step:    %i\n", reply->gpio_step);
-  printf("      gpio_dir:     %i\n", reply->gpio_dir);
-  printf("      max_velocity: %f\n", reply->max_velocity);
-  printf("      max_accel:    %f\n", reply->max_accel);
-  printf("      cmd_type:     %u\n", reply->cmd_type);
+  rtlog_printf("INFO: Received confirmation of config received by RP for joint: %u\n"
+               "      enable:       %u\n"
+               "      gpio_step:    %i\n"
+               "      gpio_dir:     %i\n"
+               "      max_velocity: %f\n"
+               "      max_accel:    %f\n"
+               "      cmd_type:     %u\n",
+               (unsigned)joint, reply->enable, reply->gpio_step, reply->gpio_dir,
+               reply->max_velocity, reply->max_accel, reply->cmd_type);
 
   last_joint_config[joint].enable = reply->enable;
   last_joint_config[joint].gpio_step = reply->gpio_step;
@@ -489,33 +1034,33 @@ bool unpack_joint_config(
   last_joint_config[joint].max_velocity = reply->max_velocity;
   last_joint_config[joint].max_accel = reply->max_accel;
   last_joint_config[joint].cmd_type = reply->cmd_type;
+  rp->joint_config_replied |= 1u << joint;
 
-  (*received_count)++;
   return true;
 }
 
 /* Update last_gpio_config with the values the RP confirmed — this stops
  * configure_gpio() from retransmitting (diff disappears). If the reply never
  * arrives the diff persists and the config is resent next rotation. */
-bool unpack_gpio_config(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    size_t* received_count,
-    struct Message_gpio_config* last_gpio_config
-) {
-  UNPACK_MSG(struct Reply_gpio_config, reply, rx_buf, rx_offset);
+bool unpack_gpio_config(const void* view, void* context) {
+  struct Message_gpio_config* last_gpio_config = ((struct ReplyContext*)context)->last_gpio_config;
+  const struct Reply_gpio_config* reply = view;
   size_t gpio = reply->gpio_count;
+  if(gpio >= MAX_GPIO) {
+    return false;
+  }
 
-  printf("INFO: Received confirmation of config received by RP for gpio: %u\n", gpio);
-  printf("      gpio_type:   %i\n", reply->gpio_type);
-  printf("      index:       %i\n", reply->index);
-  printf("      address:     %i\n", reply->address);
+  rtlog_printf("INFO: Received confirmation of config received by RP for gpio: %u\n"
+               "      gpio_type:   %i\n"
+               "      index:       %i\n"
+               "      address:     %i\n",
+               (unsigned)gpio, reply->gpio_type, reply->index, reply->address);
 
   last_gpio_config[gpio].gpio_type = reply->gpio_type;
   last_gpio_config[gpio].index = reply->index;
   last_gpio_config[gpio].address = reply->address;
+  rp->gpio_config_replied[gpio / 32] |= 1u << (gpio % 32);
 
-  (*received_count)++;
   return true;
 }
 
@@ -523,13 +1068,9 @@ bool unpack_gpio_config(
 #define EMA_ALPHA (1.0 / 1000.0)
 
 /* Process received update containing metrics data. */
-bool unpack_joint_metrics(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    size_t* received_count,
-    skeleton_t* data
-) {
-  UNPACK_MSG(struct Reply_joint_metrics, reply, rx_buf, rx_offset);
+bool unpack_joint_metrics(const void* view, void* context) {
+  skeleton_t* data = ((struct ReplyContext*)context)->data;
+  const struct Reply_joint_metrics* reply = view;
 
   data->ema_overrun  = data->ema_overrun  * (1.0 - EMA_ALPHA) + reply->overrun_occurred  * EMA_ALPHA;
   data->ema_underrun = data->ema_underrun * (1.0 - EMA_ALPHA) + reply->underrun_occurred * EMA_ALPHA;
@@ -538,19 +1079,15 @@ bool unpack_joint_metrics(
   *data->update_underrun = (hal_float_t)data->ema_underrun;
   *data->core1_work_us   = reply->core1_work_us;
   *data->core0_work_us   = reply->core0_work_us;
+  *data->periods_coasted += reply->coasted;
 
-  (*received_count)++;
   return true;
 }
 
 /* Process received update containing spindle data. */
-bool unpack_spindle_speed(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    size_t* received_count,
-    skeleton_t* data
-) {
-  UNPACK_MSG(struct Reply_spindle_speed, reply, rx_buf, rx_offset);
+bool unpack_spindle_speed(const void* view, void* context) {
+  skeleton_t* data = ((struct ReplyContext*)context)->data;
+  const struct Reply_spindle_speed* reply = view;
 
   uint8_t spindle = reply->spindle_index;
 
@@ -559,137 +1096,112 @@ bool unpack_spindle_speed(
   *data->spindle_speed_fb[spindle] = rpm;
   *data->spindle_at_speed[spindle] = fabs(rpm - expected_rpm) < 10.0;
 
-  (*received_count)++;
   return true;
 }
 
 /* Update last_spindle_config with the values the RP confirmed — this stops
  * configure_spindle() from retransmitting (diff disappears). If the reply never
  * arrives the diff persists and the config is resent next rotation. */
-bool unpack_spindle_config(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    size_t* received_count,
-    struct Message_spindle_config* last_spindle_config
-) {
-  UNPACK_MSG(struct Reply_spindle_config, reply, rx_buf, rx_offset);
+bool unpack_spindle_config(const void* view, void* context) {
+  struct Message_spindle_config* last_spindle_config = ((struct ReplyContext*)context)->last_spindle_config;
+  const struct Reply_spindle_config* reply = view;
   size_t spindle_index = reply->spindle_index;
+  if(spindle_index >= MAX_SPINDLE) {
+    return false;
+  }
 
-  printf("INFO: Received confirmation of config received by RP for spindle: %u\n", spindle_index);
-  printf("      modbus_address   %i\n", reply->modbus_address);
-  printf("      vfd_type:        %i\n", reply->vfd_type);
-  printf("      bitrate:         %i\n", reply->bitrate);
+  rtlog_printf("INFO: Received confirmation of config received by RP for spindle: %u\n"
+               "      modbus_address   %i\n"
+               "      vfd_type:        %i\n"
+               "      bitrate:         %i\n",
+               (unsigned)spindle_index, reply->modbus_address, reply->vfd_type, reply->bitrate);
 
   last_spindle_config[spindle_index].modbus_address = reply->modbus_address;
   last_spindle_config[spindle_index].vfd_type = reply->vfd_type;
   last_spindle_config[spindle_index].bitrate = reply->bitrate;
+  rp->spindle_config_replied |= 1u << spindle_index;
 
-  (*received_count)++;
   return true;
 }
 
 /* Process received update containing GPIO values. */
-bool unpack_gpio(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    size_t* received_count,
-    skeleton_t* data
-) {
-  UNPACK_MSG(struct Reply_gpio, reply, rx_buf, rx_offset);
+bool unpack_gpio(const void* view, void* context) {
+  skeleton_t* data = ((struct ReplyContext*)context)->data;
+  const struct Reply_gpio* reply = view;
   size_t bank = reply->bank;
   uint32_t values = reply->values;
 
   data->gpio_confirmation_pending[bank] = reply->confirmation_pending;
 
   data->gpio_data_received[bank] = values;
-  (*received_count)++;
   return true;
 }
 
-/* Extract structs from data received over network. */
-void process_data(
+/* Handler and size for each REPLY_* type. */
+static const struct NWDispatch reply_dispatch[REPLY_TYPE_COUNT] = {
+  [REPLY_VERSION]           = NW_DISPATCH(struct Reply_version, unpack_version_reply),
+  [REPLY_TIMING]            = NW_DISPATCH(struct Reply_timing, unpack_timing),
+  [REPLY_JOINT_MOVEMENT]    = NW_DISPATCH(struct Reply_joint_movement, unpack_joint_movement),
+  [REPLY_JOINT_CONFIG]      = NW_DISPATCH(struct Reply_joint_config, unpack_joint_config),
+  [REPLY_JOINT_METRICS]     = NW_DISPATCH(struct Reply_joint_metrics, unpack_joint_metrics),
+  [REPLY_GPIO]              = NW_DISPATCH(struct Reply_gpio, unpack_gpio),
+  [REPLY_GPIO_CONFIG]       = NW_DISPATCH(struct Reply_gpio_config, unpack_gpio_config),
+  [REPLY_SPINDLE_SPEED]     = NW_DISPATCH(struct Reply_spindle_speed, unpack_spindle_speed),
+  [REPLY_SPINDLE_CONFIG]    = NW_DISPATCH(struct Reply_spindle_config, unpack_spindle_config),
+  [REPLY_FEATURES]          = NW_DISPATCH(struct Reply_features, unpack_features_reply),
+  [REPLY_JOINT_MOVEMENT_V2] = NW_DISPATCH_VAR(
+      sizeof(struct Reply_joint_movement_v2), joint_movement_v2_length, unpack_joint_movement_v2),
+  [REPLY_CONFIG_HASH]       = NW_DISPATCH(struct Reply_config_hash, unpack_config_hash_reply),
+  [REPLY_CLOCK_SYNC]        = NW_DISPATCH(struct Reply_clock_sync, unpack_clock_sync),
+  [REPLY_TICK_SYNC]         = NW_DISPATCH(struct Reply_tick_sync, unpack_tick_sync),
+  [REPLY_FLASH_WRITE]       = NW_DISPATCH(struct Reply_flash_write, unpack_flash_write_reply),
+};
+
+static void process_reply(
     struct NWBuffer* rx_buf,
     skeleton_t* data,
     size_t* received_count,
     size_t expected_length,
+    bool newest,
+    uint64_t rx_ns,
     struct Message_joint_config* last_joint_config,
     struct Message_gpio_config* last_gpio_config,
     struct Message_spindle_config* last_spindle_config
 ) {
   size_t rx_offset = 0;
 
-  if(rx_buf->length + sizeof(rx_buf->length) + sizeof(rx_buf->checksum) != expected_length) {
-    printf("WARN: RX length not equal to expected. %u\n", *received_count);
+  if(nw_buff_wire_len(rx_buf) != expected_length) {
+    rtlog_printf("WARN: RX length not equal to expected. %zu\n", *received_count);
     return;
   }
-  if(rx_buf->length > NW_BUF_LEN) {
-    printf("WARN: RX length greater than buffer size. %u\n", *received_count);
+  if(nw_buff_len(rx_buf) > NW_BUF_LEN) {
+    rtlog_printf("WARN: RX length greater than buffer size. %zu\n", *received_count);
     return;
   }
 
   if(!checkNWBuff(rx_buf)) {
-    printf("WARN: RX checksum fail.\n");
+    rtlog_printf("WARN: RX checksum fail.\n");
     return;
   }
 
-  bool unpack_success = true;
-
-  while(unpack_success) {
-    struct Reply_header* header = unpack_nw_buff(
-        rx_buf, rx_offset, NULL, NULL, sizeof(struct Reply_header));
-
-    if(!header || ! header->type) {
-      // Legitimate end of data.
-      break;
-    }
-    switch(header->type) {
-      case REPLY_VERSION:
-        unpack_success = unpack_success && unpack_version_reply(
-            rx_buf, &rx_offset, received_count);
-        break;
-      case REPLY_TIMING:
-        ;
-        unpack_success = unpack_success && unpack_timing(
-            rx_buf, &rx_offset, received_count, data);
-        break;
-      case REPLY_JOINT_MOVEMENT:
-        unpack_success = unpack_success && unpack_joint_movement(
-            rx_buf, &rx_offset, received_count, data);
-        break;
-      case REPLY_JOINT_CONFIG:
-        unpack_success = unpack_success && unpack_joint_config(
-            rx_buf, &rx_offset, received_count, last_joint_config);
-        break;
-      case REPLY_GPIO_CONFIG:
-        unpack_success = unpack_success && unpack_gpio_config(
-            rx_buf, &rx_offset, received_count, last_gpio_config);
-        break;
-      case REPLY_JOINT_METRICS:
-        unpack_success = unpack_success && unpack_joint_metrics(
-            rx_buf, &rx_offset, received_count, data);
-        break;
-      case REPLY_SPINDLE_SPEED:
-        unpack_success = unpack_success && unpack_spindle_speed(
-            rx_buf, &rx_offset, received_count, data);
-        break;
-      case REPLY_SPINDLE_CONFIG:
-        unpack_success = unpack_success && unpack_spindle_config(
-            rx_buf, &rx_offset, received_count, last_spindle_config);
-        break;
-      case REPLY_GPIO:
-        unpack_success = unpack_success && unpack_gpio(
-            rx_buf, &rx_offset, received_count, data);
-        break;
-      default:
-        printf("WARN: Invalid message type: %u\t%lu\n", header->type, *received_count);
-        // Implies data corruption.
-        unpack_success = false;
-        break;
-    }
+  struct ReplyContext context = {
+    .data = data,
+    .last_joint_config = last_joint_config,
+    .last_gpio_config = last_gpio_config,
+    .last_spindle_config = last_spindle_config,
+    .newest = newest,
+    .rx_ns = rx_ns
+  };
+  enum NWDispatchResult result = nw_dispatch(
+      rx_buf, reply_dispatch, REPLY_TYPE_COUNT, &context, &rx_offset, received_count);
+
+  if(result == NW_DISPATCH_UNKNOWN_TYPE) {
+    rtlog_printf("WARN: Invalid message type: %u\t%zu\n", rx_buf->payload[rx_offset], *received_count);
+    // Implies data corruption.
   }
 
   if(rx_offset < rx_buf->length) {
-    printf("WARN: Unconsumed RX buffer remainder: %u bytes.\t%u\n",
+    rtlog_printf("WARN: Unconsumed RX buffer remainder: %zu bytes.\t%zu\n",
         rx_buf->length - rx_offset, *received_count);
     // Implies data corruption.
     // Received a message type in the header but not enough data in the buffer
@@ -697,3 +1209,71 @@ void process_data(
   }
 }
 
+/* Extract structs from data received over network. */
+void process_data(
+    struct NWBuffer* rx_buf,
+    skeleton_t* data,
+    size_t* received_count,
+    size_t expected_length,
+    struct Message_joint_config* last_joint_config,
+    struct Message_gpio_config* last_gpio_config,
+    struct Message_spindle_config* last_spindle_config
+) {
+  process_reply(rx_buf, data, received_count, expected_length, true, host_time_ns(),
+      last_joint_config, last_gpio_config, last_spindle_config);
+}
+
+/* Drain every reply queued since the last cycle, in NW_RX_BATCH sized
+ * recvmmsg() calls. All are unpacked in order so no config confirmation, GPIO
+ * state or metric is lost, but joint feedback is only written from the newest.
+ * Returns the number of replies received. */
+size_t receive_replies(
+    int device,
+    skeleton_t* data,
+    size_t* received_count,
+    struct Message_joint_config* last_joint_config,
+    struct Message_gpio_config* last_gpio_config,
+    struct Message_spindle_config* last_spindle_config
+) {
+  static struct NWBuffer rx_buffers[NW_RX_BATCH];
+  static size_t rx_lengths[NW_RX_BATCH];
+  static uint64_t rx_times[NW_RX_BATCH];
+  size_t total = 0;
+  size_t held = 0;  /* rx_buffers[0] is carried over from a full batch. */
+  size_t count = 0;
+
+  for(size_t batch = 0; batch < NW_RX_MAX_BATCHES; batch++) {
+    count = held + get_replies_non_block(
+        device, rx_buffers + held, rx_lengths + held, rx_times + held, NW_RX_BATCH - held);
+    for(size_t i = held; i < count; i++) {
+      capture_packet(CAPTURE_RX, device, *data->seq_out, &rx_buffers[i], rx_lengths[i]);
+    }
+    if(count < NW_RX_BATCH || batch + 1 == NW_RX_MAX_BATCHES) {
+      break;
+    }
+    /* A full batch: more may be queued, so the last is not known to be the
+     * newest yet. */
+    uint64_t unpack_start = host_time_ns();
+    for(size_t i = 0; i + 1 < count; i++) {
+      process_reply(&rx_buffers[i], data, received_count, rx_lengths[i], false, rx_times[i],
+          last_joint_config, last_gpio_config, last_spindle_config);
+    }
+    data->cycle_unpack_ns += host_time_ns() - unpack_start;
+    total += count - 1;
+    rx_buffers[0] = rx_buffers[count - 1];
+    rx_lengths[0] = rx_lengths[count - 1];
+    rx_times[0]   = rx_times[count - 1];
+    held = 1;
+  }
+
+  if(count == 0) {
+    return total;
+  }
+  uint64_t unpack_start = host_time_ns();
+  for(size_t i = 0; i < count; i++) {
+    process_reply(&rx_buffers[i], data, received_count, rx_lengths[i], i + 1 == count,
+        rx_times[i], last_joint_config, last_gpio_config, last_spindle_config);
+  }
+  data->cycle_unpack_ns += host_time_ns() - unpack_start;
+  return total + count;
+}
@@ -0,0 +1,242 @@
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rp2040_defines.h"
+
+/* Deferred driver diagnostics.
+ * The servo thread formats each message into a slot of a preallocated
+ * lock-free queue with rtlog_printf(); it never blocks on the console and
+ * never allocates. Messages over the rate limit, or that find the queue full,
+ * are counted and dropped. A drain thread prints the queue to stdout and
+ * reports how many were lost.
+ * Until rtlog_start() is called (tools, tests, module load) rtlog_printf()
+ * prints directly. */
+
+/* Must be a power of two. */
+#define RTLOG_RING_LEN        256
+/* Longest message kept; longer ones are truncated. */
+#define RTLOG_TEXT_LEN        248
+/* At most RTLOG_WINDOW_MAX messages are queued per RTLOG_WINDOW_NS. */
+#define RTLOG_WINDOW_NS       1000000000ull
+#define RTLOG_WINDOW_MAX      100
+#define RTLOG_DRAIN_SLEEP_NS  10000000
+
+static_assert((RTLOG_RING_LEN & (RTLOG_RING_LEN - 1)) == 0,
+              "RTLOG_RING_LEN must be a power of two");
+static_assert(RTLOG_WINDOW_MAX < RTLOG_RING_LEN,
+              "A full rate window must fit on the ring");
+
+struct RtlogRecord {
+  uint64_t time_ns;           // Host CLOCK_MONOTONIC when logged.
+  char text[RTLOG_TEXT_LEN];  // Always NUL terminated.
+};
+
+/* Same bounded queue as rp2040_capture.c. */
+struct RtlogSlot {
+  _Atomic uint32_t sequence;
+  struct RtlogRecord record;
+};
+
+struct RtlogRing {
+  _Atomic uint32_t head;          // Next position to write.
+  _Atomic uint32_t dropped;       // Messages lost to a full ring or the rate limit.
+  _Atomic uint64_t window_start;  // Start of the current rate window.
+  _Atomic uint32_t window_count;  // Messages offered in the current window.
+  uint32_t tail;                  // Next position to read. Consumer only.
+  uint32_t reported;              // dropped when last reported. Consumer only.
+  struct RtlogSlot slots[RTLOG_RING_LEN];
+};
+
+static struct RtlogRing* rtlog_ring = NULL;
+static _Atomic bool rtlog_active = false;
+
+static pthread_t rtlog_thread;
+static _Atomic bool rtlog_thread_run = false;
+
+/* Allocate the ring and start queueing. Not RT safe.
+ * Returns false if out of memory. */
+bool rtlog_ring_init(void) {
+  if(rtlog_ring == NULL) {
+    rtlog_ring = malloc(sizeof(*rtlog_ring));
+    if(rtlog_ring == NULL) {
+      return false;
+    }
+  }
+  atomic_store_explicit(&rtlog_ring->head, 0, memory_order_relaxed);
+  atomic_store_explicit(&rtlog_ring->dropped, 0, memory_order_relaxed);
+  atomic_store_explicit(&rtlog_ring->window_start, host_time_ns(), memory_order_relaxed);
+  atomic_store_explicit(&rtlog_ring->window_count, 0, memory_order_relaxed);
+  rtlog_ring->tail = 0;
+  rtlog_ring->reported = 0;
+  for(uint32_t pos = 0; pos < RTLOG_RING_LEN; pos++) {
+    atomic_store_explicit(&rtlog_ring->slots[pos].sequence, pos, memory_order_relaxed);
+  }
+  atomic_store_explicit(&rtlog_active, true, memory_order_release);
+  return true;
+}
+
+void rtlog_ring_free(void) {
+  atomic_store_explicit(&rtlog_active, false, memory_order_release);
+  free(rtlog_ring);
+  rtlog_ring = NULL;
+}
+
+/* True if one more message fits in the current rate window. */
+static bool rtlog_within_rate(struct RtlogRing* ring, uint64_t now) {
+  uint64_t start = atomic_load_explicit(&ring->window_start, memory_order_relaxed);
+  if(now - start >= RTLOG_WINDOW_NS) {
+    /* Whoever wins the exchange opens the new window; a loser counts against
+     * it, which errs on the side of fewer messages. */
+    if(atomic_compare_exchange_strong_explicit(
+          &ring->window_start, &start, now, memory_order_relaxed, memory_order_relaxed)) {
+      atomic_store_explicit(&ring->window_count, 0, memory_order_relaxed);
+    }
+  }
+  return atomic_fetch_add_explicit(&ring->window_count, 1, memory_order_relaxed)
+      < RTLOG_WINDOW_MAX;
+}
+
+/* Log one message. RT safe once rtlog_ring_init() has run; before that it
+ * prints directly. Messages carry their own "WARN:" style prefix and
+ * trailing newline. */
+__attribute__((format(printf, 1, 2)))
+void rtlog_printf(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  if(!atomic_load_explicit(&rtlog_active, memory_order_acquire)) {
+    vprintf(format, args);
+    va_end(args);
+    return;
+  }
+
+  struct RtlogRing* ring = rtlog_ring;
+  uint64_t now = host_time_ns();
+  if(!rtlog_within_rate(ring, now)) {
+    atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+    va_end(args);
+    return;
+  }
+
+  uint32_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  struct RtlogSlot* slot;
+  for(;;) {
+    slot = &ring->slots[pos & (RTLOG_RING_LEN - 1)];
+    uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    int32_t diff = (int32_t)(sequence - pos);
+    if(diff == 0) {
+      if(atomic_compare_exchange_weak_explicit(
+            &ring->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+        break;
+      }
+    } else if(diff < 0) {
+      atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+      va_end(args);
+      return;
+    } else {
+      pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    }
+  }
+
+  slot->record.time_ns = now;
+  vsnprintf(slot->record.text, RTLOG_TEXT_LEN, format, args);
+  va_end(args);
+  atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+}
+
+/* Take the oldest message off the ring. Single consumer.
+ * Returns false if the ring is empty. */
+bool rtlog_pop(struct RtlogRecord* record) {
+  struct RtlogRing* ring = rtlog_ring;
+  if(ring == NULL) {
+    return false;
+  }
+  uint32_t pos = ring->tail;
+  struct RtlogSlot* slot = &ring->slots[pos & (RTLOG_RING_LEN - 1)];
+  uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+  if(sequence != pos + 1) {
+    return false;
+  }
+  memcpy(record, &slot->record, sizeof(*record));
+  atomic_store_explicit(&slot->sequence, pos + RTLOG_RING_LEN, memory_order_release);
+  ring->tail = pos + 1;
+  return true;
+}
+
+/* Messages dropped since the last call. Single consumer. */
+uint32_t rtlog_take_dropped(void) {
+  struct RtlogRing* ring = rtlog_ring;
+  if(ring == NULL) {
+    return 0;
+  }
+  uint32_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+  uint32_t count = dropped - ring->reported;
+  ring->reported = dropped;
+  return count;
+}
+
+/* Print everything queued on the ring to out, then any drops.
+ * Returns the number of messages printed. */
+size_t rtlog_drain(FILE* out) {
+  struct RtlogRecord record;
+  size_t count = 0;
+  while(rtlog_pop(&record)) {
+    fputs(record.text, out);
+    count++;
+  }
+  uint32_t dropped = rtlog_take_dropped();
+  if(dropped > 0) {
+    fprintf(out, "WARN: %u driver log messages dropped\n", dropped);
+  }
+  if(count > 0 || dropped > 0) {
+    fflush(out);
+  }
+  return count;
+}
+
+static void* rtlog_drainer(void* arg) {
+  (void)arg;
+  const struct timespec pause = {.tv_sec = 0, .tv_nsec = RTLOG_DRAIN_SLEEP_NS};
+  while(atomic_load_explicit(&rtlog_thread_run, memory_order_acquire)) {
+    if(rtlog_drain(stdout) == 0) {
+      nanosleep(&pause, NULL);
+    }
+  }
+  return NULL;
+}
+
+/* Queue messages from here on and print them from a drain thread.
+ * Not RT safe; call before the servo thread starts. Returns 0 or errno. */
+int rtlog_start(void) {
+  if(!rtlog_ring_init()) {
+    return ENOMEM;
+  }
+  atomic_store_explicit(&rtlog_thread_run, true, memory_order_release);
+  int error = pthread_create(&rtlog_thread, NULL, rtlog_drainer, NULL);
+  if(error != 0) {
+    atomic_store_explicit(&rtlog_thread_run, false, memory_order_release);
+    rtlog_ring_free();
+  }
+  return error;
+}
+
+/* Stop the drain thread and print what is left on the ring. Later messages
+ * print directly. Call once the servo thread no longer runs. */
+void rtlog_stop(void) {
+  if(!atomic_load_explicit(&rtlog_thread_run, memory_order_acquire)) {
+    return;
+  }
+  atomic_store_explicit(&rtlog_active, false, memory_order_release);
+  atomic_store_explicit(&rtlog_thread_run, false, memory_order_release);
+  pthread_join(rtlog_thread, NULL);
+  rtlog_drain(stdout);
+  rtlog_ring_free();
+}
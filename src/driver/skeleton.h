@@ -1,6 +1,17 @@
 #ifndef SKELETON_H
 #define SKELETON_H
 
+#include "rp2040_histogram.h"
+
+/* Per bank masks of the gpio_type params, so serialize_gpio() only visits
+ * configured pins. Rebuilt whenever gpio_type differs from type. */
+struct GpioMasks {
+  hal_u32_t type[MAX_GPIO];       /* gpio_type the masks were built from. */
+  uint32_t in[MAX_GPIO_BANK];     /* HAL input pins, driven from the board. */
+  uint32_t out[MAX_GPIO_BANK];    /* HAL output pins, sent to the board. */
+  uint32_t debug[MAX_GPIO_BANK];  /* *_DEBUG types, printed on change. */
+};
+
 /* Runtime data for a single HAL port/channel.
  * Assumes hal_u32_t, hal_s32_t, hal_float_t, hal_bit_t are defined by the includer
  * (hal.h in production; mock typedefs in test builds). */
@@ -35,9 +46,31 @@ typedef struct {
   hal_u32_t* core0_work_us;
   hal_float_t* update_overrun;
   hal_float_t* update_underrun;
+  hal_u32_t* periods_coasted;
+  hal_float_t* clock_offset_us;   /* RP clock minus host clock. */
+  hal_float_t* clock_drift_ppm;
+  hal_float_t* latency_up_us;
+  hal_float_t* latency_down_us;
+  hal_float_t* round_trip_us;     /* 0 until a REPLY_CLOCK_SYNC has arrived. */
+  hal_s32_t* tick_phase_error_us; /* From REPLY_TICK_SYNC. */
+  hal_u32_t* tx_class_bytes[TX_CLASS_COUNT];  /* Bytes packed per TX_CLASS_* last cycle. */
+  hal_u32_t* feedback_mode;     /* FEEDBACK_* that delivered this cycle's joint feedback. */
+  hal_float_t* hist_p50_us[HIST_COUNT];
+  hal_float_t* hist_p99_us[HIST_COUNT];
+  hal_float_t* hist_max_us[HIST_COUNT];
+  hal_bit_t* hist_reset;        /* Clear the histograms while set. */
+  hal_u32_t  coast_periods;     /* Missed updates the board may coast through; 0 = off. */
+  hal_u32_t  reply_wait_us;     /* Spin this long after sending for the reply; 0 = off. */
+  hal_u32_t  sync_ticks;        /* Align the tick to the timebase shared by all boards. */
 
   double ema_overrun;
   double ema_underrun;
+  long period_ns;           /* Servo thread period, as passed to write_port(). */
+  size_t read_replies;      /* Replies drained by read_port() since the last write. */
+  struct Histogram hist[HIST_COUNT];
+  uint32_t hist_refresh;      /* Cycle count driving the round-robin percentile refresh. */
+  uint64_t cycle_receive_ns;  /* Spent in receive calls since the last write, incl. unpack. */
+  uint64_t cycle_unpack_ns;   /* Spent unpacking replies since the last write. */
 
   hal_bit_t* gpio_data_in[MAX_GPIO];
   hal_bit_t* gpio_data_in_not[MAX_GPIO];
@@ -49,6 +82,7 @@ typedef struct {
 
   hal_u32_t gpio_data_received[MAX_GPIO_BANK];
   hal_bit_t gpio_confirmation_pending[MAX_GPIO_BANK];
+  struct GpioMasks gpio_masks;
 
   hal_bit_t* spindle_fwd[MAX_SPINDLE];
   hal_bit_t* spindle_rev[MAX_SPINDLE];
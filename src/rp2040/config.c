@@ -18,17 +18,16 @@
 #include "buffer.h"
 #include "gpio.h"
 
-// Mutexes for locking the main config which is shared between cores.
+// Mutex for locking the main config which is shared between cores.
 mutex_t mtx_top;
-mutex_t mtx_joint[MAX_JOINT];
 
 /* tick: incremented by the timer ISR on Core0; Core1 blocks on it each loop.
  * last_packet_tick: written by Core0 once per received packet; Core1 reads it
  *   to detect network loss via (tick - last_packet_tick) > MAX_MISSED_PACKET.
  * linuxcnc_restart_detected: set by Core0 in update_packet_metrics() when
  *   id_diff < 0 (sequence wrap = LinuxCNC restarted); Core1 reads and clears it.
- * packet_generation: incremented by Core0 after all joint configs from one
- *   packet are written; Core1 waits on it to avoid reading a half-written config.
+ * packet_generation: incremented by Core0 once a packet's joint commands are
+ *   published; Core1 waits on it before reading them.
  * All four are 32-bit aligned (or bool) with a single writer and single reader —
  * atomic on Cortex-M0+, no mutex needed. */
 volatile uint32_t tick = 0;
@@ -45,62 +44,48 @@ volatile struct ConfigGlobal config = {
   .last_id_diff = 0,
   .update_time_us = 1000,    // 1000us.
   .pio_io_configured = false,
+  .features = 0,
+  .coast_periods = 0,
   .joint = {
     {
       // Axis 0.
-      .updated_from_c0 = 0,
-      .updated_from_c1 = 0,
       .enabled = 0,
       .io_pos_step = -1,
       .io_pos_dir = -1,
-      .velocity_requested = 0,
-      .abs_pos_requested = 0,
-      .abs_pos_achieved = 0,
+      .velocity_requested_q = 0,
+      .abs_pos_requested_q = 0,
       .max_velocity = 50,
-      .max_accel = 2.0,
-      .velocity_achieved = 0
+      .max_accel = 2.0
     },
     {
       // Axis 1.
-      .updated_from_c0 = 0,
-      .updated_from_c1 = 0,
       .enabled = 0,
       .io_pos_step = -1,
       .io_pos_dir = -1,
-      .velocity_requested = 0,
-      .abs_pos_requested = 0,
-      .abs_pos_achieved = 0,
+      .velocity_requested_q = 0,
+      .abs_pos_requested_q = 0,
       .max_velocity = 50,
-      .max_accel = 10.0,
-      .velocity_achieved = 0
+      .max_accel = 10.0
     },
     {
       // Axis 2.
-      .updated_from_c0 = 0,
-      .updated_from_c1 = 0,
       .enabled = 0,
       .io_pos_step = -1,
       .io_pos_dir = -1,
-      .velocity_requested = 0,
-      .abs_pos_requested = 0,
-      .abs_pos_achieved = 0,
+      .velocity_requested_q = 0,
+      .abs_pos_requested_q = 0,
       .max_velocity = 50,
-      .max_accel = 200.0,
-      .velocity_achieved = 0
+      .max_accel = 200.0
     },
     {
       // Axis 3.
-      .updated_from_c0 = 0,
-      .updated_from_c1 = 0,
       .enabled = 0,
       .io_pos_step = -1,
       .io_pos_dir = -1,
-      .velocity_requested = 0,
-      .abs_pos_requested = 0,
-      .abs_pos_achieved = 0,
+      .velocity_requested_q = 0,
+      .abs_pos_requested_q = 0,
       .max_velocity = 50,
-      .max_accel = 200.0,
-      .velocity_achieved = 0
+      .max_accel = 200.0
     },
   }
 };
@@ -111,23 +96,25 @@ void init_gpio() {
     config.gpio[gpio].type = GPIO_TYPE_NOT_SET;
     config.gpio[gpio].index = 0;
     config.gpio[gpio].address = 0;
-    config.gpio[gpio].value = false;
   }
 
   for(uint16_t bank = 0; bank < MAX_GPIO_BANK; bank++) {
+    config.gpio_values[bank] = 0;
     // Set confirmation to force an initial Reply_gpio to be sent.
     config.gpio_confirmation_pending[bank] = false;
   }
 }
 
+static void reset_joint_exchange(void);
+
 void init_config()
 {
   init_gpio();
+  reset_joint_exchange();
 
   mutex_init(&mtx_top);
 
   for(uint8_t joint = 0; joint < MAX_JOINT; joint++) {
-    mutex_init(&mtx_joint[joint]);
     memset((void*)&config.joint[joint], 0, sizeof(config.joint[joint]));
     config.joint[joint].io_pos_step = -1;
     config.joint[joint].io_pos_dir  = -1;
@@ -156,9 +143,14 @@ int32_t get_last_id_diff(void) {
   return config.last_id_diff;
 }
 
+uint8_t get_coast_periods(void) {
+  // Single byte written by Core0, read by Core1; atomic on Cortex-M0+.
+  return config.coast_periods;
+}
+
 /* Set metrics for tracking successful update transmission and jitter. */
 void update_packet_metrics(
-    struct Message_timing* message,
+    const struct Message_timing* message,
     int32_t* id_diff,
     int32_t* time_diff
 ) {
@@ -178,190 +170,213 @@ void update_packet_metrics(
   mutex_exit(&mtx_top);
 }
 
-uint8_t has_new_c0_data(const uint8_t joint) {
-  mutex_enter_blocking(&mtx_joint[joint]);
-  uint8_t updated = config.joint[joint].updated_from_c0;
-
-  mutex_exit(&mtx_joint[joint]);
-  return updated;
-}
-
-void update_joint_config(
-    const uint8_t joint,
-    const uint8_t core,
-    const uint8_t* enabled,
-    const int8_t* io_pos_step,
-    const int8_t* io_pos_dir,
-    const double* velocity_requested,
-    const double* abs_pos_requested,
-    const int32_t* abs_pos_achieved,
-    const double* max_velocity,
-    const double* max_accel,
-    const int32_t* velocity_achieved,
-    const uint8_t* cmd_type
-)
-{
-  if(joint >= MAX_JOINT) {
-    return;
-  }
+/* Joint commands travel to Core1, and feedback back to Core0, through a
+ * seqlock each. There is one writer per seqlock; sequence is odd while it is
+ * copying in. A reader copies out and tries again if sequence was odd or has
+ * moved since, so neither core ever holds the other up for more than one
+ * copy. */
+struct JointCommandSnapshot {
+  uint32_t sequence;
+  uint32_t generation;                    // packet_generation once published.
+  uint32_t disables_applied[MAX_JOINT];   // Core1 disables already in joint[].
+  struct JointCommand joint[MAX_JOINT];
+};
 
-  mutex_enter_blocking(&mtx_joint[joint]);
+struct JointFeedbackSnapshot {
+  uint32_t sequence;
+  struct JointFeedback joint[MAX_JOINT];
+};
 
-  if(enabled != NULL) {
-    config.joint[joint].enabled = *enabled;
-  }
-  if(io_pos_step != NULL) {
-    config.joint[joint].io_pos_step = *io_pos_step;
-  }
-  if(io_pos_dir != NULL) {
-    config.joint[joint].io_pos_dir = *io_pos_dir;
-  }
-  if(velocity_requested != NULL) {
-    config.joint[joint].velocity_requested = *velocity_requested;
-  }
-  if(abs_pos_requested != NULL) {
-    config.joint[joint].abs_pos_requested = *abs_pos_requested;
-  }
-  if(abs_pos_achieved != NULL) {
-    config.joint[joint].abs_pos_achieved = *abs_pos_achieved;
-  }
-  if(max_velocity != NULL) {
-    config.joint[joint].max_velocity = *max_velocity;
-  }
-  if(max_accel != NULL) {
-    config.joint[joint].max_accel = *max_accel;
+static struct JointCommandSnapshot command_snapshot;
+static struct JointFeedbackSnapshot feedback_snapshot;
+
+/* Joints written since the last publish_joint_commands(). Core0 only. */
+static uint8_t joints_staged = 0;
+
+/* Totals are written by Core1 only; Core0 keeps how much it has reported. */
+static volatile uint32_t overrun_total = 0;
+static volatile uint32_t underrun_total = 0;
+static volatile uint32_t coasted_total = 0;
+static uint32_t overrun_reported = 0;
+static uint32_t underrun_reported = 0;
+static uint32_t coasted_reported = 0;
+/* Updates missed in a row. Core1 only. */
+static uint32_t missed_run = 0;
+
+/* Requests are counted by Core1 only, and applied by Core0 only. */
+static volatile uint32_t disable_requests[MAX_JOINT];
+static uint32_t disables_applied[MAX_JOINT];
+
+static void seqlock_write_begin(uint32_t* sequence) {
+  __atomic_store_n(sequence, *sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void seqlock_write_end(uint32_t* sequence) {
+  __atomic_store_n(sequence, *sequence + 1, __ATOMIC_RELEASE);
+}
+
+static uint32_t seqlock_read_begin(const uint32_t* sequence) {
+  uint32_t begin;
+  while((begin = __atomic_load_n(sequence, __ATOMIC_ACQUIRE)) & 1) {
   }
-  if(velocity_achieved != NULL) {
-    config.joint[joint].velocity_achieved = *velocity_achieved;
+  return begin;
+}
+
+static bool seqlock_read_retry(const uint32_t* sequence, uint32_t begin) {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(sequence, __ATOMIC_RELAXED) != begin;
+}
+
+static void reset_joint_exchange(void) {
+  memset(&command_snapshot, 0, sizeof(command_snapshot));
+  command_snapshot.generation = packet_generation;
+  memset(&feedback_snapshot, 0, sizeof(feedback_snapshot));
+  memset((void*)disable_requests, 0, sizeof(disable_requests));
+  memset(disables_applied, 0, sizeof(disables_applied));
+  joints_staged = 0;
+  overrun_total = 0;
+  underrun_total = 0;
+  coasted_total = 0;
+  overrun_reported = 0;
+  underrun_reported = 0;
+  coasted_reported = 0;
+  missed_run = 0;
+}
+
+void count_joint_updates(uint32_t packets) {
+  if(packets == 0) {
+    /* do_steps() extrapolates through the first get_coast_periods() misses
+     * in a row; only the ones after that are underruns. */
+    if(missed_run < get_coast_periods()) {
+      coasted_total++;
+    } else {
+      underrun_total++;
+    }
+    missed_run++;
+    return;
   }
-  if(cmd_type != NULL) {
-    config.joint[joint].cmd_type = *cmd_type;
+  missed_run = 0;
+  if(packets > 1) {
+    /* -1 because one packet was consumed; the rest are excess. */
+    overrun_total += packets - 1;
   }
+}
 
-  switch(core) {
-    case CORE0:
-      config.joint[joint].updated_from_c0++;
-      break;
-    case CORE1:
-      config.joint[joint].updated_from_c1++;
-      break;
-  }
+uint32_t get_and_reset_overrun_count(void) {
+  uint32_t total = overrun_total;
+  uint32_t count = total - overrun_reported;
+  overrun_reported = total;
+  return count;
+}
 
-  mutex_exit(&mtx_joint[joint]);
+uint32_t get_and_reset_underrun_count(void) {
+  uint32_t total = underrun_total;
+  uint32_t count = total - underrun_reported;
+  underrun_reported = total;
+  return count;
 }
 
+uint32_t get_and_reset_coasted_count(void) {
+  uint32_t total = coasted_total;
+  uint32_t count = total - coasted_reported;
+  coasted_reported = total;
+  return count;
+}
 
-uint32_t get_joint_config(
-    const uint8_t joint,
-    const uint8_t core,
-    uint8_t* enabled,
-    int8_t* io_pos_step,
-    int8_t* io_pos_dir,
-    double* velocity_requested,
-    double* abs_pos_requested,
-    int32_t* abs_pos_achieved,
-    double* max_velocity,
-    double* max_accel,
-    int32_t* velocity_achieved,
-    uint8_t* cmd_type)
-{
+volatile struct JointCommand* stage_joint_command(const uint8_t joint) {
   if(joint >= MAX_JOINT) {
-    return 0;
+    return NULL;
   }
+  joints_staged |= 1u << joint;
+  return &config.joint[joint];
+}
 
-  mutex_enter_blocking(&mtx_joint[joint]);
-
-  int32_t updated_by_other_core;
-  switch(core) {
-    case CORE0:
-      updated_by_other_core = config.joint[joint].updated_from_c1;
-      config.joint[joint].updated_from_c1 = 0;
-      break;
-    case CORE1:
-      updated_by_other_core = config.joint[joint].updated_from_c0;
-      config.joint[joint].updated_from_c0 = 0;
-      if(updated_by_other_core == 0) {
-        config.joint[joint].underrun_count++;
-      } else if(updated_by_other_core > 1) {
-        /* -1 because one packet was consumed; the rest are excess. */
-        config.joint[joint].overrun_count += updated_by_other_core - 1;
-      }
-      break;
-  }
+void publish_joint_commands(void) {
+  uint32_t generation = packet_generation + 1;
 
-  if(enabled != NULL) {
-    *enabled = config.joint[joint].enabled;
-  }
-  if(io_pos_step != NULL) {
-    *io_pos_step = config.joint[joint].io_pos_step;
-  }
-  if(io_pos_dir != NULL) {
-    *io_pos_dir = config.joint[joint].io_pos_dir;
-  }
-  if(velocity_requested != NULL) {
-    *velocity_requested = config.joint[joint].velocity_requested;
-  }
-  if(abs_pos_requested != NULL) {
-    *abs_pos_requested = config.joint[joint].abs_pos_requested;
-  }
-  if(abs_pos_achieved != NULL) {
-    *abs_pos_achieved = config.joint[joint].abs_pos_achieved;
-  }
-  if(max_velocity != NULL) {
-    *max_velocity = config.joint[joint].max_velocity;
-  }
-  if(max_accel != NULL) {
-    *max_accel = config.joint[joint].max_accel;
+  apply_joint_disables();
+  for(uint8_t joint = 0; joint < MAX_JOINT; joint++) {
+    if(joints_staged & (1u << joint)) {
+      config.joint[joint].generation = generation;
+    }
   }
-  if(velocity_achieved != NULL) {
-    *velocity_achieved = config.joint[joint].velocity_achieved;
+  joints_staged = 0;
+
+  seqlock_write_begin(&command_snapshot.sequence);
+  command_snapshot.generation = generation;
+  for(uint8_t joint = 0; joint < MAX_JOINT; joint++) {
+    command_snapshot.disables_applied[joint] = disables_applied[joint];
+    command_snapshot.joint[joint] = config.joint[joint];
   }
-  if(cmd_type != NULL) {
-    *cmd_type = config.joint[joint].cmd_type;
+  seqlock_write_end(&command_snapshot.sequence);
+
+  packet_generation = generation;
+}
+
+uint32_t read_joint_commands(struct JointCommand commands[MAX_JOINT]) {
+  uint32_t generation;
+  uint32_t applied[MAX_JOINT];
+  uint32_t begin;
+  do {
+    begin = seqlock_read_begin(&command_snapshot.sequence);
+    generation = command_snapshot.generation;
+    memcpy(applied, command_snapshot.disables_applied, sizeof(applied));
+    memcpy(commands, command_snapshot.joint, sizeof(command_snapshot.joint));
+  } while(seqlock_read_retry(&command_snapshot.sequence, begin));
+
+  /* Core0 may not have caught up with a disable yet. */
+  for(uint8_t joint = 0; joint < MAX_JOINT; joint++) {
+    if(applied[joint] != disable_requests[joint]) {
+      commands[joint].enabled = 0;
+    }
   }
+  return generation;
+}
 
-  mutex_exit(&mtx_joint[joint]);
+void publish_joint_feedback(const struct JointFeedback feedback[MAX_JOINT]) {
+  seqlock_write_begin(&feedback_snapshot.sequence);
+  memcpy(feedback_snapshot.joint, feedback, sizeof(feedback_snapshot.joint));
+  seqlock_write_end(&feedback_snapshot.sequence);
+}
 
-  return updated_by_other_core;
+uint32_t read_joint_feedback(struct JointFeedback feedback[MAX_JOINT]) {
+  uint32_t begin;
+  do {
+    begin = seqlock_read_begin(&feedback_snapshot.sequence);
+    memcpy(feedback, feedback_snapshot.joint, sizeof(feedback_snapshot.joint));
+  } while(seqlock_read_retry(&feedback_snapshot.sequence, begin));
+  return begin / 2;
 }
 
-uint32_t get_and_reset_overrun_count(const uint8_t joint) {
-  if(joint >= MAX_JOINT) {
-    return 0;
+bool any_joint_enabled(void) {
+  for(uint8_t joint = 0; joint < MAX_JOINT; joint++) {
+    if(config.joint[joint].enabled) {
+      return true;
+    }
   }
-  mutex_enter_blocking(&mtx_joint[joint]);
-  uint32_t count = config.joint[joint].overrun_count;
-  config.joint[joint].overrun_count = 0;
-  mutex_exit(&mtx_joint[joint]);
-  return count;
+  return false;
 }
 
-uint32_t get_and_reset_underrun_count(const uint8_t joint) {
+void disable_joint(const uint8_t joint, const uint8_t core) {
   if(joint >= MAX_JOINT) {
-    return 0;
+    return;
   }
-  mutex_enter_blocking(&mtx_joint[joint]);
-  uint32_t count = config.joint[joint].underrun_count;
-  config.joint[joint].underrun_count = 0;
-  mutex_exit(&mtx_joint[joint]);
-  return count;
+  if(core == CORE1) {
+    disable_requests[joint]++;
+    return;
+  }
+  stage_joint_command(joint)->enabled = 0;
 }
 
-void disable_joint(const uint8_t joint, const uint8_t core) {
-  uint8_t enabled = 0;
-  update_joint_config(
-      joint,
-      core,
-      &enabled,
-      NULL,
-      NULL,
-      NULL,
-      NULL,
-      NULL,
-      NULL,
-      NULL,
-      NULL,
-      NULL);
+void apply_joint_disables(void) {
+  for(uint8_t joint = 0; joint < MAX_JOINT; joint++) {
+    uint32_t requests = disable_requests[joint];
+    if(requests != disables_applied[joint]) {
+      disables_applied[joint] = requests;
+      config.joint[joint].enabled = 0;
+    }
+  }
 }
 
 /* Serialise metrics stored in global config in a format for sending over UDP. */
@@ -376,22 +391,31 @@ bool serialise_timing(struct NWBuffer* tx_buf, int32_t update_id, int32_t time_d
   uint16_t tx_buf_len = pack_nw_buff(tx_buf, &reply, sizeof(reply));
 
   if(!tx_buf_len) {
-    printf("WARN: TX length greater than buffer size. %u\n", update_id);
     return false;
   }
 
   return true;
 }
 
+/* velocity_cmd as reported to the driver: the requested velocity in the
+ * units MSG_SET_JOINT_ABS_POS carries it. */
+static float velocity_cmd(size_t joint) {
+  return (float)((double)config.joint[joint].velocity_requested_q
+                 * ((double)get_period() / 65536.0));
+}
+
 /* Serialise data stored in global config in a format for sending over UDP. */
 bool serialise_joint_movement(
     struct NWBuffer* tx_buf,
     uint8_t wait_for_data)
 {
-  int32_t abs_pos_achieved;
-  int32_t velocity_achieved;
-  uint32_t updated = 0;
-
+  static uint32_t feedback_seen = 0;
+  struct JointFeedback feedback[MAX_JOINT];
+  uint32_t published;
+  do {
+    published = read_joint_feedback(feedback);
+  } while(published == feedback_seen && wait_for_data);
+  feedback_seen = published;
 
   struct Reply_joint_movement reply;
   memset(&reply, 0, sizeof(reply));
@@ -401,29 +425,10 @@ bool serialise_joint_movement(
   reply.core1_tick       = core1_loop_count;
 
   for(size_t joint = 0; joint < MAX_JOINT; joint++) {
-    uint8_t enabled = 0;
-    double velocity_requested = 0.0;
-    do {
-      updated = get_joint_config(
-          joint,
-          CORE0,
-          &enabled,
-          NULL, //&io_pos_step,
-          NULL, //&io_pos_dir,
-          &velocity_requested,
-          NULL, //&abs_pos_requested,
-          &abs_pos_achieved,
-          NULL, //&max_velocity,
-          NULL, //&max_accel,
-          &velocity_achieved,
-          NULL  //&cmd_type
-          );
-    } while(updated == 0 && wait_for_data);
-
-    reply.abs_pos_achieved[joint]  = abs_pos_achieved;
-    reply.velocity_achieved[joint] = velocity_achieved;
-    reply.enabled[joint]           = enabled;
-    reply.velocity_cmd[joint]      = (float)velocity_requested;
+    reply.abs_pos_achieved[joint]  = feedback[joint].abs_pos_achieved;
+    reply.velocity_achieved[joint] = feedback[joint].velocity_achieved;
+    reply.enabled[joint]           = feedback[joint].enabled;
+    reply.velocity_cmd[joint]      = velocity_cmd(joint);
   }
 
   uint16_t tx_buf_len = pack_nw_buff(tx_buf, &reply, sizeof(reply));
@@ -436,6 +441,105 @@ bool serialise_joint_movement(
   return true;
 }
 
+/* Movement state as sent in a REPLY_JOINT_MOVEMENT_V2, kept so later replies
+ * can be coded against whichever one the driver acknowledges. The driver acks
+ * once per cycle so only the last few are ever referenced. */
+#define MOVEMENT_HISTORY 16
+
+struct MovementState {
+  uint16_t id;
+  bool valid;
+  uint8_t enabled;
+  int32_t abs_pos_achieved[MAX_JOINT];
+  int32_t velocity_achieved[MAX_JOINT];
+  float velocity_cmd[MAX_JOINT];
+};
+
+static struct MovementState movement_history[MOVEMENT_HISTORY];
+static uint16_t movement_id = 0;
+static uint16_t movement_ack_id = 0;
+static bool movement_ack_valid = false;
+
+void joint_movement_ack(uint16_t id, bool valid) {
+  movement_ack_id = id;
+  movement_ack_valid = valid;
+}
+
+static size_t append_field(uint8_t* buf, size_t offset, const void* value, size_t len) {
+  memcpy(buf + offset, value, len);
+  return offset + len;
+}
+
+bool serialise_joint_movement_v2(struct NWBuffer* tx_buf) {
+  uint16_t id = movement_id + 1;
+  struct MovementState* state = &movement_history[id % MOVEMENT_HISTORY];
+  const struct MovementState* base = &movement_history[movement_ack_id % MOVEMENT_HISTORY];
+  bool keyframe = !movement_ack_valid || !base->valid || base->id != movement_ack_id;
+
+  struct MovementState current = {.id = id, .valid = true};
+  struct JointFeedback feedback[MAX_JOINT];
+  read_joint_feedback(feedback);
+  for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+    current.enabled |= (feedback[joint].enabled ? 1u : 0u) << joint;
+    current.abs_pos_achieved[joint] = feedback[joint].abs_pos_achieved;
+    current.velocity_achieved[joint] = feedback[joint].velocity_achieved;
+    current.velocity_cmd[joint] = velocity_cmd(joint);
+  }
+
+  uint8_t buf[REPLY_JOINT_MOVEMENT_V2_MAX_LEN];
+  struct Reply_joint_movement_v2 reply = {0};
+  reply.type             = REPLY_JOINT_MOVEMENT_V2;
+  reply.count            = MAX_JOINT;
+  reply.enabled          = current.enabled;
+  reply.id               = id;
+  reply.base_id          = keyframe ? id : movement_ack_id;
+  reply.update_period_us = config.update_time_us;
+  reply.core1_tick       = core1_loop_count;
+
+  size_t offset = sizeof(reply);
+  for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+    int32_t delta = current.abs_pos_achieved[joint];
+    if(!keyframe) {
+      delta = (int32_t)((uint32_t)delta - (uint32_t)base->abs_pos_achieved[joint]);
+      if(delta == 0) {
+        continue;
+      }
+    }
+    reply.pos_present |= 1u << joint;
+    if(keyframe || delta < INT16_MIN || delta > INT16_MAX) {
+      reply.pos_wide |= 1u << joint;
+      offset = append_field(buf, offset, &delta, sizeof(int32_t));
+    } else {
+      int16_t narrow = delta;
+      offset = append_field(buf, offset, &narrow, sizeof(int16_t));
+    }
+  }
+  for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+    if(keyframe || current.velocity_achieved[joint] != base->velocity_achieved[joint]) {
+      reply.vel_present |= 1u << joint;
+      offset = append_field(
+          buf, offset, &current.velocity_achieved[joint], sizeof(int32_t));
+    }
+  }
+  for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+    if(keyframe || memcmp(&current.velocity_cmd[joint], &base->velocity_cmd[joint],
+                          sizeof(float)) != 0) {
+      reply.vcmd_present |= 1u << joint;
+      offset = append_field(buf, offset, &current.velocity_cmd[joint], sizeof(float));
+    }
+  }
+  memcpy(buf, &reply, sizeof(reply));
+
+  if(!pack_nw_buff(tx_buf, buf, offset)) {
+    return false;
+  }
+
+  /* Only remember states that actually went out. */
+  *state = current;
+  movement_id = id;
+  return true;
+}
+
 bool serialise_spindle_speed_out(
     struct NWBuffer* tx_buf, float speed, struct vfd_stats *vfd_stats)
 {
@@ -478,7 +582,6 @@ bool serialise_spindle_config(size_t spindle, struct NWBuffer* tx_buf) {
   uint16_t tx_buf_len = pack_nw_buff(tx_buf, &reply, sizeof(reply));
 
   if(!tx_buf_len) {
-    printf("WARN: TX length greater than buffer size.\n");
     return false;
   }
 
@@ -496,37 +599,15 @@ bool serialise_joint_config(const uint32_t joint, struct NWBuffer* tx_buf) {
     return false;
   }
 
-  uint8_t enabled;
-  int8_t io_pos_step;
-  int8_t io_pos_dir;
-  double max_velocity;
-  double max_accel;
-  uint8_t cmd_type;
-
-  get_joint_config(
-        joint,
-        CORE0,
-        &enabled,
-        &io_pos_step,
-        &io_pos_dir,
-        NULL, //&velocity_requested,
-        NULL, //&abs_pos_requested,
-        NULL, //&abs_pos_achieved,
-        &max_velocity,
-        &max_accel,
-        NULL, //&velocity_achieved
-        &cmd_type
-        );
-
   struct Reply_joint_config reply;
   reply.type = REPLY_JOINT_CONFIG;
   reply.joint = joint;
-  reply.enable = enabled;
-  reply.gpio_step = io_pos_step;
-  reply.gpio_dir = io_pos_dir;
-  reply.cmd_type = cmd_type;
-  reply.max_velocity = max_velocity;
-  reply.max_accel = max_accel;
+  reply.enable = config.joint[joint].enabled;
+  reply.gpio_step = config.joint[joint].io_pos_step;
+  reply.gpio_dir = config.joint[joint].io_pos_dir;
+  reply.cmd_type = config.joint[joint].cmd_type;
+  reply.max_velocity = config.joint[joint].max_velocity;
+  reply.max_accel = config.joint[joint].max_accel;
 
   uint16_t tx_buf_len = pack_nw_buff(tx_buf, &reply, sizeof(reply));
 
@@ -542,21 +623,16 @@ bool serialise_joint_metrics(struct NWBuffer* tx_buf) {
   struct Reply_joint_metrics reply;
   reply.type = REPLY_JOINT_METRICS;
 
-  uint32_t any_overrun  = 0;
-  uint32_t any_underrun = 0;
-  for(size_t joint = 0; joint < MAX_JOINT; joint++) {
-    any_overrun  |= get_and_reset_overrun_count(joint);
-    any_underrun |= get_and_reset_underrun_count(joint);
-  }
-  reply.overrun_occurred  = any_overrun  ? 1 : 0;
-  reply.underrun_occurred = any_underrun ? 1 : 0;
+  reply.overrun_occurred  = get_and_reset_overrun_count()  ? 1 : 0;
+  reply.underrun_occurred = get_and_reset_underrun_count() ? 1 : 0;
+  uint32_t coasted        = get_and_reset_coasted_count();
+  reply.coasted           = coasted > UINT8_MAX ? UINT8_MAX : coasted;
   reply.core1_work_us     = core1_work_us;
   reply.core0_work_us     = core0_work_us;
 
   uint16_t tx_buf_len = pack_nw_buff(tx_buf, &reply, sizeof(reply));
 
   if(!tx_buf_len) {
-    printf("WARN: TX length greater than buffer size.\n");
     return false;
   }
 
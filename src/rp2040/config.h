@@ -25,9 +25,9 @@ extern volatile uint32_t last_packet_tick;
  * disable joints, then clears it. Single-writer/single-reader — same
  * atomic pattern as last_packet_tick. No mutex needed. */
 extern volatile bool linuxcnc_restart_detected;
-/* Incremented by Core0 after all joint configs for a packet are written.
- * Core1 waits for this to advance before processing. Single-writer
- * (Core0), single-reader (Core1) — same atomic pattern as tick. */
+/* Incremented by publish_joint_commands() once a packet's joint commands are
+ * visible to Core1. Core1 waits for this to advance before processing.
+ * Single-writer (Core0), single-reader (Core1) — same atomic pattern as tick. */
 extern volatile uint32_t packet_generation;
 /* Incremented by Core1 each time core1_tick() runs. Single-writer (Core1),
  * single-reader (Core0 via serialise_joint_movement). Atomic on Cortex-M0+. */
@@ -37,23 +37,28 @@ extern volatile uint32_t core1_loop_count;
 extern volatile uint32_t core1_work_us;
 extern volatile uint32_t core0_work_us;
 
-/* Configuration object for an joint.
- * This is the format for the global config that is shared between cores. */
-struct ConfigAxis {
-  uint8_t updated_from_c0;        // Data was updated on core 0.
-  uint8_t updated_from_c1;        // Data was updated on core 1.
-  uint32_t overrun_count;         // Core0 wrote N>1 packets before Core1 read: N-1 discarded per tick.
-  uint32_t underrun_count;        // Core1 ran with no new Core0 packet (updated_from_c0 == 0).
+/* What Core0 asks of a joint.
+ * config.joint[] is Core0's working copy, written as messages are unpacked;
+ * Core1 only ever sees a whole packet's worth at once through
+ * publish_joint_commands() / read_joint_commands(). */
+struct JointCommand {
   int8_t enabled;
   int8_t io_pos_step;             // Physical step IO pin.
   int8_t io_pos_dir;              // Physical direction IO pin.
   uint8_t cmd_type;               // JOINT_CMD_POSITION or JOINT_CMD_VELOCITY
-  double velocity_requested;      // In steps. Default value is UINT_MAX / 2.
-  double abs_pos_requested;       // In steps. Default value is UINT_MAX / 2.
-  int32_t abs_pos_achieved;       // In steps. Default value is UINT_MAX / 2.
+  uint32_t generation;            // packet_generation that last wrote this joint.
+  int32_t velocity_requested_q;   // Q16.16 steps per update_time_us.
+  int64_t abs_pos_requested_q;    // Q32.32 steps.
   double max_velocity;
   double max_accel;               // ticks / update_time_ticks ^ 2
-  int32_t velocity_achieved;      // Steps per update_time_us.
+};
+
+/* What Core1 did with a joint last period.
+ * Published once per tick by Core1 with publish_joint_feedback(). */
+struct JointFeedback {
+  int8_t enabled;                 // enabled as applied by Core1.
+  int32_t abs_pos_achieved;       // In steps.
+  int32_t velocity_achieved;      // Q16.16 steps per update_time_us.
 };
 
 /* Configuration object for a single GPIO. */
@@ -61,7 +66,6 @@ struct ConfigGPIO {
   uint8_t type;                 // See GPIO_TYPE_XXXX in messages.h.
   uint8_t index;                // IP pin number.
   uint8_t address;              // i2c address if applicable.
-  bool value;                   // Last set value for output pins.
 };
 
 /* Configuration object for an i2c interface. */
@@ -79,10 +83,13 @@ struct ConfigGlobal {
   int32_t last_id_diff;       // id_diff from the most recently received packet.
   uint32_t update_time_us;    // Driven by how often we get joint updates from controlling host.
   bool pio_io_configured;     // PIO IO pins set.
+  uint16_t features;          // FEATURE_* bits negotiated with the driver.
+  uint8_t coast_periods;      // From MSG_SET_JOINT_COAST; Core1 coasts this many missed updates.
 
-  struct ConfigAxis joint[MAX_JOINT];
+  struct JointCommand joint[MAX_JOINT];  // Core0 only. See struct JointCommand.
   struct ConfigGPIO gpio[MAX_GPIO];
   struct ConfigI2c i2c[MAX_I2C_MCP];
+  uint32_t gpio_values[MAX_GPIO_BANK];  // Last value of each GPIO, bit n is gpio bank * 32 + n.
   bool gpio_confirmation_pending[MAX_GPIO_BANK];
 };
 
@@ -91,6 +98,9 @@ void init_config();
 
 int32_t get_last_id_diff(void);
 
+/* Missed periods Core1 may coast through; see MSG_SET_JOINT_COAST. */
+uint8_t get_coast_periods(void);
+
 /* Update the period of the main timing loop.
  * This should closely match the rate at which we receive joint position data. */
 void update_period(uint32_t update_time_us);
@@ -101,47 +111,52 @@ uint32_t get_period();
 
 /* Set metrics for tracking successful update transmission and jitter. */
 void update_packet_metrics(
-    struct Message_timing* message,
+    const struct Message_timing* message,
     int32_t* id_diff,
     int32_t* time_diff);
 
-uint8_t has_new_c0_data(const uint8_t joint);
-
-uint32_t get_and_reset_overrun_count(const uint8_t joint);
-uint32_t get_and_reset_underrun_count(const uint8_t joint);
-
-void update_joint_config(
-    const uint8_t joint,
-    const uint8_t core,
-    const uint8_t* enabled,
-    const int8_t* io_pos_step,
-    const int8_t* io_pos_dir,
-    const double* velocity_requested,
-    const double* abs_pos_requested,
-    const int32_t* abs_pos_achieved,
-    const double* max_velocity,
-    const double* max_accel,
-    const int32_t* velocity_achieved,
-    const uint8_t* cmd_type
-);
-
-uint32_t get_joint_config(
-    const uint8_t joint,
-    const uint8_t core,
-    uint8_t* enabled,
-    int8_t* io_pos_step,
-    int8_t* io_pos_dir,
-    double* velocity_requested,
-    double* abs_pos_requested,
-    int32_t* abs_pos_achieved,
-    double* max_velocity,
-    double* max_accel,
-    int32_t* velocity_achieved,
-    uint8_t* cmd_type
-    );
+/* Core1: record how many packets were published since its last tick.
+ * None is an underrun; more than one is an overrun of all but the newest. */
+void count_joint_updates(uint32_t packets);
+
+/* Core0: counts since the last call. */
+uint32_t get_and_reset_overrun_count(void);
+uint32_t get_and_reset_underrun_count(void);
+
+/* Core0: missed updates Core1 coasted through since the last call. These
+ * are not counted as underruns. */
+uint32_t get_and_reset_coasted_count(void);
+
+/* Core0: config.joint[joint] for writing, marked as updated by the packet
+ * being unpacked. NULL if joint is out of range. */
+volatile struct JointCommand* stage_joint_command(const uint8_t joint);
+
+/* Core0: make config.joint[] visible to Core1 as one snapshot, then advance
+ * packet_generation. Call once per packet, after it has been unpacked. */
+void publish_joint_commands(void);
 
+/* Core1: copy of the newest snapshot from publish_joint_commands(), with any
+ * joint Core1 has disabled since forced off.
+ * Returns the packet_generation it was published with. */
+uint32_t read_joint_commands(struct JointCommand commands[MAX_JOINT]);
+
+/* Core1: make this period's feedback visible to Core0. */
+void publish_joint_feedback(const struct JointFeedback feedback[MAX_JOINT]);
+
+/* Core0: copy of the newest feedback from Core1.
+ * Returns how many times feedback has been published. */
+uint32_t read_joint_feedback(struct JointFeedback feedback[MAX_JOINT]);
+
+/* Core0 clears the joint's enabled command directly. Core1 cannot write
+ * config.joint[]; it files a request that read_joint_commands() honours at
+ * once and Core0 folds into config.joint[] with apply_joint_disables(). */
 void disable_joint(const uint8_t joint, const uint8_t core);
 
+/* Core0: clear enabled on joints Core1 has disabled. */
+void apply_joint_disables(void);
+
+bool any_joint_enabled(void);
+
 /* Serialise metrics stored in global config in a format for sending over UDP. */
 bool serialise_timing(struct NWBuffer* tx_buf, int32_t update_id, int32_t time_diff);
 
@@ -150,6 +165,14 @@ bool serialise_joint_movement(
     struct NWBuffer* tx_buf,
     uint8_t wait_for_data);
 
+/* Change-masked form of serialise_joint_movement(), coded against the last
+ * reply acknowledged with joint_movement_ack(). */
+bool serialise_joint_movement_v2(struct NWBuffer* tx_buf);
+
+/* Record the newest REPLY_JOINT_MOVEMENT_V2 the driver has decoded.
+ * valid == false forces the next reply to be a keyframe. */
+void joint_movement_ack(uint16_t id, bool valid);
+
 /* Serialise data stored in global config in a format for sending over UDP. */
 bool serialise_joint_config(
     const uint32_t joint,
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef BUILD_TESTS
+
+#include "../test/mocks/rp_mocks.h"
+
+#else  // BUILD_TESTS
+
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#endif  // BUILD_TESTS
+
+#include "config_cache.h"
+#include "config_hash.h"
+
+#define CONFIG_CACHE_MAGIC 0x43464731u  // "CFG1"
+
+/* Two sectors at the very end of flash, well clear of the program image.
+ * Writes alternate between them so a power cut mid-write leaves the other
+ * sector's record intact. */
+#define CONFIG_CACHE_OFFSET (PICO_FLASH_SIZE_BYTES - 2 * FLASH_SECTOR_SIZE)
+
+/* flash_range_program() writes whole pages. */
+#define CONFIG_CACHE_PROGRAM_LEN \
+  ((sizeof(struct ConfigCacheRecord) + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE)
+
+static_assert(CONFIG_CACHE_PROGRAM_LEN <= FLASH_SECTOR_SIZE, "Config cache record exceeds a flash sector");
+
+static struct ConfigCacheRecord cache = {0};  // Config applied since boot.
+static bool     cache_changed  = false;       // cache differs from when it was last saved.
+static uint64_t cache_changed_at = 0;
+
+static bool     flash_valid    = false;       // A record was found or written.
+static uint32_t flash_hash     = 0;
+static uint32_t flash_sequence = 0;
+static uint8_t  flash_sector   = 0;           // Sector holding the newest record.
+
+static void mark_changed(void) {
+  cache_changed = true;
+  cache_changed_at = time_us_64();
+}
+
+void config_cache_joint(const struct Message_joint_config* message) {
+  if(message->joint >= MAX_JOINT) {
+    return;
+  }
+  struct Message_joint_config entry;
+  memcpy(&entry, message, sizeof(entry));
+  entry.enable = 0;
+  if(memcmp(&cache.joint[entry.joint], &entry, sizeof(entry)) != 0) {
+    cache.joint[entry.joint] = entry;
+    mark_changed();
+  }
+}
+
+void config_cache_gpio(const struct Message_gpio_config* message) {
+  if(message->gpio_count >= MAX_GPIO) {
+    return;
+  }
+  if(memcmp(&cache.gpio[message->gpio_count], message, sizeof(*message)) != 0) {
+    memcpy(&cache.gpio[message->gpio_count], message, sizeof(*message));
+    mark_changed();
+  }
+}
+
+void config_cache_spindle(const struct Message_spindle_config* message) {
+  if(message->spindle_index >= MAX_SPINDLE) {
+    return;
+  }
+  if(memcmp(&cache.spindle[message->spindle_index], message, sizeof(*message)) != 0) {
+    memcpy(&cache.spindle[message->spindle_index], message, sizeof(*message));
+    mark_changed();
+  }
+}
+
+static uint32_t record_hash(const struct ConfigCacheRecord* record) {
+  uint32_t hash = CONFIG_HASH_INIT;
+  for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+    if(record->joint[joint].type == MSG_SET_JOINT_CONFIG) {
+      hash = config_hash_joint(hash, &record->joint[joint]);
+    }
+  }
+  for(size_t gpio = 0; gpio < MAX_GPIO; gpio++) {
+    if(record->gpio[gpio].type == MSG_SET_GPIO_CONFIG
+        && record->gpio[gpio].gpio_type != GPIO_TYPE_NOT_SET) {
+      hash = config_hash_gpio(hash, &record->gpio[gpio]);
+    }
+  }
+  for(size_t spindle = 0; spindle < MAX_SPINDLE; spindle++) {
+    if(record->spindle[spindle].type == MSG_SET_SPINDLE_CONFIG) {
+      hash = config_hash_spindle(hash, &record->spindle[spindle]);
+    }
+  }
+  return hash;
+}
+
+static uint32_t record_check(const struct ConfigCacheRecord* record) {
+  return config_hash_bytes(
+      CONFIG_HASH_INIT, record, offsetof(struct ConfigCacheRecord, check));
+}
+
+uint32_t config_cache_hash(void) {
+  return record_hash(&cache);
+}
+
+static const struct ConfigCacheRecord* sector_record(uint8_t sector) {
+  return (const struct ConfigCacheRecord*)
+    (XIP_BASE + CONFIG_CACHE_OFFSET + sector * FLASH_SECTOR_SIZE);
+}
+
+static bool record_valid(const struct ConfigCacheRecord* record) {
+  return record->magic == CONFIG_CACHE_MAGIC && record->check == record_check(record);
+}
+
+const struct ConfigCacheRecord* config_cache_load(void) {
+  const struct ConfigCacheRecord* newest = NULL;
+  for(uint8_t sector = 0; sector < 2; sector++) {
+    const struct ConfigCacheRecord* record = sector_record(sector);
+    if(!record_valid(record)) {
+      continue;
+    }
+    if(!newest || (int32_t)(record->sequence - newest->sequence) > 0) {
+      newest = record;
+      flash_sector = sector;
+    }
+  }
+
+  flash_valid = (newest != NULL);
+  if(newest) {
+    flash_hash = newest->hash;
+    flash_sequence = newest->sequence;
+  }
+  return newest;
+}
+
+bool config_cache_due(bool joints_idle) {
+  if(!cache_changed || !joints_idle) {
+    return false;
+  }
+  if(time_us_64() - cache_changed_at < CONFIG_CACHE_SAVE_DELAY_US) {
+    return false;
+  }
+  if(flash_valid && config_cache_hash() == flash_hash) {
+    // Replayed from flash, or changed and changed back.
+    cache_changed = false;
+    return false;
+  }
+  return true;
+}
+
+void config_cache_write(void) {
+  cache_changed = false;
+
+  uint32_t hash = config_cache_hash();
+  static uint8_t program_buf[CONFIG_CACHE_PROGRAM_LEN];
+  uint8_t sector = flash_valid ? !flash_sector : 0;
+  cache.magic = CONFIG_CACHE_MAGIC;
+  cache.sequence = flash_sequence + 1;
+  cache.hash = hash;
+  cache.check = record_check(&cache);
+  memset(program_buf, 0xff, sizeof(program_buf));
+  memcpy(program_buf, &cache, sizeof(cache));
+
+  /* Core1 is parked in RAM and interrupts are off while flash is unavailable
+   * to XIP. */
+  uint32_t offset = CONFIG_CACHE_OFFSET + sector * FLASH_SECTOR_SIZE;
+  multicore_lockout_start_blocking();
+  uint32_t interrupts = save_and_disable_interrupts();
+  flash_range_erase(offset, FLASH_SECTOR_SIZE);
+  flash_range_program(offset, program_buf, sizeof(program_buf));
+  restore_interrupts(interrupts);
+  multicore_lockout_end_blocking();
+
+  flash_valid = true;
+  flash_hash = hash;
+  flash_sequence = cache.sequence;
+  flash_sector = sector;
+  printf("Config cached to flash: %08x\n", hash);
+}
+
+#ifdef BUILD_TESTS
+void config_cache_reset_for_test(void) {
+  memset(&cache, 0, sizeof(cache));
+  cache_changed    = false;
+  cache_changed_at = 0;
+  flash_valid      = false;
+  flash_hash       = 0;
+  flash_sequence   = 0;
+  flash_sector     = 0;
+}
+#endif
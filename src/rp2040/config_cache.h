@@ -0,0 +1,57 @@
+#ifndef CONFIG_CACHE__H
+#define CONFIG_CACHE__H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "messages.h"
+
+/* Joint, GPIO and spindle config as last applied, kept in the wire format so
+ * it can be replayed through the normal unpack_*_config() handlers at boot.
+ * An entry whose type is 0 was never configured. Joint enable is always
+ * stored as 0. */
+struct ConfigCacheRecord {
+  uint32_t magic;                 // CONFIG_CACHE_MAGIC
+  uint32_t sequence;              // Newer of the two sectors wins.
+  uint32_t hash;                  // config_cache_hash() of the entries below.
+  struct Message_joint_config joint[MAX_JOINT];
+  struct Message_gpio_config gpio[MAX_GPIO];
+  struct Message_spindle_config spindle[MAX_SPINDLE];
+  uint32_t check;                 // FNV-1a of everything above.
+};
+
+/* Config must be unchanged this long before it is written to flash, so a
+ * driver streaming its config at startup causes one write, not dozens. */
+#define CONFIG_CACHE_SAVE_DELAY_US 2000000
+
+/* Record config as it is applied. Called by the unpack_*_config() handlers. */
+void config_cache_joint(const struct Message_joint_config* message);
+void config_cache_gpio(const struct Message_gpio_config* message);
+void config_cache_spindle(const struct Message_spindle_config* message);
+
+/* Hash of the config recorded since boot, as advertised in REPLY_CONFIG_HASH. */
+uint32_t config_cache_hash(void);
+
+/* Newest valid record in flash, or NULL. Points into flash; the caller
+ * replays it and the replay re-records the entries. */
+const struct ConfigCacheRecord* config_cache_load(void);
+
+/* Longest config_cache_write() can take: a sector erase is typically 45 ms
+ * but the flash datasheet allows 400 ms, plus a few page programs. Sent to
+ * the driver in REPLY_FLASH_WRITE. */
+#define CONFIG_CACHE_WRITE_HOLD_MS 500
+
+/* True if the recorded config differs from flash and has settled. Only pass
+ * joints_idle when no joint is enabled. */
+bool config_cache_due(bool joints_idle);
+
+/* Write the recorded config to the older flash sector. Both cores pause for
+ * up to CONFIG_CACHE_WRITE_HOLD_MS, so Core0 announces the write in
+ * REPLY_FLASH_WRITE and only calls this once that reply has been sent. */
+void config_cache_write(void);
+
+#ifdef BUILD_TESTS
+void config_cache_reset_for_test(void);
+#endif
+
+#endif  // CONFIG_CACHE__H
@@ -3,8 +3,12 @@
 #include <stdio.h>
 
 #include "config.h"
+#include "config_cache.h"
+#include "core0.h"
 #include "messages.h"
 #include "buffer.h"
+#include "dispatch.h"
+#include "event_log.h"
 #include "gpio.h"
 #include "i2c.h"
 #include "modbus.h"
@@ -27,40 +31,38 @@
 float req_spindle_frequency = 0;
 float act_spindle_frequency = -1000000;
 
-bool unpack_timing(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    struct NWBuffer* tx_buf,
-    size_t* received_count
-) {
-  void* data_p = unpack_nw_buff(
-      rx_buf, *rx_offset, rx_offset, NULL, sizeof(struct Message_timing));
-
-  if(! data_p) {
-    return false;
-  }
-
-  struct Message_timing* message = data_p;
+/* Passed to every MSG_* handler by process_received_buffer(). */
+struct MessageContext {
+  struct NWBuffer* tx_buf;
+  size_t* received_count;
+  uint64_t rx_time_us;      // time_us_64() when the packet was taken from the socket.
+};
+
+/* The last MSG_CLOCK_SYNC, answered by serialise_clock_sync() once the rest of
+ * the reply is packed. */
+static struct {
+  bool pending;
+  uint64_t host_tx_us;
+  uint64_t rp_rx_us;
+} clock_sync = {0};
+
+bool unpack_timing(const void* view, void* context) {
+  struct MessageContext* ctx = context;
+  const struct Message_timing* message = view;
   int32_t id_diff;
   int32_t time_diff;
   update_packet_metrics(message, &id_diff, &time_diff);
-  if(!serialise_timing(tx_buf, message->update_id, time_diff)) {
-    printf("WARN: TX buf full, drop timing rep\n");
+  if(!serialise_timing(ctx->tx_buf, message->update_id, time_diff)) {
+    log_event(CORE0, LOG_TX_FULL, REPLY_TIMING, 0);
   }
 
-  (*received_count)++;
   return true;
 }
 
-bool unpack_version_request(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    struct NWBuffer* tx_buf,
-    size_t* received_count
-) {
-  void* data_p = unpack_nw_buff(
-      rx_buf, *rx_offset, rx_offset, NULL, sizeof(struct Message_version_request));
-  if (!data_p) return false;
+bool unpack_version_request(const void* view, void* context) {
+  struct MessageContext* ctx = context;
+  const struct Message_version_request* message = view;
+  uint16_t features = message->features & PROTOCOL_FEATURES;
 
   union ReplyAny reply;
   reply.version.type           = REPLY_VERSION;
@@ -68,125 +70,247 @@ bool unpack_version_request(
   reply.version.version_minor  = PROTOCOL_VERSION_MINOR;
   reply.version.version_patch  = PROTOCOL_VERSION_PATCH;
   reply.version.version_branch = PROTOCOL_VERSION_BRANCH;
-  if (!pack_nw_buff(tx_buf, &reply, sizeof(struct Reply_version))) {
-    printf("WARN: TX buf full, drop version rep\n");
+  if (!pack_nw_buff(ctx->tx_buf, &reply, sizeof(struct Reply_version))) {
+    log_event(CORE0, LOG_TX_FULL, REPLY_VERSION, 0);
   }
 
-  (*received_count)++;
-  return true;
-}
-
-bool unpack_joint_enable(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    size_t* received_count
-) {
-  void* data_p = unpack_nw_buff(
-      rx_buf, *rx_offset, rx_offset, NULL, sizeof(struct Message_joint_enable));
+  /* A driver that predates feature negotiation sends zero here and would not
+   * understand REPLY_FEATURES. */
+  config.features = features;
+  config.coast_periods = 0;
+  nw_buff_set_limit((features & FEATURE_LARGE_NW_BUF) ? NW_BUF_LEN : NW_BUF_LEN_LEGACY);
+  if (!nw_buff_set_crc32(features & FEATURE_CRC32)) {
+    /* Replies already in this packet may have been packed without the
+     * additive checksum, which now has to cover them. */
+    ctx->tx_buf->checksum = checksum(0, 0, ctx->tx_buf->length, ctx->tx_buf->payload);
+  }
+  joint_movement_ack(0, false);
+  if (message->features) {
+    reply.features.type     = REPLY_FEATURES;
+    reply.features._pad     = 0;
+    reply.features.features = features;
+    if (!pack_nw_buff(ctx->tx_buf, &reply, sizeof(struct Reply_features))) {
+      log_event(CORE0, LOG_TX_FULL, REPLY_FEATURES, 0);
+    }
+  }
 
-  if(! data_p) {
-    return false;
+  /* A driver that finds its own config in this hash marks every item as
+   * confirmed, joints disabled. Make that true. */
+  if (features & FEATURE_CONFIG_CACHE) {
+    for(uint8_t joint = 0; joint < MAX_JOINT; joint++) {
+      disable_joint(joint, CORE0);
+    }
+    reply.config_hash.type = REPLY_CONFIG_HASH;
+    memset(reply.config_hash._pad, 0, sizeof(reply.config_hash._pad));
+    reply.config_hash.hash = config_cache_hash();
+    if (!pack_nw_buff(ctx->tx_buf, &reply, sizeof(struct Reply_config_hash))) {
+      log_event(CORE0, LOG_TX_FULL, REPLY_CONFIG_HASH, 0);
+    }
   }
 
-  struct Message_joint_enable* message = data_p;
+  return true;
+}
+
+bool unpack_joint_enable(const void* view, void* context) {
+  const struct Message_joint_enable* message = view;
   uint8_t joint = message->joint;
   uint8_t enabled = message->value;
 
 #ifdef VERBOSE_CONFIG_LOG
-  printf("%u Enabling joint: %u\t%i\n", *received_count, joint, enabled);
+  struct MessageContext* ctx = context;
+  printf("%u Enabling joint: %u\t%i\n", *ctx->received_count, joint, enabled);
 #endif
-  update_joint_config(
-      joint, CORE0,
-      &enabled, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  volatile struct JointCommand* command = stage_joint_command(joint);
+  if(command) {
+    command->enabled = enabled;
+  }
 
-  (*received_count)++;
   return true;
 }
 
-bool unpack_joint_abs_pos(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    size_t* received_count
-) {
-  struct Message_set_joints_pos message;
-  void* data_p = unpack_nw_buff(
-      rx_buf, *rx_offset, rx_offset, &message, sizeof(struct Message_set_joints_pos));
+/* (int64_t)(value * 2^frac_bits), read straight from the IEEE 754 bits so
+ * the M0+ needs no soft-float calls. Truncates toward zero as the cast does;
+ * saturates where the cast would be undefined. NaN saturates too. */
+static int64_t double_to_fixed(double value, int frac_bits) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  bool negative = bits >> 63;
+  int exponent = (int)((bits >> 52) & 0x7ff);
+  if(exponent == 0) {
+    return 0;  // Zero or subnormal.
+  }
+  uint64_t mantissa = (bits & ((1ull << 52) - 1)) | (1ull << 52);
+  int shift = exponent - 1075 + frac_bits;
+  uint64_t magnitude;
+  if(exponent == 0x7ff || shift > 10) {
+    return negative ? INT64_MIN : INT64_MAX;
+  } else if(shift >= 0) {
+    magnitude = mantissa << shift;
+  } else if(shift > -64) {
+    magnitude = mantissa >> -shift;
+  } else {
+    magnitude = 0;
+  }
+  return negative ? -(int64_t)magnitude : (int64_t)magnitude;
+}
 
-  if(! data_p) {
-    return false;
+bool unpack_joint_abs_pos(const void* view, void* context) {
+  (void) context; /* unused */
+  const struct Message_set_joints_pos* message = view;
+
+  /* Only process up to MAX_JOINT joints; message->count may be larger if
+   * driver has more joints than this firmware. */
+  size_t n = message->count < MAX_JOINT ? message->count : MAX_JOINT;
+  /* Core1 works in fixed point per period; convert from steps and steps/s
+   * here so it never has to. Velocity is steps/s over the period in µs, the
+   * unit MSG_SET_JOINT_POS_Q carries. */
+  int64_t period_us = get_period();
+  for(size_t joint = 0; joint < n; joint++) {
+    volatile struct JointCommand* command = stage_joint_command(joint);
+    int64_t velocity_q = double_to_fixed(message->velocity[joint], 16);
+    command->velocity_requested_q = period_us ? (int32_t)(velocity_q / period_us) : 0;
+    command->abs_pos_requested_q = double_to_fixed(message->position[joint], 32);
   }
 
-  /* Copy doubles out of packed struct before taking addresses — avoids
-   * unaligned pointer UB on Cortex-M0+. Only process up to MAX_JOINT joints;
-   * message.count may be larger if driver has more joints than this firmware. */
-  size_t n = message.count < MAX_JOINT ? message.count : MAX_JOINT;
-  double pos[WIRE_MAX_JOINT], vel[WIRE_MAX_JOINT];
-  for(size_t j = 0; j < n; j++) {
-    pos[j] = message.position[j];
-    vel[j] = message.velocity[j];
+  return true;
+}
+
+/* Length of a MSG_SET_JOINT_POS_Q from its header. */
+size_t joint_pos_q_length(const void* view) {
+  const struct Message_set_joints_pos_q* message = view;
+  if(message->count > WIRE_MAX_JOINT) {
+    return 0;
   }
+  return MESSAGE_SET_JOINTS_POS_Q_LEN(message->count);
+}
+
+/* Compact form of unpack_joint_abs_pos(): Q32.32 position and Q16.16
+ * velocity in Core1's units for only the joints the driver populated. */
+bool unpack_joint_pos_q(const void* view, void* context) {
+  (void) context; /* unused */
+  const struct Message_set_joints_pos_q* message = view;
+  size_t count = message->count;
 
+  size_t n = count < MAX_JOINT ? count : MAX_JOINT;
+
+  // Set again by unpack_joint_coast() if it follows in this packet.
+  config.coast_periods = 0;
   for(size_t joint = 0; joint < n; joint++) {
-    update_joint_config(
-        joint, CORE0,
-        NULL, NULL, NULL, &vel[joint], &pos[joint], NULL, NULL, NULL, NULL, NULL);
+    struct Joint_setpoint_q setpoint;
+    memcpy(&setpoint, &message->joint[joint], sizeof(setpoint));
+
+    /* Already in the units Core1 works in. */
+    volatile struct JointCommand* command = stage_joint_command(joint);
+    command->velocity_requested_q = setpoint.velocity;
+    command->abs_pos_requested_q = setpoint.position;
   }
 
-  (*received_count)++;
   return true;
 }
 
-bool unpack_spindle_config(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    struct NWBuffer* tx_buf,
-    size_t* received_count
-) {
-  void* data_p = unpack_nw_buff(
-      rx_buf, *rx_offset, rx_offset, NULL, sizeof(struct Message_spindle_config));
-
-  if(! data_p) {
+/* How many missed updates Core1 may coast through before the next
+ * setpoints. count_joint_updates() counts those as coasted, not underruns. */
+bool unpack_joint_coast(const void* view, void* context) {
+  (void) context; /* unused */
+  const struct Message_set_joint_coast* message = view;
+  if(message->periods > MAX_COAST_PERIODS) {
     return false;
   }
+  config.coast_periods = message->periods;
+
+  return true;
+}
+
+bool unpack_feedback_ack(const void* view, void* context) {
+  (void) context; /* unused */
+  const struct Message_feedback_ack* message = view;
+  joint_movement_ack(message->id, message->valid);
+
+  return true;
+}
+
+bool unpack_clock_sync(const void* view, void* context) {
+  struct MessageContext* ctx = context;
+  const struct Message_clock_sync* message = view;
+  clock_sync.host_tx_us = message->host_tx_us;
+  clock_sync.rp_rx_us   = ctx->rx_time_us;
+  clock_sync.pending    = true;
+
+  return true;
+}
+
+bool serialise_clock_sync(struct NWBuffer* tx_buf) {
+  if(!clock_sync.pending) {
+    return true;
+  }
+  clock_sync.pending = false;
+
+  union ReplyAny reply;
+  reply.clock_sync.type = REPLY_CLOCK_SYNC;
+  memset(reply.clock_sync._pad, 0, sizeof(reply.clock_sync._pad));
+  reply.clock_sync.host_tx_us = clock_sync.host_tx_us;
+  reply.clock_sync.rp_rx_us   = clock_sync.rp_rx_us;
+  reply.clock_sync.rp_tx_us   = time_us_64();
+  return pack_nw_buff(tx_buf, &reply, sizeof(struct Reply_clock_sync));
+}
+
+bool unpack_tick_sync(const void* view, void* context) {
+  (void) context; /* unused */
+  const struct Message_tick_sync* message = view;
+  timing_set_target(message->rp_target_us);
+
+  return true;
+}
+
+bool serialise_tick_sync(struct NWBuffer* tx_buf) {
+  int32_t phase_error_us;
+  if(!timing_take_phase_error(&phase_error_us)) {
+    return true;
+  }
+
+  union ReplyAny reply;
+  reply.tick_sync.type = REPLY_TICK_SYNC;
+  memset(reply.tick_sync._pad, 0, sizeof(reply.tick_sync._pad));
+  reply.tick_sync.phase_error_us = phase_error_us;
+  return pack_nw_buff(tx_buf, &reply, sizeof(struct Reply_tick_sync));
+}
 
-  struct Message_spindle_config* message = data_p;
+bool serialise_flash_write(struct NWBuffer* tx_buf) {
+  union ReplyAny reply;
+  reply.flash_write.type    = REPLY_FLASH_WRITE;
+  reply.flash_write._pad    = 0;
+  reply.flash_write.hold_ms = CONFIG_CACHE_WRITE_HOLD_MS;
+  return pack_nw_buff(tx_buf, &reply, sizeof(struct Reply_flash_write));
+}
+
+bool unpack_spindle_config(const void* view, void* context) {
+  struct MessageContext* ctx = context;
+  const struct Message_spindle_config* message = view;
   uint8_t spindle = message->spindle_index;
   if(spindle > 0) {
-    printf("%u ERROR: More than one spindle not yet supported. %u\n",
-        *received_count, message->spindle_index);
+    log_event(CORE0, LOG_BAD_SPINDLE, spindle, *ctx->received_count);
     return false;
   }
 
 #ifdef VERBOSE_CONFIG_LOG
-  printf("%u Configuring spindle: %u\n", *received_count, message->spindle_index);
+  printf("%u Configuring spindle: %u\n", *ctx->received_count, message->spindle_index);
 #endif
   
   vfd_config.address = message->modbus_address;
   vfd_config.bitrate = message->bitrate;
   vfd_config.type = message->vfd_type;
+  config_cache_spindle(message);
 
-
-  if(!serialise_spindle_config(spindle, tx_buf)) {
-    printf("WARN: TX buf full, drop spindle config rep\n");
+  if(!serialise_spindle_config(spindle, ctx->tx_buf)) {
+    log_event(CORE0, LOG_TX_FULL, REPLY_SPINDLE_CONFIG, 0);
   }
 
-  (*received_count)++;
   return true;
 }
 
-bool unpack_spindle_speed(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    size_t* received_count
-) {
-  void* data_p = unpack_nw_buff(
-      rx_buf, *rx_offset, rx_offset, NULL, sizeof(struct Message_spindle_speed));
-
-  if(! data_p) {
-    return false;
-  }
-
-  struct Message_spindle_speed* message = data_p;
+bool unpack_spindle_speed(const void* view, void* context) {
+  (void) context; /* unused */
+  const struct Message_spindle_speed* message = view;
 
   for(size_t spindle = 0; spindle < MAX_SPINDLE; spindle++) {
     if(spindle > 0) {
@@ -197,24 +321,12 @@ bool unpack_spindle_speed(
     req_spindle_frequency = message->speed[spindle];
   }
 
-  (*received_count)++;
   return true;
 }
 
-bool unpack_joint_config(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    struct NWBuffer* tx_buf,
-    size_t* received_count
-) {
-  void* data_p = unpack_nw_buff(
-      rx_buf, *rx_offset, rx_offset, NULL, sizeof(struct Message_joint_config));
-
-  if(! data_p) {
-    return false;
-  }
-
-  struct Message_joint_config* message = data_p;
+bool unpack_joint_config(const void* view, void* context) {
+  struct MessageContext* ctx = context;
+  const struct Message_joint_config* message = view;
   uint8_t joint = message->joint;
   uint8_t enabled = message->enable;
   int8_t io_step = message->gpio_step;
@@ -226,73 +338,55 @@ bool unpack_joint_config(
 
 #ifdef VERBOSE_CONFIG_LOG
   printf("%u Cfg joint %u: en=%u step=%i dir=%i vel=%f acc=%f cmd=%u\n",
-      *received_count, joint, enabled, io_step, io_dir, max_velocity, max_accel, cmd_type);
+      *ctx->received_count, joint, enabled, io_step, io_dir, max_velocity, max_accel, cmd_type);
 #endif
-  update_joint_config(
-      joint,
-      CORE0,
-      &enabled,
-      &io_step,
-      &io_dir,
-      NULL,
-      NULL,
-      NULL,
-      &max_velocity,
-      &max_accel,
-      NULL,
-      &cmd_type);
-
-  if(!serialise_joint_config(joint, tx_buf)) {
-    printf("WARN: TX buf full, drop joint config rep\n");
-  }
-
-  (*received_count)++;
-  return true;
-}
-
-bool unpack_gpio(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    size_t* received_count
-) {
-  void* data_p = unpack_nw_buff(
-      rx_buf, *rx_offset, rx_offset, NULL, sizeof(struct Message_gpio));
+  volatile struct JointCommand* command = stage_joint_command(joint);
+  if(command) {
+    command->enabled = enabled;
+    command->io_pos_step = io_step;
+    command->io_pos_dir = io_dir;
+    command->max_velocity = max_velocity;
+    command->max_accel = max_accel;
+    command->cmd_type = cmd_type;
+  }
+  config_cache_joint(message);
 
-  if(! data_p) {
-    return false;
+  if(!serialise_joint_config(joint, ctx->tx_buf)) {
+    log_event(CORE0, LOG_TX_FULL, REPLY_JOINT_CONFIG, 0);
   }
 
-  struct Message_gpio* message = data_p;
+  return true;
+}
+
+bool unpack_gpio(const void* view, void* context) {
+  struct MessageContext* ctx = context;
+  const struct Message_gpio* message = view;
   const uint8_t bank = message->bank;
   uint32_t values = message->values;
   bool confirmation_pending = message->confirmation_pending;
+  if(bank >= MAX_GPIO_BANK) {
+    log_event(CORE0, LOG_BAD_GPIO_BANK, bank, *ctx->received_count);
+    return false;
+  }
 
   config.gpio_confirmation_pending[bank] = confirmation_pending;
 
   gpio_set_values(bank, values);
 
-  (*received_count)++;
   return true;
 }
 
-bool unpack_gpio_config(
-    struct NWBuffer* rx_buf,
-    size_t* rx_offset,
-    struct NWBuffer* tx_buf,
-    size_t* received_count
-) {
-  void* data_p = unpack_nw_buff(
-      rx_buf, *rx_offset, rx_offset, NULL, sizeof(struct Message_gpio_config));
-
-  if(! data_p) {
-    return false;
-  }
-
-  struct Message_gpio_config* message = data_p;
+bool unpack_gpio_config(const void* view, void* context) {
+  struct MessageContext* ctx = context;
+  const struct Message_gpio_config* message = view;
   uint8_t gpio_type = message->gpio_type;
   uint8_t gpio_count = message->gpio_count;
   uint8_t index = message->index;
   uint8_t address = message->address;
+  if(gpio_count >= MAX_GPIO) {
+    log_event(CORE0, LOG_BAD_GPIO, gpio_count, *ctx->received_count);
+    return false;
+  }
 
 #ifdef VERBOSE_CONFIG_LOG
   printf("Cfg gpio t=%u i=%u a=%u c=%u\n", gpio_type, index, address, gpio_count);
@@ -301,6 +395,8 @@ bool unpack_gpio_config(
   config.gpio[gpio_count].type = gpio_type;
   config.gpio[gpio_count].index = index;
   config.gpio[gpio_count].address = address;
+  gpio_update_masks();
+  config_cache_gpio(message);
 
   switch(gpio_type) {
     case GPIO_TYPE_NATIVE_OUT:
@@ -341,14 +437,32 @@ bool unpack_gpio_config(
       break;
   }
 
-  if(!serialise_gpio_config(gpio_count, tx_buf)) {
-    printf("WARN: TX buf full, drop gpio conf rep\n");
+  if(!serialise_gpio_config(gpio_count, ctx->tx_buf)) {
+    log_event(CORE0, LOG_TX_FULL, REPLY_GPIO_CONFIG, 0);
   }
 
-  (*received_count)++;
   return true;
 }
 
+/* Handler and size for each MSG_* type. */
+static const struct NWDispatch message_dispatch[MSG_TYPE_COUNT] = {
+  [MSG_VERSION_REQUEST]    = NW_DISPATCH(struct Message_version_request, unpack_version_request),
+  [MSG_TIMING]             = NW_DISPATCH(struct Message_timing, unpack_timing),
+  [MSG_SET_JOINT_ENABLED]  = NW_DISPATCH(struct Message_joint_enable, unpack_joint_enable),
+  [MSG_SET_JOINT_ABS_POS]  = NW_DISPATCH(struct Message_set_joints_pos, unpack_joint_abs_pos),
+  [MSG_SET_JOINT_CONFIG]   = NW_DISPATCH(struct Message_joint_config, unpack_joint_config),
+  [MSG_SET_GPIO]           = NW_DISPATCH(struct Message_gpio, unpack_gpio),
+  [MSG_SET_GPIO_CONFIG]    = NW_DISPATCH(struct Message_gpio_config, unpack_gpio_config),
+  [MSG_SET_SPINDLE_CONFIG] = NW_DISPATCH(struct Message_spindle_config, unpack_spindle_config),
+  [MSG_SET_SPINDLE_SPEED]  = NW_DISPATCH(struct Message_spindle_speed, unpack_spindle_speed),
+  [MSG_SET_JOINT_POS_Q]    = NW_DISPATCH_VAR(
+      offsetof(struct Message_set_joints_pos_q, joint), joint_pos_q_length, unpack_joint_pos_q),
+  [MSG_FEEDBACK_ACK]       = NW_DISPATCH(struct Message_feedback_ack, unpack_feedback_ack),
+  [MSG_SET_JOINT_COAST]    = NW_DISPATCH(struct Message_set_joint_coast, unpack_joint_coast),
+  [MSG_CLOCK_SYNC]         = NW_DISPATCH(struct Message_clock_sync, unpack_clock_sync),
+  [MSG_TICK_SYNC]          = NW_DISPATCH(struct Message_tick_sync, unpack_tick_sync),
+};
+
 /* Process data received over the network.
  * This consists of serialised structs as defined in src/shared/massages.h
  */
@@ -360,19 +474,19 @@ void process_received_buffer(
 ) {
   size_t rx_offset = 0;
 
-  if(rx_buf->length + sizeof(rx_buf->length) + sizeof(rx_buf->checksum) != expected_length) {
-    printf("WARN: RX len incorrect %u\n", *received_count);
+  if(nw_buff_wire_len(rx_buf) != expected_length) {
+    log_event(CORE0, LOG_RX_LENGTH, nw_buff_wire_len(rx_buf), expected_length);
     reset_nw_buf(rx_buf);
     return;
   }
-  if(rx_buf->length > NW_BUF_LEN) {
-    printf("WARN: RX len > buf size %u\n", *received_count);
+  if(nw_buff_len(rx_buf) > NW_BUF_LEN) {
+    log_event(CORE0, LOG_RX_OVERSIZE, nw_buff_len(rx_buf), 0);
     reset_nw_buf(rx_buf);
     return;
   }
 
   if(!checkNWBuff(rx_buf)) {
-    printf("WARN: RX checksum\n");
+    log_event(CORE0, LOG_RX_CHECKSUM, 0, 0);
 
     reset_nw_buf(rx_buf);
     reset_nw_buf(tx_buf);
@@ -380,69 +494,25 @@ void process_received_buffer(
     return;
   }
 
-  bool unpack_success = true;
-
-  while(unpack_success) {
-    struct Message_header* header = unpack_nw_buff(
-        rx_buf, rx_offset, NULL, NULL, sizeof(struct Message_header));
-
-    if(!header || !header->type) {
-      // End of data.
-      break;
-    }
+  struct MessageContext context = {
+    .tx_buf = tx_buf,
+    .received_count = received_count,
+    .rx_time_us = time_us_64()
+  };
+  enum NWDispatchResult result = nw_dispatch(
+      rx_buf, message_dispatch, MSG_TYPE_COUNT, &context, &rx_offset, received_count);
 
-    switch(header->type) {
-      case MSG_VERSION_REQUEST:
-        unpack_success = unpack_success && unpack_version_request(
-            rx_buf, &rx_offset, tx_buf, received_count);
-        break;
-      case MSG_TIMING:
-        ;
-        unpack_success = unpack_success && unpack_timing(
-            rx_buf, &rx_offset, tx_buf, received_count);
-        break;
-      case MSG_SET_JOINT_ENABLED:
-        unpack_success = unpack_success && unpack_joint_enable(
-            rx_buf, &rx_offset, received_count);
-        break;
-      case MSG_SET_JOINT_ABS_POS:
-        unpack_success = unpack_success && unpack_joint_abs_pos(
-            rx_buf, &rx_offset, received_count);
-        break;
-      case MSG_SET_JOINT_CONFIG:
-        unpack_success = unpack_success && unpack_joint_config(
-            rx_buf, &rx_offset, tx_buf, received_count);
-        break;
-      case MSG_SET_SPINDLE_CONFIG:
-        unpack_success = unpack_success && unpack_spindle_config(
-            rx_buf, &rx_offset, tx_buf, received_count);
-        break;
-      case MSG_SET_SPINDLE_SPEED:
-        unpack_success = unpack_success && unpack_spindle_speed(
-            rx_buf, &rx_offset, received_count);
-        break;
-      case MSG_SET_GPIO:
-        unpack_success = unpack_success && unpack_gpio(
-            rx_buf, &rx_offset, received_count);
-        break;
-      case MSG_SET_GPIO_CONFIG:
-        unpack_success = unpack_success && unpack_gpio_config(
-            rx_buf, &rx_offset, tx_buf, received_count);
-        break;
-      default:
-        printf("WARN: Invalid message type: %u\t%lu\n", header->type, *received_count);
-        // Implies data corruption.
-        unpack_success = false;
-        reset_nw_buf(rx_buf);
-        reset_nw_buf(tx_buf);
-        *received_count = 0;
-        return;
-    }
+  if(result == NW_DISPATCH_UNKNOWN_TYPE) {
+    log_event(CORE0, LOG_RX_BAD_TYPE, rx_buf->payload[rx_offset], *received_count);
+    // Implies data corruption.
+    reset_nw_buf(rx_buf);
+    reset_nw_buf(tx_buf);
+    *received_count = 0;
+    return;
   }
 
   if(rx_offset < rx_buf->length) {
-    printf("WARN: Unconsumed RX buffer remainder: %u bytes.\t%u\n",
-        rx_buf->length - rx_offset, *received_count);
+    log_event(CORE0, LOG_RX_REMAINDER, rx_buf->length - rx_offset, *received_count);
     // Implies data corruption.
     // Received a message type in the header but not enough data in the buffer
     // to populate the struct.
@@ -452,13 +522,50 @@ void process_received_buffer(
   return;
 }
 
+/* Apply the config cached in flash as if the driver had just sent it. */
+static void restore_cached_config(void) {
+  const struct ConfigCacheRecord* record = config_cache_load();
+  if(!record) {
+    printf("No cached config in flash.\n");
+    return;
+  }
+
+  static struct NWBuffer scratch_buf;  // Replies are discarded.
+  size_t received_count = 0;
+  struct MessageContext context = {
+    .tx_buf = &scratch_buf,
+    .received_count = &received_count
+  };
+  for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+    if(record->joint[joint].type == MSG_SET_JOINT_CONFIG) {
+      unpack_joint_config(&record->joint[joint], &context);
+    }
+    reset_nw_buf(&scratch_buf);
+  }
+  for(size_t gpio = 0; gpio < MAX_GPIO; gpio++) {
+    if(record->gpio[gpio].type == MSG_SET_GPIO_CONFIG) {
+      unpack_gpio_config(&record->gpio[gpio], &context);
+    }
+    reset_nw_buf(&scratch_buf);
+  }
+  for(size_t spindle = 0; spindle < MAX_SPINDLE; spindle++) {
+    if(record->spindle[spindle].type == MSG_SET_SPINDLE_CONFIG) {
+      unpack_spindle_config(&record->spindle[spindle], &context);
+    }
+    reset_nw_buf(&scratch_buf);
+  }
+  printf("Restored cached config: %08x\n", record->hash);
+}
+
 void core0_main() {
   int retval = 0;
-  struct NWBuffer rx_buf = {0};
-  struct NWBuffer tx_buf = {0};
+  // Static: two full size buffers would take most of Core0's 2KB stack.
+  static struct NWBuffer rx_buf = {0};
+  static struct NWBuffer tx_buf = {0};
   size_t received_msg_count = 0;
   size_t data_received = 0;
   size_t time_now;
+  bool flash_write_due = false;  // Announced in the reply being built.
 
   // Need these to store the IP and port.
   // We get the remote values when receiving data.
@@ -468,6 +575,7 @@ void core0_main() {
 
   modbus_init();
   timing_init();
+  restore_cached_config();
 
   int count = 0;
   while (1) {
@@ -475,6 +583,8 @@ void core0_main() {
     retval = 0;
 
     while(data_received == 0 || retval <= 0) {
+      apply_joint_disables();
+      log_drain(time_us_64());
       retval = get_UDP(
           SOCKET_NUMBER,
           NW_PORT,
@@ -490,17 +600,25 @@ void core0_main() {
       uint64_t t_c0_start = time_us_64();
       /* Only call recover_clock() on received packets. During a missed packet
        * the timer free-runs at the current period, which is correct behaviour. */
-      /* Serialise before waking Core1 — avoids joint mutex contention. */
-      if(!serialise_joint_movement(&tx_buf, false)) {
-        printf("WARN: TX buf full, drop joint movement\n");
+      /* Serialise before waking Core1 so the feedback is from the period
+       * that has just ended. */
+      bool movement_packed = (config.features & FEATURE_COMPACT_FEEDBACK) ?
+          serialise_joint_movement_v2(&tx_buf) :
+          serialise_joint_movement(&tx_buf, false);
+      if(!movement_packed) {
+        log_event(CORE0, LOG_TX_FULL, (config.features & FEATURE_COMPACT_FEEDBACK) ?
+                  REPLY_JOINT_MOVEMENT_V2 : REPLY_JOINT_MOVEMENT, 0);
       }
       if(!serialise_joint_metrics(&tx_buf)) {
-        printf("WARN: TX buf full, drop joint metrics\n");
+        log_event(CORE0, LOG_TX_FULL, REPLY_JOINT_METRICS, 0);
       }
 
-      packet_generation++;   /* all joint configs from this packet are now written */
+      publish_joint_commands();
       last_packet_tick = tick;
       recover_clock();
+      if(!serialise_tick_sync(&tx_buf)) {
+        log_event(CORE0, LOG_TX_FULL, REPLY_TICK_SYNC, 0);
+      }
 
       time_now = time_us_64();
       gpio_put(LED_PIN, (time_now / 1000000) % 2);
@@ -509,22 +627,41 @@ void core0_main() {
       // No need to update each spindle every cycle.
       if(count % 100 == 0) {
         if(!serialise_spindle_speed_out(&tx_buf, act_spindle_frequency, &vfd.stats)) {
-          printf("WARN: TX buff full, drop spindle speed\n");
+          log_event(CORE0, LOG_TX_FULL, REPLY_SPINDLE_SPEED, 0);
         }
       }
 
       size_t tx_buf_len = 0;
       gpio_serialize(&tx_buf, &tx_buf_len);
 
+      /* Only a driver that negotiated the cache knows to wait out the write,
+       * so without it the config is never cached. */
+      flash_write_due = (config.features & FEATURE_CONFIG_CACHE)
+          && config_cache_due(!any_joint_enabled())
+          && serialise_flash_write(&tx_buf);
+
       count++;
 
+      // Last, so rp_tx_us is as close to the send as possible.
+      if(!serialise_clock_sync(&tx_buf)) {
+        log_event(CORE0, LOG_TX_FULL, REPLY_CLOCK_SYNC, 0);
+      }
+
+      if(config.features & FEATURE_CRC32) {
+        seal_nw_buff_crc32(&tx_buf);
+      }
+
       put_UDP(
           SOCKET_NUMBER,
           NW_PORT,
           &tx_buf,
-          tx_buf.length + sizeof(tx_buf.length) + sizeof(tx_buf.checksum),
+          nw_buff_wire_len(&tx_buf),
           destip_machine,
           &destport_machine);
+      if(flash_write_due) {
+        config_cache_write();
+        flash_write_due = false;
+      }
       act_spindle_frequency = modbus_loop(req_spindle_frequency);
       core0_work_us = (uint32_t)(time_us_64() - t_c0_start);
     }
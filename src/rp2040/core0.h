@@ -1,10 +1,29 @@
 #ifndef CORE0__H
 #define CORE0__H
 
+#include <stdbool.h>
+
 #include "buffer.h"
 
-size_t process_received_buffer(
-    struct NWBuffer* rx_buf, struct NWBuffer* tx_buf, uint8_t* received_count, uint16_t expected_length);
+#include <stddef.h>
+
+/* Unpack every message in rx_buf, packing any replies into tx_buf.
+ * received_count is set to the number of messages handled, or 0 if the
+ * packet was rejected. */
+void process_received_buffer(
+    struct NWBuffer* rx_buf, struct NWBuffer* tx_buf, size_t* received_count, size_t expected_length);
+
+/* Pack REPLY_CLOCK_SYNC if a MSG_CLOCK_SYNC arrived in the last packet.
+ * Returns false only if it did not fit. */
+bool serialise_clock_sync(struct NWBuffer* tx_buf);
+
+/* Pack REPLY_TICK_SYNC if recover_clock() applied a MSG_TICK_SYNC target.
+ * Returns false only if it did not fit. */
+bool serialise_tick_sync(struct NWBuffer* tx_buf);
+
+/* Pack REPLY_FLASH_WRITE, announcing that config_cache_write() follows this
+ * reply. Returns false if it did not fit. */
+bool serialise_flash_write(struct NWBuffer* tx_buf);
 
 void core0_main();
 
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 
 #ifdef BUILD_TESTS
 
@@ -13,12 +14,18 @@
 
 #include "core1.h"
 #include "config.h"
+#include "event_log.h"
 #include "pio.h"
 
 static uint32_t last_tick               = 0;
 static uint32_t last_packet_generation  = 0;
 static bool     no_network              = false;
 
+/* Core1's copies of the joint exchange; see read_joint_commands(). */
+static struct JointCommand  joint_commands[MAX_JOINT];
+static struct JointFeedback joint_feedback[MAX_JOINT];
+static uint32_t             last_command_generation = 0;
+
 void wait_for_packet(void) {
   while (tick == last_tick) {}
   last_tick = tick;
@@ -54,7 +61,7 @@ void handle_network_timeout(void) {
   for (uint8_t joint = 0; joint < MAX_JOINT; joint++) {
     disable_joint(joint, CORE1);
   }
-  printf("No NW\n");
+  log_event(CORE1, LOG_NETWORK_DOWN, 0, 0);
   no_network = true;
 }
 
@@ -62,14 +69,22 @@ void handle_network_recovery(void) {
   if (!no_network) {
     return;
   }
-  printf("NW up\n");
+  log_event(CORE1, LOG_NETWORK_UP, 0, 0);
   no_network = false;
 }
 
 void step_all_joints(void) {
+  uint32_t generation = read_joint_commands(joint_commands);
+  count_joint_updates(generation - last_command_generation);
+
   for (uint8_t joint = 0; joint < MAX_JOINT; joint++) {
-    do_steps(joint);
+    /* Only joints the packet wrote count as updated. */
+    int32_t age = (int32_t)(joint_commands[joint].generation - last_command_generation);
+    do_steps(joint, &joint_commands[joint], age > 0, &joint_feedback[joint]);
   }
+  last_command_generation = generation;
+
+  publish_joint_feedback(joint_feedback);
 }
 
 static void core1_tick(void) {
@@ -92,6 +107,10 @@ static void core1_tick(void) {
 }
 
 void core1_main(void) {
+#ifndef BUILD_TESTS
+  // Lets Core0 park this core while config_cache_write() writes flash.
+  multicore_lockout_victim_init();
+#endif
   while (1) {
     core1_tick();
   }
@@ -125,5 +144,8 @@ void core1_reset_for_test(void) {
   last_tick               = 0;
   last_packet_generation  = 0;
   no_network              = false;
+  memset(joint_commands, 0, sizeof(joint_commands));
+  memset(joint_feedback, 0, sizeof(joint_feedback));
+  last_command_generation = 0;
 }
 #endif
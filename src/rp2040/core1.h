@@ -19,7 +19,8 @@ void handle_network_timeout(void);
 /* If no_network was set: log reconnection and clear it. Otherwise no-op. */
 void handle_network_recovery(void);
 
-/* Call do_steps() for all MAX_JOINT joints. */
+/* Read the newest joint commands, call do_steps() for all MAX_JOINT joints
+ * and publish their feedback. */
 void step_all_joints(void);
 
 void init_core1(void);
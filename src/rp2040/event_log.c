@@ -0,0 +1,127 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef BUILD_TESTS
+
+#include "../test/mocks/rp_mocks.h"
+
+#else  // BUILD_TESTS
+
+#include "pico/stdlib.h"
+
+#endif  // BUILD_TESTS
+
+#include "config.h"
+#include "event_log.h"
+
+static_assert((LOG_RING_LEN & (LOG_RING_LEN - 1)) == 0, "LOG_RING_LEN must be a power of two");
+
+/* Single producer, single consumer. head is only written by the producing
+ * core and tail only by Core0, each published with release so the other
+ * side sees the record before the index that covers it. */
+struct LogRing {
+  uint32_t head;            // Next position to write.
+  uint32_t tail;            // Next position to read.
+  uint32_t dropped;         // Written by the producer only.
+  uint32_t reported;        // dropped when last printed. Core0 only.
+  struct LogRecord records[LOG_RING_LEN];
+};
+
+static struct LogRing log_rings[2];
+static uint64_t last_drain_us = 0;
+static uint8_t  drain_core = CORE0;   // Core whose ring is looked at first.
+
+static const char* const log_formats[LOG_EVENT_COUNT] = {
+  [LOG_TX_FULL]         = "WARN: TX buf full, drop reply type %lu\n",
+  [LOG_RX_LENGTH]       = "WARN: RX len incorrect %lu, expected %lu\n",
+  [LOG_RX_OVERSIZE]     = "WARN: RX len > buf size %lu\n",
+  [LOG_RX_CHECKSUM]     = "WARN: RX checksum\n",
+  [LOG_RX_BAD_TYPE]     = "WARN: Invalid message type: %lu\t%lu\n",
+  [LOG_RX_REMAINDER]    = "WARN: Unconsumed RX buffer remainder: %lu bytes.\t%lu\n",
+  [LOG_BAD_SPINDLE]     = "ERROR: More than one spindle not yet supported. %lu\t%lu\n",
+  [LOG_BAD_GPIO_BANK]   = "ERROR: GPIO bank out of range. %lu\t%lu\n",
+  [LOG_BAD_GPIO]        = "ERROR: GPIO out of range. %lu\t%lu\n",
+  [LOG_GPIO_OUT]        = "DBG GPIO OUT: %lu  val: %lu\n",
+  [LOG_JOINT_ENABLED]   = "J%lu enab\n",
+  [LOG_JOINT_DISABLED]  = "J%lu disab\n",
+  [LOG_NETWORK_DOWN]    = "No NW\n",
+  [LOG_NETWORK_UP]      = "NW up\n",
+  [LOG_MCP_RECONFIG]    = "Reconfig at %02lx\n",
+  [LOG_MCP_FAULT]       = "MCP Fault chip=%02lx abort=%02lx\n",
+};
+
+void log_event(uint8_t core, enum LogEvent event, uint32_t a, uint32_t b) {
+  struct LogRing* ring = &log_rings[core & 1];
+  uint32_t head = ring->head;
+  if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_LEN) {
+    __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+    return;
+  }
+  struct LogRecord* record = &ring->records[head & (LOG_RING_LEN - 1)];
+  record->time_us = (uint32_t)time_us_64();
+  record->event = event;
+  record->core = core;
+  record->_pad = 0;
+  record->a = a;
+  record->b = b;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+bool log_pop(uint8_t core, struct LogRecord* record) {
+  struct LogRing* ring = &log_rings[core & 1];
+  uint32_t tail = ring->tail;
+  if(tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+  *record = ring->records[tail & (LOG_RING_LEN - 1)];
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+uint32_t log_take_dropped(uint8_t core) {
+  struct LogRing* ring = &log_rings[core & 1];
+  uint32_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+  uint32_t count = dropped - ring->reported;
+  ring->reported = dropped;
+  return count;
+}
+
+bool log_drain(uint64_t now_us) {
+  if(now_us - last_drain_us < LOG_DRAIN_INTERVAL_US) {
+    return false;
+  }
+  for(uint8_t i = 0; i < 2; i++) {
+    uint8_t core = drain_core;
+    drain_core ^= 1;
+    struct LogRecord record;
+    if(log_pop(core, &record)) {
+      printf("%lu.%06lu ", (unsigned long)(record.time_us / 1000000),
+             (unsigned long)(record.time_us % 1000000));
+      if(record.event < LOG_EVENT_COUNT) {
+        printf(log_formats[record.event], (unsigned long)record.a, (unsigned long)record.b);
+      } else {
+        printf("Unknown log event %u\n", record.event);
+      }
+    } else {
+      /* Only once the ring is empty, so the count comes after the events kept. */
+      uint32_t dropped = log_take_dropped(core);
+      if(!dropped) {
+        continue;
+      }
+      printf("WARN: core%u dropped %lu log events\n", core, (unsigned long)dropped);
+    }
+    last_drain_us = now_us;
+    return true;
+  }
+  return false;
+}
+
+#ifdef BUILD_TESTS
+void log_reset_for_test(void) {
+  memset(log_rings, 0, sizeof(log_rings));
+  last_drain_us = 0;
+  drain_core = CORE0;
+}
+#endif
@@ -0,0 +1,70 @@
+#ifndef EVENT_LOG__H
+#define EVENT_LOG__H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Deferred logging for the hot paths.
+ * Printing over UART can stall a core for milliseconds, so code that runs
+ * every packet or every tick records a fixed size binary event instead. Each
+ * core has its own ring with a single producer: that core, outside interrupt
+ * handlers. Core0 formats and prints the events from idle time between
+ * packets with log_drain(). An event that finds its ring full is dropped and
+ * counted. */
+
+enum LogEvent {
+  LOG_TX_FULL,          // a: REPLY_* type that did not fit.
+  LOG_RX_LENGTH,        // a: bytes on the wire, b: bytes expected.
+  LOG_RX_OVERSIZE,      // a: payload length.
+  LOG_RX_CHECKSUM,
+  LOG_RX_BAD_TYPE,      // a: message type, b: messages dispatched before it.
+  LOG_RX_REMAINDER,     // a: bytes not consumed, b: messages dispatched.
+  LOG_BAD_SPINDLE,      // a: spindle index, b: messages dispatched.
+  LOG_BAD_GPIO_BANK,    // a: bank, b: messages dispatched.
+  LOG_BAD_GPIO,         // a: gpio, b: messages dispatched.
+  LOG_GPIO_OUT,         // a: gpio, b: new value. For gpio_type GPIO_TYPE_*_DEBUG.
+  LOG_JOINT_ENABLED,    // a: joint.
+  LOG_JOINT_DISABLED,   // a: joint.
+  LOG_NETWORK_DOWN,
+  LOG_NETWORK_UP,
+  LOG_MCP_RECONFIG,     // a: i2c address.
+  LOG_MCP_FAULT,        // a: chip, b: abort reason.
+  LOG_EVENT_COUNT
+};
+
+struct LogRecord {
+  uint32_t time_us;     // Low 32 bits of time_us_64() when logged.
+  uint8_t  event;       // enum LogEvent
+  uint8_t  core;        // CORE0 or CORE1
+  uint16_t _pad;
+  uint32_t a;
+  uint32_t b;
+};
+
+/* Must be a power of two. */
+#define LOG_RING_LEN 64
+
+/* At most one event is printed per interval, to keep within what the UART
+ * can take at 115200 baud without the printf blocking. */
+#define LOG_DRAIN_INTERVAL_US 5000
+
+/* Record an event from core. Never blocks. */
+void log_event(uint8_t core, enum LogEvent event, uint32_t a, uint32_t b);
+
+/* Take the oldest event off core's ring. Core0 only.
+ * Returns false if the ring is empty. */
+bool log_pop(uint8_t core, struct LogRecord* record);
+
+/* Events dropped from core's ring since the last call. Core0 only. */
+uint32_t log_take_dropped(uint8_t core);
+
+/* Print at most one event, or one dropped count, if LOG_DRAIN_INTERVAL_US
+ * has passed since the last. Core0 only, between packets.
+ * Returns true if anything was printed. */
+bool log_drain(uint64_t now_us);
+
+#ifdef BUILD_TESTS
+void log_reset_for_test(void);
+#endif
+
+#endif  // EVENT_LOG__H
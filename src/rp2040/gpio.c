@@ -2,6 +2,7 @@
 #include <string.h>
 
 #include "config.h"
+#include "event_log.h"
 #include "gpio.h"
 #include "i2c.h"
 #include "messages.h"
@@ -18,10 +19,24 @@
 
 
 uint8_t gpio_i2c_mcp_addresses[MAX_I2C_MCP] = {0xff, 0xff, 0xff, 0xff};
-uint8_t gpio_last_type[32 * MAX_I2C_MCP];
 
 struct i2c_gpio_state i2c_gpio;
 
+/* Per bank masks of config.gpio, so the per packet work only visits the GPIO
+ * of each type. Bit n of a bank is gpio bank * 32 + n. */
+struct GpioBankMasks {
+  uint32_t native_out;
+  uint32_t native_in;
+  uint32_t mcp_out;
+  uint32_t mcp_in;              // Both MCP input types.
+  uint32_t debug;               // The *_DEBUG types, printed on change.
+};
+
+static struct GpioBankMasks gpio_masks[MAX_GPIO_BANK];
+
+/* Slot in i2c_gpio.config of each MCP GPIO, allocated at config time. */
+static uint8_t gpio_mcp_slot[MAX_GPIO];
+
 void update_gpio_config(
     const uint8_t gpio,
     const uint8_t* type,
@@ -49,7 +64,15 @@ void update_gpio_config(
     config.gpio[gpio].address = *address;
   }
   if(value != NULL) {
-    config.gpio[gpio].value = *value;
+    uint32_t bit = 0x1u << (gpio % 32);
+    if(*value) {
+      config.gpio_values[gpio / 32] |= bit;
+    } else {
+      config.gpio_values[gpio / 32] &= ~bit;
+    }
+  }
+  if(type != NULL || index != NULL || address != NULL) {
+    gpio_update_masks();
   }
 }
 
@@ -76,43 +99,125 @@ void get_gpio_config(
     *address = config.gpio[gpio].address;
   }
   if(value != NULL) {
-    *value = config.gpio[gpio].value;
+    *value = config.gpio_values[gpio / 32] & (0x1u << (gpio % 32));
   }
 }
 
-void gpio_set_values(const uint8_t bank, uint32_t values) {
-  for(uint8_t gpio = bank * 32; gpio < (bank + 1) * 32; gpio++) {
-    uint8_t type;
-    uint8_t index;
-    uint8_t address;
-    bool current_value;
-    get_gpio_config(gpio, &type, &index, &address, &current_value);
+void gpio_update_masks(void) {
+  memset(gpio_masks, 0, sizeof(gpio_masks));
 
-    // Parsed from Message_gpio.
-    bool new_value = values & (0x1 << (gpio % 32));
+  for(uint16_t gpio = 0; gpio < MAX_GPIO; gpio++) {
+    struct GpioBankMasks* masks = &gpio_masks[gpio / 32];
+    uint32_t bit = 0x1u << (gpio % 32);
+    uint8_t type = config.gpio[gpio].type;
+    uint8_t index = config.gpio[gpio].index;
+    uint8_t address = config.gpio[gpio].address;
 
-    if(new_value == current_value) {
-      continue;
+    switch(type) {
+      case GPIO_TYPE_NATIVE_OUT_DEBUG:
+      case GPIO_TYPE_NATIVE_IN_DEBUG:
+        masks->debug |= bit;
+        break;
+      default:
+        break;
     }
-    config.gpio_confirmation_pending[bank] = true;
 
     switch(type) {
       case GPIO_TYPE_NATIVE_OUT_DEBUG:
-        printf("DBG GPIO OUT: %u  IO: %u  val: %u\n", gpio, index, new_value);
-        // Note: no break.
       case GPIO_TYPE_NATIVE_OUT:
-        gpio_local_set_out_pin(index, new_value);
+      case GPIO_TYPE_NATIVE_IN_DEBUG:
+      case GPIO_TYPE_NATIVE_IN:
+        if(index >= NATIVE_GPIO_COUNT) {
+          printf("WARN: Native GPIO index out of range. GPIO: %u  Index: %u\n", gpio, index);
+          break;
+        }
+        if(type == GPIO_TYPE_NATIVE_OUT || type == GPIO_TYPE_NATIVE_OUT_DEBUG) {
+          masks->native_out |= bit;
+        } else {
+          masks->native_in |= bit;
+        }
         break;
       case GPIO_TYPE_I2C_MCP_OUT:
-        gpio_i2c_mcp_set_out_pin(index, address, new_value);
+      case GPIO_TYPE_I2C_MCP_IN:
+      case GPIO_TYPE_I2C_MCP_IN_PULLUP:
+      {
+        int i2c = gpio_i2c_mcp_alloc(address);
+        if(i2c == -1) {
+          printf("WARN: Too may i2c addresses. Add: %u  Index: %u\n", address, index);
+          break;
+        }
+        gpio_mcp_slot[gpio] = i2c;
+        if(type == GPIO_TYPE_I2C_MCP_OUT) {
+          masks->mcp_out |= bit;
+        } else {
+          masks->mcp_in |= bit;
+        }
+      }
         break;
       default:
         break;
     }
-    gpio_last_type[gpio] = type;
+  }
+}
 
-    update_gpio_config(gpio, NULL, NULL, NULL, &new_value);
+void gpio_set_values(const uint8_t bank, uint32_t values) {
+  if(bank >= MAX_GPIO_BANK) {
+    log_event(CORE0, LOG_BAD_GPIO_BANK, bank, 0);
+    return;
   }
+
+  // Parsed from Message_gpio.
+  uint32_t changed = values ^ config.gpio_values[bank];
+  if(!changed) {
+    return;
+  }
+  config.gpio_confirmation_pending[bank] = true;
+  const struct GpioBankMasks* masks = &gpio_masks[bank];
+
+  // All native outputs in one write.
+  uint32_t pin_mask = 0;
+  uint32_t pin_values = 0;
+  for(uint32_t bits = changed & masks->native_out; bits; bits &= bits - 1) {
+    uint8_t bit = __builtin_ctz(bits);
+    uint8_t gpio = bank * 32 + bit;
+    uint8_t index = config.gpio[gpio].index;
+    bool new_value = values & (0x1u << bit);
+    if(masks->debug & (0x1u << bit)) {
+      log_event(CORE0, LOG_GPIO_OUT, gpio, new_value);
+    }
+    pin_mask |= 0x1u << index;
+    pin_values |= (uint32_t)new_value << index;
+  }
+  if(pin_mask) {
+    gpio_local_set_out_pins(pin_mask, pin_values);
+  }
+
+  // MCP23017 output buffers, a whole port byte at a time.
+  uint8_t port_set[MAX_I2C_MCP][2] = {0};
+  uint8_t port_clear[MAX_I2C_MCP][2] = {0};
+  uint32_t mcp_changed = changed & masks->mcp_out;
+  for(uint32_t bits = mcp_changed; bits; bits &= bits - 1) {
+    uint8_t bit = __builtin_ctz(bits);
+    uint8_t gpio = bank * 32 + bit;
+    uint8_t index = config.gpio[gpio].index;
+    uint8_t i2c = gpio_mcp_slot[gpio];
+    uint8_t bitmask = 0x1 << (index & 7);
+    if(values & (0x1u << bit)) {
+      port_set[i2c][(index >> 3) & 1] |= bitmask;
+    } else {
+      port_clear[i2c][(index >> 3) & 1] |= bitmask;
+    }
+  }
+  if(mcp_changed) {
+    for(uint8_t i2c = 0; i2c < MAX_I2C_MCP; i2c++) {
+      for(uint8_t port = 0; port < 2; port++) {
+        uint8_t *data = &i2c_gpio.config[i2c].output_data[port];
+        *data = (*data & ~port_clear[i2c][port]) | port_set[i2c][port];
+      }
+    }
+  }
+
+  config.gpio_values[bank] = values;
 }
 
 void gpio_local_set_out_pin(uint8_t index, bool new_value) {
@@ -120,8 +225,8 @@ void gpio_local_set_out_pin(uint8_t index, bool new_value) {
   gpio_put(index, new_value);
 }
 
-bool gpio_local_get_pin(uint32_t index) {
-  return gpio_get(index);
+void gpio_local_set_out_pins(uint32_t pin_mask, uint32_t pin_values) {
+  gpio_put_masked(pin_mask, pin_values);
 }
 
 int gpio_i2c_mcp_alloc(uint8_t address) {
@@ -174,61 +279,45 @@ bool gpio_i2c_mcp_get_pin(uint8_t index, uint8_t address, uint8_t pullup) {
 
 /* Pack GPIO inputs in buffer for UDP transmission. */
 void gpio_serialize(struct NWBuffer* tx_buf, size_t* tx_buf_len) {
-  uint32_t values[MAX_GPIO_BANK] = {0};
+  uint32_t values[MAX_GPIO_BANK];
   bool to_send[MAX_GPIO_BANK];
+  // Every native input pin in one read, taken only if a bank needs it.
+  uint32_t native_pins = 0;
+  bool native_sampled = false;
 
   for(uint8_t bank = 0; bank < MAX_GPIO_BANK; bank++) {
-    values[bank] = 0;
-    to_send[bank] = false;
-  }
-
-  for(uint8_t gpio = 0; gpio < MAX_GPIO; gpio++) {
-    uint8_t bank = gpio / 32;
-
+    const struct GpioBankMasks* masks = &gpio_masks[bank];
     // For inputs will be set to value of pin.
     // For outputs will use value in config that pin was last set to.
-    uint8_t type;
-    uint8_t index;
-    uint8_t address;
-    bool previous_value;
-    bool new_value;
+    uint32_t sampled = 0;
 
-    get_gpio_config(gpio, &type, &index, &address, &previous_value);
+    if(masks->native_in && !native_sampled) {
+      native_pins = gpio_get_all();
+      native_sampled = true;
+    }
+    for(uint32_t bits = masks->native_in; bits; bits &= bits - 1) {
+      uint8_t bit = __builtin_ctz(bits);
+      uint8_t index = config.gpio[bank * 32 + bit].index;
+      sampled |= ((native_pins >> index) & 0x1u) << bit;
+    }
 
-    switch(type) {
-      case GPIO_TYPE_NATIVE_IN_DEBUG:
-      case GPIO_TYPE_NATIVE_IN:
-        new_value = gpio_local_get_pin(index);
-        if(previous_value != new_value) {
-          to_send[bank] = true;
-          config.gpio_confirmation_pending[bank] = true;
-          // Do not update config here.
-          // Config gets updated on incoming Message_gpio.
-        }
-        break;
-      case GPIO_TYPE_I2C_MCP_IN:
-      case GPIO_TYPE_I2C_MCP_IN_PULLUP:
-        new_value = gpio_i2c_mcp_get_pin(index, address, type == GPIO_TYPE_I2C_MCP_IN_PULLUP);
-        if(previous_value != new_value) {
-          to_send[bank] = true;
-          config.gpio_confirmation_pending[bank] = true;
-        }
-        break;
-      case GPIO_TYPE_I2C_MCP_OUT:
-        new_value = gpio_i2c_mcp_get_pin(index, address, 0);
-        if(previous_value != new_value) {
-          to_send[bank] = true;
-          config.gpio_confirmation_pending[bank] = true;
-        }
-        break;
-      default:
-        // GPIO_TYPE_*_IN.
-        new_value = previous_value;
-        break;
+    // MCP outputs are read back too, so a failed write shows up on the host.
+    for(uint32_t bits = masks->mcp_in | masks->mcp_out; bits; bits &= bits - 1) {
+      uint8_t bit = __builtin_ctz(bits);
+      uint8_t gpio = bank * 32 + bit;
+      uint8_t index = config.gpio[gpio].index;
+      uint8_t data = i2c_gpio.config[gpio_mcp_slot[gpio]].input_data[(index >> 3) & 1];
+      sampled |= (uint32_t)((data >> (index & 7)) & 0x1) << bit;
     }
-    gpio_last_type[gpio] = type;
 
-    values[bank] |= (new_value << (gpio % 32));
+    uint32_t sample_mask = masks->native_in | masks->mcp_in | masks->mcp_out;
+    values[bank] = (config.gpio_values[bank] & ~sample_mask) | sampled;
+    to_send[bank] = values[bank] != config.gpio_values[bank];
+    if(to_send[bank]) {
+      config.gpio_confirmation_pending[bank] = true;
+      // Do not update config here.
+      // Config gets updated on incoming Message_gpio.
+    }
   }
 
   struct Reply_gpio reply;
@@ -246,7 +335,7 @@ void gpio_serialize(struct NWBuffer* tx_buf, size_t* tx_buf_len) {
     *tx_buf_len = pack_nw_buff(tx_buf, &reply, sizeof(reply));
 
     if(! *tx_buf_len) {
-      printf("WARN: TX length greater than buffer size. gpio bank: %u\n", bank);
+      log_event(CORE0, LOG_TX_FULL, REPLY_GPIO, 0);
       return;
     }
   }
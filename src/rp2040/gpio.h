@@ -3,6 +3,9 @@
 
 #include "config.h"
 
+/* Native GPIO on the RP2040. */
+#define NATIVE_GPIO_COUNT 30
+
 extern volatile struct ConfigGlobal config;
 
 /* Updates the GPIO config from CORE0 only.
@@ -23,13 +26,21 @@ void get_gpio_config(
     bool* value
 );
 
-/* Calls handler for all 32 IO pins in the specified bank.
+/* Rebuild the per bank type masks from config.gpio. Call after changing the
+ * type, index or address of any GPIO other than through update_gpio_config().
+ * Allocates an i2c slot for each MCP address. */
+void gpio_update_masks(void);
+
+/* Applies the output pins that changed in the specified bank.
  * Each bit in values represents the value of a pin.
  * Multiple sets of 32 can be set by increasing bank. */
 void gpio_set_values(const uint8_t bank, uint32_t values);
 
 void gpio_local_set_out_pin(uint8_t index, bool new_value);
 
+/* Set the native pins in pin_mask to pin_values in one write. */
+void gpio_local_set_out_pins(uint32_t pin_mask, uint32_t pin_values);
+
 /* Convert I2C address to slot number, allocating a new slot if needed. */
 int gpio_i2c_mcp_alloc(uint8_t address);
 
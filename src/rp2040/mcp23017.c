@@ -1,5 +1,7 @@
 #include <stdbool.h>
 #include <stdio.h>
+#include "config.h"
+#include "event_log.h"
 #include "i2c.h"
 
 #ifdef BUILD_TESTS
@@ -110,7 +112,7 @@ static void i2c_gpio_next_chip(struct i2c_gpio_state *gpio) {
   case I2CGPIO_TYPE_MCP23017:
     if (cfg->needs_config == 1) {
       cfg->needs_config = 2;
-      printf("Reconfig at %02x\n", cfg->i2c_address);
+      log_event(CORE1, LOG_MCP_RECONFIG, cfg->i2c_address, 0);
       i2c_gpio_run_setup_sequence(gpio);
     }
     else if (cfg->needs_config == 0) {
@@ -135,7 +137,7 @@ void i2c_gpio_poll(struct i2c_gpio_state *gpio) {
     return;
   }
   if (i2c_engine_is_fault(&gpio->engine)) {
-    printf("MCP Fault chip=%02x abort=%02x\n", gpio->cur_chip, gpio->engine.abort_reason);
+    log_event(CORE1, LOG_MCP_FAULT, gpio->cur_chip, gpio->engine.abort_reason);
     i2c_engine_clear_fault(&gpio->engine);
     i2c_gpio_run_setup_sequence(gpio);
     i2c_engine_run(&gpio->engine);
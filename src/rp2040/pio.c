@@ -1,7 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
 
 #ifdef BUILD_TESTS
 
@@ -19,11 +18,7 @@
 
 #include "pio.h"
 #include "config.h"
-
-/* PIO instruction cycles consumed by the state machine loop itself (derived
- * from pico_stepper.pio); subtracted when converting step period to PIO len. */
-#define STEP_PIO_LEN_OVERHEAD  9
-#define RP2040_CLOCK_MHZ       133
+#include "event_log.h"
 
 /* Remaining SMs after step_gen, capped at MAX_JOINT (can't count more joints
  * than we move). For MAX_JOINT=4: 4 feedback SMs (current behaviour).
@@ -48,9 +43,12 @@ typedef struct {
     uint32_t sm_count;  /* step_count SM on PIO1; valid only for joint < NUM_FEEDBACK */
     bool     init_done;
     int32_t  last_pos_achieved;
+    int32_t  last_steps_issued;  /* signed steps put to step_gen last period */
     uint32_t last_enabled;
     int32_t  last_velocity_q;
     int32_t  step_accumulator_q;
+    uint8_t  coast_periods;      /* consecutive missed updates extrapolated */
+    struct JointLimits limits;
 } JointPioState;
 
 static JointPioState joint_state[MAX_JOINT];
@@ -59,29 +57,19 @@ static uint32_t offset_pio1_gen   = 0;  /* step_gen on PIO1 (MAX_JOINT > 4 only)
 static uint32_t offset_pio1_count = 0;  /* step_count on PIO1 (NUM_FEEDBACK > 0 only) */
 static uint8_t  programs_loaded   = 0;
 
-void init_pio(const uint32_t joint)
+/* step_count pushes without blocking, so once its RX FIFO is full every later
+ * position is dropped until Core1 drains it. */
+#define STEP_COUNT_FIFO_DEPTH  4
+
+void init_pio(const uint32_t joint, const struct JointCommand* command)
 {
 
   if(joint_state[joint].init_done) {
     return;
   }
 
-  int8_t io_pos_step;
-  int8_t io_pos_dir;
-  get_joint_config(
-      joint,
-      CORE1,
-      NULL,
-      &io_pos_step,
-      &io_pos_dir,
-      NULL,
-      NULL,
-      NULL,
-      NULL,
-      NULL,
-      NULL,
-      NULL
-      );
+  int8_t io_pos_step = command->io_pos_step;
+  int8_t io_pos_dir = command->io_pos_dir;
 
   if(io_pos_step < 0 || io_pos_step >= 32) {
     printf("WARN: Joint %u step io pin is out of range: %i\n", joint, io_pos_step);
@@ -171,14 +159,24 @@ int32_t drain_rx_fifo(uint32_t sm, int32_t current_pos) {
     return current_pos;
 }
 
+/* Shortest step_len calculate_step_len() may return, so a joint never steps
+ * faster than max_vel_q. Returns INT32_MIN, i.e. no floor, for
+ * max_vel_q <= 0: "no max-velocity configured yet", so the default config
+ * does not block stepping before the first MSG_SET_JOINT_CONFIG packet. */
+int32_t min_step_len(int32_t period_ticks, int32_t max_vel_q) {
+    if (max_vel_q <= 0) {
+        return INT32_MIN;
+    }
+    return (int32_t)((int64_t)period_ticks * 65536
+                     / ((int64_t)max_vel_q << 1) - STEP_PIO_LEN_OVERHEAD);
+}
+
 /* Compute the PIO step-timer length in clock ticks.
  * Returns 0 only for step_count_q <= 0 (no motion).
  * Velocities below 1 step/period are capped at max_len so the step fits within
  * one servo period; plan_steps spaces them out via its accumulator.
- * max_vel_q <= 0 means "no max-velocity configured yet"; min_len clamping is
- * skipped so the default config does not block stepping before the first
- * MSG_SET_JOINT_CONFIG packet arrives. */
-int32_t calculate_step_len(int32_t step_count_q, int32_t period_ticks, int32_t max_vel_q) {
+ * min_len is min_step_len() for the joint's max_vel_q. */
+int32_t calculate_step_len(int32_t step_count_q, int32_t period_ticks, int32_t min_len) {
     if (step_count_q <= 0) {
         return 0;
     }
@@ -191,13 +189,8 @@ int32_t calculate_step_len(int32_t step_count_q, int32_t period_ticks, int32_t m
     int32_t v_ceil = (step_count_q + 65535) >> 16;
     int32_t len    = period_ticks / (2 * v_ceil) - STEP_PIO_LEN_OVERHEAD;
     if (len > max_len) len = max_len;
-    if (max_vel_q > 0) {
-        int32_t min_len = (int32_t)((int64_t)period_ticks * 65536
-                                    / ((int64_t)max_vel_q << 1) - STEP_PIO_LEN_OVERHEAD);
-        int32_t clamped = len < min_len ? min_len : len;
-        return clamped > max_len ? max_len : clamped;
-    }
-    return len;
+    int32_t clamped = len < min_len ? min_len : len;
+    return clamped > max_len ? max_len : clamped;
 }
 
 /* Clamp velocity change to at most max_accel_q per period.
@@ -252,80 +245,163 @@ static void issue_pio_step(uint32_t joint, int32_t step_len_ticks,
     }
 }
 
-/* Compute the commanded velocity (steps/s) for this period.
+/* Floor of the square root of value. */
+uint32_t isqrt64(uint64_t value) {
+    uint64_t root = 0;
+    uint64_t bit  = (uint64_t)1 << 62;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+/* value * factor_q32 / 2^32, rounded toward zero and saturated to int64.
+ * factor_q32 is unsigned Q32.32. */
+static int64_t mul_q32(int64_t value, uint64_t factor_q32) {
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    uint64_t v_hi = magnitude >> 32, v_lo = (uint32_t)magnitude;
+    uint64_t f_hi = factor_q32 >> 32, f_lo = (uint32_t)factor_q32;
+
+    uint64_t high = v_hi * f_hi;
+    uint64_t product = (v_lo * f_lo) >> 32;
+    bool overflow = high >= ((uint64_t)1 << 31);
+    overflow |= __builtin_add_overflow(product, high << 32, &product);
+    overflow |= __builtin_add_overflow(product, v_hi * f_lo, &product);
+    overflow |= __builtin_add_overflow(product, v_lo * f_hi, &product);
+    if (overflow || product > INT64_MAX) {
+        return value < 0 ? -INT64_MAX : INT64_MAX;
+    }
+    return value < 0 ? -(int64_t)product : (int64_t)product;
+}
+
+/* Largest Q32.32 factor joint_limits_refresh() will store. */
+#define MAX_GAIN  2147483648.0
+
+static uint64_t to_q32(double factor) {
+    if (!(factor > 0.0)) {
+        return 0;
+    }
+    if (factor >= MAX_GAIN) {
+        factor = MAX_GAIN;
+    }
+    return (uint64_t)(factor * 4294967296.0 + 0.5);
+}
+
+bool joint_limits_refresh(
+    struct JointLimits* limits, uint32_t period_us, double max_velocity, double max_accel)
+{
+  /* Compare bit patterns: equality on doubles is a soft-float call. */
+  if (limits->period_us == period_us
+      && memcmp(&limits->max_velocity, &max_velocity, sizeof(max_velocity)) == 0
+      && memcmp(&limits->max_accel, &max_accel, sizeof(max_accel)) == 0) {
+    return false;
+  }
+  limits->period_us    = period_us;
+  limits->max_velocity = max_velocity;
+  limits->max_accel    = max_accel;
+
+  double period = (double)period_us;
+  /* Accel is steps/s²; convert to Q16.16 steps/period/period → multiply by period_s². */
+  double period_s = period * 1e-6;
+  limits->period_ticks  = (int32_t)((int64_t)period_us * RP2040_CLOCK_MHZ);
+  limits->max_vel_q     = (int32_t)((max_velocity / period) * 65536.0 * VEL_HEADROOM);
+  limits->min_step_len  = min_step_len(limits->period_ticks, limits->max_vel_q);
+  limits->max_accel_q   = (int32_t)(max_accel * period_s * period_s * 65536.0);
+  limits->clamp_accel_q = (int32_t)(limits->max_accel_q * ACCEL_HEADROOM);
+
+  /* Kp of 0.5 (position) and 0.01 (velocity) per period at 1000µs, as
+   * fractions of the error to close per period at this period. */
+  limits->pos_gain_q32 = to_q32(0.5e6 / (period * period));
+  limits->vel_gain_q32 = to_q32(0.01e6 / (period * period));
+  /* Any positive max_accel caps, however small. */
+  limits->cap_gain_q32 = to_q32(2.0 * max_accel / (period * period));
+  if (max_accel > 0.0 && limits->cap_gain_q32 == 0) {
+    limits->cap_gain_q32 = 1;
+  }
+  return true;
+}
+
+/* Compute the commanded velocity (Q16.16 steps/period) for this period.
  *
  * In position mode: vel_ff + Kp*error, with a 1-step dead zone.
- * The correction is capped to sqrt(2*max_accel*|error|) steps/s so the motor
- * can always decelerate to rest within the remaining error distance (bang-bang
+ * The correction is capped to sqrt(2*max_accel*|error|) so the motor can
+ * always decelerate to rest within the remaining error distance (bang-bang
  * stopping profile).  Without this cap, large errors after emergency decel
  * produce a correction that saturates clamp_accel every period — limit cycle.
- * Returns 0.0 when disabled or no new Core0 data (underrun/network loss). */
-double compute_velocity_cmd(
+ * Works in Q32.32 steps/period and truncates toward zero once at the end.
+ * Returns 0 when disabled or no new Core0 data (underrun/network loss). */
+int32_t compute_velocity_cmd(
     uint8_t  cmd_type,
-    double   velocity_requested,
-    double   abs_pos_requested,
+    int32_t  velocity_requested_q,
+    int64_t  abs_pos_requested_q,
     int32_t  abs_pos_achieved,
     uint8_t  enabled,
     uint32_t updated,
-    uint32_t update_period_us,
-    double   max_accel)
+    const struct JointLimits* limits)
 {
-  if (cmd_type == JOINT_CMD_POSITION) {
-    double vel_ff      = velocity_requested;
-    double error_steps = abs_pos_requested - (double)abs_pos_achieved;
-    double correction  = 0.0;
-    if (error_steps >= 1.0 || error_steps <= -1.0) {
-      correction = error_steps * (1.0e6 / (double)update_period_us) * 0.5;
-      if (max_accel > 0.0) {
-        double max_correction = sqrt(2.0 * max_accel * fabs(error_steps));
-        if (correction >  max_correction) correction =  max_correction;
-        if (correction < -max_correction) correction = -max_correction;
+  if (!enabled || updated == 0) {
+    return 0;
+  }
+  int64_t error_q32;
+  if (__builtin_sub_overflow(abs_pos_requested_q, (int64_t)abs_pos_achieved * 4294967296, &error_q32)) {
+    error_q32 = abs_pos_requested_q < 0 ? -INT64_MAX : INT64_MAX;
+  }
+  int64_t correction_q32 = 0;
+  if (error_q32 >= ((int64_t)1 << 32) || error_q32 <= -((int64_t)1 << 32)) {
+    if (cmd_type == JOINT_CMD_POSITION) {
+      correction_q32 = mul_q32(error_q32, limits->pos_gain_q32);
+      if (limits->cap_gain_q32) {
+        /* sqrt(k * |error|) in Q16.16 is isqrt of k * |error| in Q32.32. */
+        int64_t radicand = mul_q32(error_q32 < 0 ? -error_q32 : error_q32, limits->cap_gain_q32);
+        int64_t max_correction_q32 = (int64_t)isqrt64((uint64_t)radicand) << 16;
+        if (correction_q32 >  max_correction_q32) correction_q32 =  max_correction_q32;
+        if (correction_q32 < -max_correction_q32) correction_q32 = -max_correction_q32;
       }
-    }
-    velocity_requested = vel_ff + correction;
-  } else {
-    /* Velocity mode: gentle position correction to prevent drift accumulation.
-     * Pure velocity mode has no feedback — any systematic step-rate undershoot
-     * (e.g. from update_period_us bias or dropped periods) accumulates without
-     * bound.  Kp = 0.01× of position-mode gain limits steady-state lag to
-     * ~50× the per-period undershoot without fighting the trajectory planner. */
-    double error_steps = abs_pos_requested - (double)abs_pos_achieved;
-    if (error_steps >= 1.0 || error_steps <= -1.0) {
-      velocity_requested += error_steps * (1.0e6 / (double)update_period_us) * 0.01;
+    } else {
+      /* Velocity mode: gentle position correction to prevent drift accumulation.
+       * Pure velocity mode has no feedback — any systematic step-rate undershoot
+       * (e.g. from update_period_us bias or dropped periods) accumulates without
+       * bound.  Kp = 0.01× of position-mode gain limits steady-state lag to
+       * ~50× the per-period undershoot without fighting the trajectory planner. */
+      correction_q32 = mul_q32(error_q32, limits->vel_gain_q32);
     }
   }
-  if (!enabled || updated == 0) {
-    velocity_requested = 0.0;
+  /* |correction_q32| < 2^63 and |velocity| < 2^47 in Q32.32: the sum only
+   * overflows by being far out of int32 range, so saturate either way. */
+  int64_t velocity_q32;
+  if (__builtin_add_overflow(correction_q32, (int64_t)velocity_requested_q * 65536, &velocity_q32)) {
+    velocity_q32 = correction_q32 < 0 ? -INT64_MAX : INT64_MAX;
   }
-  return velocity_requested;
+  int64_t velocity_q = velocity_q32 / 65536;
+  if (velocity_q > INT32_MAX) return INT32_MAX;
+  if (velocity_q < -INT32_MAX) return -INT32_MAX;
+  return (int32_t)velocity_q;
 }
 
 /* Generate step counts and send to PIOs. */
-uint8_t do_steps(const uint8_t joint) {
+uint8_t do_steps(
+    const uint8_t joint,
+    const struct JointCommand* command,
+    uint32_t updated,
+    struct JointFeedback* feedback)
+{
   uint32_t update_period_us = get_period();
 
-  uint8_t enabled;
-  int32_t abs_pos_achieved = 0;
-  double velocity_requested;
-  double abs_pos_requested;
-  double max_velocity;
-  double max_accel;
-  uint8_t cmd_type;
-  int32_t velocity_achieved = 0;
-  uint32_t updated = get_joint_config(
-      joint,
-      CORE1,
-      &enabled,
-      NULL,
-      NULL,
-      &velocity_requested,
-      &abs_pos_requested,
-      &abs_pos_achieved,
-      &max_velocity,
-      &max_accel,
-      NULL,  // &velocity_achieved
-      &cmd_type
-      );
+  uint8_t enabled = command->enabled;
+  int32_t abs_pos_achieved = feedback->abs_pos_achieved;
+  int32_t vel_ff_q = command->velocity_requested_q;
+  int64_t abs_pos_requested_q = command->abs_pos_requested_q;
+  uint8_t cmd_type = command->cmd_type;
+  feedback->enabled = enabled;
 
   if(update_period_us == 0) {
     /* Period unknown: can't compute step timing. */
@@ -334,6 +410,22 @@ uint8_t do_steps(const uint8_t joint) {
     }
     return 0;
   }
+  struct JointLimits* limits = &joint_state[joint].limits;
+  joint_limits_refresh(limits, update_period_us, command->max_velocity, command->max_accel);
+
+  /* With MSG_SET_JOINT_COAST the driver has asked for a missing update to be
+   * treated as a lost packet. Extrapolate the last setpoint for up to
+   * get_coast_periods() periods rather than decelerating; the next setpoint
+   * is absolute, so the feedback loop takes up any difference. */
+  if(updated) {
+    joint_state[joint].coast_periods = 0;
+  } else if(enabled && joint_state[joint].coast_periods < get_coast_periods()) {
+    joint_state[joint].coast_periods++;
+    abs_pos_requested_q +=
+      (int64_t)vel_ff_q * 65536 * joint_state[joint].coast_periods;
+    updated = 1;
+  }
+
   if(updated == 0 && joint_state[joint].last_velocity_q == 0) {
     /* No new Core0 data and already at rest: nothing to compute. */
     if (pio_sm_is_tx_fifo_empty(JOINT_PIO(joint), joint_state[joint].sm_gen)) {
@@ -345,33 +437,44 @@ uint8_t do_steps(const uint8_t joint) {
   if(joint < NUM_FEEDBACK) {
     /* Read step_count FIFO before computing velocity correction so
      * compute_velocity_cmd sees the current-period position, not the
-     * stale value written to config at the end of the previous period. */
+     * stale value left in feedback at the end of the previous period. */
+    bool overflowed =
+      pio_sm_get_rx_fifo_level(pio1, joint_state[joint].sm_count) >= STEP_COUNT_FIFO_DEPTH;
     abs_pos_achieved = drain_rx_fifo(joint_state[joint].sm_count, abs_pos_achieved);
+    /* A full FIFO holds the positions of the first few steps since the last
+     * drain; the pushes after those were dropped. The last one drained is
+     * still a true hardware position, so build on it with only the steps
+     * issued last period that came after it. Any difference between the plan
+     * and the steps step_gen emitted then lasts one period rather than
+     * building up. */
+    if(overflowed) {
+      int32_t issued = joint_state[joint].last_steps_issued;
+      int32_t unseen = abs(issued) - STEP_COUNT_FIFO_DEPTH;
+      if(unseen > 0) {
+        abs_pos_achieved += issued > 0 ? unseen : -unseen;
+      }
+    }
   }
 
-  double vel_ff = velocity_requested;  /* save before correction is added */
-  velocity_requested = compute_velocity_cmd(
-      cmd_type, velocity_requested, abs_pos_requested, abs_pos_achieved,
-      enabled, updated, update_period_us, max_accel);
-
-  /* Use the EMA-measured inter-packet interval for step-count conversion so that
-   * crystal-frequency disagreement between host and RP is automatically tracked.
-   * VEL_HEADROOM on max_vel_q gives the correction term room to act at full speed
-   * even when update_period_us is biased slightly above SERVO_PERIOD_US by jitter. */
-  int32_t velocity_q   = (int32_t)((velocity_requested / (double)update_period_us) * 65536.0);
-  int32_t vel_ff_q     = (int32_t)((vel_ff / (double)update_period_us) * 65536.0);
-  int32_t max_vel_q    = (int32_t)((max_velocity / (double)update_period_us) * 65536.0 * VEL_HEADROOM);
-  /* Accel is steps/s²; convert to Q16.16 steps/period/period → multiply by period_s². */
-  double  period_s     = (double)update_period_us * 1e-6;
-  int32_t max_accel_q  = (int32_t)(max_accel * period_s * period_s * 65536.0);
-  int32_t clamp_accel_q = (int32_t)(max_accel_q * ACCEL_HEADROOM);
-  int32_t period_ticks = (int32_t)((int64_t)update_period_us * RP2040_CLOCK_MHZ);
+  int32_t velocity_q = compute_velocity_cmd(
+      cmd_type, vel_ff_q, abs_pos_requested_q, abs_pos_achieved,
+      enabled, updated, limits);
+
+  /* Step timing uses the EMA-measured inter-packet interval (limits->period_ticks)
+   * so that crystal-frequency disagreement between host and RP is automatically
+   * tracked. VEL_HEADROOM on max_vel_q gives the correction term room to act at
+   * full speed even when update_period_us is biased slightly above
+   * SERVO_PERIOD_US by jitter. */
+  int32_t period_ticks = limits->period_ticks;
+  /* Error in whole steps, rounded toward zero. */
+  int32_t err_int = (int32_t)((abs_pos_requested_q - (int64_t)abs_pos_achieved * 4294967296)
+                              / 4294967296);
 
   if(enabled != joint_state[joint].last_enabled) {
     joint_state[joint].last_enabled = enabled;
     if(enabled) {
-      printf("J%u enab\n", joint);
-      init_pio(joint);
+      log_event(CORE1, LOG_JOINT_ENABLED, joint, 0);
+      init_pio(joint, command);
       // Snap to commanded velocity when stopped so we don't ramp from zero
       // when LinuxCNC is already moving (joint enabled before motion started).
       // When last_velocity_q is non-zero the joint is mid-deceleration (network
@@ -381,26 +484,29 @@ uint8_t do_steps(const uint8_t joint) {
         joint_state[joint].last_velocity_q = velocity_q;
       }
     } else {
-      printf("J%u disab\n", joint);
+      log_event(CORE1, LOG_JOINT_DISABLED, joint, 0);
     }
   }
 
-  velocity_q = clamp_accel(velocity_q, joint_state[joint].last_velocity_q, clamp_accel_q);
+  velocity_q = clamp_accel(velocity_q, joint_state[joint].last_velocity_q, limits->clamp_accel_q);
 
   /* Stopping-profile cap: ensure the motor can decelerate to vel_ff within the
    * remaining distance to target.  Formula: |v| ≤ vel_ff + sqrt(2·a·|error|).
    * When vel_ff=0 this is the classic bang-bang stopping guarantee.
    * When vel_ff>0 (active jog or G-code move) the extra headroom prevents the
    * cap from interfering with normal tracking. */
-  if (cmd_type == JOINT_CMD_POSITION && max_accel_q > 0 && enabled && updated) {
-    int32_t err_int = (int32_t)(abs_pos_requested - (double)abs_pos_achieved);
+  if (cmd_type == JOINT_CMD_POSITION && limits->max_accel_q > 0 && enabled && updated) {
     if (err_int != 0 && (int64_t)velocity_q * err_int > 0) {
-      int32_t sqrt_term = (int32_t)sqrt(
-          2.0 * (double)max_accel_q * (double)abs(err_int) * 65536.0);
+      uint64_t radicand;
+      int64_t sqrt_term = INT32_MAX;
+      if (!__builtin_mul_overflow((uint64_t)limits->max_accel_q * 131072,
+                                  (uint64_t)abs(err_int), &radicand)) {
+        sqrt_term = isqrt64(radicand);
+      }
       if (err_int > 0 && velocity_q > vel_ff_q + sqrt_term)
-        velocity_q = vel_ff_q + sqrt_term;
+        velocity_q = (int32_t)(vel_ff_q + sqrt_term);
       if (err_int < 0 && velocity_q < vel_ff_q - sqrt_term)
-        velocity_q = vel_ff_q - sqrt_term;
+        velocity_q = (int32_t)(vel_ff_q - sqrt_term);
     }
   }
 
@@ -409,8 +515,7 @@ uint8_t do_steps(const uint8_t joint) {
    * velocity after the final correction step; the Bresenham accumulator drains
    * it into an overshoot step. */
   if (cmd_type == JOINT_CMD_POSITION && vel_ff_q == 0 && enabled && updated) {
-    int32_t err_snap = (int32_t)(abs_pos_requested - (double)abs_pos_achieved);
-    if (err_snap == 0) {
+    if (err_int == 0) {
       velocity_q = 0;
       joint_state[joint].step_accumulator_q = 0;
     }
@@ -424,24 +529,19 @@ uint8_t do_steps(const uint8_t joint) {
     if (pio_sm_is_tx_fifo_empty(JOINT_PIO(joint), joint_state[joint].sm_gen)) {
       pio_sm_put(JOINT_PIO(joint), joint_state[joint].sm_gen, 0);
     }
-    velocity_achieved = 0;  /* velocity_q == 0: joint has stopped */
-    update_joint_config(
-        joint, CORE1,
-        NULL, NULL, NULL, NULL, NULL,
-        &abs_pos_achieved,
-        NULL, NULL,
-        &velocity_achieved,
-        NULL);
+    feedback->abs_pos_achieved = abs_pos_achieved;
+    feedback->velocity_achieved = 0;  /* velocity_q == 0: joint has stopped */
     joint_state[joint].last_pos_achieved = abs_pos_achieved;
+    joint_state[joint].last_steps_issued = 0;
     return 0;
   }
 
   int32_t step_count_q  = abs(velocity_q);
-  int32_t step_len_ceil = calculate_step_len(step_count_q, period_ticks, max_vel_q);
+  int32_t step_len_ceil = calculate_step_len(step_count_q, period_ticks, limits->min_step_len);
   int32_t n_steps       = plan_steps(velocity_q, joint, period_ticks, step_len_ceil);
   /* Derive step_len for the exact n_steps this period (floor or ceil of v),
    * so the PIO pulse rate matches the intended physical step count. */
-  int32_t step_len_ticks = calculate_step_len(n_steps * 65536, period_ticks, max_vel_q);
+  int32_t step_len_ticks = calculate_step_len(n_steps * 65536, period_ticks, limits->min_step_len);
 
   uint32_t direction = (velocity_q > 0);
 
@@ -458,23 +558,11 @@ uint8_t do_steps(const uint8_t joint) {
   /* Report Q16.16 internal velocity so the driver can detect velocity_q==0
    * exactly.  Integer step-delta aliased to 0 at low speed (<1 step/period),
    * causing premature network-recovery detection on the driver side. */
-  velocity_achieved = velocity_q;
-
-  update_joint_config(
-      joint,
-      CORE1,
-      NULL,
-      NULL,
-      NULL,
-      NULL,
-      NULL,
-      &abs_pos_achieved,
-      NULL,
-      NULL,
-      &velocity_achieved,
-      NULL);
+  feedback->abs_pos_achieved = abs_pos_achieved;
+  feedback->velocity_achieved = velocity_q;
 
   joint_state[joint].last_pos_achieved  = abs_pos_achieved;
+  joint_state[joint].last_steps_issued  = (direction ? 1 : -1) * n_steps;
 
   return enabled ? updated : 0;
 }
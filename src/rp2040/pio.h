@@ -1,8 +1,11 @@
 #ifndef PIO__H
 #define PIO__H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "config.h"
+
 /* Allow firmware to accelerate slightly faster than LinuxCNC's ramp rate so
  * integer truncation of max_accel_q never causes systematic tracking lag. */
 #define ACCEL_HEADROOM 1.1
@@ -21,30 +24,67 @@
  * correction steps when vel-cmd is at its limit. */
 #define VEL_HEADROOM 1.01
 
+/* PIO instruction cycles step_gen spends outside its delay loops in each half
+ * of a step (derived from pico_stepper.pio): a step of length len takes
+ * 2 * (len + STEP_PIO_LEN_OVERHEAD) cycles. Subtracted when converting step
+ * period to PIO len. */
+#define STEP_PIO_LEN_OVERHEAD  9
+#define RP2040_CLOCK_MHZ       133
+
 /* Initialize PIO state machines for a joint.
  * Always sets up a step_gen SM on the appropriate PIO block.
  * Also sets up a step_count SM on PIO1 for joints 0..NUM_FEEDBACK-1.
  */
-void init_pio(const uint32_t joint);
+void init_pio(const uint32_t joint, const struct JointCommand* command);
+
+/* A joint's limits in the units do_steps() works in: Q16.16 steps per period
+ * for velocity, Q16.16 steps per period per period for acceleration, PIO clock
+ * ticks for time. Derived from JointCommand's max_velocity and max_accel and
+ * the period by joint_limits_refresh(), which does the floating point once per
+ * change so the per-period path is integer only. */
+struct JointLimits {
+  uint32_t period_us;       // Period the rest were derived for. 0 = never.
+  double   max_velocity;    // JointCommand values the rest were derived from.
+  double   max_accel;
+  int32_t  period_ticks;
+  int32_t  max_vel_q;       // Including VEL_HEADROOM.
+  int32_t  min_step_len;    // Shortest step_len at max_vel_q. See min_step_len().
+  int32_t  max_accel_q;
+  int32_t  clamp_accel_q;   // Including ACCEL_HEADROOM.
+  uint64_t pos_gain_q32;    // Position mode correction per step of error. Q32.32.
+  uint64_t vel_gain_q32;    // Velocity mode correction per step of error. Q32.32.
+  uint64_t cap_gain_q32;    // 2 * max_accel / period². Q32.32. 0 = no cap.
+};
 
-/* Compute the commanded velocity (steps/s) for this period.
+/* Re-derive limits if period_us, max_velocity or max_accel differ from what
+ * they were derived for. Returns true if they did. */
+bool joint_limits_refresh(
+    struct JointLimits* limits, uint32_t period_us, double max_velocity, double max_accel);
+
+/* Compute the commanded velocity (Q16.16 steps/period) for this period.
  * Applies the position controller (position mode) and collapses to 0 when
  * disabled or when no new Core0 data is available (underrun / network loss).
- * max_accel (steps/s²) caps the position correction to sqrt(2*max_accel*|error|)
- * — the bang-bang stopping profile — so the motor can always decelerate to rest
- * within the remaining error distance.  Pass 0.0 to disable the cap. */
-double compute_velocity_cmd(
+ * A non-zero limits->cap_gain_q32 caps the position correction to
+ * sqrt(2*max_accel*|error|) — the bang-bang stopping profile — so the motor
+ * can always decelerate to rest within the remaining error distance. */
+int32_t compute_velocity_cmd(
     uint8_t  cmd_type,
-    double   velocity_requested,
-    double   abs_pos_requested,
+    int32_t  velocity_requested_q,
+    int64_t  abs_pos_requested_q,
     int32_t  abs_pos_achieved,
     uint8_t  enabled,
     uint32_t updated,
-    uint32_t update_period_us,
-    double   max_accel);
+    const struct JointLimits* limits);
 
-/* Generate step counts and send to PIOs. */
-uint8_t do_steps(const uint8_t joint);
+/* Generate step counts for one period of command and send to PIOs.
+ * updated is non-zero if command came with a packet Core1 has not yet acted
+ * on. feedback holds the joint's state from the previous period and is
+ * updated in place. */
+uint8_t do_steps(
+    const uint8_t joint,
+    const struct JointCommand* command,
+    uint32_t updated,
+    struct JointFeedback* feedback);
 
 int32_t clamp_accel(int32_t velocity_q, int32_t last_velocity_q, int32_t max_accel_q);
 
@@ -54,7 +94,9 @@ void pio_reset_for_test(void);
 
 /* Exposed for unit testing only. */
 int32_t drain_rx_fifo(uint32_t sm, int32_t current_pos);
-int32_t calculate_step_len(int32_t step_count_q, int32_t period_ticks, int32_t max_vel_q);
+int32_t min_step_len(int32_t period_ticks, int32_t max_vel_q);
+int32_t calculate_step_len(int32_t step_count_q, int32_t period_ticks, int32_t min_len);
+uint32_t isqrt64(uint64_t value);
 int32_t plan_steps(int32_t velocity_q, uint8_t joint, int32_t period_ticks, int32_t step_len);
 #endif  // BUILD_TESTS
 
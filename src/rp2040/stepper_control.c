@@ -28,10 +28,14 @@
 
 
 /* Network */
+#ifndef BOARD_INDEX
+#define BOARD_INDEX 0
+#endif
+
 static wiz_NetInfo g_net_info =
     {
-        .mac = {0x00, 0x08, 0xDC, 0x12, 0x34, 0x56}, // MAC address
-        .ip = {192, 168, 12, 2},                     // IP address
+        .mac = {0x00, 0x08, 0xDC, 0x12, 0x34, 0x56 + BOARD_INDEX}, // MAC address
+        .ip = {192, 168, 12, 2 + BOARD_INDEX},       // IP address
         .sn = {255, 255, 255, 0},                    // Subnet Mask
         .gw = {192, 168, 12, 1},                     // Gateway
         .dns = {8, 8, 8, 8},                         // DNS server
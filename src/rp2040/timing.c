@@ -22,6 +22,14 @@ static uint32_t last_period_us    = 0;
 static uint64_t time_last         = 0;
 static bool     time_initialized  = false;
 static alarm_id_t tick_alarm      = -1;
+static uint64_t tick_scheduled_us = 0;      // Fire time given to the last add_alarm_at().
+
+/* MSG_TICK_SYNC target for the next recover_clock(), and the phase error
+ * found applying it, for REPLY_TICK_SYNC. */
+static bool     target_pending      = false;
+static uint64_t target_us           = 0;
+static bool     phase_error_pending = false;
+static int32_t  phase_error_us      = 0;
 
 /* Hardware alarm ISR — increments Core1's tick semaphore.
  * Negative return tells the SDK to reschedule from the scheduled fire time
@@ -36,10 +44,49 @@ static int64_t tick_alarm_callback(alarm_id_t id, void *user_data) {
 void timing_init(void) {
     uint32_t period_us = ave_period_us_x64 >> 6;
     last_period_us     = period_us;
-    absolute_time_t fire_at = from_us_since_boot(time_us_64() + period_us / 4);
+    tick_scheduled_us  = time_us_64() + period_us / 4;
+    absolute_time_t fire_at = from_us_since_boot(tick_scheduled_us);
     tick_alarm = add_alarm_at(fire_at, tick_alarm_callback, NULL, true);
 }
 
+void timing_set_target(uint64_t rp_target_us) {
+    target_us      = rp_target_us;
+    target_pending = true;
+}
+
+bool timing_take_phase_error(int32_t* error_us) {
+    if (!phase_error_pending) {
+        return false;
+    }
+    phase_error_pending = false;
+    *error_us = phase_error_us;
+    return true;
+}
+
+/* Move target_us by whole periods to the first tick after time_now, and
+ * record how far the free running tick was from that grid. */
+static uint64_t align_to_target(uint64_t time_now, uint32_t period_us) {
+    int64_t ahead = (int64_t)(target_us - time_now);
+    uint64_t fire_at_us = target_us;
+    if (ahead <= 0) {
+        fire_at_us += ((uint64_t)(-ahead) / period_us + 1) * period_us;
+    } else if (ahead > (int64_t)period_us) {
+        fire_at_us -= ((uint64_t)(ahead - 1) / period_us) * period_us;
+    }
+
+    /* The alarm reschedules itself every period from tick_scheduled_us, so
+     * its ticks lie on that grid. Wrap the difference to ±period/2. */
+    int64_t error = (int64_t)(tick_scheduled_us - fire_at_us) % (int64_t)period_us;
+    if (error >= (int64_t)(period_us + 1) / 2) {
+        error -= period_us;
+    } else if (error < -(int64_t)period_us / 2) {
+        error += period_us;
+    }
+    phase_error_us      = (int32_t)error;
+    phase_error_pending = true;
+    return fire_at_us;
+}
+
 /* Called after every received packet.
  * Updates the EMA of inter-packet period; calls update_period when the
  * integer-µs average changes.  Phase-locks the tick alarm to the packet
@@ -77,14 +124,21 @@ void recover_clock(void) {
         last_period_us = period_us;
     }
 
-    /* Phase-lock: reschedule tick from this packet's arrival time + period/4.
+    /* Phase-lock: reschedule tick from this packet's arrival time + period/4,
+     * or onto the driver's shared timebase if the packet carried a target.
      * Cancelling and rescheduling a one-shot alarm on every packet does not
      * starve Core1 (unlike restarting a repeating timer), because the fire
      * time is an absolute value rather than a countdown from now. */
+    uint64_t fire_at_us = time_now + period_us / 4;
+    if (target_pending) {
+        target_pending = false;
+        fire_at_us = align_to_target(time_now, period_us);
+    }
     if (tick_alarm >= 0) {
         cancel_alarm(tick_alarm);
     }
-    absolute_time_t fire_at = from_us_since_boot(time_now + period_us / 4);
+    tick_scheduled_us = fire_at_us;
+    absolute_time_t fire_at = from_us_since_boot(fire_at_us);
     tick_alarm = add_alarm_at(fire_at, tick_alarm_callback, NULL, true);
 }
 
@@ -95,5 +149,10 @@ void timing_reset_for_test(void) {
     time_last         = 0;
     time_initialized  = false;
     tick_alarm        = -1;
+    tick_scheduled_us = 0;
+    target_pending      = false;
+    target_us           = 0;
+    phase_error_pending = false;
+    phase_error_us      = 0;
 }
 #endif
@@ -1,6 +1,9 @@
 #ifndef TIMING__H
 #define TIMING__H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 /* Set up the hardware repeating timer that drives Core1's tick semaphore.
  * Must be called once from core0_main() before entering the packet loop. */
 void timing_init(void);
@@ -11,6 +14,14 @@ void timing_init(void);
  * arrival time + period/4 on every call to keep overrun/underrun symmetric. */
 void recover_clock(void);
 
+/* MSG_TICK_SYNC: have the next recover_clock() put the tick on the grid of
+ * periods through rp_target_us rather than at arrival + period/4. */
+void timing_set_target(uint64_t rp_target_us);
+
+/* Phase error found by the last recover_clock() that applied a target, in µs.
+ * Returns false if there is none not yet taken. */
+bool timing_take_phase_error(int32_t* error_us);
+
 #ifdef BUILD_TESTS
 /* Reset all static state — used by test setup fixtures only. */
 void timing_reset_for_test(void);
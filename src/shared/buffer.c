@@ -1,15 +1,50 @@
 #include "buffer.h"
+#include <stdbool.h>
 #include <stdio.h>
 
 size_t aligned32(size_t input) {
   return input + 3 - ((input - 1) % 4);
 }
 
+/* Largest payload the other end of the link can receive. Packing stops here
+ * even though every NWBuffer has room for NW_BUF_LEN. */
+static size_t nw_buf_limit = NW_BUF_LEN_LEGACY;
+
+/* Set the payload limit once the peer's buffer size is known.
+ * Clamped to NW_BUF_LEN_LEGACY..NW_BUF_LEN; returns the limit applied. */
+size_t nw_buff_set_limit(size_t limit) {
+  if(limit < NW_BUF_LEN_LEGACY) {
+    limit = NW_BUF_LEN_LEGACY;
+  }
+  if(limit > NW_BUF_LEN) {
+    limit = NW_BUF_LEN;
+  }
+  nw_buf_limit = limit;
+  return limit;
+}
+
+size_t nw_buff_limit(void) {
+  return nw_buf_limit;
+}
+
+/* Set once FEATURE_CRC32 is negotiated: every packet sent will be sealed with
+ * seal_nw_buff_crc32(), so the additive checksum is not kept. */
+static bool nw_buf_crc32 = false;
+
+/* While enabled, pack_nw_buff() leaves the additive checksum at 0 and keeps
+ * NW_CRC32_LEN free below the limit so the seal always fits. A buffer packed
+ * while enabled must be sealed. Returns the mode applied. */
+bool nw_buff_set_crc32(bool enabled) {
+  nw_buf_crc32 = enabled;
+  return enabled;
+}
+
 size_t pack_nw_buff(struct NWBuffer* buffer, void* new_data, size_t new_data_len) {
   // 32bit align value.
   size_t new_data_len_aligned = aligned32(new_data_len);
 
-  if(buffer->length + new_data_len_aligned > NW_BUF_LEN) {
+  size_t limit = nw_buf_crc32 ? nw_buf_limit - NW_CRC32_LEN : nw_buf_limit;
+  if(buffer->length + new_data_len_aligned > limit) {
     // Buffer full.
     return 0;
   }
@@ -21,8 +56,10 @@ size_t pack_nw_buff(struct NWBuffer* buffer, void* new_data, size_t new_data_len
   memset(buffer->payload + buffer->length, 0, new_data_len_aligned);
   memcpy(buffer->payload + buffer->length, new_data, new_data_len);
 
-  buffer->checksum = checksum(
-      buffer->checksum, buffer->length, buffer->length + new_data_len_aligned, buffer->payload);
+  if(!nw_buf_crc32) {
+    buffer->checksum = checksum(
+        buffer->checksum, buffer->length, buffer->length + new_data_len_aligned, buffer->payload);
+  }
   buffer->length += new_data_len_aligned;
 
   return new_data_len_aligned;
@@ -65,8 +102,28 @@ void* unpack_nw_buff(
   return data_p;
 }
 
-/* Calculate checksum and compare to the checksum stored in the NW data. */
+/* Calculate checksum and compare to the checksum stored in the NW data.
+ * A packet sealed with seal_nw_buff_crc32() is checked against its CRC-32
+ * trailer instead; on success the flag and trailer are stripped from length so
+ * the payload parses the same as an unsealed one. */
 size_t checkNWBuff(struct NWBuffer* buffer) {
+  if(buffer->length & NW_LENGTH_CRC32) {
+    size_t length = nw_buff_len(buffer);
+    if(length < NW_CRC32_LEN || length > NW_BUF_LEN) {
+      return 0;
+    }
+    length -= NW_CRC32_LEN;
+
+    uint32_t trailer;
+    memcpy(&trailer, buffer->payload + length, sizeof(trailer));
+    if(trailer != crc32(0, 0, length, buffer->payload)) {
+      // CRC failure.
+      return 0;
+    }
+    buffer->length = length;
+    return 1;
+  }
+
   uint16_t cs = 0;
   if(buffer->checksum != checksum(cs, 0, buffer->length, buffer->payload)) {
     // Checksum failure.
@@ -75,6 +132,37 @@ size_t checkNWBuff(struct NWBuffer* buffer) {
   return 1;
 }
 
+/* Append a CRC-32 of the payload and flag the packet as CRC protected.
+ * Call once, after the last pack_nw_buff().
+ * Returns 0 and leaves the packet unchanged if there is no room for the
+ * trailer. That only happens with nw_buff_set_crc32() off, when the packet is
+ * still valid with the additive checksum. */
+size_t seal_nw_buff_crc32(struct NWBuffer* buffer) {
+  if(buffer->length & NW_LENGTH_CRC32) {
+    // Already sealed.
+    return 0;
+  }
+  if(buffer->length + NW_CRC32_LEN > nw_buf_limit) {
+    return 0;
+  }
+
+  uint32_t crc = crc32(0, 0, buffer->length, buffer->payload);
+  memcpy(buffer->payload + buffer->length, &crc, sizeof(crc));
+  buffer->length = (buffer->length + NW_CRC32_LEN) | NW_LENGTH_CRC32;
+
+  return NW_CRC32_LEN;
+}
+
+/* Payload length, excluding the NW_LENGTH_CRC32 flag. */
+size_t nw_buff_len(struct NWBuffer* buffer) {
+  return buffer->length & ~NW_LENGTH_CRC32;
+}
+
+/* Number of bytes to put on the wire for this buffer. */
+size_t nw_buff_wire_len(struct NWBuffer* buffer) {
+  return sizeof(buffer->length) + sizeof(buffer->checksum) + nw_buff_len(buffer);
+}
+
 void reset_nw_buf(struct NWBuffer* buffer) {
   buffer->length = 0;
   buffer->checksum = 0;
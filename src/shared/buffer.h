@@ -2,15 +2,34 @@
 #define BUFFER__H
 
 #include <sys/types.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 #include <assert.h>
 
 // Must be even number as the checksum is calculated on uint16_t chunks which
 // account for 2 bytes.
-#define NW_BUF_LEN 512
+// Payload capacity of every NWBuffer: a full 1500 byte Ethernet MTU less the
+// IPv4 (20) and UDP (8) headers and the NWBuffer length and checksum (4).
+#define NW_BUF_LEN 1468
 
-struct NWBuffer {
+// Payload limit of firmware and drivers that predate FEATURE_LARGE_NW_BUF.
+// pack_nw_buff() keeps to this until the peer has agreed to the full size.
+#define NW_BUF_LEN_LEGACY 512
+
+static_assert(NW_BUF_LEN % 4 == 0 && NW_BUF_LEN_LEGACY % 4 == 0,
+              "NW buffer sizes must hold whole 32 bit aligned messages");
+static_assert(NW_BUF_LEN_LEGACY <= NW_BUF_LEN, "Legacy limit exceeds buffer");
+static_assert(NW_BUF_LEN + 4 + 8 + 20 <= 1500, "NWBuffer exceeds one Ethernet frame");
+
+/* Set in NWBuffer.length when the packet ends in a CRC-32 trailer instead of
+ * relying on the additive checksum. See seal_nw_buff_crc32(). */
+#define NW_LENGTH_CRC32 0x8000
+#define NW_CRC32_LEN    sizeof(uint32_t)
+
+/* Aligned so messages packed on 4 byte boundaries in payload can be read in
+ * place (see dispatch.h). */
+struct __attribute__((aligned(4))) NWBuffer {
     uint16_t length;
     uint16_t checksum;
     uint8_t payload[NW_BUF_LEN];
@@ -23,6 +42,12 @@ size_t aligned32(size_t input);
 
 size_t pack_nw_buff(struct NWBuffer* buffer, void* new_data, size_t new_data_len);
 
+size_t nw_buff_set_limit(size_t limit);
+
+size_t nw_buff_limit(void);
+
+bool nw_buff_set_crc32(bool enabled);
+
 void* unpack_nw_buff(
     struct NWBuffer* buffer,
     size_t payload_offset,
@@ -33,9 +58,19 @@ void* unpack_nw_buff(
 
 size_t checkNWBuff(struct NWBuffer* buffer);
 
+size_t seal_nw_buff_crc32(struct NWBuffer* buffer);
+
+size_t nw_buff_len(struct NWBuffer* buffer);
+
+size_t nw_buff_wire_len(struct NWBuffer* buffer);
+
 void reset_nw_buf(struct NWBuffer* buffer);
 
 uint16_t checksum(uint16_t val_in, size_t pos_in, size_t pos_end, void* data);
 
+uint16_t checksum_bytewise(uint16_t val_in, size_t pos_in, size_t pos_end, void* data);
+
+uint32_t crc32(uint32_t crc_val, size_t pos_in, size_t pos_end, void* data);
+
 
 #endif  // BUFFER__H
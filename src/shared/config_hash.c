@@ -0,0 +1,37 @@
+#include "config_hash.h"
+
+#include <string.h>
+
+#define FNV_PRIME 16777619u
+
+uint32_t config_hash_bytes(uint32_t hash, const void* data, size_t len) {
+  const uint8_t* bytes = data;
+  for(size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+uint32_t config_hash_joint(uint32_t hash, const struct Message_joint_config* message) {
+  struct Message_joint_config canonical;
+  memcpy(&canonical, message, sizeof(canonical));
+  canonical.type = MSG_SET_JOINT_CONFIG;
+  canonical.enable = 0;
+  memset(canonical._pad, 0, sizeof(canonical._pad));
+  return config_hash_bytes(hash, &canonical, sizeof(canonical));
+}
+
+uint32_t config_hash_gpio(uint32_t hash, const struct Message_gpio_config* message) {
+  struct Message_gpio_config canonical;
+  memcpy(&canonical, message, sizeof(canonical));
+  canonical.type = MSG_SET_GPIO_CONFIG;
+  return config_hash_bytes(hash, &canonical, sizeof(canonical));
+}
+
+uint32_t config_hash_spindle(uint32_t hash, const struct Message_spindle_config* message) {
+  struct Message_spindle_config canonical;
+  memcpy(&canonical, message, sizeof(canonical));
+  canonical.type = MSG_SET_SPINDLE_CONFIG;
+  return config_hash_bytes(hash, &canonical, sizeof(canonical));
+}
@@ -0,0 +1,24 @@
+#ifndef CONFIG_HASH__H
+#define CONFIG_HASH__H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "messages.h"
+
+/* Hash of the joint, GPIO and spindle config one end holds, used by
+ * FEATURE_CONFIG_CACHE to tell whether firmware already has the driver's
+ * config. Both ends hash the same wire messages in the same order:
+ * configured joints, then configured GPIO, then configured spindles, each in
+ * index order. Joint enable is runtime state, so it is hashed as 0. */
+
+#define CONFIG_HASH_INIT 2166136261u  // FNV-1a 32 bit offset basis.
+
+/* FNV-1a over len bytes of data, continuing from hash. */
+uint32_t config_hash_bytes(uint32_t hash, const void* data, size_t len);
+
+uint32_t config_hash_joint(uint32_t hash, const struct Message_joint_config* message);
+uint32_t config_hash_gpio(uint32_t hash, const struct Message_gpio_config* message);
+uint32_t config_hash_spindle(uint32_t hash, const struct Message_spindle_config* message);
+
+#endif  // CONFIG_HASH__H
@@ -0,0 +1,64 @@
+#include <stdint.h>
+
+#include "dispatch.h"
+
+/* Pointer to len bytes at offset in the payload, without copying.
+ * NULL if the data overlaps the end of the buffer or is not aligned to align. */
+const void* nw_view(struct NWBuffer* buffer, size_t offset, size_t len, size_t align) {
+  const void* view = unpack_nw_buff(buffer, offset, NULL, NULL, len);
+  if(!view || ((uintptr_t)view % align)) {
+    return NULL;
+  }
+  return view;
+}
+
+/* Call the table handler for each message in the buffer, starting at *offset.
+ * *offset is left at the end of the data on success or at the start of the
+ * message that failed otherwise. handled_count is incremented per message
+ * handled. */
+enum NWDispatchResult nw_dispatch(
+    struct NWBuffer* buffer,
+    const struct NWDispatch* table,
+    size_t table_len,
+    void* context,
+    size_t* offset,
+    size_t* handled_count
+) {
+  while(*offset < buffer->length) {
+    uint8_t type = buffer->payload[*offset];
+    if(type == 0) {
+      // Zero type pads the end of the message list.
+      break;
+    }
+    if(type >= table_len || !table[type].size) {
+      return NW_DISPATCH_UNKNOWN_TYPE;
+    }
+
+    const struct NWDispatch* entry = &table[type];
+    const void* view = nw_view(buffer, *offset, entry->size, entry->align);
+    if(!view) {
+      return unpack_nw_buff(buffer, *offset, NULL, NULL, entry->size) ?
+        NW_DISPATCH_INVALID : NW_DISPATCH_TRUNCATED;
+    }
+
+    size_t len = entry->size;
+    if(entry->length) {
+      len = entry->length(view);
+      if(len < entry->size) {
+        return NW_DISPATCH_INVALID;
+      }
+      if(!unpack_nw_buff(buffer, *offset, NULL, NULL, len)) {
+        return NW_DISPATCH_TRUNCATED;
+      }
+    }
+
+    if(!entry->handler(view, context)) {
+      return NW_DISPATCH_HANDLER_FAILED;
+    }
+
+    *offset += aligned32(len);
+    (*handled_count)++;
+  }
+
+  return NW_DISPATCH_OK;
+}
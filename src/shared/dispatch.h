@@ -0,0 +1,62 @@
+#ifndef DISPATCH__H
+#define DISPATCH__H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "buffer.h"
+
+/* Table driven unpacking of the message list in an NWBuffer.
+ * Firmware (MSG_*) and driver (REPLY_*) each declare a table indexed by
+ * message type. nw_dispatch() walks the payload, checks each message fits and is
+ * aligned, and passes the handler a pointer into the payload (a view) rather
+ * than a copy. */
+
+/* pack_nw_buff() places every message on a 4 byte boundary and NWBuffer is
+ * 4 byte aligned, so every view is at least this aligned. */
+#define NW_VIEW_ALIGN 4
+
+/* view points at a message of the handler's type inside the NWBuffer payload.
+ * Only valid until the buffer is reset. Return false to stop unpacking. */
+typedef bool (*nw_handler)(const void* view, void* context);
+
+/* For variable length types: full length of the message, given that its first
+ * NWDispatch.size bytes are present. Return 0 if the header is invalid. */
+typedef size_t (*nw_length)(const void* view);
+
+struct NWDispatch {
+  uint16_t size;      // Message length, or fixed header length if length is set.
+                      // 0 marks an unused message type.
+  uint8_t align;      // Required alignment of the view.
+  nw_length length;   // NULL for fixed size messages.
+  nw_handler handler;
+};
+
+/* Table entry for a fixed size message. */
+#define NW_DISPATCH(type_struct, handler_) \
+  {sizeof(type_struct), NW_VIEW_ALIGN, NULL, (handler_)}
+
+/* Table entry for a message whose length depends on its header. */
+#define NW_DISPATCH_VAR(header_len, length_, handler_) \
+  {(header_len), NW_VIEW_ALIGN, (length_), (handler_)}
+
+enum NWDispatchResult {
+  NW_DISPATCH_OK = 0,         // Reached end of data.
+  NW_DISPATCH_UNKNOWN_TYPE,   // No table entry for the type at *offset.
+  NW_DISPATCH_TRUNCATED,      // Message at *offset overlaps end of data.
+  NW_DISPATCH_INVALID,        // Header failed validation or view misaligned.
+  NW_DISPATCH_HANDLER_FAILED  // Handler returned false.
+};
+
+const void* nw_view(struct NWBuffer* buffer, size_t offset, size_t len, size_t align);
+
+enum NWDispatchResult nw_dispatch(
+    struct NWBuffer* buffer,
+    const struct NWDispatch* table,
+    size_t table_len,
+    void* context,
+    size_t* offset,
+    size_t* handled_count
+);
+
+#endif  // DISPATCH__H
@@ -2,7 +2,9 @@
 #define UPDATE_TYPES__H
 
 #include <sys/types.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <assert.h>
 #include "version.h"
 
 /* This file contains objects that are passed over Ethernet UDP between host and RP2040.
@@ -24,11 +26,7 @@
   #define MAX_JOINT WIRE_MAX_JOINT
 #endif
 
-#ifdef BUILD_TESTS
-#define MAX_GPIO 64
-#else
-#define MAX_GPIO 32
-#endif
+#define MAX_GPIO 128
 
 #define MAX_GPIO_BANK (MAX_GPIO / 32)
 #define MAX_SPINDLE 4
@@ -45,13 +43,41 @@
 #define MSG_SET_GPIO_CONFIG          7  // Set config for a single GPIO.
 #define MSG_SET_SPINDLE_CONFIG       8  // Set spindle configuration
 #define MSG_SET_SPINDLE_SPEED        9  // Set spindle speed
+#define MSG_SET_JOINT_POS_Q         10  // Compact fixed-point joint setpoints.
+#define MSG_FEEDBACK_ACK            11  // Last REPLY_JOINT_MOVEMENT_V2 the driver decoded.
+#define MSG_SET_JOINT_COAST         12  // Missed updates Core1 may coast through.
+#define MSG_CLOCK_SYNC              13  // Host transmit time for clock offset estimation.
+#define MSG_TICK_SYNC               14  // Time, in RP clock, to align the next tick with.
+#define MSG_TYPE_COUNT              15  // One more than the highest MSG_* value.
+
+/* Optional protocol features, negotiated during the version handshake.
+ * The driver advertises the features it understands in
+ * Message_version_request.features; firmware replies with Reply_features
+ * holding the subset both sides support. Firmware that predates negotiation
+ * ignores the field (it was alignment padding) and never sends Reply_features,
+ * so the driver falls back to the original messages. */
+#define FEATURE_COMPACT_JOINT_POS    (1u << 0)  // MSG_SET_JOINT_POS_Q accepted.
+#define FEATURE_COMPACT_FEEDBACK     (1u << 1)  // REPLY_JOINT_MOVEMENT_V2 sent.
+#define FEATURE_CRC32                (1u << 2)  // Packets sealed with a CRC-32 trailer.
+#define FEATURE_JOINT_COAST          (1u << 3)  // MSG_SET_JOINT_COAST accepted.
+#define FEATURE_LARGE_NW_BUF         (1u << 4)  // Packets up to NW_BUF_LEN, not NW_BUF_LEN_LEGACY.
+#define FEATURE_CONFIG_CACHE         (1u << 5)  // REPLY_CONFIG_HASH sent with the version; REPLY_FLASH_WRITE.
+#define FEATURE_CLOCK_SYNC           (1u << 6)  // MSG_CLOCK_SYNC answered with REPLY_CLOCK_SYNC.
+#define FEATURE_TICK_SYNC            (1u << 7)  // MSG_TICK_SYNC answered with REPLY_TICK_SYNC.
+
+#define PROTOCOL_FEATURES            (FEATURE_COMPACT_JOINT_POS | FEATURE_COMPACT_FEEDBACK \
+                                      | FEATURE_CRC32 | FEATURE_JOINT_COAST \
+                                      | FEATURE_LARGE_NW_BUF | FEATURE_CONFIG_CACHE \
+                                      | FEATURE_CLOCK_SYNC | FEATURE_TICK_SYNC)
 
 struct __attribute__((packed)) Message_header {
   uint8_t type;
 };
 
 struct __attribute__((packed)) Message_version_request {
-  uint8_t type;  // MSG_VERSION_REQUEST — no payload; reply carries the version
+  uint8_t type;                   // MSG_VERSION_REQUEST; reply carries the version
+  uint8_t _pad;
+  uint16_t features;              // FEATURE_* bits the driver understands.
 };
 
 struct __attribute__((packed)) Message_timing {
@@ -68,6 +94,63 @@ struct __attribute__((packed)) Message_set_joints_pos {
   double velocity[WIRE_MAX_JOINT];
 };
 
+/* One joint's setpoint in MSG_SET_JOINT_POS_Q. */
+struct __attribute__((packed)) Joint_setpoint_q {
+  int64_t position;               // Q32.32 steps.
+  int32_t velocity;               // Q16.16 steps/s over the period in µs.
+};
+
+/* Fixed-point replacement for Message_set_joints_pos. Variable length: only
+ * the first `count` entries of `joint` are sent on the wire, so use
+ * MESSAGE_SET_JOINTS_POS_Q_LEN(count) rather than sizeof(). */
+struct __attribute__((packed)) Message_set_joints_pos_q {
+  uint8_t type;                   // MSG_SET_JOINT_POS_Q
+  uint8_t count;                  // number of entries in joint[] (= firmware MAX_JOINT)
+  uint8_t _pad[2];
+  struct Joint_setpoint_q joint[WIRE_MAX_JOINT];
+};
+
+#define MESSAGE_SET_JOINTS_POS_Q_LEN(count) \
+  (offsetof(struct Message_set_joints_pos_q, joint) \
+   + (count) * sizeof(struct Joint_setpoint_q))
+
+/* Most missed updates MSG_SET_JOINT_COAST may ask Core1 to coast through. */
+#define MAX_COAST_PERIODS 4
+
+/* Sent after MSG_SET_JOINT_POS_Q. Until the next setpoints arrive, Core1
+ * extrapolates the last ones through up to `periods` missed updates rather
+ * than decelerating. Setpoints without it turn coasting off. */
+struct __attribute__((packed)) Message_set_joint_coast {
+  uint8_t type;                   // MSG_SET_JOINT_COAST
+  uint8_t periods;                // At most MAX_COAST_PERIODS.
+  uint8_t _pad[2];
+};
+
+/* Sent every cycle once FEATURE_COMPACT_FEEDBACK is negotiated. Firmware codes
+ * REPLY_JOINT_MOVEMENT_V2 deltas against the acknowledged reply. */
+struct __attribute__((packed)) Message_feedback_ack {
+  uint8_t type;                   // MSG_FEEDBACK_ACK
+  uint8_t valid;                  // 0: driver holds no decoded state; send a keyframe.
+  uint16_t id;                    // Reply_joint_movement_v2.id of the newest decoded reply.
+};
+
+/* NTP style timestamp exchange. Firmware answers with REPLY_CLOCK_SYNC as late
+ * as it can in the same reply packet. */
+struct __attribute__((packed)) Message_clock_sync {
+  uint8_t type;                   // MSG_CLOCK_SYNC
+  uint8_t _pad[3];
+  uint64_t host_tx_us;            // Host monotonic clock when packed.
+};
+
+/* A tick time on a timebase shared by every board, converted by the driver
+ * into this board's clock. Firmware schedules its tick on the grid of servo
+ * periods through it instead of phase locking to packet arrival. */
+struct __attribute__((packed)) Message_tick_sync {
+  uint8_t type;                   // MSG_TICK_SYNC
+  uint8_t _pad[3];
+  uint64_t rp_target_us;          // time_us_64() on the RP at which a tick is due.
+};
+
 struct __attribute__((packed)) Message_joint_enable {
   uint8_t type;                   // MSG_SET_JOINT_ENABLED
   uint8_t joint;
@@ -119,6 +202,11 @@ union MessageAny {
   struct Message_version_request version_request;
   struct Message_timing timing;
   struct Message_set_joints_pos set_abs_pos;
+  struct Message_set_joints_pos_q set_pos_q;
+  struct Message_set_joint_coast set_joint_coast;
+  struct Message_feedback_ack feedback_ack;
+  struct Message_clock_sync clock_sync;
+  struct Message_tick_sync tick_sync;
   struct Message_joint_enable joint_enable;
   struct Message_gpio gpio;
   struct Message_joint_config joint_config;
@@ -138,6 +226,13 @@ union MessageAny {
 #define REPLY_GPIO_CONFIG            7
 #define REPLY_SPINDLE_SPEED          8
 #define REPLY_SPINDLE_CONFIG         9
+#define REPLY_FEATURES              10  // Negotiated FEATURE_* bits.
+#define REPLY_JOINT_MOVEMENT_V2     11  // Change-masked form of REPLY_JOINT_MOVEMENT.
+#define REPLY_CONFIG_HASH           12  // Hash of the config firmware is running with.
+#define REPLY_CLOCK_SYNC            13  // RP timestamps for the last MSG_CLOCK_SYNC.
+#define REPLY_TICK_SYNC             14  // Tick phase error found applying MSG_TICK_SYNC.
+#define REPLY_FLASH_WRITE           15  // Firmware stops answering while it writes flash.
+#define REPLY_TYPE_COUNT            16  // One more than the highest REPLY_* value.
 
 struct __attribute__((packed)) Reply_header {
   uint8_t type;
@@ -151,6 +246,49 @@ struct __attribute__((packed)) Reply_version {
   uint32_t version_branch;  // 0 = main; FNV-1a hash of branch name otherwise
 };
 
+/* Only sent when the Message_version_request carried a non-zero features field. */
+struct __attribute__((packed)) Reply_features {
+  uint8_t  type;            // REPLY_FEATURES
+  uint8_t  _pad;
+  uint16_t features;        // FEATURE_* bits supported by both ends.
+};
+
+/* Follows Reply_features when FEATURE_CONFIG_CACHE is negotiated. If hash
+ * matches the driver's config (see config_hash.h) the driver may skip
+ * sending it; firmware has disabled every joint before replying. */
+struct __attribute__((packed)) Reply_config_hash {
+  uint8_t  type;            // REPLY_CONFIG_HASH
+  uint8_t  _pad[3];
+  uint32_t hash;            // config_hash_*() of the applied config.
+};
+
+/* Sent when FEATURE_CONFIG_CACHE is negotiated, in the last reply before
+ * firmware writes its config cache to flash. Both cores stop for the write, so
+ * the driver should neither send nor count missed replies for hold_ms. */
+struct __attribute__((packed)) Reply_flash_write {
+  uint8_t  type;            // REPLY_FLASH_WRITE
+  uint8_t  _pad;
+  uint16_t hold_ms;         // Longest the write can take.
+};
+
+/* The four NTP timestamps less the one the driver takes on receipt. RP times
+ * are time_us_64() and unrelated to the host clock. */
+struct __attribute__((packed)) Reply_clock_sync {
+  uint8_t  type;            // REPLY_CLOCK_SYNC
+  uint8_t  _pad[3];
+  uint64_t host_tx_us;      // Echo of Message_clock_sync.host_tx_us.
+  uint64_t rp_rx_us;        // When the packet carrying it was received.
+  uint64_t rp_tx_us;        // When this reply was packed, just before sending.
+};
+
+/* How far the tick was from the MSG_TICK_SYNC target before it was moved
+ * there, wrapped to within half a servo period. */
+struct __attribute__((packed)) Reply_tick_sync {
+  uint8_t  type;            // REPLY_TICK_SYNC
+  uint8_t  _pad[3];
+  int32_t  phase_error_us;  // Positive when the tick would have been late.
+};
+
 struct __attribute__((packed)) Reply_timing {
   uint8_t type;
   uint32_t update_id;
@@ -169,6 +307,38 @@ struct __attribute__((packed)) Reply_joint_movement {
   uint32_t core1_tick;
 };
 
+/* Variable length form of Reply_joint_movement, sent instead of it once
+ * FEATURE_COMPACT_FEEDBACK is negotiated. Bit j of each mask refers to joint j.
+ *
+ * Values are coded against the earlier reply `base_id`, which is the last one
+ * the driver acknowledged with MSG_FEEDBACK_ACK. When id == base_id the reply
+ * is a keyframe: every field is present and positions are absolute.
+ *
+ * The fixed header is followed, unaligned and in joint order, by:
+ *   - a position delta per bit in pos_present: int32 if set in pos_wide, else int16;
+ *   - an int32 velocity_achieved (Q16.16) per bit in vel_present;
+ *   - a float velocity_cmd per bit in vcmd_present.
+ * Fields whose bit is clear are unchanged from the base reply. */
+struct __attribute__((packed)) Reply_joint_movement_v2 {
+  uint8_t  type;                  // REPLY_JOINT_MOVEMENT_V2
+  uint8_t  count;                 // number of valid joints (= firmware MAX_JOINT)
+  uint8_t  enabled;               // bit j set when joint j is enabled.
+  uint8_t  pos_present;
+  uint8_t  pos_wide;
+  uint8_t  vel_present;
+  uint8_t  vcmd_present;
+  uint8_t  _pad;
+  uint16_t id;                    // Sequence number of this reply.
+  uint16_t base_id;               // Reply the deltas are relative to.
+  uint32_t update_period_us;
+  uint32_t core1_tick;
+};
+
+#define REPLY_JOINT_MOVEMENT_V2_MAX_LEN \
+  (sizeof(struct Reply_joint_movement_v2) + WIRE_MAX_JOINT * 3 * sizeof(int32_t))
+
+static_assert(WIRE_MAX_JOINT <= 8, "Reply_joint_movement_v2 masks are 8 bits");
+
 struct __attribute__((packed)) Reply_joint_config {
   uint8_t type;
   uint8_t joint;
@@ -193,7 +363,7 @@ struct __attribute__((packed)) Reply_joint_metrics {
   uint8_t  type;
   uint8_t  overrun_occurred;   /* 1 if any joint overran this tick, else 0 */
   uint8_t  underrun_occurred;  /* 1 if any joint underran this tick, else 0 */
-  uint8_t  _pad;               /* align uint32_t fields to 4-byte boundary */
+  uint8_t  coasted;            /* missed updates Core1 coasted through since last reply (saturates) */
   uint32_t core1_work_us;      /* µs Core1 spent working last period (excl. wait_for_packet) */
   uint32_t core0_work_us;      /* µs Core0 spent working last period (packet rx → response tx) */
 };
@@ -230,8 +400,14 @@ struct __attribute__((packed)) Reply_spindle_config {
 union ReplyAny {
   struct Reply_header header;
   struct Reply_version version;
+  struct Reply_features features;
+  struct Reply_config_hash config_hash;
+  struct Reply_flash_write flash_write;
+  struct Reply_clock_sync clock_sync;
+  struct Reply_tick_sync tick_sync;
   struct Reply_timing timing;
   struct Reply_joint_movement joint_movement;
+  struct Reply_joint_movement_v2 joint_movement_v2;
   struct Reply_joint_config joint_config;
   struct Reply_gpio_config gpio_config;
   struct Reply_joint_metrics joint_metrics;
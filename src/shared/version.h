@@ -6,6 +6,6 @@
 #define VERSION_H
 #define PROTOCOL_VERSION_MAJOR   0
 #define PROTOCOL_VERSION_MINOR   2
-#define PROTOCOL_VERSION_PATCH   63
+#define PROTOCOL_VERSION_PATCH   94
 #define PROTOCOL_VERSION_BRANCH  2242753066
 #endif  // VERSION_H
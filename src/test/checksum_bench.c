@@ -0,0 +1,71 @@
+/* Host throughput benchmark for the NWBuffer integrity checks.
+ * Reports bytes/us for the byte-wise reference checksum, the word-wise
+ * checksum() and crc32() over a PACKET_LEN payload, the packet size in use
+ * until FEATURE_LARGE_NW_BUF is negotiated.
+ * Not a pass/fail test; it only fails if the implementations disagree. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "buffer.h"
+
+#define ITERATIONS 20000
+#define PACKET_LEN NW_BUF_LEN_LEGACY
+
+typedef uint32_t (*bench_fn)(uint8_t* data);
+
+static uint32_t run_bytewise(uint8_t* data) {
+    return checksum_bytewise(0, 0, PACKET_LEN, data);
+}
+
+static uint32_t run_wordwise(uint8_t* data) {
+    return checksum(0, 0, PACKET_LEN, data);
+}
+
+static uint32_t run_crc32(uint8_t* data) {
+    return crc32(0, 0, PACKET_LEN, data);
+}
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Returns an xor of all results so the compiler can't drop the calls. */
+static uint32_t bench(const char* name, bench_fn fn, struct NWBuffer* buffer) {
+    uint32_t sink = 0;
+    double start = now_us();
+    for(size_t i = 0; i < ITERATIONS; i++) {
+        buffer->payload[0] = i;
+        sink ^= fn(buffer->payload);
+    }
+    double elapsed = now_us() - start;
+
+    printf("%-10s %8.1f bytes/us  (%.3f us per %u byte packet)\n",
+           name,
+           (double)PACKET_LEN * ITERATIONS / elapsed,
+           elapsed / ITERATIONS,
+           PACKET_LEN);
+    return sink;
+}
+
+int main(void) {
+    struct NWBuffer buffer = {0};
+    uint32_t seed = 1;
+    for(size_t index = 0; index < PACKET_LEN; index++) {
+        seed = seed * 1103515245 + 12345;
+        buffer.payload[index] = seed >> 16;
+    }
+
+    uint32_t reference = bench("bytewise", run_bytewise, &buffer);
+    uint32_t wordwise = bench("wordwise", run_wordwise, &buffer);
+    bench("crc32", run_crc32, &buffer);
+
+    if(reference != wordwise) {
+        printf("ERROR: word-wise checksum differs from byte-wise.\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <cmocka.h>
+
+#include "../driver/rp2040_network.c"
+#include "mocks/driver_mocks.h"
+#include "../shared/messages.h"
+
+/* Where test_write_fixture() leaves a capture for the replay tool tests. */
+static const char* fixture_path = "capture_fixture.rpc";
+
+static struct NWBuffer make_packet(uint8_t fill, size_t len) {
+    struct NWBuffer buffer = {0};
+    uint8_t payload[NW_BUF_LEN];
+    memset(payload, fill, len);
+    pack_nw_buff(&buffer, payload, len);
+    return buffer;
+}
+
+/* Map a finished capture file for reading. */
+static struct CaptureFileHeader* map_capture(const char* path, size_t* size) {
+    int fd = open(path, O_RDONLY);
+    assert_true(fd >= 0);
+    *size = lseek(fd, 0, SEEK_END);
+    void* map = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    assert_true(map != MAP_FAILED);
+    assert_true(capture_file_valid(map, *size));
+    return map;
+}
+
+/* Records come off the ring in the order captured with every field intact. */
+static void test_ring_keeps_order(void **state) {
+    (void) state; /* unused */
+    struct CaptureRecord record;
+
+    assert_true(capture_ring_init());
+    assert_false(capture_pop(&record));
+
+    for(uint32_t i = 0; i < 3; i++) {
+        struct NWBuffer packet = make_packet(0x10 + i, 8 * (i + 1));
+        capture_packet(i % 2 ? CAPTURE_RX : CAPTURE_TX, i, 100 + i,
+                       &packet, nw_buff_wire_len(&packet));
+    }
+
+    for(uint32_t i = 0; i < 3; i++) {
+        assert_true(capture_pop(&record));
+        assert_int_equal(record.direction, i % 2 ? CAPTURE_RX : CAPTURE_TX);
+        assert_int_equal(record.device, i);
+        assert_int_equal(record.seq_out, 100 + i);
+        assert_int_equal(record.length, 4 + 8 * (i + 1));
+        assert_int_equal(record.packet.length, 8 * (i + 1));
+        assert_int_equal(record.packet.payload[0], 0x10 + i);
+        assert_true(checkNWBuff(&record.packet));
+    }
+    assert_false(capture_pop(&record));
+    capture_ring_free();
+}
+
+/* A full ring drops new records and counts them rather than blocking or
+ * overwriting ones not yet written. */
+static void test_ring_full_drops_newest(void **state) {
+    (void) state; /* unused */
+    struct CaptureRecord record;
+    struct NWBuffer packet = make_packet(0xaa, 4);
+
+    assert_true(capture_ring_init());
+    for(uint32_t i = 0; i < CAPTURE_RING_LEN + 5; i++) {
+        capture_packet(CAPTURE_TX, 0, i, &packet, nw_buff_wire_len(&packet));
+    }
+    assert_int_equal(capture_ring->dropped, 5);
+
+    for(uint32_t i = 0; i < CAPTURE_RING_LEN; i++) {
+        assert_true(capture_pop(&record));
+        assert_int_equal(record.seq_out, i);
+    }
+    assert_false(capture_pop(&record));
+
+    /* Space again once drained. */
+    capture_packet(CAPTURE_TX, 0, 7, &packet, nw_buff_wire_len(&packet));
+    assert_true(capture_pop(&record));
+    assert_int_equal(record.seq_out, 7);
+    capture_ring_free();
+}
+
+/* Nothing is recorded, or touched, while capture is off. */
+static void test_capture_off_is_noop(void **state) {
+    (void) state; /* unused */
+    struct CaptureRecord record;
+    struct NWBuffer packet = make_packet(0x55, 4);
+
+    capture_packet(CAPTURE_TX, 0, 1, &packet, nw_buff_wire_len(&packet));
+    assert_false(capture_pop(&record));
+}
+
+/* The file keeps the newest capacity records and reads back oldest first. */
+static void test_file_wraps(void **state) {
+    (void) state; /* unused */
+    const char* path = "capture_wrap_test.rpc";
+    struct CaptureFile file = {.fd = -1};
+    struct NWBuffer packet = make_packet(0x01, 12);
+
+    assert_true(capture_ring_init());
+    assert_int_equal(capture_file_open(&file, path, 4), 0);
+    for(uint32_t i = 0; i < 6; i++) {
+        capture_packet(CAPTURE_TX, 0, i, &packet, nw_buff_wire_len(&packet));
+    }
+    assert_int_equal(capture_file_drain(&file), 6);
+    assert_int_equal(capture_file_drain(&file), 0);
+    capture_file_close(&file);
+    capture_ring_free();
+
+    size_t size;
+    struct CaptureFileHeader* header = map_capture(path, &size);
+    assert_int_equal(size, capture_file_size(4));
+    assert_int_equal(header->written, 6);
+    assert_int_equal(header->dropped, 0);
+    assert_int_equal(capture_file_first(header), 2);
+    for(uint64_t i = capture_file_first(header); i < header->written; i++) {
+        assert_int_equal(capture_file_record(header, i)->seq_out, i);
+    }
+    munmap(header, size);
+    unlink(path);
+}
+
+/* capture_start() to capture_stop() with the writer thread. Everything
+ * captured before the stop is in the file. */
+static void test_start_stop(void **state) {
+    (void) state; /* unused */
+    const char* path = "capture_start_test.rpc";
+    struct NWBuffer packet = make_packet(0x02, 16);
+
+    assert_int_equal(capture_start(path, 64), 0);
+    for(uint32_t i = 0; i < 10; i++) {
+        capture_packet(CAPTURE_RX, 1, i, &packet, nw_buff_wire_len(&packet));
+    }
+    capture_stop();
+    assert_null(capture_ring);
+
+    size_t size;
+    struct CaptureFileHeader* header = map_capture(path, &size);
+    assert_int_equal(header->written, 10);
+    assert_int_equal(capture_file_record(header, 9)->device, 1);
+    munmap(header, size);
+    unlink(path);
+
+    assert_int_not_equal(capture_start("/nonexistent/dir/capture.rpc", 64), 0);
+    assert_null(capture_ring);
+}
+
+/* A short exchange with two boards: MSG_TIMING out, REPLY_TIMING and
+ * REPLY_JOINT_MOVEMENT back. Left in place for the replay tool tests. */
+static void test_write_fixture(void **state) {
+    (void) state; /* unused */
+    struct CaptureFile file = {.fd = -1};
+
+    nw_buff_set_limit(NW_BUF_LEN_LEGACY);
+    assert_true(capture_ring_init());
+    assert_int_equal(capture_file_open(&file, fixture_path, 64), 0);
+
+    for(uint32_t seq = 1; seq <= 8; seq++) {
+        for(int device = 0; device < 2; device++) {
+            struct NWBuffer tx = {0};
+            assert_true(serialize_timing(&tx, seq, 1000) > 0);
+            capture_packet(CAPTURE_TX, device, seq, &tx, nw_buff_wire_len(&tx));
+        }
+        for(int device = 0; device < 2; device++) {
+            struct NWBuffer rx = {0};
+            union ReplyAny reply = {0};
+            reply.timing.type = REPLY_TIMING;
+            reply.timing.update_id = seq;
+            reply.timing.time_diff = 0;
+            reply.timing.rp_update_len = 1000;
+            assert_true(pack_nw_buff(&rx, &reply, sizeof(reply.timing)) > 0);
+
+            memset(&reply, 0, sizeof(reply));
+            reply.joint_movement.type = REPLY_JOINT_MOVEMENT;
+            reply.joint_movement.count = 4;
+            for(int joint = 0; joint < 4; joint++) {
+                reply.joint_movement.abs_pos_achieved[joint] = seq * 10 * (joint + 1);
+                reply.joint_movement.enabled[joint] = 1;
+            }
+            reply.joint_movement.update_period_us = 1000;
+            assert_true(pack_nw_buff(&rx, &reply, sizeof(reply.joint_movement)) > 0);
+            capture_packet(CAPTURE_RX, device, seq, &rx, nw_buff_wire_len(&rx));
+        }
+    }
+
+    assert_int_equal(capture_file_drain(&file), 32);
+    capture_file_close(&file);
+    capture_ring_free();
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        fixture_path = argv[1];
+    }
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_ring_keeps_order),
+        cmocka_unit_test(test_ring_full_drops_newest),
+        cmocka_unit_test(test_capture_off_is_noop),
+        cmocka_unit_test(test_file_wraps),
+        cmocka_unit_test(test_start_stop),
+        cmocka_unit_test(test_write_fixture),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -9,6 +9,9 @@
 #include "../shared/messages.h"
 #include "../shared/buffer.c"
 #include "../shared/checksum.c"
+#include "../shared/config_hash.c"
+#include "../driver/rp2040_capture.h"
+#include "../driver/rp2040_rtlog.c"
 
 /* ---- stub globals used by rp2040_eth_state.c ---- */
 
@@ -16,11 +19,24 @@
 #include <netdb.h>
 struct sockaddr_in remote_addr[MAX_DEVICES];
 
-/* Controllable mock state for send_data / get_reply_non_block. */
+/* Controllable mock state for send_data / receive_replies. */
 static int    g_send_retval     = 0;
 static int    g_send_call_count = 0;
-static size_t g_reply_length    = 0;
+static size_t g_reply_count    = 0;
 static int    g_reply_call_count= 0;
+/* Bytes the motion and joint config stubs pack; 0 packs nothing. */
+static size_t g_motion_len      = 0;
+static size_t g_config_len      = 0;
+static int    g_joint_config_calls = 0;
+static int    g_gpio_config_calls  = 0;
+
+static size_t stub_pack(struct NWBuffer *b, size_t len) {
+    if(len == 0) {
+        return 1;
+    }
+    static uint8_t payload[NW_BUF_LEN];
+    return pack_nw_buff(b, payload, len);
+}
 
 /* ---- stub implementations of rp2040_network.c symbols ---- */
 /* reset_nw_buf is provided by buffer.c (included above). */
@@ -30,40 +46,128 @@ size_t serialize_timing(struct NWBuffer *b, uint32_t id, uint32_t t) {
 }
 bool get_version_checked(void) { return true; }
 size_t serialize_version_request(struct NWBuffer *b) { (void)b; return 1; }
+uint16_t get_negotiated_features(void) { return 0; }
+static bool     g_config_hash_pending = false;
+static uint32_t g_config_hash         = 0;
+bool take_firmware_config_hash(uint32_t *hash) {
+    if(!g_config_hash_pending) {
+        return false;
+    }
+    g_config_hash_pending = false;
+    *hash = g_config_hash;
+    return true;
+}
+static uint16_t g_flash_hold_ms = 0;
+bool take_flash_write_hold(uint16_t *hold_ms) {
+    if(!g_flash_hold_ms) {
+        return false;
+    }
+    *hold_ms = g_flash_hold_ms;
+    g_flash_hold_ms = 0;
+    return true;
+}
+/* REPLY_*_CONFIG the stubbed process_data() has "received". */
+static uint32_t g_joint_replied   = 0;
+static uint32_t g_gpio_replied[MAX_GPIO_BANK];
+static uint32_t g_spindle_replied = 0;
+void take_config_replies(uint32_t *joints, uint32_t *gpio, uint32_t *spindles) {
+    *joints = g_joint_replied;
+    memcpy(gpio, g_gpio_replied, sizeof(g_gpio_replied));
+    *spindles = g_spindle_replied;
+    g_joint_replied = 0;
+    memset(g_gpio_replied, 0, sizeof(g_gpio_replied));
+    g_spindle_replied = 0;
+}
+size_t serialize_feedback_ack(struct NWBuffer *b) { (void)b; return 1; }
 uint16_t serialize_gpio(struct NWBuffer *b, skeleton_t *d) { (void)b; (void)d; return 0; }
 uint8_t get_detected_joint_count(void) { return 0; }
 size_t serialize_joint_config(struct NWBuffer *b, uint8_t j, uint8_t e,
                                uint8_t s, uint8_t dr, float v, float a, uint8_t c) {
-    (void)b; (void)j; (void)e; (void)s; (void)dr; (void)v; (void)a; (void)c; return 1;
+    (void)j; (void)e; (void)s; (void)dr; (void)v; (void)a; (void)c;
+    g_joint_config_calls++;
+    return stub_pack(b, g_config_len);
 }
 size_t serialize_gpio_config(struct NWBuffer *b, uint8_t g, uint8_t t,
                               uint8_t i, uint8_t addr) {
-    (void)b; (void)g; (void)t; (void)i; (void)addr; return 1;
+    (void)g; (void)t; (void)i; (void)addr;
+    g_gpio_config_calls++;
+    return stub_pack(b, g_config_len);
 }
 bool serialise_spindle_config(struct NWBuffer *b, uint8_t s, uint8_t v,
                                uint8_t addr, uint16_t r) {
     (void)b; (void)s; (void)v; (void)addr; (void)r; return true;
 }
-size_t serialize_joint_pos(struct NWBuffer *b, skeleton_t *d) { (void)b; (void)d; return 1; }
+size_t serialize_joint_pos(struct NWBuffer *b, skeleton_t *d) {
+    (void)d; return stub_pack(b, g_motion_len);
+}
+size_t serialize_joint_coast(struct NWBuffer *b, skeleton_t *d) {
+    (void)b; (void)d; return 1;
+}
+size_t serialize_clock_sync(struct NWBuffer *b) { (void)b; return 1; }
+size_t serialize_tick_sync(struct NWBuffer *b, uint64_t t) { (void)b; (void)t; return 1; }
 bool serialise_spindle_speed_in(struct NWBuffer *b, skeleton_t *d) { (void)b; (void)d; return true; }
 
-void process_data(struct NWBuffer *b, skeleton_t *d, size_t *c, size_t l,
-                  struct Message_joint_config *jc, struct Message_gpio_config *gc,
-                  struct Message_spindle_config *sc) {
-    (void)b; (void)d; (void)c; (void)l; (void)jc; (void)gc; (void)sc;
-}
 void reset_version_check(void) {}
+void select_device(int device) { (void)device; }
+
+/* Order of send/receive calls as "S<dev>" / "R<dev>". */
+static char   g_call_log[64];
+static int    g_dead_dev = -1;   /* Board whose sends fail and never replies. */
+
+static void log_call(char what, int dev) {
+    size_t len = strlen(g_call_log);
+    if(len + 2 < sizeof(g_call_log)) {
+        g_call_log[len] = what;
+        g_call_log[len + 1] = (char)('0' + dev);
+        g_call_log[len + 2] = '\0';
+    }
+}
 
 int send_data(int dev, struct NWBuffer *buf) {
-    (void)dev; (void)buf;
+    (void)buf;
     g_send_call_count++;
-    return g_send_retval;
+    log_call('S', dev);
+    return dev == g_dead_dev ? -1 : g_send_retval;
 }
-size_t get_reply_non_block(int dev, struct NWBuffer *buf) {
-    (void)dev; (void)buf;
+/* From call g_reply_current_at on, the reply to the packet just sent has
+ * arrived; 0 never. */
+static int    g_reply_current_at = 0;
+static uint64_t g_host_time_us   = 0;
+
+size_t receive_replies(int dev, skeleton_t *d, size_t *c,
+                       struct Message_joint_config *jc, struct Message_gpio_config *gc,
+                       struct Message_spindle_config *sc) {
+    (void)c; (void)jc; (void)gc; (void)sc;
     g_reply_call_count++;
-    return g_reply_length;
+    log_call('R', dev);
+    if(dev == g_dead_dev) {
+        return 0;
+    }
+    if(g_reply_current_at > 0 && g_reply_call_count == g_reply_current_at) {
+        *d->seq_in = *d->seq_out;
+        return 1;
+    }
+    return g_reply_count;
+}
+/* Packets passed to the capture ring. */
+static int      g_capture_count   = 0;
+static uint32_t g_capture_seq_out = 0;
+static size_t   g_capture_length  = 0;
+
+void capture_packet(uint8_t dir, int dev, uint32_t seq_out,
+                    const struct NWBuffer *buf, size_t len) {
+    (void)dev; (void)buf;
+    if(dir == CAPTURE_TX) {
+        g_capture_count++;
+        g_capture_seq_out = seq_out;
+        g_capture_length  = len;
+    }
 }
+uint64_t host_time_us(void) { return g_host_time_us += 10; }
+/* Each read of the ns clock advances it g_host_step_ns. */
+static uint64_t g_host_time_ns = 0;
+static uint64_t g_host_step_ns = 1000;
+uint64_t host_time_ns(void) { return g_host_time_ns += g_host_step_ns; }
 
 /* ---- code under test ---- */
 #include "../driver/rp2040_eth_state.c"
@@ -89,6 +193,12 @@ static hal_float_t v_joint_ferror_suggest[MAX_JOINT];
 static hal_float_t v_joint_vel_calculated[MAX_JOINT];
 static hal_s32_t   v_joint_pos_error_fb[MAX_JOINT];
 static hal_bit_t   v_joint_enable_fb[MAX_JOINT];
+static hal_u32_t   v_tx_class_bytes[TX_CLASS_COUNT];
+static hal_u32_t   v_feedback_mode;
+static hal_float_t v_hist_p50_us[HIST_COUNT];
+static hal_float_t v_hist_p99_us[HIST_COUNT];
+static hal_float_t v_hist_max_us[HIST_COUNT];
+static hal_bit_t   v_hist_reset;
 
 static skeleton_t make_data(void) {
     memset(&v_eth_up, 0, sizeof(v_eth_up));
@@ -113,6 +223,22 @@ static skeleton_t make_data(void) {
     d.seq_out         = &v_seq_out;
     d.seq_in          = &v_seq_in;
     d.config_complete = &v_config_complete;
+    d.feedback_mode   = &v_feedback_mode;
+    d.period_ns       = 1000000;
+    for(int c = 0; c < TX_CLASS_COUNT; c++) {
+        v_tx_class_bytes[c] = 0;
+        d.tx_class_bytes[c] = &v_tx_class_bytes[c];
+    }
+    v_hist_reset = false;
+    d.hist_reset = &v_hist_reset;
+    for(int h = 0; h < HIST_COUNT; h++) {
+        v_hist_p50_us[h] = 0;
+        v_hist_p99_us[h] = 0;
+        v_hist_max_us[h] = 0;
+        d.hist_p50_us[h] = &v_hist_p50_us[h];
+        d.hist_p99_us[h] = &v_hist_p99_us[h];
+        d.hist_max_us[h] = &v_hist_max_us[h];
+    }
     for(int i = 0; i < MAX_JOINT; i++) {
         d.joint_enable_cmd[i]     = &v_joint_enable_cmd[i];
         d.joint_vel_fb[i]         = &v_joint_vel_fb[i];
@@ -141,8 +267,20 @@ static skeleton_t make_data(void) {
 static void reset_mocks(void) {
     g_send_retval      = 0;
     g_send_call_count  = 0;
-    g_reply_length     = 0;
+    g_reply_count     = 0;
     g_reply_call_count = 0;
+    g_reply_current_at = 0;
+    g_motion_len       = 0;
+    g_config_len       = 0;
+    g_joint_config_calls = 0;
+    g_gpio_config_calls  = 0;
+    g_config_hash_pending = false;
+    g_flash_hold_ms    = 0;
+    g_call_log[0]      = '\0';
+    g_host_step_ns     = 1000;
+    g_dead_dev    = -1;
+    g_capture_count = 0;
+    nw_buff_set_limit(NW_BUF_LEN_LEGACY);
     eth_state_reset();
 }
 
@@ -155,7 +293,7 @@ static void test_cable_unplug_sets_eth_down(void **state) {
     reset_mocks();
     skeleton_t data = make_data();
     *data.eth_up = true;
-    g_reply_length = 0;   /* no replies — simulates unplugged cable */
+    g_reply_count = 0;   /* no replies — simulates unplugged cable */
 
     for(int i = 0; i <= MAX_SKIPPED_PACKETS; i++) {
         eth_state_update(&data, 0, i, 0, 1);
@@ -172,7 +310,7 @@ static void test_send_failure_sets_eth_down(void **state) {
     skeleton_t data = make_data();
     *data.eth_up = true;
     g_send_retval  = -1;   /* send always fails */
-    g_reply_length = 0;    /* no replies */
+    g_reply_count = 0;    /* no replies */
 
     for(int i = 0; i <= MAX_SKIPPED_PACKETS; i++) {
         eth_state_update(&data, 0, i, 0, 1);
@@ -181,7 +319,7 @@ static void test_send_failure_sets_eth_down(void **state) {
 }
 
 /* After send_data() fails, sends are skipped for 2000 periods but
- * get_reply_non_block still runs every period. */
+ * receive_replies still runs every period. */
 static void test_cooloff_skips_send_but_not_receive(void **state) {
     (void)state;
     reset_mocks();
@@ -204,6 +342,59 @@ static void test_cooloff_skips_send_but_not_receive(void **state) {
     assert_int_equal(g_reply_call_count, 2000);   /* receive runs every period */
 }
 
+/* A board announcing a flash write is neither sent to nor called down while
+ * it is silent; once the hold ends, misses count again. */
+static void test_flash_write_holds_off_eth_down(void **state) {
+    (void)state;
+    reset_mocks();
+    skeleton_t data = make_data();
+    *data.eth_up = true;
+
+    g_reply_count   = 1;
+    g_flash_hold_ms = 500;
+    eth_state_update(&data, 0, 0, 0, 1);
+    assert_int_equal(g_send_call_count, 1);
+
+    g_reply_count = 0;
+    for(int i = 1; i <= 5 * MAX_SKIPPED_PACKETS; i++) {
+        eth_state_update(&data, 0, i, 0, 1);
+    }
+    assert_true(*data.eth_up);
+    assert_int_equal(*data.rx_miss_count, 0);
+    assert_int_equal(g_send_call_count, 1);
+
+    g_host_time_us += 500 * 1000;
+    for(int i = 0; i <= MAX_SKIPPED_PACKETS; i++) {
+        eth_state_update(&data, 0, i, 0, 1);
+    }
+    assert_int_equal(g_send_call_count, 1 + MAX_SKIPPED_PACKETS + 1);
+    assert_false(*data.eth_up);
+}
+
+/* Every packet handed to send_data() is captured, with the seq-out it carries,
+ * including ones the socket refuses. Nothing is captured during cooloff. */
+static void test_sent_packets_are_captured(void **state) {
+    (void)state;
+    reset_mocks();
+    skeleton_t data = make_data();
+    *data.eth_up = true;
+    g_reply_count = 1;
+    g_motion_len  = 16;
+
+    eth_state_update(&data, 0, 41, 0, 1);
+    assert_int_equal(g_capture_count, 1);
+    assert_int_equal(g_capture_seq_out, 41);
+    assert_true(g_capture_length >= 4 + g_motion_len);  /* Header and payload. */
+
+    g_send_retval = -1;
+    eth_state_update(&data, 0, 42, 0, 1);
+    assert_int_equal(g_capture_count, 2);
+    assert_int_equal(g_capture_seq_out, 42);
+
+    eth_state_update(&data, 0, 43, 0, 1);
+    assert_int_equal(g_capture_count, 2);
+}
+
 /* on_eth_up fires only when all joints report vel_fb == 0.0 AND
  * last_joint_config[joint].enable == false. */
 static void test_recovery_waits_for_all_stopped(void **state) {
@@ -211,7 +402,7 @@ static void test_recovery_waits_for_all_stopped(void **state) {
     reset_mocks();
     skeleton_t data = make_data();
     *data.eth_up = false;
-    g_reply_length = 1;   /* fake a received packet so the recovery path runs */
+    g_reply_count = 1;   /* fake a received packet so the recovery path runs */
 
     /* While joint is still moving, recovery must not fire. */
     v_joint_vel_fb[0] = 1.0;
@@ -251,7 +442,7 @@ static void test_recovery_requires_all_joints_stopped_multi_joint(void **state)
     reset_mocks();
     skeleton_t data = make_data();
     *data.eth_up   = false;
-    g_reply_length = 1;
+    g_reply_count = 1;
 
     /* Joint 0 stopped, joint 1 still moving. */
     v_joint_vel_fb[0] = 0.0;
@@ -266,14 +457,349 @@ static void test_recovery_requires_all_joints_stopped_multi_joint(void **state)
     assert_true(*data.machine_on);
 }
 
+/* Motion is packed first and always fits; config that would push the packet
+ * past the budget is held back and retried once there is room. */
+static void test_composer_defers_config_over_budget(void **state) {
+    (void)state;
+    reset_mocks();
+    skeleton_t data = make_data();
+    *data.eth_up = true;
+    g_reply_count = 1;
+    g_motion_len = NW_BUF_LEN_LEGACY - 32;
+    g_config_len = 40;   /* Joint 0 config always differs: gpio_step is -1. */
+
+    eth_state_update(&data, 0, 0, 0, 1);
+    assert_int_equal(g_send_call_count, 1);
+    assert_int_equal(*data.tx_class_bytes[TX_CLASS_MOTION], NW_BUF_LEN_LEGACY - 32);
+    assert_int_equal(*data.tx_class_bytes[TX_CLASS_CONFIG], 0);
+
+    /* The deferred item is retried once the budget allows it. */
+    nw_buff_set_limit(NW_BUF_LEN);
+    eth_state_update(&data, 0, 1, 0, 1);
+    assert_int_equal(*data.tx_class_bytes[TX_CLASS_MOTION], NW_BUF_LEN_LEGACY - 32);
+    assert_int_equal(*data.tx_class_bytes[TX_CLASS_CONFIG], 40);
+
+    /* No room for motion at all: nothing is sent. */
+    nw_buff_set_limit(NW_BUF_LEN_LEGACY);
+    g_motion_len = NW_BUF_LEN_LEGACY + 4;
+    eth_state_update(&data, 0, 2, 0, 1);
+    assert_int_equal(g_send_call_count, 2);
+    assert_int_equal(*data.tx_class_bytes[TX_CLASS_MOTION], 0);
+}
+
+/* Every dirty config item goes out in the first packet, and an item awaiting
+ * its REPLY_*_CONFIG is not resent until CONFIG_RESEND_CYCLES have passed. */
+static void test_config_burst_and_resend_throttle(void **state) {
+    (void)state;
+    reset_mocks();
+    skeleton_t data = make_data();
+    *data.eth_up = true;
+    g_reply_count = 1;
+    g_config_len = 8;
+    data.gpio_type[0] = GPIO_TYPE_NATIVE_OUT;
+    data.gpio_type[1] = GPIO_TYPE_NATIVE_IN;
+    data.gpio_type[2] = GPIO_TYPE_NATIVE_IN;
+
+    eth_state_update(&data, 0, 0, 0, 2);
+    assert_int_equal(g_joint_config_calls, 2);
+    assert_int_equal(g_gpio_config_calls, 3);
+    assert_int_equal(*data.tx_class_bytes[TX_CLASS_CONFIG], 5 * 8);
+
+    /* No confirmation arrives (process_data is stubbed). */
+    for(size_t count = 1; count < CONFIG_RESEND_CYCLES; count++) {
+        eth_state_update(&data, 0, count, 0, 2);
+        assert_int_equal(*data.tx_class_bytes[TX_CLASS_CONFIG], 0);
+    }
+    eth_state_update(&data, 0, CONFIG_RESEND_CYCLES, 0, 2);
+    assert_int_equal(g_joint_config_calls, 4);
+    assert_int_equal(g_gpio_config_calls, 6);
+
+    /* A confirmed item is no longer dirty. */
+    eth->last_gpio_config[0].gpio_type = GPIO_TYPE_NATIVE_OUT;
+    g_gpio_replied[0] = 1u << 0;
+    eth_state_update(&data, 0, 2 * CONFIG_RESEND_CYCLES, 0, 2);
+    assert_int_equal(g_gpio_config_calls, 8);
+}
+
+/* A REPLY_CONFIG_HASH matching the HAL config marks everything confirmed, so
+ * no config is sent. A stale hash changes nothing. */
+static void test_config_cache_hash_match_skips_config(void **state) {
+    (void)state;
+    reset_mocks();
+    skeleton_t data = make_data();
+    *data.eth_up = true;
+    g_reply_count = 1;
+    g_config_len = 8;
+    data.joint_gpio_step[0] = 2;
+    data.joint_gpio_dir[0]  = 3;
+    v_joint_vel_limit[0] = 10.0;
+    v_joint_scale[0]     = 100.0;
+    data.gpio_type[5]  = GPIO_TYPE_NATIVE_IN;
+    data.gpio_index[5] = 12;
+
+    g_config_hash_pending = true;
+    g_config_hash = hal_config_hash(&data, 2) + 1;
+    eth_state_update(&data, 0, 0, 0, 2);
+    assert_int_equal(g_joint_config_calls, 2);
+    assert_int_equal(g_gpio_config_calls, 1);
+
+    reset_mocks();
+    g_reply_count = 1;
+    g_config_len = 8;
+    g_config_hash_pending = true;
+    g_config_hash = hal_config_hash(&data, 2);
+    eth_state_update(&data, 0, 0, 0, 2);
+    assert_int_equal(g_joint_config_calls, 0);
+    assert_int_equal(g_gpio_config_calls, 0);
+    assert_true(*data.config_complete);
+    assert_false(eth->last_joint_config[0].enable);
+    assert_int_equal(eth->last_gpio_config[5].index, 12);
+}
+
+/* config-complete follows a HAL param change and the REPLY_*_CONFIG that
+ * confirms it, without anything else being rechecked. */
+static void test_config_complete_tracks_changes(void **state) {
+    (void)state;
+    reset_mocks();
+    skeleton_t data = make_data();
+    *data.eth_up = true;
+    g_reply_count = 1;
+    g_config_len = 8;
+    data.joint_gpio_step[0] = 2;
+    data.joint_gpio_dir[0]  = 3;
+    data.joint_gpio_step[1] = 4;
+    data.joint_gpio_dir[1]  = 5;
+    g_config_hash_pending = true;
+    g_config_hash = hal_config_hash(&data, 2);
+    eth_state_update(&data, 0, 0, 0, 2);
+    assert_true(*data.config_complete);
+    assert_int_equal(eth->unconfirmed_count, 0);
+
+    /* A GPIO param changes: one item is dirty and gets sent. */
+    data.gpio_type[100]  = GPIO_TYPE_NATIVE_IN;
+    data.gpio_index[100] = 7;
+    eth_state_update(&data, 0, 1, 0, 2);
+    assert_false(*data.config_complete);
+    assert_int_equal(eth->unconfirmed_count, 1);
+    assert_int_equal(g_gpio_config_calls, 1);
+
+    /* Its reply arrives. */
+    eth->last_gpio_config[100].gpio_type = GPIO_TYPE_NATIVE_IN;
+    eth->last_gpio_config[100].index     = 7;
+    g_gpio_replied[100 / 32] = 1u << (100 % 32);
+    eth_state_update(&data, 0, 2, 0, 2);
+    assert_true(*data.config_complete);
+    assert_int_equal(eth->unconfirmed_count, 0);
+
+    /* Enabling a joint makes it dirty but leaves it counted as confirmed. */
+    v_joint_enable_cmd[1] = true;
+    eth_state_update(&data, 0, 3, 0, 2);
+    assert_true(*data.config_complete);
+    assert_int_equal(g_joint_config_calls, 1);
+
+    /* A joint limit change is not. */
+    v_joint_scale[0]     = 100.0;
+    v_joint_vel_limit[0] = 20.0;
+    eth_state_update(&data, 0, 4, 0, 2);
+    assert_false(*data.config_complete);
+}
+
+/* reply-wait-us spins after sending until the reply to this packet arrives. */
+static void test_reply_wait_catches_current_reply(void **state) {
+    (void)state;
+    reset_mocks();
+    skeleton_t data = make_data();
+    *data.eth_up = true;
+    data.reply_wait_us = 200;
+    g_reply_current_at = 3;
+
+    eth_state_update(&data, 0, 5, 0, 1);
+    assert_int_equal(g_reply_call_count, 3);
+    assert_int_equal(*data.seq_in, 5);
+    assert_int_equal(*data.feedback_mode, FEEDBACK_SAME_CYCLE);
+    assert_int_equal(*data.rx_miss_count, 0);
+
+    /* Without the wait the reply is picked up next cycle. */
+    reset_mocks();
+    data.reply_wait_us = 0;
+    g_reply_count = 1;
+    eth_state_update(&data, 0, 6, 0, 1);
+    assert_int_equal(g_reply_call_count, 1);
+    assert_int_equal(*data.feedback_mode, FEEDBACK_PREVIOUS);
+}
+
+/* The spin gives up at reply-wait-us, and never takes over half the period. */
+static void test_reply_wait_is_bounded(void **state) {
+    (void)state;
+    reset_mocks();
+    skeleton_t data = make_data();
+    *data.eth_up = true;
+    data.reply_wait_us = 200;
+
+    eth_state_update(&data, 0, 1, 0, 1);
+    /* The stub clock advances 10µs per read. */
+    assert_in_range(g_reply_call_count, 19, 21);
+    assert_int_equal(*data.feedback_mode, FEEDBACK_NONE);
+
+    reset_mocks();
+    data.period_ns = 100000;
+    eth_state_update(&data, 0, 2, 0, 1);
+    assert_in_range(g_reply_call_count, 4, 6);
+}
+
+/* Replies drained by the read funct count for the cycle. */
+static void test_read_funct_delivers_feedback(void **state) {
+    (void)state;
+    reset_mocks();
+    skeleton_t data = make_data();
+    *data.eth_up = true;
+
+    g_reply_count = 1;
+    eth_state_read(&data, 0);
+    g_reply_count = 0;
+    eth_state_update(&data, 0, 1, 0, 1);
+    assert_int_equal(*data.feedback_mode, FEEDBACK_READ);
+    assert_true(*data.eth_up);
+    assert_int_equal(*data.rx_miss_count, 0);
+    assert_int_equal(data.read_replies, 0);
+
+    /* Nothing at all this cycle. */
+    eth_state_update(&data, 0, 2, 0, 1);
+    assert_int_equal(*data.feedback_mode, FEEDBACK_NONE);
+    assert_int_equal(*data.rx_miss_count, 1);
+}
+
+/* Every board's packet goes out before any board's replies are collected,
+ * and each board keeps its own link state. */
+static void test_boards_send_together_keep_own_state(void **state) {
+    (void)state;
+    reset_mocks();
+    skeleton_t data[2] = {make_data(), make_data()};
+    const int num_joints[2] = {1, 1};
+    /* Board 1 gets its own link pins; joint pins stay shared. */
+    hal_bit_t eth_up_1 = false, config_complete_1 = false;
+    hal_u32_t rx_miss_1 = 0, seq_out_1 = 0, seq_in_1 = 0, feedback_mode_1 = 0;
+    data[1].eth_up          = &eth_up_1;
+    data[1].config_complete = &config_complete_1;
+    data[1].rx_miss_count   = &rx_miss_1;
+    data[1].seq_out         = &seq_out_1;
+    data[1].seq_in          = &seq_in_1;
+    data[1].feedback_mode   = &feedback_mode_1;
+    *data[0].eth_up = true;
+    *data[1].eth_up = true;
+
+    g_reply_count = 1;
+    eth_state_update_boards(data, 2, 1, 0, num_joints);
+    assert_int_equal(strcmp(g_call_log, "S0S1R0R1"), 0);
+
+    /* Board 1's link fails; board 0 is unaffected. */
+    g_dead_dev = 1;
+    for(int i = 0; i <= MAX_SKIPPED_PACKETS; i++) {
+        eth_state_update_boards(data, 2, 2 + i, 0, num_joints);
+    }
+    assert_true(*data[0].eth_up);
+    assert_false(*data[1].eth_up);
+    assert_int_equal(eth_states[0].send_fail_count, 0);
+    assert_true(eth_states[1].send_fail_count > 0);
+}
+
+/* Two boards that never reply share one reply-wait deadline: the servo
+ * thread spins at most half a period in all, not half a period per board. */
+static void test_reply_wait_bounded_across_boards(void **state) {
+    (void)state;
+    reset_mocks();
+    skeleton_t data[2] = {make_data(), make_data()};
+    const int num_joints[2] = {1, 1};
+    hal_bit_t eth_up_1 = true, config_complete_1 = false;
+    hal_u32_t rx_miss_1 = 0, seq_out_1 = 0, seq_in_1 = 0, feedback_mode_1 = 0;
+    data[1].eth_up          = &eth_up_1;
+    data[1].config_complete = &config_complete_1;
+    data[1].rx_miss_count   = &rx_miss_1;
+    data[1].seq_out         = &seq_out_1;
+    data[1].seq_in          = &seq_in_1;
+    data[1].feedback_mode   = &feedback_mode_1;
+    *data[0].eth_up = true;
+    data[0].reply_wait_us = 1000;  /* more than the period: capped at 500µs */
+    data[1].reply_wait_us = 1000;
+
+    uint64_t start_us = g_host_time_us;
+    eth_state_update_boards(data, 2, 1, 0, num_joints);
+    /* The stub clock advances 10µs per read. */
+    assert_true(g_host_time_us - start_us <= data[0].period_ns / 2000 + 20);
+    /* Both boards were polled while waiting. */
+    assert_non_null(strstr(g_call_log, "R0R1R0R1"));
+    assert_int_equal(*data[0].feedback_mode, FEEDBACK_NONE);
+    assert_int_equal(*data[1].feedback_mode, FEEDBACK_NONE);
+}
+
+/* Send and receive times reach the histograms and their pins; hist.reset
+ * clears them. */
+static void test_timing_histograms(void **state) {
+    (void)state;
+    reset_mocks();
+    skeleton_t data = make_data();
+    *data.eth_up = true;
+    g_reply_count = 1;
+
+    /* Every clock read is 1 µs on: send and receive each take 1 µs. */
+    int cycle = 0;
+    for(; cycle < 10; cycle++) {
+        eth_state_update(&data, 0, cycle, 0, 1);
+    }
+    assert_int_equal(data.hist[HIST_SEND].total, 10);
+    assert_int_equal(data.hist[HIST_RECEIVE].total, 10);
+    assert_int_equal(data.hist[HIST_UNPACK].total, 10);
+    /* Send is refreshed on the first cycle; receive waits its turn. */
+    assert_float_equal(*data.hist_p50_us[HIST_SEND], 1.0, 1e-9);
+    assert_float_equal(*data.hist_p50_us[HIST_RECEIVE], 0.0, 1e-9);
+    assert_float_equal(*data.hist_max_us[HIST_RECEIVE], 1.0, 1e-9);
+    for(; cycle < HIST_REFRESH_CYCLES * HIST_COUNT; cycle++) {
+        eth_state_update(&data, 0, cycle, 0, 1);
+    }
+    assert_float_equal(*data.hist_p50_us[HIST_RECEIVE], 1.0, 1e-9);
+    assert_float_equal(*data.hist_p99_us[HIST_UNPACK], 0.0, 1e-9);
+
+    /* One slow send, off a refresh cycle, shows in max at once and in the
+     * percentiles only once send's turn comes round again. */
+    eth_state_update(&data, 0, cycle++, 0, 1);
+    g_host_step_ns = 50000;
+    eth_state_update(&data, 0, cycle++, 0, 1);
+    g_host_step_ns = 1000;
+    assert_float_equal(*data.hist_max_us[HIST_SEND], 50.0, 1e-9);
+    assert_float_equal(*data.hist_p99_us[HIST_SEND], 1.0, 1e-9);
+    for(int i = 0; i < HIST_REFRESH_CYCLES * HIST_COUNT; i++) {
+        eth_state_update(&data, 0, cycle++, 0, 1);
+    }
+    /* Now the top of 1 µs's bucket, no longer capped by the max. */
+    assert_true(*data.hist_p50_us[HIST_SEND] >= 1.0 && *data.hist_p50_us[HIST_SEND] < 1.125);
+
+    *data.hist_reset = true;
+    eth_state_update(&data, 0, cycle++, 0, 1);
+    assert_int_equal(data.hist[HIST_SEND].total, 0);
+    assert_float_equal(*data.hist_max_us[HIST_SEND], 0.0, 1e-9);
+    assert_float_equal(*data.hist_p50_us[HIST_SEND], 0.0, 1e-9);
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_cable_unplug_sets_eth_down),
         cmocka_unit_test(test_send_failure_sets_eth_down),
         cmocka_unit_test(test_cooloff_skips_send_but_not_receive),
+        cmocka_unit_test(test_flash_write_holds_off_eth_down),
+        cmocka_unit_test(test_sent_packets_are_captured),
         cmocka_unit_test(test_recovery_waits_for_all_stopped),
         cmocka_unit_test(test_recovery_requires_all_joints_stopped_multi_joint),
         cmocka_unit_test(test_force_disable_while_eth_down),
+        cmocka_unit_test(test_composer_defers_config_over_budget),
+        cmocka_unit_test(test_config_burst_and_resend_throttle),
+        cmocka_unit_test(test_config_cache_hash_match_skips_config),
+        cmocka_unit_test(test_config_complete_tracks_changes),
+        cmocka_unit_test(test_reply_wait_catches_current_reply),
+        cmocka_unit_test(test_reply_wait_is_bounded),
+        cmocka_unit_test(test_reply_wait_bounded_across_boards),
+        cmocka_unit_test(test_read_funct_delivers_feedback),
+        cmocka_unit_test(test_boards_send_together_keep_own_state),
+        cmocka_unit_test(test_timing_histograms),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -69,6 +69,7 @@ void setup_data(skeleton_t* data) {
         data->gpio_data_received[bank] = 0;
         data->gpio_confirmation_pending[bank] = 0;
     }
+    memset(&data->gpio_masks, 0, sizeof(data->gpio_masks));
 }
 
 /* Turn a 32 bit value into an array of bool. */
@@ -92,6 +93,17 @@ bool helper_compare_gpio_data(hal_bit_t** gpio_data, uint32_t values, uint8_t ba
 }
 
 /* When an input on the RP changes value, the HAL data should change in response. */
+/* Unpack the replies in buffer as process_data() does, without the length and
+ * checksum checks. */
+static bool dispatch_replies(
+        struct NWBuffer* buffer,
+        size_t* rx_offset,
+        size_t* received_count,
+        struct ReplyContext context) {
+    return nw_dispatch(buffer, reply_dispatch, REPLY_TYPE_COUNT, &context,
+                       rx_offset, received_count) == NW_DISPATCH_OK;
+}
+
 static void test_serialize_gpio_in_change(void **state) {
     (void) state; /* unused */
 
@@ -383,6 +395,46 @@ static void test_serialize_gpio_out_retransmits_without_reply(void **state) {
     assert_int_equal(msg2->values, hal_values);
 }
 
+/* gpio_type is a HAL param and may change between calls. The masks
+ * serialize_gpio keeps must follow it. */
+static void test_serialize_gpio_type_change(void **state) {
+    (void) state;
+
+    skeleton_t data = {0};
+    setup_data(&data);
+
+    // HAL output wants bit 3 high; the board last reported it low.
+    *data.gpio_data_out[35] = true;
+    data.gpio_data_received[1] = 0;
+    data.gpio_type[35] = GPIO_TYPE_NATIVE_IN;
+
+    // As an input, the HAL pin follows the board and nothing needs sending.
+    struct NWBuffer buffer = {0};
+    assert_int_equal(serialize_gpio(&buffer, &data), 0);
+    assert_int_equal(data.gpio_masks.in[1], 0x1 << 3);
+    assert_int_equal(*data.gpio_data_in[35], false);
+
+    // Now an output: the HAL value must go to the board.
+    data.gpio_type[35] = GPIO_TYPE_NATIVE_OUT;
+    struct NWBuffer buffer2 = {0};
+    size_t data_size = serialize_gpio(&buffer2, &data);
+    assert_int_equal(data.gpio_masks.in[1], 0);
+    assert_int_equal(data.gpio_masks.out[1], 0x1 << 3);
+
+    assert_int_equal(data_size, aligned32(sizeof(struct Message_gpio)));
+    struct Message_gpio* msg = (void*)buffer2.payload;
+    assert_int_equal(msg->type, MSG_SET_GPIO);
+    assert_int_equal(msg->bank, 1);
+    assert_int_equal(msg->values, 0x1 << 3);
+    assert_int_equal(msg->confirmation_pending, true);
+
+    // Unconfigured again: the pin is ignored.
+    data.gpio_type[35] = GPIO_TYPE_NOT_SET;
+    struct NWBuffer buffer3 = {0};
+    assert_int_equal(serialize_gpio(&buffer3, &data), 0);
+    assert_int_equal(data.gpio_masks.out[1], 0);
+}
+
 static void test_unpack_gpio(void **state) {
     (void) state; /* unused */
 
@@ -407,7 +459,7 @@ static void test_unpack_gpio(void **state) {
     memcpy(buffer.payload, &reply, sizeof(reply));
     buffer.length = aligned32(sizeof(reply));
 
-    bool result = unpack_gpio(&buffer, &rx_offset, &received_count, &data);
+    bool result = dispatch_replies(&buffer, &rx_offset, &received_count, (struct ReplyContext){.data = &data});
 
     assert_int_equal(data.gpio_data_received[reply.bank], reply.values);
     assert_int_equal(result, true);
@@ -436,7 +488,9 @@ static void test_unpack_gpio_config(void **state) {
     memcpy(buffer.payload, &reply, sizeof(reply));
     buffer.length = 8;  // 32-bit aligned size of Reply_gpio_config
 
-    bool result = unpack_gpio_config(&buffer, &rx_offset, &received_count, last_gpio_config);
+    bool result = dispatch_replies(
+        &buffer, &rx_offset, &received_count,
+        (struct ReplyContext){.last_gpio_config = last_gpio_config});
 
     assert_true(result);
     assert_int_equal(received_count, 1);
@@ -453,6 +507,7 @@ int main(void) {
         cmocka_unit_test(test_serialize_gpio_in_change),
         cmocka_unit_test(test_serialize_gpio_confirmation_pending),
         cmocka_unit_test(test_serialize_gpio_nothing_to_do),
+        cmocka_unit_test(test_serialize_gpio_type_change),
         cmocka_unit_test(test_unpack_gpio),
         cmocka_unit_test(test_unpack_gpio_config)
     };
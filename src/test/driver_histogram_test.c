@@ -0,0 +1,83 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+
+#include "../driver/rp2040_histogram.h"
+
+
+/* Every value lands in a bucket that contains it and is no wider than
+ * 1/HISTOGRAM_SUB of it, and buckets follow on from each other. */
+static void test_bucket_bounds(void **state) {
+    (void) state; /* unused */
+
+    uint32_t values[] = {0, 1, 7, 8, 9, 15, 16, 17, 100, 999, 1000, 65535,
+                         1000000, 0x7fffffff, 0x80000000, UINT32_MAX};
+    for(size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        size_t bucket = histogram_bucket(values[i]);
+        assert_true(bucket < HISTOGRAM_BUCKETS);
+        uint32_t top = histogram_bucket_top(bucket);
+        uint32_t bottom = bucket == 0 ? 0 : histogram_bucket_top(bucket - 1) + 1;
+        assert_true(values[i] >= bottom);
+        assert_true(values[i] <= top);
+        assert_true((uint64_t)(top - bottom) * HISTOGRAM_SUB <= bottom || top - bottom == 0);
+    }
+    assert_int_equal(histogram_bucket(UINT32_MAX), HISTOGRAM_BUCKETS - 1);
+    assert_int_equal(histogram_bucket_top(HISTOGRAM_BUCKETS - 1), UINT32_MAX);
+}
+
+static void test_percentiles(void **state) {
+    (void) state; /* unused */
+
+    struct Histogram hist;
+    histogram_reset(&hist);
+    static const uint32_t permille[3] = {500, 990, 1000};
+    uint32_t out[3];
+
+    histogram_percentiles(&hist, permille, out, 3);
+    assert_int_equal(out[0], 0);
+    assert_int_equal(out[2], 0);
+
+    /* 1000 samples of 1..1000 µs in ns, then one 5 ms outlier. */
+    for(uint32_t value = 1; value <= 1000; value++) {
+        histogram_add(&hist, value * 1000);
+    }
+    histogram_add(&hist, 5000000);
+    assert_int_equal(hist.total, 1001);
+    assert_int_equal(hist.max, 5000000);
+
+    histogram_percentiles(&hist, permille, out, 3);
+    /* Within a bucket width (12.5%) above the true value. */
+    assert_true(out[0] >= 500000 && out[0] <= 500000 * 9 / 8);
+    assert_true(out[1] >= 990000 && out[1] <= 990000 * 9 / 8);
+    assert_int_equal(out[2], 5000000);
+}
+
+/* Counts halve rather than overflow, keeping their proportions. */
+static void test_counts_halve_at_limit(void **state) {
+    (void) state; /* unused */
+
+    struct Histogram hist;
+    histogram_reset(&hist);
+    hist.count[histogram_bucket(10)] = HISTOGRAM_MAX_TOTAL / 4 * 3;
+    hist.count[histogram_bucket(1000)] = HISTOGRAM_MAX_TOTAL / 4;
+    hist.total = HISTOGRAM_MAX_TOTAL;
+    hist.max = 1000;
+
+    histogram_add(&hist, 10);
+    assert_int_equal(hist.count[histogram_bucket(10)], HISTOGRAM_MAX_TOTAL / 8 * 3 + 1);
+    assert_int_equal(hist.count[histogram_bucket(1000)], HISTOGRAM_MAX_TOTAL / 8);
+    assert_int_equal(hist.total, HISTOGRAM_MAX_TOTAL / 2 + 1);
+    assert_int_equal(hist.max, 1000);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_bucket_bounds),
+        cmocka_unit_test(test_percentiles),
+        cmocka_unit_test(test_counts_halve_at_limit),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
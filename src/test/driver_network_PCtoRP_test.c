@@ -69,6 +69,90 @@ static void test_serialize_jont_pos(void **state) {
     assert_memory_equal(velocity, message_p->velocity, sizeof(double) * MAX_JOINT);
 }
 
+/* Once the firmware has agreed FEATURE_COMPACT_JOINT_POS, setpoints go out
+ * in fixed point and only for the joints the firmware reported. */
+static void test_serialize_joint_pos_q(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer buffer = {0};
+
+    double position[MAX_JOINT] = {34.5, -78.25, 12.0, 56.75};
+    double velocity[MAX_JOINT] = {1000.0, -500.0, 0.0, 1.0};
+    double scale[MAX_JOINT] = {1, 2, 1, 1};
+
+    skeleton_t data = {0};
+    data.period_ns = 2000000;  /* not 1ms, so the velocity unit shows */
+    for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+        data.joint_scale[joint]   = &scale[joint];
+        data.joint_pos_cmd[joint] = &position[joint];
+        data.joint_vel_cmd[joint] = &velocity[joint];
+    }
+
+    rp->detected_joint_count = 3;
+    rp->negotiated_features  = FEATURE_COMPACT_JOINT_POS;
+
+    size_t data_size = serialize_joint_pos(&buffer, &data);
+
+    assert_int_equal(data_size, aligned32(MESSAGE_SET_JOINTS_POS_Q_LEN(3)));
+    assert_true(data_size < sizeof(struct Message_set_joints_pos));
+    assert_int_equal(buffer.length, data_size);
+
+    struct Message_set_joints_pos_q* message_p = (void*)buffer.payload;
+    assert_int_equal(message_p->type, MSG_SET_JOINT_POS_Q);
+    assert_int_equal(message_p->count, 3);
+    for(size_t joint = 0; joint < 3; joint++) {
+        int64_t pos_q = message_p->joint[joint].position;
+        int32_t vel_q = message_p->joint[joint].velocity;
+        /* Exactly what Core0 makes of MSG_SET_JOINT_ABS_POS: steps/s over
+         * the period in µs, truncated. */
+        assert_int_equal(pos_q, (int64_t)(position[joint] * scale[joint] * 4294967296.0));
+        assert_int_equal(vel_q, (int32_t)((velocity[joint] * scale[joint] / 2000.0) * 65536.0));
+    }
+
+    /* Until negotiated the legacy message is used. */
+    reset_version_check();
+    reset_nw_buf(&buffer);
+    data_size = serialize_joint_pos(&buffer, &data);
+    assert_int_equal(data_size, aligned32(sizeof(struct Message_set_joints_pos)));
+    assert_int_equal(((struct Message_header*)buffer.payload)->type, MSG_SET_JOINT_ABS_POS);
+
+    rp->detected_joint_count = 0;
+}
+
+/* The coast allowance is a fixed size message, capped at MAX_COAST_PERIODS. */
+static void test_serialize_joint_coast(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer buffer = {0};
+    skeleton_t data = {0};
+    data.coast_periods = 2;
+
+    assert_true(serialize_joint_coast(&buffer, &data));
+    assert_int_equal(buffer.length, aligned32(sizeof(struct Message_set_joint_coast)));
+    struct Message_set_joint_coast* message_p = (void*)buffer.payload;
+    assert_int_equal(message_p->type, MSG_SET_JOINT_COAST);
+    assert_int_equal(message_p->periods, 2);
+
+    reset_nw_buf(&buffer);
+    data.coast_periods = MAX_COAST_PERIODS + 5;
+    assert_true(serialize_joint_coast(&buffer, &data));
+    assert_int_equal(message_p->periods, MAX_COAST_PERIODS);
+}
+
+static void test_serialize_version_request(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer buffer = {0};
+
+    size_t data_size = serialize_version_request(&buffer);
+
+    /* Same size on the wire as the original type-only request. */
+    assert_int_equal(data_size, 4);
+    struct Message_version_request* message_p = (void*)buffer.payload;
+    assert_int_equal(message_p->type, MSG_VERSION_REQUEST);
+    assert_int_equal(message_p->features, PROTOCOL_FEATURES);
+}
+
 static void test_serialize_joint_enable(void **state) {
     (void) state; /* unused */
 
@@ -141,12 +225,113 @@ static void test_serialize_joint_config(void **state) {
     assert_int_equal(message.cmd_type, message_p->cmd_type);
 }
 
+/* A simulated board whose crystal runs ppm fast, with a clock that read
+ * base_us at host time 0. */
+struct SimBoard {
+    double base_us;
+    double ppm;
+};
+
+static double sim_rp_time(const struct SimBoard* board, double host_us) {
+    return board->base_us + host_us * (1.0 + board->ppm * 1e-6);
+}
+
+static double sim_host_time(const struct SimBoard* board, double rp_us) {
+    return (rp_us - board->base_us) / (1.0 + board->ppm * 1e-6);
+}
+
+/* Two boards with different crystal errors and clock offsets are synced
+ * through the driver's own reply path and given one host target. Each reply
+ * crosses the same wire, slower down than up, then waits in the socket for
+ * a different time per board before it is unpacked. The kernel receive stamp
+ * is t4, so the wait biases neither board and the shared wire asymmetry
+ * biases both alike: their ticks must land within a few µs of each other. */
+static void test_serialize_tick_sync__two_boards_align(void **state) {
+    (void) state; /* unused */
+
+    const struct SimBoard boards[2] = {
+        { .base_us =   5000000.0, .ppm =  40.0 },
+        { .base_us = 123456789.0, .ppm = -25.0 },
+    };
+    hal_float_t offset_us, drift_ppm, up_us, down_us, round_trip;
+    skeleton_t data = {0};
+    data.clock_offset_us = &offset_us;
+    data.clock_drift_ppm = &drift_ppm;
+    data.latency_up_us   = &up_us;
+    data.latency_down_us = &down_us;
+    data.round_trip_us   = &round_trip;
+    /* What stamping t4 on unpack would have made of the same exchanges. */
+    struct ClockSync unpack_stamped[2] = {0};
+    uint64_t host_us = 1000000;
+    for(int device = 0; device < 2; device++) {
+        memset(&device_state[device].clock_sync, 0, sizeof(struct ClockSync));
+    }
+
+    /* 3 s of exchanges, one per 1 ms servo period. */
+    for(int i = 0; i < 3000; i++, host_us += 1000) {
+        for(int device = 0; device < 2; device++) {
+            select_device(device);
+            uint64_t up   = 80 + (i % 5) + ((i * 7919) % 13 == 0 ? 400 : 0);
+            uint64_t down = 110 + ((i * 31) % 7);
+            uint64_t wait = device == 0 ? 200 + (i * 37) % 700 : 20 + i % 3;
+            uint64_t t1 = host_us;
+            struct Reply_clock_sync reply = {
+                .type = REPLY_CLOCK_SYNC,
+                .host_tx_us = t1,
+                .rp_rx_us = (uint64_t)llround(sim_rp_time(&boards[device], t1 + up)),
+                .rp_tx_us = (uint64_t)llround(sim_rp_time(&boards[device], t1 + up + 15)),
+            };
+            uint64_t arrived_us = t1 + up + 15 + down;
+            struct NWBuffer buffer = {0};
+            pack_nw_buff(&buffer, &reply, sizeof(reply));
+            size_t received_count = 0;
+            process_reply(&buffer, &data, &received_count, nw_buff_wire_len(&buffer), true,
+                          arrived_us * 1000, NULL, NULL, NULL);
+            assert_int_equal(received_count, 1);
+            assert_true(clock_sync_update(&unpack_stamped[device], t1,
+                        reply.rp_rx_us, reply.rp_tx_us, arrived_us + wait));
+        }
+    }
+
+    uint64_t target_us = host_us + 250;
+    double tick_host_us[2];
+    for(int device = 0; device < 2; device++) {
+        select_device(device);
+        struct NWBuffer buffer = {0};
+        size_t data_size = serialize_tick_sync(&buffer, target_us);
+        assert_int_equal(data_size, aligned32(sizeof(struct Message_tick_sync)));
+
+        struct Message_tick_sync* message_p = (void*)buffer.payload;
+        assert_int_equal(message_p->type, MSG_TICK_SYNC);
+        tick_host_us[device] = sim_host_time(&boards[device], (double)message_p->rp_target_us);
+        /* Half the 30µs the down leg is slower by. */
+        assert_true(fabs(tick_host_us[device] - (double)target_us) < 20.0);
+    }
+    assert_true(fabs(tick_host_us[0] - tick_host_us[1]) < 3.0);
+
+    /* Stamped on unpack, board 0's longer waits would have pulled it away. */
+    double unpack_skew_us = clock_sync_offset_at(&unpack_stamped[0], target_us)
+                            - clock_sync_offset_at(&device_state[0].clock_sync, target_us);
+    assert_true(fabs(unpack_skew_us) > 50.0);
+
+    /* No offset yet: nothing is packed. */
+    memset(&device_state[1].clock_sync, 0, sizeof(struct ClockSync));
+    struct NWBuffer buffer = {0};
+    assert_int_equal(serialize_tick_sync(&buffer, target_us), 0);
+    assert_int_equal(buffer.length, 0);
+    select_device(0);
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_serialize_timing),
         cmocka_unit_test(test_serialize_jont_pos),
+        cmocka_unit_test(test_serialize_joint_pos_q),
+        cmocka_unit_test(test_serialize_joint_coast),
+        cmocka_unit_test(test_serialize_version_request),
         cmocka_unit_test(test_serialize_joint_enable),
-        cmocka_unit_test(test_serialize_joint_config)
+        cmocka_unit_test(test_serialize_joint_config),
+        cmocka_unit_test(test_serialize_tick_sync__two_boards_align)
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -6,6 +6,7 @@
 
 #include "../driver/rp2040_network.c"
 #include "mocks/driver_mocks.h"
+#include <sys/socket.h>
 #include "../shared/messages.h"
 
 
@@ -30,6 +31,13 @@ hal_u32_t core1_work_us;
 hal_u32_t core0_work_us;
 hal_float_t update_overrun;
 hal_float_t update_underrun;
+hal_u32_t periods_coasted;
+hal_float_t clock_offset_us;
+hal_float_t clock_drift_ppm;
+hal_float_t latency_up_us;
+hal_float_t latency_down_us;
+hal_float_t round_trip_us;
+hal_s32_t tick_phase_error_us;
 
 hal_float_t spindle_speed_fb[MAX_SPINDLE];
 hal_float_t spindle_speed_cmd[MAX_SPINDLE];
@@ -58,6 +66,13 @@ void setup_data(skeleton_t* data) {
   data->core1_tick      = &core1_tick;
   data->core1_work_us   = &core1_work_us;
   data->core0_work_us   = &core0_work_us;
+  data->periods_coasted = &periods_coasted;
+  data->clock_offset_us = &clock_offset_us;
+  data->clock_drift_ppm = &clock_drift_ppm;
+  data->latency_up_us   = &latency_up_us;
+  data->latency_down_us = &latency_down_us;
+  data->round_trip_us   = &round_trip_us;
+  data->tick_phase_error_us = &tick_phase_error_us;
 
   for (size_t s = 0; s < MAX_SPINDLE; s++) {
     data->spindle_speed_fb[s]  = &spindle_speed_fb[s];
@@ -69,6 +84,17 @@ void setup_data(skeleton_t* data) {
 
 
 /* Test the message types. */
+/* Unpack the replies in buffer as process_data() does, without the length and
+ * checksum checks. */
+static bool dispatch_replies(
+        struct NWBuffer* buffer,
+        size_t* rx_offset,
+        size_t* received_count,
+        struct ReplyContext context) {
+    return nw_dispatch(buffer, reply_dispatch, REPLY_TYPE_COUNT, &context,
+                       rx_offset, received_count) == NW_DISPATCH_OK;
+}
+
 static void test_timing(void **state) {
     (void) state; /* unused */
 
@@ -154,6 +180,127 @@ static void test_joint_movement(void **state) {
     assert_int_equal(*data.core1_tick, message.core1_tick);
 }
 
+/* Helper: append raw bytes to a compact movement reply under construction. */
+static size_t put_bytes(uint8_t* buf, size_t offset, const void* value, size_t len) {
+    memcpy(buf + offset, value, len);
+    return offset + len;
+}
+
+static void send_movement_v2(skeleton_t* data, const uint8_t* bytes, size_t len) {
+    struct NWBuffer buffer = {0};
+    size_t mess_received_count = 0;
+    pack_nw_buff(&buffer, (void*)bytes, len);
+    process_data(&buffer, data, &mess_received_count,
+                 buffer.length + sizeof(buffer.length) + sizeof(buffer.checksum),
+                 NULL, NULL, NULL);
+    assert_int_equal(mess_received_count, 1);
+}
+
+/* Keyframe followed by a delta coded against it rebuilds the full state. */
+static void test_joint_movement_v2(void **state) {
+    (void) state; /* unused */
+
+    skeleton_t data = {0};
+    setup_data(&data);
+    reset_version_check();
+    for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+        *data.joint_scale[joint] = 1.0;
+    }
+
+    uint8_t bytes[REPLY_JOINT_MOVEMENT_V2_MAX_LEN];
+    struct Reply_joint_movement_v2 reply = {
+        .type = REPLY_JOINT_MOVEMENT_V2,
+        .count = MAX_JOINT,
+        .enabled = 0x5,
+        .pos_present = 0xf,
+        .pos_wide = 0xf,
+        .vel_present = 0xf,
+        .vcmd_present = 0xf,
+        .id = 7,
+        .base_id = 7,
+        .update_period_us = 1000,
+        .core1_tick = 55,
+    };
+    size_t offset = sizeof(reply);
+    for(int32_t joint = 0; joint < MAX_JOINT; joint++) {
+        int32_t pos = 100 * joint - 50;
+        offset = put_bytes(bytes, offset, &pos, sizeof(pos));
+    }
+    for(int32_t joint = 0; joint < MAX_JOINT; joint++) {
+        int32_t vel = 65536 * joint;
+        offset = put_bytes(bytes, offset, &vel, sizeof(vel));
+    }
+    for(int32_t joint = 0; joint < MAX_JOINT; joint++) {
+        float vcmd = 10.0f * joint;
+        offset = put_bytes(bytes, offset, &vcmd, sizeof(vcmd));
+    }
+    memcpy(bytes, &reply, sizeof(reply));
+    send_movement_v2(&data, bytes, offset);
+
+    for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+        assert_double_equal(*data.joint_pos_fb[joint], 100.0 * joint - 50, 1e-9);
+        assert_double_equal(*data.joint_vel_fb[joint], (double)joint, 1e-9);
+        assert_int_equal(*data.joint_enable_fb[joint], joint % 2 == 0);
+        assert_double_equal(*data.joint_vel_calculated[joint], 10.0 * joint, 1e-6);
+    }
+    assert_int_equal(*data.core1_tick, 55);
+
+    struct NWBuffer ack_buf = {0};
+    serialize_feedback_ack(&ack_buf);
+    struct Message_feedback_ack* ack = (void*)ack_buf.payload;
+    assert_int_equal(ack->type, MSG_FEEDBACK_ACK);
+    assert_int_equal(ack->valid, 1);
+    assert_int_equal(ack->id, 7);
+
+    /* Delta against reply 7: joint 1 moves -3 (int16), joint 3 moves +70000
+     * (int32), joint 0 changes velocity, everything else is unchanged. */
+    reply.id = 8;
+    reply.enabled = 0x1;
+    reply.pos_present = 0xa;
+    reply.pos_wide = 0x8;
+    reply.vel_present = 0x1;
+    reply.vcmd_present = 0x0;
+    reply.core1_tick = 56;
+    int16_t narrow = -3;
+    int32_t wide = 70000;
+    int32_t vel = -131072;
+    offset = sizeof(reply);
+    offset = put_bytes(bytes, offset, &narrow, sizeof(narrow));
+    offset = put_bytes(bytes, offset, &wide, sizeof(wide));
+    offset = put_bytes(bytes, offset, &vel, sizeof(vel));
+    memcpy(bytes, &reply, sizeof(reply));
+    send_movement_v2(&data, bytes, offset);
+
+    assert_double_equal(*data.joint_pos_fb[0], -50.0, 1e-9);
+    assert_double_equal(*data.joint_pos_fb[1], 47.0, 1e-9);
+    assert_double_equal(*data.joint_pos_fb[2], 150.0, 1e-9);
+    assert_double_equal(*data.joint_pos_fb[3], 70250.0, 1e-9);
+    assert_double_equal(*data.joint_vel_fb[0], -2.0, 1e-9);
+    assert_double_equal(*data.joint_vel_fb[3], 3.0, 1e-9);
+    assert_int_equal(*data.joint_enable_fb[2], 0);
+    assert_double_equal(*data.joint_vel_calculated[3], 30.0, 1e-6);
+    assert_int_equal(*data.core1_tick, 56);
+
+    /* Coded against a reply we never decoded: consumed but not applied. */
+    reply.id = 20;
+    reply.base_id = 19;
+    reply.core1_tick = 57;
+    offset = sizeof(reply);
+    offset = put_bytes(bytes, offset, &narrow, sizeof(narrow));
+    offset = put_bytes(bytes, offset, &wide, sizeof(wide));
+    offset = put_bytes(bytes, offset, &vel, sizeof(vel));
+    memcpy(bytes, &reply, sizeof(reply));
+    send_movement_v2(&data, bytes, offset);
+
+    assert_double_equal(*data.joint_pos_fb[1], 47.0, 1e-9);
+    assert_int_equal(*data.core1_tick, 56);
+    reset_nw_buf(&ack_buf);
+    serialize_feedback_ack(&ack_buf);
+    assert_int_equal(ack->id, 8);
+
+    reset_version_check();
+}
+
 static void test_joint_config(void **state) {
     (void) state; /* unused */
 
@@ -315,7 +462,7 @@ static void test_unpack_spindle_speed(void **state) {
     memcpy(buffer.payload, &reply, sizeof(reply));
     buffer.length = aligned32(sizeof(reply));
 
-    bool result = unpack_spindle_speed(&buffer, &rx_offset, &received_count, &data);
+    bool result = dispatch_replies(&buffer, &rx_offset, &received_count, (struct ReplyContext){.data = &data});
 
     assert_true(result);
     assert_int_equal(received_count, 1);
@@ -348,7 +495,7 @@ static void test_unpack_spindle_not_at_speed(void **state) {
     memcpy(buffer.payload, &reply, sizeof(reply));
     buffer.length = aligned32(sizeof(reply));
 
-    bool result = unpack_spindle_speed(&buffer, &rx_offset, &received_count, &data);
+    bool result = dispatch_replies(&buffer, &rx_offset, &received_count, (struct ReplyContext){.data = &data});
 
     assert_true(result);
     assert_int_equal(received_count, 1);
@@ -374,7 +521,9 @@ static void test_unpack_spindle_config(void **state) {
     memcpy(buffer.payload, &reply, sizeof(reply));
     buffer.length = 8;  /* sizeof(reply) = 6, aligned32(6) = 8 */
 
-    bool result = unpack_spindle_config(&buffer, &rx_offset, &received_count, last_spindle_config);
+    bool result = dispatch_replies(
+        &buffer, &rx_offset, &received_count,
+        (struct ReplyContext){.last_spindle_config = last_spindle_config});
 
     assert_true(result);
     assert_int_equal(received_count, 1);
@@ -385,8 +534,8 @@ static void test_unpack_spindle_config(void **state) {
 }
 
 static void reset_version_state(void) {
-    version_checked = false;
-    version_match   = false;
+    rp->version_checked = false;
+    rp->version_match   = false;
 }
 
 static void test_version__matching__ok(void **state) {
@@ -407,10 +556,10 @@ static void test_version__matching__ok(void **state) {
     memcpy(buffer.payload, &reply, sizeof(reply));
     buffer.length = aligned32(sizeof(reply));
 
-    bool result = unpack_version_reply(&buffer, &rx_offset, &received_count);
+    bool result = dispatch_replies(&buffer, &rx_offset, &received_count, (struct ReplyContext){0});
 
     assert_true(result);
-    assert_true(version_checked);
+    assert_true(rp->version_checked);
     assert_true(get_version_match());
     assert_int_equal(received_count, 1);
     assert_int_equal(rx_offset, aligned32(sizeof(reply)));
@@ -434,10 +583,10 @@ static void test_version__patch_mismatch__not_ok(void **state) {
     memcpy(buffer.payload, &reply, sizeof(reply));
     buffer.length = aligned32(sizeof(reply));
 
-    bool result = unpack_version_reply(&buffer, &rx_offset, &received_count);
+    bool result = dispatch_replies(&buffer, &rx_offset, &received_count, (struct ReplyContext){0});
 
     assert_true(result);
-    assert_true(version_checked);
+    assert_true(rp->version_checked);
     assert_false(get_version_match());
     assert_int_equal(received_count, 1);
 }
@@ -460,10 +609,10 @@ static void test_version__branch_mismatch__not_ok(void **state) {
     memcpy(buffer.payload, &reply, sizeof(reply));
     buffer.length = aligned32(sizeof(reply));
 
-    bool result = unpack_version_reply(&buffer, &rx_offset, &received_count);
+    bool result = dispatch_replies(&buffer, &rx_offset, &received_count, (struct ReplyContext){0});
 
     assert_true(result);
-    assert_true(version_checked);
+    assert_true(rp->version_checked);
     assert_false(get_version_match());
     assert_int_equal(received_count, 1);
 }
@@ -486,23 +635,421 @@ static void test_version__already_checked__skips_second_check(void **state) {
     };
     memcpy(buffer.payload, &reply, sizeof(reply));
     buffer.length = aligned32(sizeof(reply));
-    unpack_version_reply(&buffer, &rx_offset, &received_count);
+    dispatch_replies(&buffer, &rx_offset, &received_count, (struct ReplyContext){0});
     assert_true(get_version_match());
 
     /* Second reply: mismatching — should be ignored since already checked. */
     rx_offset = 0;
     reply.version_patch = PROTOCOL_VERSION_PATCH + 99;
     memcpy(buffer.payload, &reply, sizeof(reply));
-    unpack_version_reply(&buffer, &rx_offset, &received_count);
+    dispatch_replies(&buffer, &rx_offset, &received_count, (struct ReplyContext){0});
 
     assert_true(get_version_match());  /* still true — second check was skipped */
     assert_int_equal(received_count, 2);
 }
 
+static void test_features__negotiated__stored(void **state) {
+    (void)state;
+    reset_version_check();
+
+    struct NWBuffer buffer = {0};
+    size_t received_count = 0;
+    skeleton_t data = {0};
+    setup_data(&data);
+
+    struct Reply_features reply = {
+        .type     = REPLY_FEATURES,
+        .features = FEATURE_COMPACT_JOINT_POS | 0x8000,  /* unknown bit ignored */
+    };
+    memcpy(buffer.payload, &reply, sizeof(reply));
+    buffer.length = aligned32(sizeof(reply));
+    buffer.checksum = checksum(0, 0, buffer.length, buffer.payload);
+
+    process_data(&buffer, &data, &received_count,
+                 buffer.length + sizeof(buffer.length) + sizeof(buffer.checksum),
+                 NULL, NULL, NULL);
+
+    assert_int_equal(received_count, 1);
+    assert_int_equal(get_negotiated_features(), FEATURE_COMPACT_JOINT_POS);
+    assert_int_equal(nw_buff_limit(), NW_BUF_LEN_LEGACY);
+
+    /* Firmware with full size buffers lifts the packing limit. */
+    reply.features = FEATURE_LARGE_NW_BUF;
+    memcpy(buffer.payload, &reply, sizeof(reply));
+    buffer.checksum = checksum(0, 0, buffer.length, buffer.payload);
+    process_data(&buffer, &data, &received_count,
+                 buffer.length + sizeof(buffer.length) + sizeof(buffer.checksum),
+                 NULL, NULL, NULL);
+    assert_int_equal(nw_buff_limit(), NW_BUF_LEN);
+
+    /* Link loss forgets the negotiation until the next handshake. */
+    reset_version_check();
+    assert_int_equal(get_negotiated_features(), 0);
+    assert_int_equal(nw_buff_limit(), NW_BUF_LEN_LEGACY);
+}
+
+/* Each board keeps the limit and CRC-32 mode it negotiated. Selecting a
+ * board applies them to pack_nw_buff(); renegotiating one leaves the others
+ * alone. */
+static void test_features__limit_per_board(void **state) {
+    (void)state;
+    select_device(0);
+    reset_version_check();
+    select_device(1);
+    reset_version_check();
+
+    struct NWBuffer buffer = {0};
+    size_t received_count = 0;
+    skeleton_t data = {0};
+    setup_data(&data);
+
+    struct Reply_features reply = {
+        .type     = REPLY_FEATURES,
+        .features = FEATURE_LARGE_NW_BUF | FEATURE_CRC32,
+    };
+    memcpy(buffer.payload, &reply, sizeof(reply));
+    buffer.length = aligned32(sizeof(reply));
+    buffer.checksum = checksum(0, 0, buffer.length, buffer.payload);
+    process_data(&buffer, &data, &received_count,
+                 buffer.length + sizeof(buffer.length) + sizeof(buffer.checksum),
+                 NULL, NULL, NULL);
+    assert_int_equal(nw_buff_limit(), NW_BUF_LEN);
+
+    static uint8_t message[NW_BUF_LEN];
+    select_device(0);
+    assert_int_equal(get_negotiated_features(), 0);
+    assert_int_equal(nw_buff_limit(), NW_BUF_LEN_LEGACY);
+    reset_nw_buf(&buffer);
+    /* No CRC-32 trailer to leave room for. */
+    assert_int_equal(pack_nw_buff(&buffer, message, NW_BUF_LEN_LEGACY), NW_BUF_LEN_LEGACY);
+
+    select_device(1);
+    assert_int_equal(nw_buff_limit(), NW_BUF_LEN);
+    reset_nw_buf(&buffer);
+    assert_int_equal(pack_nw_buff(&buffer, message, NW_BUF_LEN), 0);
+    assert_int_equal(pack_nw_buff(&buffer, message, NW_BUF_LEN - NW_CRC32_LEN),
+                     NW_BUF_LEN - NW_CRC32_LEN);
+
+    select_device(0);
+    reset_version_check();
+    select_device(1);
+    assert_int_equal(nw_buff_limit(), NW_BUF_LEN);
+    reset_version_check();
+    select_device(0);
+}
+
+/* REPLY_CONFIG_HASH is handed to the state machine once, and forgotten on
+ * link loss. */
+static void test_config_hash__taken_once(void **state) {
+    (void)state;
+    reset_version_check();
+
+    struct NWBuffer buffer = {0};
+    size_t received_count = 0;
+    skeleton_t data = {0};
+    setup_data(&data);
+
+    struct Reply_config_hash reply = {.type = REPLY_CONFIG_HASH, .hash = 0x12345678};
+    memcpy(buffer.payload, &reply, sizeof(reply));
+    buffer.length = aligned32(sizeof(reply));
+    buffer.checksum = checksum(0, 0, buffer.length, buffer.payload);
+
+    process_data(&buffer, &data, &received_count,
+                 buffer.length + sizeof(buffer.length) + sizeof(buffer.checksum),
+                 NULL, NULL, NULL);
+    assert_int_equal(received_count, 1);
+
+    uint32_t hash = 0;
+    assert_true(take_firmware_config_hash(&hash));
+    assert_int_equal(hash, 0x12345678);
+    assert_false(take_firmware_config_hash(&hash));
+
+    process_data(&buffer, &data, &received_count,
+                 buffer.length + sizeof(buffer.length) + sizeof(buffer.checksum),
+                 NULL, NULL, NULL);
+    reset_version_check();
+    assert_false(take_firmware_config_hash(&hash));
+}
+
+/* REPLY_FLASH_WRITE hands its hold to the state machine once, and is
+ * forgotten on link loss. */
+static void test_flash_write__hold_taken_once(void **state) {
+    (void)state;
+    reset_version_check();
+
+    struct NWBuffer buffer = {0};
+    size_t received_count = 0;
+    skeleton_t data = {0};
+    setup_data(&data);
+
+    struct Reply_flash_write reply = {.type = REPLY_FLASH_WRITE, .hold_ms = 500};
+    memcpy(buffer.payload, &reply, sizeof(reply));
+    buffer.length = aligned32(sizeof(reply));
+    buffer.checksum = checksum(0, 0, buffer.length, buffer.payload);
+
+    process_data(&buffer, &data, &received_count,
+                 buffer.length + sizeof(buffer.length) + sizeof(buffer.checksum),
+                 NULL, NULL, NULL);
+    assert_int_equal(received_count, 1);
+
+    uint16_t hold_ms = 0;
+    assert_true(take_flash_write_hold(&hold_ms));
+    assert_int_equal(hold_ms, 500);
+    assert_false(take_flash_write_hold(&hold_ms));
+
+    process_data(&buffer, &data, &received_count,
+                 buffer.length + sizeof(buffer.length) + sizeof(buffer.checksum),
+                 NULL, NULL, NULL);
+    reset_version_check();
+    assert_false(take_flash_write_hold(&hold_ms));
+}
+
+static void test_clock_sync__offset_drift_latency(void **state) {
+    (void)state;
+    struct ClockSync sync = {0};
+
+    /* RP clock ~1s ahead. 50µs up, 10µs on the RP, 60µs down. */
+    assert_true(clock_sync_update(&sync, 0, 1000050, 1000060, 120));
+    assert_float_equal(sync.offset_us, 999995, 0.5);
+    assert_float_equal(sync.latency_up_us, 55, 0.5);
+    assert_float_equal(sync.latency_down_us, 55, 0.5);
+    assert_float_equal(sync.round_trip_us, 120, 0.5);
+    assert_float_equal(sync.drift, 0, 1e-12);
+
+    /* A congested exchange does not move the offset. */
+    assert_true(clock_sync_update(&sync, 500000, 1500050, 1500060, 502120));
+    assert_float_equal(sync.offset_us, 999995, 0.5);
+    assert_float_equal(sync.latency_up_us, 55, 0.5);
+    assert_float_equal(sync.latency_down_us, 2055, 0.5);
+    assert_float_equal(sync.round_trip_us, 2120, 0.5);
+
+    /* 2s later the RP has gained 40µs: 20ppm. */
+    assert_true(clock_sync_update(&sync, 2000000, 3000090, 3000100, 2000120));
+    assert_float_equal(sync.offset_us, 1000035, 0.5);
+    assert_float_equal(sync.drift * 1e6, 20, 0.01);
+
+    /* Drift is applied between samples. */
+    assert_true(clock_sync_update(&sync, 2500000, 3500100, 3500110, 2502000));
+    assert_float_equal(sync.offset_us, 1000035 + 20 * 0.502, 0.5);
+
+    /* RP time longer than the round trip. */
+    assert_false(clock_sync_update(&sync, 0, 1000000, 1000200, 100));
+}
+
+static void test_clock_sync__reply_sets_pins(void **state) {
+    (void)state;
+    reset_version_check();
+
+    struct NWBuffer buffer = {0};
+    size_t received_count = 0;
+    skeleton_t data = {0};
+    setup_data(&data);
+    round_trip_us = 0;
+
+    uint64_t now = host_time_us();
+    struct Reply_clock_sync reply = {
+      .type = REPLY_CLOCK_SYNC,
+      .host_tx_us = now - 200,
+      .rp_rx_us = 5000100,
+      .rp_tx_us = 5000120,
+    };
+    memcpy(buffer.payload, &reply, sizeof(reply));
+    buffer.length = aligned32(sizeof(reply));
+    buffer.checksum = checksum(0, 0, buffer.length, buffer.payload);
+
+    process_data(&buffer, &data, &received_count,
+                 buffer.length + sizeof(buffer.length) + sizeof(buffer.checksum),
+                 NULL, NULL, NULL);
+    assert_int_equal(received_count, 1);
+    assert_true(round_trip_us >= 200);
+    assert_float_equal(latency_up_us + latency_down_us + 20, round_trip_us, 0.5);
+}
+
+static void test_tick_sync__reply_sets_pin(void **state) {
+    (void)state;
+
+    struct NWBuffer buffer = {0};
+    size_t received_count = 0;
+    skeleton_t data = {0};
+    setup_data(&data);
+    tick_phase_error_us = 0;
+
+    struct Reply_tick_sync reply = {
+      .type = REPLY_TICK_SYNC,
+      .phase_error_us = -7,
+    };
+    memcpy(buffer.payload, &reply, sizeof(reply));
+    buffer.length = aligned32(sizeof(reply));
+    buffer.checksum = checksum(0, 0, buffer.length, buffer.payload);
+
+    process_data(&buffer, &data, &received_count,
+                 buffer.length + sizeof(buffer.length) + sizeof(buffer.checksum),
+                 NULL, NULL, NULL);
+    assert_int_equal(received_count, 1);
+    assert_int_equal(tick_phase_error_us, -7);
+}
+
+/* The REPLY_TIMING echo of a packed MSG_TIMING is timed once. */
+static void test_timing_echo__round_trip_histogram(void **state) {
+    (void)state;
+
+    struct NWBuffer buffer = {0};
+    size_t received_count = 0;
+    skeleton_t data = {0};
+    setup_data(&data);
+    histogram_reset(&data.hist[HIST_ROUND_TRIP]);
+
+    struct NWBuffer tx_buffer = {0};
+    uint64_t before_ns = host_time_ns();
+    serialize_timing(&tx_buffer, 4321, 0);
+
+    struct Reply_timing reply = {
+      .type = REPLY_TIMING,
+      .update_id = 4321,
+    };
+    memcpy(buffer.payload, &reply, sizeof(reply));
+    buffer.length = aligned32(sizeof(reply));
+    buffer.checksum = checksum(0, 0, buffer.length, buffer.payload);
+
+    for(int i = 0; i < 2; i++) {
+        process_data(&buffer, &data, &received_count,
+                     buffer.length + sizeof(buffer.length) + sizeof(buffer.checksum),
+                     NULL, NULL, NULL);
+    }
+    uint64_t elapsed_ns = host_time_ns() - before_ns;
+    assert_int_equal(seq_in, 4321);
+    assert_int_equal(data.hist[HIST_ROUND_TRIP].total, 1);
+    assert_true(data.hist[HIST_ROUND_TRIP].max <= elapsed_ns);
+}
+
+/* Replies queued on the mock socket, handed out by __wrap_recvmmsg(). */
+#define RX_QUEUE_LEN (NW_RX_BATCH + 4)
+static struct NWBuffer rx_queue[RX_QUEUE_LEN];
+static size_t rx_queue_count = 0;
+static size_t rx_queue_next = 0;
+static int recvmmsg_calls = 0;
+/* When set, each reply carries an SCM_TIMESTAMPNS this long before now. */
+static int64_t rx_queue_age_ns = -1;
+
+int __wrap_recvmmsg(
+    int fd, struct mmsghdr *messages, unsigned int vlen, int flags, struct timespec *timeout
+) {
+    (void)fd; (void)flags; (void)timeout;
+    recvmmsg_calls++;
+    unsigned int count = 0;
+    while(count < vlen && rx_queue_next < rx_queue_count) {
+        struct NWBuffer* reply = &rx_queue[rx_queue_next++];
+        memcpy(messages[count].msg_hdr.msg_iov[0].iov_base, reply, nw_buff_wire_len(reply));
+        messages[count].msg_len = nw_buff_wire_len(reply);
+        struct msghdr* header = &messages[count].msg_hdr;
+        if(rx_queue_age_ns >= 0) {
+            struct timespec stamp;
+            clock_gettime(CLOCK_REALTIME, &stamp);
+            int64_t stamp_ns = (int64_t)stamp.tv_sec * 1000000000 + stamp.tv_nsec - rx_queue_age_ns;
+            stamp.tv_sec  = stamp_ns / 1000000000;
+            stamp.tv_nsec = stamp_ns % 1000000000;
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(header);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type  = SCM_TIMESTAMPNS;
+            cmsg->cmsg_len   = CMSG_LEN(sizeof(stamp));
+            memcpy(CMSG_DATA(cmsg), &stamp, sizeof(stamp));
+            header->msg_controllen = CMSG_SPACE(sizeof(stamp));
+        } else {
+            header->msg_controllen = 0;
+        }
+        count++;
+    }
+    if(count == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return count;
+}
+
+/* More replies than one batch are queued. All are unpacked but only the
+ * newest updates joint feedback. */
+static void test_receive_replies__drains_queue(void **state) {
+    (void)state;
+    skeleton_t data = {0};
+    setup_data(&data);
+    struct Message_joint_config last_joint_config[MAX_JOINT] = {0};
+    joint_pos_fb[0] = -1.0;
+
+    memset(rx_queue, 0, sizeof(rx_queue));
+    for(size_t i = 0; i < RX_QUEUE_LEN; i++) {
+        struct Reply_timing timing = {.type = REPLY_TIMING, .update_id = 100 + i};
+        pack_nw_buff(&rx_queue[i], &timing, sizeof(timing));
+        if(i + 1 < RX_QUEUE_LEN) {
+            struct Reply_joint_movement movement = {
+                .type = REPLY_JOINT_MOVEMENT,
+                .count = MAX_JOINT,
+                .abs_pos_achieved = {1000 * (i + 1)},
+            };
+            pack_nw_buff(&rx_queue[i], &movement, sizeof(movement));
+        }
+        if(i == 2) {
+            struct Reply_joint_config config = {
+                .type = REPLY_JOINT_CONFIG, .joint = 1, .gpio_step = 7, .max_velocity = 10.0};
+            pack_nw_buff(&rx_queue[i], &config, sizeof(config));
+        }
+    }
+    rx_queue_count = RX_QUEUE_LEN;
+    rx_queue_next = 0;
+    recvmmsg_calls = 0;
+
+    size_t received_count = 0;
+    size_t reply_count = receive_replies(0, &data, &received_count, last_joint_config, NULL, NULL);
+
+    assert_int_equal(reply_count, RX_QUEUE_LEN);
+    assert_int_equal(received_count, 2 * RX_QUEUE_LEN - 1 + 1);
+    assert_int_equal(recvmmsg_calls, 2);
+    assert_int_equal(seq_in, 100 + RX_QUEUE_LEN - 1);
+    // Config from an old reply is kept.
+    assert_int_equal(last_joint_config[1].gpio_step, 7);
+    // The newest reply has no movement so feedback is untouched.
+    assert_float_equal(joint_pos_fb[0], -1.0, 1e-9);
+
+    // Queue empty.
+    received_count = 0;
+    assert_int_equal(
+        receive_replies(0, &data, &received_count, last_joint_config, NULL, NULL), 0);
+}
+
+/* A clock sync reply that waited in the socket is timed to when the kernel
+ * received it, not to when it was drained. */
+static void test_receive_replies__clock_sync_uses_kernel_stamp(void **state) {
+    (void)state;
+    reset_version_check();
+    skeleton_t data = {0};
+    setup_data(&data);
+    round_trip_us = 0;
+
+    /* Sent 1200us ago, received 1000us ago: a 200us round trip. */
+    memset(rx_queue, 0, sizeof(rx_queue));
+    struct Reply_clock_sync reply = {
+      .type = REPLY_CLOCK_SYNC,
+      .host_tx_us = host_time_us() - 1200,
+      .rp_rx_us = 5000100,
+      .rp_tx_us = 5000120,
+    };
+    pack_nw_buff(&rx_queue[0], &reply, sizeof(reply));
+    rx_queue_count = 1;
+    rx_queue_next = 0;
+    rx_queue_age_ns = 1000000;
+
+    size_t received_count = 0;
+    assert_int_equal(receive_replies(0, &data, &received_count, NULL, NULL, NULL), 1);
+    rx_queue_age_ns = -1;
+
+    assert_float_equal(round_trip_us, 200, 50);
+    assert_float_equal(latency_up_us + latency_down_us + 20, round_trip_us, 0.5);
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_timing),
         cmocka_unit_test(test_joint_movement),
+        cmocka_unit_test(test_joint_movement_v2),
         cmocka_unit_test(test_joint_config),
         cmocka_unit_test(test_joint_metrics),
         cmocka_unit_test(test_joint_metrics_ema_ratios),
@@ -513,6 +1060,16 @@ int main(void) {
         cmocka_unit_test(test_version__patch_mismatch__not_ok),
         cmocka_unit_test(test_version__branch_mismatch__not_ok),
         cmocka_unit_test(test_version__already_checked__skips_second_check),
+        cmocka_unit_test(test_features__negotiated__stored),
+        cmocka_unit_test(test_features__limit_per_board),
+        cmocka_unit_test(test_config_hash__taken_once),
+        cmocka_unit_test(test_flash_write__hold_taken_once),
+        cmocka_unit_test(test_clock_sync__offset_drift_latency),
+        cmocka_unit_test(test_clock_sync__reply_sets_pins),
+        cmocka_unit_test(test_tick_sync__reply_sets_pin),
+        cmocka_unit_test(test_timing_echo__round_trip_histogram),
+        cmocka_unit_test(test_receive_replies__drains_queue),
+        cmocka_unit_test(test_receive_replies__clock_sync_uses_kernel_stamp),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,146 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <cmocka.h>
+
+#include "../driver/rp2040_rtlog.c"
+
+/* Host clock, defined in rp2040_network.c in production. */
+static uint64_t g_host_time_ns = 0;
+uint64_t host_time_ns(void) { return g_host_time_ns; }
+
+/* Let a whole rate window pass. */
+static void open_new_window(void) {
+    g_host_time_ns += RTLOG_WINDOW_NS;
+}
+
+/* Messages come off the ring in the order logged, formatted, and cut to
+ * RTLOG_TEXT_LEN. */
+static void test_ring_keeps_order(void **state) {
+    (void) state; /* unused */
+    struct RtlogRecord record;
+    char longer[RTLOG_TEXT_LEN * 2];
+
+    assert_true(rtlog_ring_init());
+    assert_false(rtlog_pop(&record));
+
+    for(int i = 0; i < 3; i++) {
+        rtlog_printf("INFO: message %i of %s\n", i, "three");
+    }
+    memset(longer, 'x', sizeof(longer) - 1);
+    longer[sizeof(longer) - 1] = '\0';
+    rtlog_printf("%s", longer);
+
+    for(int i = 0; i < 3; i++) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "INFO: message %i of three\n", i);
+        assert_true(rtlog_pop(&record));
+        assert_string_equal(record.text, expected);
+    }
+    assert_true(rtlog_pop(&record));
+    assert_int_equal(strlen(record.text), RTLOG_TEXT_LEN - 1);
+    assert_false(rtlog_pop(&record));
+    assert_int_equal(rtlog_take_dropped(), 0);
+    rtlog_ring_free();
+}
+
+/* Past RTLOG_WINDOW_MAX in one window messages are counted, not queued,
+ * until the next window opens. */
+static void test_rate_limit(void **state) {
+    (void) state; /* unused */
+    struct RtlogRecord record;
+
+    assert_true(rtlog_ring_init());
+    for(int i = 0; i < RTLOG_WINDOW_MAX + 5; i++) {
+        rtlog_printf("WARN: %i\n", i);
+    }
+    assert_int_equal(rtlog_take_dropped(), 5);
+    assert_int_equal(rtlog_take_dropped(), 0);
+
+    for(int i = 0; i < RTLOG_WINDOW_MAX; i++) {
+        assert_true(rtlog_pop(&record));
+    }
+    assert_false(rtlog_pop(&record));
+
+    open_new_window();
+    rtlog_printf("WARN: next window\n");
+    assert_true(rtlog_pop(&record));
+    assert_string_equal(record.text, "WARN: next window\n");
+    assert_int_equal(rtlog_take_dropped(), 0);
+    rtlog_ring_free();
+}
+
+/* A full ring drops new messages rather than blocking or overwriting ones
+ * not yet printed. */
+static void test_ring_full_drops_newest(void **state) {
+    (void) state; /* unused */
+    struct RtlogRecord record;
+
+    assert_true(rtlog_ring_init());
+    for(int i = 0; i < RTLOG_RING_LEN + 5; i++) {
+        if(i % RTLOG_WINDOW_MAX == 0) {
+            open_new_window();
+        }
+        rtlog_printf("%i\n", i);
+    }
+    assert_int_equal(rtlog_take_dropped(), 5);
+
+    for(int i = 0; i < RTLOG_RING_LEN; i++) {
+        assert_true(rtlog_pop(&record));
+        assert_int_equal(atoi(record.text), i);
+    }
+    assert_false(rtlog_pop(&record));
+    rtlog_ring_free();
+}
+
+/* rtlog_drain() prints what was queued, then how much was lost. */
+static void test_drain_reports_drops(void **state) {
+    (void) state; /* unused */
+    const char* dropped = "WARN: 2 driver log messages dropped\n";
+    char output[4096] = {0};
+    FILE* out = fmemopen(output, sizeof(output), "w");
+    assert_non_null(out);
+
+    assert_true(rtlog_ring_init());
+    for(int i = 0; i < RTLOG_WINDOW_MAX + 2; i++) {
+        rtlog_printf("INFO: %i\n", i);
+    }
+    assert_int_equal(rtlog_drain(out), RTLOG_WINDOW_MAX);
+    assert_int_equal(rtlog_drain(out), 0);
+    fclose(out);
+    assert_memory_equal(output, "INFO: 0\nINFO: 1\n", 16);
+    assert_string_equal(output + strlen(output) - strlen(dropped), dropped);
+    rtlog_ring_free();
+}
+
+/* rtlog_start() to rtlog_stop() with the drain thread. Nothing is queued
+ * outside it. */
+static void test_start_stop(void **state) {
+    (void) state; /* unused */
+    struct RtlogRecord record;
+
+    rtlog_printf("INFO: printed directly\n");
+    assert_false(rtlog_pop(&record));
+
+    assert_int_equal(rtlog_start(), 0);
+    for(int i = 0; i < 10; i++) {
+        rtlog_printf("INFO: from the drain thread %i\n", i);
+    }
+    rtlog_stop();
+    assert_null(rtlog_ring);
+    assert_false(rtlog_pop(&record));
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_ring_keeps_order),
+        cmocka_unit_test(test_rate_limit),
+        cmocka_unit_test(test_ring_full_drops_newest),
+        cmocka_unit_test(test_drain_reports_drops),
+        cmocka_unit_test(test_start_stop),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -1,23 +1,6 @@
 #include <stdint.h>
 #include <stddef.h>
 
-void update_joint_config(
-    const uint8_t joint,
-    const uint8_t core,
-    const uint8_t* enabled,
-    const int8_t* io_pos_step,
-    const int8_t* io_pos_dir,
-    const double* velocity_requested,
-    const double* abs_pos_requested,
-    const int32_t* abs_pos_achieved,
-    const double* max_velocity,
-    const double* max_accel,
-    const int32_t* velocity_achieved,
-    const uint8_t* cmd_type
-)
-{
-}
-
 void update_packet_metrics(
     uint32_t update_id,
     uint32_t time,
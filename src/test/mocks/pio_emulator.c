@@ -0,0 +1,538 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pio_emulator.h"
+
+void step_gen_program(size_t pio) { (void)pio; }
+void step_count_program(size_t pio) { (void)pio; }
+
+/* pioasm output for pico_stepper.pio, addresses relative to the program.
+ * Regenerate if the .pio file changes. */
+static const uint16_t step_gen_instructions[] = {
+  0xe020,  //  0: set    x, 0
+  0xb045,  //  1: mov    y, status       side 0   ; wrap_target
+  0x0069,  //  2: jmp    !y, 9
+  0xa342,  //  3: nop                           [3]
+  0x0021,  //  4: jmp    !x, 1
+  0xa041,  //  5: mov    y, x
+  0x0086,  //  6: jmp    y--, 6
+  0xbf41,  //  7: mov    y, x            side 1 [7]
+  0x0088,  //  8: jmp    y--, 8                   ; wrap
+  0x80a0,  //  9: pull   block
+  0x6001,  // 10: out    pins, 1
+  0x603f,  // 11: out    x, 31
+  0x0004,  // 12: jmp    4
+};
+
+static const uint16_t step_count_instructions[] = {
+  0xe040,  //  0: set    y, 0
+  0x2020,  //  1: wait   0 pin, 0
+  0x20a0,  //  2: wait   1 pin, 0
+  0x00c8,  //  3: jmp    pin, 8
+  0x0085,  //  4: jmp    y--, 5
+  0xa0c2,  //  5: mov    isr, y
+  0x8000,  //  6: push   noblock
+  0x0001,  //  7: jmp    1
+  0xa04a,  //  8: mov    y, ~y
+  0x008a,  //  9: jmp    y--, 10
+  0xa04a,  // 10: mov    y, ~y
+  0xa0c2,  // 11: mov    isr, y
+  0x8000,  // 12: push   noblock
+  0x0001,  // 13: jmp    1
+};
+
+struct PioEmuProgram {
+  const uint16_t* instructions;
+  uint8_t         length;
+  uint8_t         wrap_target;
+  uint8_t         wrap;
+};
+
+static const struct PioEmuProgram step_gen = {
+  step_gen_instructions, sizeof(step_gen_instructions) / sizeof(uint16_t), 1, 8
+};
+static const struct PioEmuProgram step_count = {
+  step_count_instructions, sizeof(step_count_instructions) / sizeof(uint16_t), 0, 13
+};
+
+#define PIO_EMU_BLOCKS       2
+#define PIO_EMU_SMS          4
+#define PIO_EMU_FIFO_DEPTH   4
+#define PIO_EMU_MEMORY       32
+#define PIO_EMU_SYNC_CYCLES  2     // Input synchroniser: a level driven in cycle t
+                                   // is seen from cycle t + 1 + PIO_EMU_SYNC_CYCLES.
+#define PIO_EMU_MAX_STALL    (1u << 24)
+
+struct PioEmuFifo {
+  uint32_t data[PIO_EMU_FIFO_DEPTH];
+  uint8_t  head;
+  uint8_t  level;
+};
+
+struct PioEmuSm {
+  bool     claimed;
+  bool     enabled;
+  uint8_t  pc;
+  uint32_t x;
+  uint32_t y;
+  uint32_t isr;
+  uint32_t osr;
+  uint8_t  isr_count;
+  uint8_t  osr_count;
+  uint8_t  delay;
+  struct PioEmuFifo tx;
+  struct PioEmuFifo rx;
+
+  /* pio_sm_config */
+  uint8_t  wrap_target;
+  uint8_t  wrap;
+  uint8_t  sideset_base;
+  uint8_t  sideset_count;  // Including the enable bit when optional.
+  bool     sideset_opt;
+  uint8_t  out_base;
+  uint8_t  out_count;
+  uint8_t  set_base;
+  uint8_t  set_count;
+  uint8_t  in_base;
+  uint8_t  jmp_pin;
+  uint8_t  status_tx_less_than;
+};
+
+struct PioEmuBlock {
+  uint16_t memory[PIO_EMU_MEMORY];
+  uint32_t used;           // Bitmap of occupied instruction memory.
+  struct PioEmuSm sm[PIO_EMU_SMS];
+};
+
+static struct PioEmuBlock blocks[PIO_EMU_BLOCKS];
+static uint64_t now_cycles;
+static uint32_t gpio_out;
+static uint32_t gpio_history[PIO_EMU_SYNC_CYCLES + 1];  // [0] is this cycle.
+static struct PioEmuEdge edges[PIO_EMU_MAX_EDGES];
+static size_t edge_count;
+
+static void emu_fail(const char* what, size_t pio, size_t sm) {
+  fprintf(stderr, "pio_emulator: %s (pio %zu sm %zu, cycle %llu)\n",
+          what, pio, sm, (unsigned long long)now_cycles);
+  abort();
+}
+
+static struct PioEmuBlock* block_of(size_t pio) {
+  if(pio >= PIO_EMU_BLOCKS) {
+    emu_fail("no such PIO block; was pio_emu_reset() called?", pio, 0);
+  }
+  return &blocks[pio];
+}
+
+static struct PioEmuSm* sm_of(size_t pio, size_t sm) {
+  if(sm >= PIO_EMU_SMS) {
+    emu_fail("no such SM", pio, sm);
+  }
+  return &block_of(pio)->sm[sm];
+}
+
+static bool fifo_push(struct PioEmuFifo* fifo, uint32_t value) {
+  if(fifo->level == PIO_EMU_FIFO_DEPTH) {
+    return false;
+  }
+  fifo->data[(fifo->head + fifo->level++) % PIO_EMU_FIFO_DEPTH] = value;
+  return true;
+}
+
+static uint32_t fifo_pop(struct PioEmuFifo* fifo) {
+  uint32_t value = fifo->data[fifo->head];
+  fifo->head = (fifo->head + 1) % PIO_EMU_FIFO_DEPTH;
+  fifo->level--;
+  return value;
+}
+
+/* GPIO levels as the PIO input path sees them this cycle. */
+static uint32_t gpio_in(void) {
+  return gpio_history[PIO_EMU_SYNC_CYCLES];
+}
+
+static void write_pins(uint8_t base, uint8_t count, uint32_t value) {
+  for(uint8_t bit = 0; bit < count; bit++) {
+    uint32_t mask = 1u << ((base + bit) % 32);
+    gpio_out = (value >> bit) & 1 ? gpio_out | mask : gpio_out & ~mask;
+  }
+}
+
+static uint32_t read_pins(uint8_t base) {
+  uint32_t in = gpio_in();
+  return base == 0 ? in : (in >> base) | (in << (32 - base));
+}
+
+static uint32_t bit_reverse(uint32_t value) {
+  uint32_t out = 0;
+  for(int bit = 0; bit < 32; bit++) {
+    out = (out << 1) | ((value >> bit) & 1);
+  }
+  return out;
+}
+
+static uint32_t shift_out(struct PioEmuSm* state, uint8_t count) {
+  uint32_t value = count == 32 ? state->osr : state->osr & ((1u << count) - 1);
+  state->osr = count == 32 ? 0 : state->osr >> count;
+  state->osr_count = state->osr_count + count > 32 ? 32 : state->osr_count + count;
+  return value;
+}
+
+static void shift_in(struct PioEmuSm* state, uint32_t value, uint8_t count) {
+  if(count == 32) {
+    state->isr = value;
+  } else {
+    value &= (1u << count) - 1;
+    state->isr = (state->isr >> count) | (value << (32 - count));
+  }
+  state->isr_count = state->isr_count + count > 32 ? 32 : state->isr_count + count;
+}
+
+/* Execute one cycle of an enabled SM. Shifts are to the right, which is how
+ * both programs configure them. */
+static void step_sm(size_t pio, size_t index) {
+  struct PioEmuBlock* block = &blocks[pio];
+  struct PioEmuSm* state = &block->sm[index];
+  if(state->delay > 0) {
+    state->delay--;
+    return;
+  }
+
+  uint16_t instruction = block->memory[state->pc];
+  uint8_t field = (instruction >> 8) & 0x1f;
+  uint8_t delay_bits = 5 - state->sideset_count;
+  uint8_t delay = field & ((1u << delay_bits) - 1);
+  uint8_t sideset = field >> delay_bits;
+  if(state->sideset_opt) {
+    if(sideset & (1u << (state->sideset_count - 1))) {
+      write_pins(state->sideset_base, state->sideset_count - 1, sideset);
+    }
+  } else if(state->sideset_count > 0) {
+    write_pins(state->sideset_base, state->sideset_count, sideset);
+  }
+
+  uint8_t arg1 = (instruction >> 5) & 0x7;
+  uint8_t arg2 = instruction & 0x1f;
+  uint8_t bit_count = arg2 == 0 ? 32 : arg2;
+  bool stall = false;
+  bool jump = false;
+  uint8_t target = 0;
+
+  switch(instruction >> 13) {
+    case 0: {  // JMP
+      bool taken = false;
+      switch(arg1) {
+        case 0: taken = true; break;
+        case 1: taken = state->x == 0; break;
+        case 2: taken = state->x-- != 0; break;
+        case 3: taken = state->y == 0; break;
+        case 4: taken = state->y-- != 0; break;
+        case 5: taken = state->x != state->y; break;
+        case 6: taken = (gpio_in() >> state->jmp_pin) & 1; break;
+        case 7: taken = state->osr_count < 32; break;
+      }
+      jump = taken;
+      target = arg2;
+      break;
+    }
+    case 1: {  // WAIT
+      bool polarity = (instruction >> 7) & 1;
+      uint8_t source = (instruction >> 5) & 0x3;
+      uint8_t pin;
+      if(source == 0) {
+        pin = arg2;
+      } else if(source == 1) {
+        pin = (state->in_base + arg2) % 32;
+      } else {
+        emu_fail("WAIT IRQ is not modelled", pio, index);
+      }
+      stall = ((gpio_in() >> pin) & 1) != polarity;
+      break;
+    }
+    case 2: {  // IN
+      uint32_t value = 0;
+      switch(arg1) {
+        case 0: value = read_pins(state->in_base); break;
+        case 1: value = state->x; break;
+        case 2: value = state->y; break;
+        case 3: value = 0; break;
+        case 6: value = state->isr; break;
+        case 7: value = state->osr; break;
+        default: emu_fail("reserved IN source", pio, index);
+      }
+      shift_in(state, value, bit_count);
+      break;
+    }
+    case 3: {  // OUT
+      uint32_t value = shift_out(state, bit_count);
+      switch(arg1) {
+        case 0: write_pins(state->out_base, bit_count < state->out_count ? bit_count : state->out_count, value); break;
+        case 1: state->x = value; break;
+        case 2: state->y = value; break;
+        case 3: break;
+        case 4: break;  // PINDIRS: directions are not modelled.
+        case 5: jump = true; target = value & 0x1f; break;
+        case 6: state->isr = value; state->isr_count = bit_count; break;
+        case 7: emu_fail("OUT EXEC is not modelled", pio, index);
+      }
+      break;
+    }
+    case 4: {  // PUSH / PULL
+      bool if_flag = (instruction >> 6) & 1;
+      bool block_flag = (instruction >> 5) & 1;
+      if(if_flag) {
+        emu_fail("PUSH IFFULL / PULL IFEMPTY are not modelled", pio, index);
+      }
+      if((instruction >> 7) & 1) {
+        if(state->tx.level > 0) {
+          state->osr = fifo_pop(&state->tx);
+          state->osr_count = 0;
+        } else if(block_flag) {
+          stall = true;
+        } else {
+          state->osr = state->x;
+          state->osr_count = 0;
+        }
+      } else {
+        if(fifo_push(&state->rx, state->isr)) {
+          state->isr = 0;
+          state->isr_count = 0;
+        } else if(block_flag) {
+          stall = true;
+        } else {
+          state->isr = 0;  // Noblock push to a full FIFO is dropped.
+          state->isr_count = 0;
+        }
+      }
+      break;
+    }
+    case 5: {  // MOV
+      uint32_t value = 0;
+      switch(instruction & 0x7) {
+        case 0: value = read_pins(state->in_base); break;
+        case 1: value = state->x; break;
+        case 2: value = state->y; break;
+        case 3: value = 0; break;
+        case 5: value = state->tx.level < state->status_tx_less_than ? 0xffffffff : 0; break;
+        case 6: value = state->isr; break;
+        case 7: value = state->osr; break;
+        default: emu_fail("reserved MOV source", pio, index);
+      }
+      switch((instruction >> 3) & 0x3) {
+        case 1: value = ~value; break;
+        case 2: value = bit_reverse(value); break;
+        case 3: emu_fail("reserved MOV operation", pio, index);
+      }
+      switch(arg1) {
+        case 0: write_pins(state->out_base, state->out_count, value); break;
+        case 1: state->x = value; break;
+        case 2: state->y = value; break;
+        case 5: jump = true; target = value & 0x1f; break;
+        case 6: state->isr = value; state->isr_count = 0; break;
+        case 7: state->osr = value; state->osr_count = 0; break;
+        default: emu_fail("MOV EXEC is not modelled", pio, index);
+      }
+      break;
+    }
+    case 6:
+      emu_fail("IRQ is not modelled", pio, index);
+      break;
+    case 7:  // SET
+      switch(arg1) {
+        case 0: write_pins(state->set_base, state->set_count, arg2); break;
+        case 1: state->x = arg2; break;
+        case 2: state->y = arg2; break;
+        case 4: break;  // PINDIRS
+        default: emu_fail("reserved SET destination", pio, index);
+      }
+      break;
+  }
+
+  if(stall) {
+    return;
+  }
+  state->delay = delay;
+  if(jump) {
+    state->pc = target;
+  } else if(state->pc == state->wrap) {
+    state->pc = state->wrap_target;
+  } else {
+    state->pc = (state->pc + 1) % PIO_EMU_MEMORY;
+  }
+}
+
+static void log_edges(uint32_t before) {
+  uint32_t changed = before ^ gpio_out;
+  while(changed) {
+    uint8_t pin = __builtin_ctz(changed);
+    changed &= changed - 1;
+    if(edge_count == PIO_EMU_MAX_EDGES) {
+      emu_fail("edge log full; call pio_emu_clear_edges() more often", 0, 0);
+    }
+    edges[edge_count++] = (struct PioEmuEdge){now_cycles, pin, (gpio_out >> pin) & 1};
+  }
+}
+
+void pio_emu_reset(void) {
+  memset(blocks, 0, sizeof(blocks));
+  memset(gpio_history, 0, sizeof(gpio_history));
+  gpio_out = 0;
+  now_cycles = 0;
+  edge_count = 0;
+  pio0 = 0;
+  pio1 = 1;
+}
+
+void pio_emu_run(uint64_t cycles) {
+  for(uint64_t cycle = 0; cycle < cycles; cycle++) {
+    memmove(&gpio_history[1], &gpio_history[0], PIO_EMU_SYNC_CYCLES * sizeof(uint32_t));
+    gpio_history[0] = gpio_out;
+    uint32_t before = gpio_out;
+    for(size_t pio = 0; pio < PIO_EMU_BLOCKS; pio++) {
+      for(size_t sm = 0; sm < PIO_EMU_SMS; sm++) {
+        if(blocks[pio].sm[sm].enabled) {
+          step_sm(pio, sm);
+        }
+      }
+    }
+    log_edges(before);
+    now_cycles++;
+  }
+}
+
+uint64_t pio_emu_cycles(void) {
+  return now_cycles;
+}
+
+bool pio_emu_gpio(uint8_t pin) {
+  return (gpio_out >> pin) & 1;
+}
+
+size_t pio_emu_edges(const struct PioEmuEdge** out) {
+  *out = edges;
+  return edge_count;
+}
+
+void pio_emu_clear_edges(void) {
+  edge_count = 0;
+}
+
+
+/* ---- The pico-sdk calls pio.c makes ---- */
+
+size_t pio_add_program(size_t pio, const void* program) {
+  struct PioEmuBlock* block = block_of(pio);
+  const struct PioEmuProgram* source =
+      program == (const void*)step_gen_program ? &step_gen :
+      program == (const void*)step_count_program ? &step_count : NULL;
+  if(source == NULL) {
+    emu_fail("unknown program", pio, 0);
+  }
+  /* Highest free space first, as the SDK allocates. */
+  uint32_t mask = (1u << source->length) - 1;
+  for(int offset = PIO_EMU_MEMORY - source->length; offset >= 0; offset--) {
+    if((block->used & (mask << offset)) != 0) {
+      continue;
+    }
+    block->used |= mask << offset;
+    for(size_t index = 0; index < source->length; index++) {
+      uint16_t instruction = source->instructions[index];
+      if((instruction >> 13) == 0) {  // Relocate JMP targets.
+        instruction = (instruction & ~0x1f) | ((instruction + offset) & 0x1f);
+      }
+      block->memory[offset + index] = instruction;
+    }
+    return (size_t)offset;
+  }
+  emu_fail("instruction memory full", pio, 0);
+  return 0;
+}
+
+int pio_claim_unused_sm(size_t pio, int required) {
+  struct PioEmuBlock* block = block_of(pio);
+  for(int sm = 0; sm < PIO_EMU_SMS; sm++) {
+    if(!block->sm[sm].claimed) {
+      block->sm[sm].claimed = true;
+      return sm;
+    }
+  }
+  if(required) {
+    emu_fail("no free SM", pio, 0);
+  }
+  return -1;
+}
+
+/* pio_sm_init(): disabled, FIFOs and shift counters cleared, at offset. */
+static struct PioEmuSm* init_sm(size_t pio, size_t sm, size_t offset,
+                                const struct PioEmuProgram* program) {
+  struct PioEmuSm* state = sm_of(pio, sm);
+  *state = (struct PioEmuSm){
+    .claimed = state->claimed,
+    .pc = offset,
+    .osr_count = 32,
+    .wrap_target = offset + program->wrap_target,
+    .wrap = offset + program->wrap,
+    /* .side_set 1 opt */
+    .sideset_count = 2,
+    .sideset_opt = true,
+  };
+  return state;
+}
+
+void step_gen_program_init(
+    size_t pio, size_t sm, size_t offset, size_t pin_step, size_t pin_direction
+) {
+  struct PioEmuSm* state = init_sm(pio, sm, offset, &step_gen);
+  state->sideset_base = pin_step;
+  state->out_base = pin_direction;
+  state->out_count = 1;
+  state->status_tx_less_than = 1;
+}
+
+void step_count_program_init(
+    size_t pio, size_t sm, size_t offset, size_t pin_step, size_t pin_direction
+) {
+  struct PioEmuSm* state = init_sm(pio, sm, offset, &step_count);
+  state->in_base = pin_step;
+  state->jmp_pin = pin_direction;
+}
+
+void pio_sm_set_enabled(size_t pio, size_t sm, int enabled) {
+  sm_of(pio, sm)->enabled = enabled;
+}
+
+int pio_sm_is_tx_fifo_full(size_t pio, size_t sm) {
+  return sm_of(pio, sm)->tx.level == PIO_EMU_FIFO_DEPTH;
+}
+
+int pio_sm_is_tx_fifo_empty(size_t pio, size_t sm) {
+  return sm_of(pio, sm)->tx.level == 0;
+}
+
+/* The CPU stalls on a full FIFO until the SM makes room. */
+void pio_sm_put(size_t pio, size_t sm, size_t word) {
+  struct PioEmuSm* state = sm_of(pio, sm);
+  for(uint32_t waited = 0; state->tx.level == PIO_EMU_FIFO_DEPTH; waited++) {
+    if(waited == PIO_EMU_MAX_STALL) {
+      emu_fail("pio_sm_put() would block forever", pio, sm);
+    }
+    pio_emu_run(1);
+  }
+  fifo_push(&state->tx, (uint32_t)word);
+}
+
+size_t pio_sm_get_rx_fifo_level(size_t pio, size_t sm) {
+  return sm_of(pio, sm)->rx.level;
+}
+
+size_t pio_sm_get_blocking(size_t pio, size_t sm) {
+  struct PioEmuSm* state = sm_of(pio, sm);
+  for(uint32_t waited = 0; state->rx.level == 0; waited++) {
+    if(waited == PIO_EMU_MAX_STALL) {
+      emu_fail("pio_sm_get_blocking() would block forever", pio, sm);
+    }
+    pio_emu_run(1);
+  }
+  return fifo_pop(&state->rx);
+}
@@ -0,0 +1,60 @@
+#ifndef MOCKS_PIO_EMULATOR__H
+#define MOCKS_PIO_EMULATOR__H
+
+/* Instruction level model of the RP2040 PIO blocks, running the assembled
+ * step_gen and step_count programs from pico_stepper.pio.
+ *
+ * Link pio_emulator.c in place of pio_mocks.c. It implements the same calls
+ * pio.c makes, and the test advances the PIO clock with pio_emu_run().
+ * Both blocks, 4 SMs each, 4 deep FIFOs, side-set, delays, mov STATUS and the
+ * 2 cycle GPIO input synchroniser are modelled. Anything the two programs do
+ * not use (IRQ, autopush/pull, EXEC) aborts rather than being silently wrong. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PIO_EMU_CLOCK_MHZ   133
+#define PIO_EMU_MAX_EDGES   (1 << 16)
+
+/* Defined by pio_mocks.h, which pio.c includes. */
+extern size_t pio0;
+extern size_t pio1;
+
+/* The pico-sdk calls pio.c makes, with pio_mocks.h's signatures. */
+void step_gen_program(size_t);
+void step_count_program(size_t);
+void step_gen_program_init(size_t, size_t, size_t, size_t, size_t);
+void step_count_program_init(size_t, size_t, size_t, size_t, size_t);
+size_t pio_add_program(size_t, const void*);
+int pio_claim_unused_sm(size_t, int);
+void pio_sm_set_enabled(size_t pio, size_t sm, int enabled);
+int pio_sm_is_tx_fifo_full(size_t, size_t);
+void pio_sm_put(size_t, size_t, size_t);
+int pio_sm_is_tx_fifo_empty(size_t, size_t);
+size_t pio_sm_get_rx_fifo_level(size_t, size_t);
+size_t pio_sm_get_blocking(size_t, size_t);
+
+/* A GPIO changing level, in PIO clock cycles since pio_emu_reset(). */
+struct PioEmuEdge {
+  uint64_t cycle;
+  uint8_t  pin;
+  uint8_t  level;
+};
+
+/* Unload all programs, release all SMs, drive every GPIO low and zero the
+ * clock. Also sets pio0 = 0 and pio1 = 1, which pio_mocks.h leaves equal. */
+void pio_emu_reset(void);
+
+/* Run every enabled SM for cycles PIO clock cycles. */
+void pio_emu_run(uint64_t cycles);
+
+uint64_t pio_emu_cycles(void);
+bool pio_emu_gpio(uint8_t pin);
+
+/* Edges logged since the last pio_emu_clear_edges(). Aborts if more than
+ * PIO_EMU_MAX_EDGES are logged without clearing. */
+size_t pio_emu_edges(const struct PioEmuEdge** edges);
+void pio_emu_clear_edges(void);
+
+#endif  // MOCKS_PIO_EMULATOR__H
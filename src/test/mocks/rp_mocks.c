@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <string.h>
 #include "rp_mocks.h"
 
 void tight_loop_contents() {
@@ -15,6 +16,13 @@ int gpio_get(uint32_t gpio) {
     return 0;
 }
 
+void gpio_put_masked(uint32_t mask, uint32_t value) {
+}
+
+uint32_t gpio_get_all(void) {
+    return 0;
+}
+
 void gpio_set_function (size_t gpio, enum gpio_function fn) {
 }
 
@@ -76,6 +84,29 @@ void multicore_launch_core1(void(*entry)(void)) {
     (void)entry;
 }
 
+void multicore_lockout_start_blocking(void) {
+}
+
+void multicore_lockout_end_blocking(void) {
+}
+
+uint32_t save_and_disable_interrupts(void) {
+    return 0;
+}
+
+void restore_interrupts(uint32_t status) {
+}
+
+uint8_t flash_mock[PICO_FLASH_SIZE_BYTES];
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    memset(flash_mock + flash_offs, 0xff, count);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    memcpy(flash_mock + flash_offs, data, count);
+}
+
 alarm_id_t add_alarm_at(absolute_time_t time, alarm_callback_t callback,
                          void *user_data, bool fire_if_past) {
     (void) time; (void) callback; (void) user_data; (void) fire_if_past;
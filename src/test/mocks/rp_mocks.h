@@ -31,6 +31,8 @@ uint64_t time_us_64();
 
 void gpio_put(uint32_t gpio, int value);
 int gpio_get(uint32_t gpio);
+void gpio_put_masked(uint32_t mask, uint32_t value);
+uint32_t gpio_get_all(void);
 
 typedef uint64_t mutex_t;
 void mutex_enter_blocking(mutex_t *mtx);
@@ -74,6 +76,20 @@ alarm_id_t add_alarm_at(absolute_time_t time, alarm_callback_t callback,
 bool cancel_alarm(alarm_id_t alarm_id);
 
 void multicore_launch_core1(void(*entry)(void));
+void multicore_lockout_start_blocking(void);
+void multicore_lockout_end_blocking(void);
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+/* Flash is a RAM array just big enough for the config cache sectors. */
+#define FLASH_PAGE_SIZE 256
+#define FLASH_SECTOR_SIZE 4096
+#define PICO_FLASH_SIZE_BYTES (2 * FLASH_SECTOR_SIZE)
+extern uint8_t flash_mock[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE ((uintptr_t)flash_mock)
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
 
 #define UART1_IRQ 0
 typedef void (*irq_handler_t)(void);
@@ -13,10 +13,13 @@ int32_t  recvfrom(uint8_t sn, uint8_t *buf, uint16_t len, uint8_t *addr, uint16_
 int32_t  sendto(uint8_t sn, const uint8_t *buf, uint16_t len, uint8_t *addr, uint16_t port);
 int8_t   socket(uint8_t sn, uint8_t protocol, uint16_t port, uint8_t flag);
 
+/* Room for an oversized packet beyond sizeof(struct NWBuffer). */
+#define SOCK_MOCK_RX_LEN 1600
+
 /* Test controls — set before each test via sock_mock_reset(). */
 extern uint8_t  sock_mock_status;
 extern uint16_t sock_mock_rx_size;
-extern uint8_t  sock_mock_rx_data[700];
+extern uint8_t  sock_mock_rx_data[SOCK_MOCK_RX_LEN];
 extern int32_t  sock_mock_socket_calls;
 
 void sock_mock_reset(void);
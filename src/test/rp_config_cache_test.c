@@ -0,0 +1,122 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include <stdio.h>
+
+#include "../shared/messages.h"
+#include "../shared/config_hash.h"
+#include "../rp2040/config_cache.h"
+#include "mocks/rp_mocks.h"
+
+static uint64_t now_us = 0;
+
+uint64_t __wrap_time_us_64() {
+    return now_us;
+}
+
+static struct Message_joint_config joint_config(uint8_t joint, int8_t step) {
+    struct Message_joint_config message = {
+        .type = MSG_SET_JOINT_CONFIG, .joint = joint, .enable = 1,
+        .gpio_step = step, .gpio_dir = step + 1, .max_velocity = 100.0, .max_accel = 10.0};
+    return message;
+}
+
+static int setup(void **state) {
+    (void) state; /* unused */
+    now_us = 0;
+    memset(flash_mock, 0xff, sizeof(flash_mock));
+    config_cache_reset_for_test();
+    return 0;
+}
+
+/* The firmware hash is the one the driver computes from the same messages,
+ * and ignores joint enable. */
+static void test_hash_matches_message_hash(void **state) {
+    (void) state; /* unused */
+
+    struct Message_joint_config joint = joint_config(0, 2);
+    struct Message_gpio_config gpio = {
+        .type = MSG_SET_GPIO_CONFIG, .gpio_type = GPIO_TYPE_NATIVE_IN, .gpio_count = 3, .index = 7};
+    config_cache_joint(&joint);
+    config_cache_gpio(&gpio);
+
+    joint.enable = 0;
+    uint32_t expected = config_hash_joint(CONFIG_HASH_INIT, &joint);
+    expected = config_hash_gpio(expected, &gpio);
+    assert_int_equal(config_cache_hash(), expected);
+
+    joint.enable = 1;
+    config_cache_joint(&joint);
+    assert_int_equal(config_cache_hash(), expected);
+}
+
+/* No write is due until the config has settled and every joint is off, and
+ * none is left due once written. */
+static void test_due_waits_for_settled_idle(void **state) {
+    (void) state; /* unused */
+
+    struct Message_joint_config joint = joint_config(0, 2);
+    config_cache_joint(&joint);
+
+    assert_false(config_cache_due(true));
+    now_us = CONFIG_CACHE_SAVE_DELAY_US;
+    assert_false(config_cache_due(false));
+    assert_true(config_cache_due(true));
+    assert_null(config_cache_load());
+    config_cache_write();
+    assert_false(config_cache_due(true));
+
+    const struct ConfigCacheRecord* record = config_cache_load();
+    assert_non_null(record);
+    assert_int_equal(record->hash, config_cache_hash());
+    assert_int_equal(record->joint[0].gpio_step, 2);
+    assert_int_equal(record->joint[0].enable, 0);
+}
+
+/* Writes alternate sectors; the newest valid record wins and a damaged one
+ * falls back to the other. Replaying the stored config writes nothing. */
+static void test_sectors_alternate(void **state) {
+    (void) state; /* unused */
+
+    struct Message_joint_config joint = joint_config(1, 2);
+    config_cache_joint(&joint);
+    now_us += CONFIG_CACHE_SAVE_DELAY_US;
+    assert_true(config_cache_due(true));
+    config_cache_write();
+    uint32_t first_hash = config_cache_hash();
+
+    joint = joint_config(1, 4);
+    config_cache_joint(&joint);
+    now_us += CONFIG_CACHE_SAVE_DELAY_US;
+    assert_true(config_cache_due(true));
+    config_cache_write();
+
+    const struct ConfigCacheRecord* record = config_cache_load();
+    assert_true((const uint8_t*)record == flash_mock + FLASH_SECTOR_SIZE);
+    assert_int_equal(record->joint[1].gpio_step, 4);
+
+    flash_mock[FLASH_SECTOR_SIZE + offsetof(struct ConfigCacheRecord, joint)] ^= 1;
+    record = config_cache_load();
+    assert_true((const uint8_t*)record == flash_mock);
+    assert_int_equal(record->hash, first_hash);
+
+    config_cache_reset_for_test();
+    record = config_cache_load();
+    config_cache_joint(&record->joint[1]);
+    now_us += CONFIG_CACHE_SAVE_DELAY_US;
+    assert_false(config_cache_due(true));
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup(test_hash_matches_message_hash, setup),
+        cmocka_unit_test_setup(test_due_waits_for_settled_idle, setup),
+        cmocka_unit_test_setup(test_sectors_alternate, setup),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -22,9 +22,17 @@ void __wrap_disable_joint(const uint8_t joint, const uint8_t core) {
 
 /* Intercept do_steps() to count calls. */
 static int do_steps_call_count = 0;
-
-uint8_t __wrap_do_steps(const uint8_t joint) {
-    (void)joint;
+static uint32_t do_steps_updated[MAX_JOINT];
+
+uint8_t __wrap_do_steps(
+    const uint8_t joint,
+    const struct JointCommand* command,
+    uint32_t updated,
+    struct JointFeedback* feedback)
+{
+    (void)command;
+    feedback->abs_pos_achieved = 100 * joint + do_steps_call_count;
+    do_steps_updated[joint] = updated;
     do_steps_call_count++;
     return 1;
 }
@@ -133,6 +141,26 @@ static void test_step_all_joints_calls_do_steps_for_each_joint(void **state) {
     assert_int_equal(MAX_JOINT, do_steps_call_count);
 }
 
+/* step_all_joints: only joints the newest packet wrote count as updated, and
+ * the feedback do_steps() leaves is published for Core0. */
+static void test_step_all_joints_exchanges_snapshots(void **state) {
+    (void)state;
+    struct JointFeedback feedback[MAX_JOINT];
+
+    stage_joint_command(1)->velocity_requested_q = 10 * 65536;
+    publish_joint_commands();
+    uint32_t published = read_joint_feedback(feedback);
+
+    step_all_joints();
+    assert_int_equal(do_steps_updated[0], 0);
+    assert_int_equal(do_steps_updated[1], 1);
+    assert_int_equal(read_joint_feedback(feedback), published + 1);
+    assert_int_equal(feedback[1].abs_pos_achieved, 101);
+
+    step_all_joints();
+    assert_int_equal(do_steps_updated[1], 0);
+}
+
 /* core1_main loop: when linuxcnc_restart_detected is set, one iteration must
  * disable all joints, clear the flag, and still call step_all_joints so motors
  * can decelerate. */
@@ -173,6 +201,7 @@ int main(void) {
         cmocka_unit_test_setup(test_handle_network_timeout_disables_once_per_outage, test_setup),
         cmocka_unit_test_setup(test_handle_network_recovery_re_arms_timeout,         test_setup),
         cmocka_unit_test_setup(test_step_all_joints_calls_do_steps_for_each_joint,   test_setup),
+        cmocka_unit_test_setup(test_step_all_joints_exchanges_snapshots,             test_setup),
         cmocka_unit_test_setup(test_core1_disables_joints_on_linuxcnc_restart,       test_setup),
         cmocka_unit_test_setup(test_core1_restart_while_network_unhealthy,           test_setup),
     };
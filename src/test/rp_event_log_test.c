@@ -0,0 +1,116 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+
+#include "../rp2040/config.h"
+#include "../rp2040/event_log.h"
+
+static int setup(void **state) {
+    (void) state; /* unused */
+    log_reset_for_test();
+    return 0;
+}
+
+/* Events come back in the order logged, on the ring of the core that
+ * logged them. */
+static void test_events_keep_order(void **state) {
+    (void) state; /* unused */
+    struct LogRecord record;
+
+    log_event(CORE0, LOG_TX_FULL, REPLY_TIMING, 0);
+    log_event(CORE1, LOG_JOINT_ENABLED, 2, 0);
+    log_event(CORE0, LOG_RX_LENGTH, 100, 64);
+
+    assert_true(log_pop(CORE0, &record));
+    assert_int_equal(record.event, LOG_TX_FULL);
+    assert_int_equal(record.core, CORE0);
+    assert_int_equal(record.a, REPLY_TIMING);
+    assert_true(log_pop(CORE0, &record));
+    assert_int_equal(record.event, LOG_RX_LENGTH);
+    assert_int_equal(record.a, 100);
+    assert_int_equal(record.b, 64);
+    assert_false(log_pop(CORE0, &record));
+
+    assert_true(log_pop(CORE1, &record));
+    assert_int_equal(record.event, LOG_JOINT_ENABLED);
+    assert_int_equal(record.core, CORE1);
+    assert_int_equal(record.a, 2);
+    assert_false(log_pop(CORE1, &record));
+}
+
+/* A full ring drops new events and counts them, leaving the rest intact. */
+static void test_full_ring_drops_newest(void **state) {
+    (void) state; /* unused */
+    struct LogRecord record;
+
+    for(uint32_t i = 0; i < LOG_RING_LEN + 3; i++) {
+        log_event(CORE1, LOG_MCP_FAULT, i, 0);
+    }
+    assert_int_equal(log_take_dropped(CORE1), 3);
+    assert_int_equal(log_take_dropped(CORE1), 0);
+    assert_int_equal(log_take_dropped(CORE0), 0);
+
+    for(uint32_t i = 0; i < LOG_RING_LEN; i++) {
+        assert_true(log_pop(CORE1, &record));
+        assert_int_equal(record.a, i);
+    }
+    assert_false(log_pop(CORE1, &record));
+
+    /* Space again once drained. */
+    log_event(CORE1, LOG_NETWORK_UP, 0, 0);
+    assert_true(log_pop(CORE1, &record));
+    assert_int_equal(record.event, LOG_NETWORK_UP);
+}
+
+/* log_drain() prints one event per LOG_DRAIN_INTERVAL_US, taking turns
+ * between the cores, then the dropped count once a ring is empty. */
+static void test_drain_is_paced(void **state) {
+    (void) state; /* unused */
+    uint64_t now = LOG_DRAIN_INTERVAL_US;
+    struct LogRecord record;
+
+    assert_false(log_drain(now));
+
+    log_event(CORE0, LOG_RX_CHECKSUM, 0, 0);
+    log_event(CORE0, LOG_RX_CHECKSUM, 0, 0);
+    log_event(CORE1, LOG_NETWORK_DOWN, 0, 0);
+
+    assert_true(log_drain(now));
+    assert_false(log_drain(now + LOG_DRAIN_INTERVAL_US - 1));
+
+    /* Core1's turn, then back to Core0. */
+    now += LOG_DRAIN_INTERVAL_US;
+    assert_true(log_drain(now));
+    assert_false(log_pop(CORE1, &record));
+    now += LOG_DRAIN_INTERVAL_US;
+    assert_true(log_drain(now));
+    assert_false(log_pop(CORE0, &record));
+    now += LOG_DRAIN_INTERVAL_US;
+    assert_false(log_drain(now));
+
+    /* Drops are reported after the events that were kept. */
+    for(uint32_t i = 0; i < LOG_RING_LEN + 1; i++) {
+        log_event(CORE0, LOG_GPIO_OUT, i, 1);
+    }
+    for(uint32_t i = 0; i < LOG_RING_LEN; i++) {
+        now += LOG_DRAIN_INTERVAL_US;
+        assert_true(log_drain(now));
+    }
+    now += LOG_DRAIN_INTERVAL_US;
+    assert_true(log_drain(now));
+    assert_int_equal(log_take_dropped(CORE0), 0);
+    now += LOG_DRAIN_INTERVAL_US;
+    assert_false(log_drain(now));
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup(test_events_keep_order, setup),
+        cmocka_unit_test_setup(test_full_ring_drops_newest, setup),
+        cmocka_unit_test_setup(test_drain_is_paced, setup),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -16,16 +16,24 @@
 
 extern uint8_t gpio_i2c_mcp_addresses[MAX_I2C_MCP];
 
-void __wrap_gpio_put(int index, int value) {
-    // printf("__wrap_gpio_put(%i, %i)\n", index, value);
-    check_expected(index);
+void __wrap_gpio_put_masked(uint32_t mask, uint32_t value) {
+    check_expected(mask);
     check_expected(value);
 }
 
-int __wrap_gpio_get(int index) {
-    printf("__wrap_gpio_get(%i)\n", index);
-    check_expected(index);
-    return mock_type(int);
+uint32_t __wrap_gpio_get_all(void) {
+    return mock_type(uint32_t);
+}
+
+/* config.gpio_values one GPIO at a time. */
+static void set_value(uint8_t gpio, bool value) {
+    update_gpio_config(gpio, NULL, NULL, NULL, &value);
+}
+
+static bool get_value(uint8_t gpio) {
+    bool value;
+    get_gpio_config(gpio, NULL, NULL, NULL, &value);
+    return value;
 }
 
 static void test_gpio_config(void **state) {
@@ -75,52 +83,49 @@ static void test_native_gpio_set_output_values(void **state) {
     uint32_t values_current = (0xFFFF0000 & values) + (values_inverted & 0x0000FFFF);
 
     // Configure the GPIO in the main config.
+    // Each bank drives the RP2040's native pins, one GPIO per pin.
     for(uint8_t gpio = 0; gpio < MAX_GPIO; gpio++) {
-        config.gpio[gpio].type = GPIO_TYPE_NATIVE_OUT;
-        config.gpio[gpio].index = gpio % MAX_GPIO;
-
-        if(gpio < 32) {
-            // bank 0;
-            // Configured values differ.
-            config.gpio[gpio].value = values_current & (0x1 << gpio);
-        } else {
-            // bank 1;
-            // Configured values are same as those sent.
-            config.gpio[gpio].value = values & (0x1 << (gpio % 32));
+        config.gpio[gpio].type = GPIO_TYPE_NOT_SET;
+        if(gpio % 32 < NATIVE_GPIO_COUNT) {
+            config.gpio[gpio].type = GPIO_TYPE_NATIVE_OUT;
+            config.gpio[gpio].index = gpio % 32;
         }
     }
+    gpio_update_masks();
 
-    config.gpio_confirmation_pending[0] = false;
-    config.gpio_confirmation_pending[1] = false;
-
-    // Set the expected function calls when we eventually call `gpio_set_values(...)`.
-    // Iterate through the bytes that represent the final status of the GPIO.
-    for(uint8_t gpio = 0; gpio < MAX_GPIO; gpio++) {
-        int bit = gpio % 32;  // Stay within the bounds of `values`.
-        int v = (values >> bit) & 0x1;
+    // bank 0: Configured values differ.
+    config.gpio_values[0] = values_current;
+    for(uint8_t bank = 1; bank < MAX_GPIO_BANK; bank++) {
+        // Configured values are same as those sent.
+        config.gpio_values[bank] = values;
+    }
 
-        if(v != config.gpio[gpio].value) {
-            expect_value(__wrap_gpio_put, index, gpio);
-            expect_value(__wrap_gpio_put, value, v);
-        }
+    for(uint8_t bank = 0; bank < MAX_GPIO_BANK; bank++) {
+        config.gpio_confirmation_pending[bank] = false;
     }
 
+    // Only bank 0 changes; its pins are written in a single call.
+    uint32_t changed = values ^ values_current;
+    expect_value(__wrap_gpio_put_masked, mask, changed);
+    expect_value(__wrap_gpio_put_masked, value, values & changed);
+
     // Now send `values` to each bank.
-    uint8_t banks = MAX_GPIO / 32;
-    for(uint8_t bank = 0; bank < banks; bank++) {
+    for(uint8_t bank = 0; bank < MAX_GPIO_BANK; bank++) {
         gpio_set_values(bank, values);
     }
 
     for(uint8_t gpio = 0; gpio < MAX_GPIO; gpio++) {
         int bit = gpio % 32;  // Stay within the bounds of `values`.
         int v = (values >> bit) & 0x1;
-        assert_int_equal(config.gpio[gpio].value, v);
+        assert_int_equal(get_value(gpio), v);
     }
 
     // Some current values in bank 0 differed from those sent.
     assert_int_equal(config.gpio_confirmation_pending[0], true);
-    // All current values in bank 1 matched from those sent.
-    assert_int_equal(config.gpio_confirmation_pending[1], false);
+    // All current values in the other banks matched from those sent.
+    for(uint8_t bank = 1; bank < MAX_GPIO_BANK; bank++) {
+        assert_int_equal(config.gpio_confirmation_pending[bank], false);
+    }
 }
 
 /* Output to the i2c MPC GPIO. */
@@ -132,43 +137,45 @@ static void test_i2c_gpio_set_output_values(void **state) {
     uint32_t values_inverted = ~values;
     uint32_t values_current = (0xFFFF0000 & values) + (values_inverted & 0x0000FFFF);
 
+    // bank 0: Configured values are same as those sent.
+    // bank 1: Configured values differ.
+    config.gpio_values[0] = values;
+    config.gpio_values[1] = values_current;
+
     // Configure the GPIO in the main config.
+    // Enough GPIO to fill every MCP slot.
+    uint8_t mcp_gpio = MAX_I2C_MCP * 16;
     for(uint8_t gpio = 0; gpio < MAX_GPIO; gpio++) {
+        config.gpio[gpio].type = GPIO_TYPE_NOT_SET;
+        if(gpio >= mcp_gpio) {
+            continue;
+        }
         config.gpio[gpio].type = GPIO_TYPE_I2C_MCP_OUT;
         // MCP23017 has 16 pins (0-15). Assign one device per 16 gpios so
         // each gpio gets a unique (address, index) pair with no overlap.
         config.gpio[gpio].index = gpio % 16;
         config.gpio[gpio].address = gpio / 16;
 
-        if(gpio < 32) {
-            // bank 0;
-            // Configured values are same as those sent.
-            config.gpio[gpio].value = values & (0x1 << gpio);
-        } else {
-            // bank 0;
-            // Configured values differ.
-            config.gpio[gpio].value = values_current & (0x1 << gpio);
-        }
-
         // The current value of the i2c value buffer.
         gpio_i2c_mcp_set_out_pin(
                 config.gpio[gpio].index,
                 config.gpio[gpio].address,
-                config.gpio[gpio].value
+                get_value(gpio)
                 );
     }
+    gpio_update_masks();
 
-    config.gpio_confirmation_pending[0] = false;
-    config.gpio_confirmation_pending[1] = false;
+    for(uint8_t bank = 0; bank < MAX_GPIO_BANK; bank++) {
+        config.gpio_confirmation_pending[bank] = false;
+    }
 
-    // Now send `values` to each bank.
-    uint8_t banks = MAX_GPIO / 32;
-    for(uint8_t bank = 0; bank < banks; bank++) {
+    // Now send `values` to the banks with MCP GPIO.
+    for(uint8_t bank = 0; bank < mcp_gpio / 32; bank++) {
         gpio_set_values(bank, values);
     }
 
     // Check the buffer has the correct values in each i2c_bucket (buffer).
-    for(uint8_t gpio = 0; gpio < MAX_GPIO; gpio++) {
+    for(uint8_t gpio = 0; gpio < mcp_gpio; gpio++) {
         uint8_t i2c_bucket;
         for(i2c_bucket = 0; i2c_bucket < MAX_I2C_MCP; i2c_bucket++) {
             if(gpio_i2c_mcp_addresses[i2c_bucket] == config.gpio[gpio].address) {
@@ -181,7 +188,7 @@ static void test_i2c_gpio_set_output_values(void **state) {
         uint8_t bmask = 0x1 << (index & 7);
         bool actual_value = i2c_gpio.config[i2c_bucket].output_data[bindex] & bmask;
 
-        assert_int_equal(expected_value, config.gpio[gpio].value);
+        assert_int_equal(expected_value, get_value(gpio));
         assert_int_equal(expected_value, actual_value);
     }
 
@@ -199,14 +206,14 @@ static void test_send_PC_to_RP(void **state) {
     struct NWBuffer tx_buf = {0};
     reset_nw_buf(&rx_buf);
     reset_nw_buf(&tx_buf);
-    uint8_t received_msg_count = 0;
+    size_t received_msg_count = 0;
 
     // Configure the GPIO in the main config.
     for(uint8_t gpio = 0; gpio < MAX_GPIO; gpio++) {
         config.gpio[gpio].type = GPIO_TYPE_NOT_SET;
         config.gpio[gpio].index = 0;
         config.gpio[gpio].address = 0;
-        config.gpio[gpio].value = false;
+        set_value(gpio, false);
     }
 
     for(uint8_t bank = 0; bank < MAX_GPIO / 32; bank++) {
@@ -215,19 +222,20 @@ static void test_send_PC_to_RP(void **state) {
 
     config.gpio[0].type = GPIO_TYPE_NATIVE_IN;
     config.gpio[0].index = 11;
-    config.gpio[0].value = false;
+    set_value(0, false);
 
     config.gpio[1].type = GPIO_TYPE_NATIVE_IN;
     config.gpio[1].index = 12;
-    config.gpio[1].value = false;
+    set_value(1, false);
 
     config.gpio[2].type = GPIO_TYPE_NATIVE_OUT;
     config.gpio[2].index = 13;
-    config.gpio[2].value = false;
+    set_value(2, false);
 
     config.gpio[3].type = GPIO_TYPE_NATIVE_OUT;
     config.gpio[3].index = 14;
-    config.gpio[3].value = false;
+    set_value(3, false);
+    gpio_update_masks();
 
 
     // Populate incoming buffer.
@@ -244,8 +252,8 @@ static void test_send_PC_to_RP(void **state) {
 
     // Only config.gpio[3] is an output pin whose value differs from
     // what is being requested.
-    expect_value(__wrap_gpio_put, index, 14);      // RP's GPIO pin.
-    expect_value(__wrap_gpio_put, value, true);    // GPIO value.
+    expect_value(__wrap_gpio_put_masked, mask, 0x1 << 14);   // RP's GPIO pin.
+    expect_value(__wrap_gpio_put_masked, value, 0x1 << 14);  // GPIO value.
 
     // Parse Message_gpio.
     process_received_buffer(
@@ -258,8 +266,8 @@ static void test_send_PC_to_RP(void **state) {
     assert_int_equal(received_msg_count, 1);
 
     // The GPIO output pins have been set in the config.
-    assert_int_equal(config.gpio[2].value, false);
-    assert_int_equal(config.gpio[3].value, true);
+    assert_int_equal(get_value(2), false);
+    assert_int_equal(get_value(3), true);
 
     // Should have reset the rx_buf.
     assert_int_equal(rx_buf.length, 0);
@@ -280,8 +288,8 @@ static void test_send_PC_to_RP(void **state) {
 
     // All output GPIO values now match what's being requested so gpio_out(...)
     // will not be called.
-    //expect_value(__wrap_gpio_put, index, 14);      // RP's GPIO pin.
-    //expect_value(__wrap_gpio_put, value, true);   // GPIO value.
+    //expect_value(__wrap_gpio_put_masked, mask, 0x1 << 14);   // RP's GPIO pin.
+    //expect_value(__wrap_gpio_put_masked, value, 0x1 << 14);  // GPIO value.
 
     // Process incoming data.
     process_received_buffer(
@@ -297,8 +305,8 @@ static void test_send_PC_to_RP(void **state) {
     //assert_int_equal(message.values_confirmed, config.gpio_values_confirmed[message.bank]);
 
     // The GPIO output pins have not changed.
-    assert_int_equal(config.gpio[2].value, false);
-    assert_int_equal(config.gpio[3].value, true);
+    assert_int_equal(get_value(2), false);
+    assert_int_equal(get_value(3), true);
 
     // Should have reset the rx_buf.
     assert_int_equal(rx_buf.length, 0);
@@ -317,14 +325,14 @@ static void test_send_PC_to_RP_confirmation_set(void **state) {
     struct NWBuffer tx_buf = {0};
     reset_nw_buf(&rx_buf);
     reset_nw_buf(&tx_buf);
-    uint8_t received_msg_count = 0;
+    size_t received_msg_count = 0;
 
     // Configure the GPIO in the main config.
     for(uint8_t gpio = 0; gpio < MAX_GPIO; gpio++) {
         config.gpio[gpio].type = GPIO_TYPE_NOT_SET;
         config.gpio[gpio].index = 0;
         config.gpio[gpio].address = 0;
-        config.gpio[gpio].value = true;
+        set_value(gpio, true);
     }
 
     for(uint8_t bank = 0; bank < MAX_GPIO / 32; bank++) {
@@ -333,19 +341,20 @@ static void test_send_PC_to_RP_confirmation_set(void **state) {
 
     config.gpio[0].type = GPIO_TYPE_NATIVE_IN;
     config.gpio[0].index = 11;
-    config.gpio[0].value = false;
+    set_value(0, false);
 
     config.gpio[1].type = GPIO_TYPE_NATIVE_IN;
     config.gpio[1].index = 12;
-    config.gpio[1].value = true;
+    set_value(1, true);
 
     config.gpio[2].type = GPIO_TYPE_NATIVE_OUT;
     config.gpio[2].index = 13;
-    config.gpio[2].value = false;
+    set_value(2, false);
 
     config.gpio[3].type = GPIO_TYPE_NATIVE_OUT;
     config.gpio[3].index = 14;
-    config.gpio[3].value = true;
+    set_value(3, true);
+    gpio_update_masks();
 
 
     // Populate incoming buffer.
@@ -394,24 +403,25 @@ static void test_send_RP_to_PC(void **state) {
         config.gpio[gpio].type = GPIO_TYPE_NOT_SET;
         config.gpio[gpio].index = 0;
         config.gpio[gpio].address = 0;
-        config.gpio[gpio].value = false;
+        set_value(gpio, false);
     }
 
     config.gpio[0].type = GPIO_TYPE_NATIVE_IN;
     config.gpio[0].index = 11;
-    config.gpio[0].value = true;
+    set_value(0, true);
 
     config.gpio[1].type = GPIO_TYPE_NATIVE_IN;
     config.gpio[1].index = 12;
-    config.gpio[1].value = false;
+    set_value(1, false);
 
     config.gpio[2].type = GPIO_TYPE_NATIVE_OUT;
     config.gpio[2].index = 13;
-    config.gpio[2].value = true;
+    set_value(2, true);
 
     config.gpio[3].type = GPIO_TYPE_NATIVE_OUT;
     config.gpio[3].index = 14;
-    config.gpio[3].value = false;
+    set_value(3, false);
+    gpio_update_masks();
 
     config.gpio_confirmation_pending[0] = true;
 
@@ -420,12 +430,9 @@ static void test_send_RP_to_PC(void **state) {
 
     reset_nw_buf(&tx_buf);
 
-    // gpio_get(...) will be called for all pins configured as inputs.
-    expect_value(__wrap_gpio_get, index, 11);      // RP's GPIO pin.
-    expect_value(__wrap_gpio_get, index, 12);      // RP's GPIO pin.
-    // Specify the gpio_get(...) return values matching the config.
-    will_return(__wrap_gpio_get, true);
-    will_return(__wrap_gpio_get, false);
+    // gpio_get_all(...) is called once for all pins configured as inputs.
+    // Return pin 11 high and pin 12 low, matching the config.
+    will_return(__wrap_gpio_get_all, 0x1 << 11);
 
     // Make the call under test.
     // Since the GPIO state does match that sent in the Message_gpio but
@@ -433,8 +440,8 @@ static void test_send_RP_to_PC(void **state) {
     gpio_serialize(&tx_buf, &tx_buf_len);
 
     // Out pins values correctly set.
-    assert_int_equal(config.gpio[0].value, true);
-    assert_int_equal(config.gpio[1].value, false);
+    assert_int_equal(get_value(0), true);
+    assert_int_equal(get_value(1), false);
 
     // Proves data was added to tx_buf_len.
     assert_int_equal(tx_buf_len, aligned32(sizeof(struct Reply_gpio)));
@@ -465,24 +472,25 @@ static void test_send_RP_to_PC_out_gpio_changed(void **state) {
         config.gpio[gpio].type = GPIO_TYPE_NOT_SET;
         config.gpio[gpio].index = 0;
         config.gpio[gpio].address = 0;
-        config.gpio[gpio].value = false;
+        set_value(gpio, false);
     }
 
     config.gpio[0].type = GPIO_TYPE_NATIVE_IN;
     config.gpio[0].index = 11;
-    config.gpio[0].value = true;
+    set_value(0, true);
 
     config.gpio[1].type = GPIO_TYPE_NATIVE_IN;
     config.gpio[1].index = 12;
-    config.gpio[1].value = false;
+    set_value(1, false);
 
     config.gpio[2].type = GPIO_TYPE_NATIVE_OUT;
     config.gpio[2].index = 13;
-    config.gpio[2].value = true;
+    set_value(2, true);
 
     config.gpio[3].type = GPIO_TYPE_NATIVE_OUT;
     config.gpio[3].index = 14;
-    config.gpio[3].value = false;
+    set_value(3, false);
+    gpio_update_masks();
 
     config.gpio_confirmation_pending[0] = false;
 
@@ -491,12 +499,9 @@ static void test_send_RP_to_PC_out_gpio_changed(void **state) {
 
     reset_nw_buf(&tx_buf);
 
-    // gpio_get(...) will be called for all pins configured as inputs.
-    expect_value(__wrap_gpio_get, index, 11);      // RP's GPIO pin.
-    expect_value(__wrap_gpio_get, index, 12);      // RP's GPIO pin.
-    // Specify the gpio_get(...) return values /not/ matching the config.
-    will_return(__wrap_gpio_get, false);
-    will_return(__wrap_gpio_get, false);
+    // gpio_get_all(...) is called once for all pins configured as inputs.
+    // Return pins 11 and 12 low, /not/ matching the config.
+    will_return(__wrap_gpio_get_all, 0);
 
     // Make the call under test.
     // Since the GPIO state does not match that sent in the Message_gpio,
@@ -505,8 +510,8 @@ static void test_send_RP_to_PC_out_gpio_changed(void **state) {
 
     // Out pins values should not have been updated yet, even though GPIO pins have changed.
     // It's up to the incoming Message_gpio to set the config values.
-    assert_int_equal(config.gpio[0].value, true);
-    assert_int_equal(config.gpio[1].value, false);
+    assert_int_equal(get_value(0), true);
+    assert_int_equal(get_value(1), false);
 
     // Proves data was added to tx_buf_len.
     assert_int_equal(tx_buf_len, aligned32(sizeof(struct Reply_gpio)));
@@ -567,24 +572,25 @@ static void test_send_RP_to_PC_matching(void **state) {
         config.gpio[gpio].type = GPIO_TYPE_NOT_SET;
         config.gpio[gpio].index = 0;
         config.gpio[gpio].address = 0;
-        config.gpio[gpio].value = false;
+        set_value(gpio, false);
     }
 
     config.gpio[0].type = GPIO_TYPE_NATIVE_IN;
     config.gpio[0].index = 11;
-    config.gpio[0].value = true;
+    set_value(0, true);
 
     config.gpio[1].type = GPIO_TYPE_NATIVE_IN;
     config.gpio[1].index = 12;
-    config.gpio[1].value = false;
+    set_value(1, false);
 
     config.gpio[2].type = GPIO_TYPE_NATIVE_OUT;
     config.gpio[2].index = 13;
-    config.gpio[2].value = true;
+    set_value(2, true);
 
     config.gpio[3].type = GPIO_TYPE_NATIVE_OUT;
     config.gpio[3].index = 14;
-    config.gpio[3].value = false;
+    set_value(3, false);
+    gpio_update_masks();
 
     config.gpio_confirmation_pending[0] = false;
 
@@ -592,12 +598,9 @@ static void test_send_RP_to_PC_matching(void **state) {
 
     reset_nw_buf(&tx_buf);
 
-    // gpio_get(...) will be called for all pins configured as inputs.
-    expect_value(__wrap_gpio_get, index, 11);      // RP's GPIO pin.
-    expect_value(__wrap_gpio_get, index, 12);      // RP's GPIO pin.
-    // Specify the gpio_get(...) return values matching the config.
-    will_return(__wrap_gpio_get, true);
-    will_return(__wrap_gpio_get, false);
+    // gpio_get_all(...) is called once for all pins configured as inputs.
+    // Return pin 11 high and pin 12 low, matching the config.
+    will_return(__wrap_gpio_get_all, 0x1 << 11);
 
     // Make the call under test.
     // Since HAL has sent values_confirmed matching GPIO,
@@ -610,13 +613,72 @@ static void test_send_RP_to_PC_matching(void **state) {
     assert_int_equal(tx_buf.checksum, 0);
 
     // Out pins values correctly set.
-    assert_int_equal(config.gpio[0].value, true);
-    assert_int_equal(config.gpio[1].value, false);
+    assert_int_equal(get_value(0), true);
+    assert_int_equal(get_value(1), false);
 
     // Config agrees that Reply_gpio has not been sent.
     assert_int_equal(config.gpio_confirmation_pending[0], false);
 }
 
+/* Inputs in the upper banks: one gpio_get_all(...) covers every bank, and MCP
+ * inputs are read from the last i2c poll. */
+static void test_send_RP_to_PC_upper_banks(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer tx_buf = {0};
+    reset_nw_buf(&tx_buf);
+    size_t tx_buf_len = 0;
+
+    for(uint8_t gpio = 0; gpio < MAX_GPIO; gpio++) {
+        config.gpio[gpio].type = GPIO_TYPE_NOT_SET;
+        config.gpio[gpio].index = 0;
+        config.gpio[gpio].address = 0;
+    }
+    for(uint8_t bank = 0; bank < MAX_GPIO_BANK; bank++) {
+        config.gpio_values[bank] = 0;
+        config.gpio_confirmation_pending[bank] = false;
+    }
+
+    // Native inputs in banks 1 and 3.
+    config.gpio[40].type = GPIO_TYPE_NATIVE_IN;
+    config.gpio[40].index = 5;
+    config.gpio[127].type = GPIO_TYPE_NATIVE_IN;
+    config.gpio[127].index = 29;
+
+    // MCP input in bank 2, on port B of the device at address 0.
+    config.gpio[70].type = GPIO_TYPE_I2C_MCP_IN;
+    config.gpio[70].index = 9;
+    config.gpio[70].address = 0;
+    gpio_update_masks();
+
+    int i2c = gpio_i2c_mcp_alloc(0);
+    assert_int_not_equal(i2c, -1);
+    i2c_gpio.config[i2c].input_data[1] = 0x1 << 1;
+
+    // Only queued once; a second read would fail the test.
+    will_return(__wrap_gpio_get_all, (0x1 << 5) | (0x1 << 29));
+
+    gpio_serialize(&tx_buf, &tx_buf_len);
+
+    // One Reply_gpio for each bank whose inputs changed.
+    assert_int_equal(tx_buf.length, aligned32(sizeof(struct Reply_gpio)) * 3);
+    assert_int_equal(config.gpio_confirmation_pending[0], false);
+
+    size_t stride = aligned32(sizeof(struct Reply_gpio));
+    struct Reply_gpio* reply_p = (void*)tx_buf.payload;
+    assert_int_equal(reply_p->bank, 1);
+    assert_int_equal(reply_p->values, 0x1 << (40 % 32));
+    assert_int_equal(reply_p->confirmation_pending, true);
+    reply_p = (void*)(tx_buf.payload + stride);
+    assert_int_equal(reply_p->bank, 2);
+    assert_int_equal(reply_p->values, 0x1 << (70 % 32));
+    reply_p = (void*)(tx_buf.payload + 2 * stride);
+    assert_int_equal(reply_p->bank, 3);
+    assert_int_equal(reply_p->values, 0x1u << (127 % 32));
+
+    i2c_gpio.config[i2c].input_data[1] = 0;
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_gpio_config),
@@ -627,7 +689,8 @@ int main(void) {
         cmocka_unit_test(test_send_PC_to_RP_confirmation_set),
         cmocka_unit_test(test_send_RP_to_PC),
         cmocka_unit_test(test_send_RP_to_PC_out_gpio_changed),
-        cmocka_unit_test(test_send_RP_to_PC_matching)
+        cmocka_unit_test(test_send_RP_to_PC_matching),
+        cmocka_unit_test(test_send_RP_to_PC_upper_banks)
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -1,13 +1,13 @@
 /* rp_multi_update_test.c
  *
- * Regression tests for overrun/underrun counting.
+ * Tests for the joint command / feedback exchange between the cores, and the
+ * overrun/underrun counting that falls out of it.
  *
- * overrun:  Core0 drains N queued W5500 packets between ticks — updated_from_c0
- *           accumulates to N before Core1 reads.  N-1 packets are discarded
- *           (only the latest position/velocity matters); overrun_count += N-1.
+ * overrun:  Core0 publishes N packets between ticks.  Core1 only reads the
+ *           latest snapshot, so N-1 are discarded; overrun_count += N-1.
  *
- * underrun: Core1 fires but Core0 has not yet received a new packet —
- *           updated_from_c0 == 0; underrun_count++.
+ * underrun: Core1 fires but Core0 has not published a new packet;
+ *           underrun_count++.
  *
  * Both counts are returned to LinuxCNC via Reply_joint_metrics.
  */
@@ -50,65 +50,150 @@ static size_t build_abs_pos_packet(
     return expected_length;
 }
 
+static uint32_t core1_generation;
+
+/* What step_all_joints() does with the exchange each tick. */
+static uint32_t core1_read(struct JointCommand commands[MAX_JOINT]) {
+    uint32_t generation = read_joint_commands(commands);
+    count_joint_updates(generation - core1_generation);
+    uint32_t previous = core1_generation;
+    core1_generation = generation;
+    return previous;
+}
+
+static void receive(double position, double velocity) {
+    struct NWBuffer rx_buf;
+    struct NWBuffer tx_buf = {0};
+    size_t received_msg_count = 0;
+    uint16_t expected_length = (uint16_t)build_abs_pos_packet(&rx_buf, position, velocity);
+    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, expected_length);
+}
+
 static int test_setup(void **state) {
     (void)state;
     init_config();
+    core1_generation = packet_generation;
     return 0;
 }
 
-/* After N packets arrive and Core1 reads once, overrun_count == N-1. */
+/* After N packets are published and Core1 reads once, overrun_count == N-1. */
 static void test_overrun_count_accumulates_when_core1_reads(void **state) {
     (void)state;
+    struct JointCommand commands[MAX_JOINT];
 
     const int N = 9;
-    struct NWBuffer rx_buf;
-    struct NWBuffer tx_buf;
-    uint8_t received_msg_count;
-    uint16_t expected_length;
-
     for (int i = 0; i < N; i++) {
-        tx_buf             = (struct NWBuffer){0};
-        received_msg_count = 0;
-        expected_length    = (uint16_t)build_abs_pos_packet(&rx_buf, (double)i * 10.0, 1.0);
-        process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, expected_length);
+        receive((double)i * 10.0, 1.0);
+        publish_joint_commands();
     }
 
-    get_joint_config(0, CORE1, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-                     NULL, NULL);
+    core1_read(commands);
 
-    assert_int_equal(get_and_reset_overrun_count(0), N - 1);
-    assert_int_equal(get_and_reset_overrun_count(0), 0);  /* resets on read */
+    /* Only the newest packet is seen. */
+    assert_int_equal(commands[0].abs_pos_requested_q, (int64_t)((N - 1) * 10) << 32);
+    assert_int_equal(get_and_reset_overrun_count(), N - 1);
+    assert_int_equal(get_and_reset_overrun_count(), 0);  /* resets on read */
 }
 
 /* One packet per tick: no overrun, no underrun. */
 static void test_no_overrun_when_one_packet_per_tick(void **state) {
     (void)state;
+    struct JointCommand commands[MAX_JOINT];
 
-    struct NWBuffer rx_buf;
-    struct NWBuffer tx_buf = {0};
-    uint8_t received_msg_count = 0;
-    uint16_t expected_length = (uint16_t)build_abs_pos_packet(&rx_buf, 10.0, 1.0);
-
-    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, expected_length);
+    receive(10.0, 1.0);
+    publish_joint_commands();
+    core1_read(commands);
 
-    get_joint_config(0, CORE1, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-                     NULL, NULL);
-
-    assert_int_equal(get_and_reset_overrun_count(0), 0);
-    assert_int_equal(get_and_reset_underrun_count(0), 0);
+    assert_int_equal(get_and_reset_overrun_count(), 0);
+    assert_int_equal(get_and_reset_underrun_count(), 0);
 }
 
 /* Core1 reads before any packet arrives: underrun_count increments. */
 static void test_underrun_count_when_core1_reads_before_packet(void **state) {
     (void)state;
+    struct JointCommand commands[MAX_JOINT];
+
+    /* No packets published. */
+    core1_read(commands);
+
+    assert_int_equal(get_and_reset_underrun_count(), 1);
+    assert_int_equal(get_and_reset_underrun_count(), 0);  /* resets on read */
+    assert_int_equal(get_and_reset_overrun_count(), 0);   /* overrun unaffected */
+}
+
+/* Core1 sees nothing of a packet until it is published, then all of it.
+ * Joints the packet did not write keep their older generation. */
+static void test_commands_visible_per_packet(void **state) {
+    (void)state;
+    struct JointCommand commands[MAX_JOINT];
+
+    receive(10.0, 1.0);
+    publish_joint_commands();
+    core1_read(commands);
+    int32_t velocity_q = commands[0].velocity_requested_q;
+
+    volatile struct JointCommand* command = stage_joint_command(0);
+    command->abs_pos_requested_q = (int64_t)20 << 32;
+    command->velocity_requested_q = 2 * 65536;
+    core1_read(commands);
+    assert_int_equal(commands[0].abs_pos_requested_q, (int64_t)10 << 32);
+    assert_int_equal(commands[0].velocity_requested_q, velocity_q);
+
+    publish_joint_commands();
+    uint32_t previous = core1_read(commands);
+    assert_int_equal(commands[0].abs_pos_requested_q, (int64_t)20 << 32);
+    assert_int_equal(commands[0].velocity_requested_q, 2 * 65536);
+    assert_true((int32_t)(commands[0].generation - previous) > 0);
+    assert_false((int32_t)(commands[1].generation - previous) > 0);
+}
+
+/* A joint Core1 disables is off from its next read, before Core0 has seen
+ * the request, and stays off until Core0 enables it again. */
+static void test_core1_disable(void **state) {
+    (void)state;
+    struct JointCommand commands[MAX_JOINT];
+
+    stage_joint_command(1)->enabled = 1;
+    publish_joint_commands();
+    core1_read(commands);
+    assert_int_equal(commands[1].enabled, 1);
+
+    disable_joint(1, CORE1);
+    core1_read(commands);
+    assert_int_equal(commands[1].enabled, 0);
+    assert_int_equal(config.joint[1].enabled, 1);
+
+    apply_joint_disables();
+    assert_int_equal(config.joint[1].enabled, 0);
+    assert_false(any_joint_enabled());
+    publish_joint_commands();
+    core1_read(commands);
+    assert_int_equal(commands[1].enabled, 0);
+
+    stage_joint_command(1)->enabled = 1;
+    publish_joint_commands();
+    core1_read(commands);
+    assert_int_equal(commands[1].enabled, 1);
+}
+
+/* Feedback reads back as published, with a count of publications. */
+static void test_feedback_round_trip(void **state) {
+    (void)state;
+    struct JointFeedback feedback[MAX_JOINT] = {0};
+    struct JointFeedback seen[MAX_JOINT];
+
+    assert_int_equal(read_joint_feedback(seen), 0);
 
-    /* No packets sent — updated_from_c0 stays 0. */
-    get_joint_config(0, CORE1, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-                     NULL, NULL);
+    feedback[2].enabled = 1;
+    feedback[2].abs_pos_achieved = -1234;
+    feedback[2].velocity_achieved = 65536;
+    publish_joint_feedback(feedback);
 
-    assert_int_equal(get_and_reset_underrun_count(0), 1);
-    assert_int_equal(get_and_reset_underrun_count(0), 0);  /* resets on read */
-    assert_int_equal(get_and_reset_overrun_count(0), 0);   /* overrun unaffected */
+    assert_int_equal(read_joint_feedback(seen), 1);
+    assert_int_equal(seen[2].enabled, 1);
+    assert_int_equal(seen[2].abs_pos_achieved, -1234);
+    assert_int_equal(seen[2].velocity_achieved, 65536);
+    assert_int_equal(seen[0].abs_pos_achieved, 0);
 }
 
 int main(void) {
@@ -119,6 +204,9 @@ int main(void) {
             test_no_overrun_when_one_packet_per_tick, test_setup),
         cmocka_unit_test_setup(
             test_underrun_count_when_core1_reads_before_packet, test_setup),
+        cmocka_unit_test_setup(test_commands_visible_per_packet, test_setup),
+        cmocka_unit_test_setup(test_core1_disable, test_setup),
+        cmocka_unit_test_setup(test_feedback_round_trip, test_setup),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
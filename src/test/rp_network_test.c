@@ -11,6 +11,7 @@
 #include "../shared/buffer.h"
 #include "../rp2040/core0.h"
 #include "../rp2040/config.h"
+#include "../rp2040/config_cache.h"
 #include "../rp2040/network.h"
 #include "../rp2040/ring_buffer.h"
 #include "mocks/rp_mocks.h"
@@ -52,6 +53,8 @@ size_t append_message(struct NWBuffer* rx_buf, union MessageAny message) {
             return pack_nw_buff(rx_buf, &message.set_abs_pos, sizeof(message.set_abs_pos));
         case MSG_SET_JOINT_CONFIG:
             return pack_nw_buff(rx_buf, &message.joint_config, sizeof(message.joint_config));
+        case MSG_CLOCK_SYNC:
+            return pack_nw_buff(rx_buf, &message.clock_sync, sizeof(message.clock_sync));
         default:
             printf("TEST HELPER ERROR: Invalid message type: %u\n", message.header.type);
             break;
@@ -64,7 +67,7 @@ static void test_unpack_multiple_message(void **state) {
 
     struct NWBuffer rx_buf = {0};
     struct NWBuffer tx_buf = {0};
-    uint8_t received_msg_count = 0;
+    size_t received_msg_count = 0;
     uint16_t expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
 
     expected_length += append_enable_message(&rx_buf, 0, 0);
@@ -83,7 +86,7 @@ static void test_unpack_multiple_message_stop_at_length(void **state) {
 
     struct NWBuffer rx_buf = {0};
     struct NWBuffer tx_buf = {0};
-    uint8_t received_msg_count = 0;
+    size_t received_msg_count = 0;
     uint16_t expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
 
     expected_length += append_enable_message(&rx_buf, 0, 0);
@@ -111,7 +114,7 @@ static void test_unpack_joint_enable_message(void **state) {
 
     struct NWBuffer rx_buf = {0};
     struct NWBuffer tx_buf = {0};
-    uint8_t received_msg_count = 0;
+    size_t received_msg_count = 0;
     uint16_t expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
 
     expected_length += append_enable_message(&rx_buf, 2, 1);
@@ -122,7 +125,7 @@ static void test_unpack_joint_enable_message(void **state) {
     // 1 message processed.
     assert_int_equal(received_msg_count, 1);
 
-    // The update_joint_config(...) method has not been mocked
+    // stage_joint_command(...) has not been mocked
     // so this will result in the config actually changing.
     assert_int_equal(config.joint[2].enabled, 1);
 }
@@ -133,7 +136,7 @@ static void test_unpack_timing_message(void **state) {
 
     struct NWBuffer rx_buf = {0};
     struct NWBuffer tx_buf = {0};
-    uint8_t received_msg_count = 0;
+    size_t received_msg_count = 0;
     uint16_t expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
 
     struct Message_timing timing = {0};
@@ -162,24 +165,60 @@ static void test_unpack_timing_message(void **state) {
     assert_int_equal(tx_buf.length, aligned32(sizeof(struct Reply_timing)));
 }
 
+/* Test MSG_CLOCK_SYNC is answered once, after the rest of the reply. */
+static void test_unpack_clock_sync_message(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer rx_buf = {0};
+    struct NWBuffer tx_buf = {0};
+    size_t received_msg_count = 0;
+    uint16_t expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
+
+    union MessageAny message = {0};
+    message.clock_sync.type = MSG_CLOCK_SYNC;
+    message.clock_sync.host_tx_us = 0x123456789abcull;
+
+    expected_length += append_message(&rx_buf, message);
+
+    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, expected_length);
+
+    assert_int_equal(received_msg_count, 1);
+    // Nothing is packed until serialise_clock_sync().
+    assert_int_equal(tx_buf.length, 0);
+
+    assert_true(serialise_clock_sync(&tx_buf));
+    assert_int_equal(tx_buf.length, aligned32(sizeof(struct Reply_clock_sync)));
+    struct Reply_clock_sync reply;
+    memcpy(&reply, tx_buf.payload, sizeof(reply));
+    assert_int_equal(reply.type, REPLY_CLOCK_SYNC);
+    assert_int_equal(reply.host_tx_us, 0x123456789abcull);
+    assert_true(reply.rp_tx_us >= reply.rp_rx_us);
+
+    // Only answered once.
+    assert_true(serialise_clock_sync(&tx_buf));
+    assert_int_equal(tx_buf.length, aligned32(sizeof(struct Reply_clock_sync)));
+}
+
 /* Test unpacking the struct Message_set_joints_pos works as intended. */
 static void test_unpack_set_abs_pos_message(void **state) {
     (void) state; /* unused */
 
     struct NWBuffer rx_buf = {0};
     struct NWBuffer tx_buf = {0};
-    uint8_t received_msg_count = 0;
+    size_t received_msg_count = 0;
     uint16_t expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
 
     struct Message_set_joints_pos message_set_abs_pos = {0};
     message_set_abs_pos.type  = MSG_SET_JOINT_ABS_POS;
     message_set_abs_pos.count = MAX_JOINT;
 
+    config.update_time_us = 1000;
     double p = 12.34;
     double v = 56.78;
     for(size_t joint = 0; joint < MAX_JOINT; joint++) {
-        message_set_abs_pos.position[joint] = p * (joint + 1);
-        message_set_abs_pos.velocity[joint] = v * (joint + 1);
+        double sign = (joint % 2) ? -1.0 : 1.0;
+        message_set_abs_pos.position[joint] = sign * p * (joint + 1);
+        message_set_abs_pos.velocity[joint] = sign * v * (joint + 1);
     }
 
     union MessageAny message = {0};
@@ -194,27 +233,293 @@ static void test_unpack_set_abs_pos_message(void **state) {
     // 1 message processed.
     assert_int_equal(received_msg_count, 1);
 
-    // The update_joint_config(...) method has not been mocked
+    // stage_joint_command(...) has not been mocked
     // so this will result in the config actually changing.
     for(size_t joint = 0; joint < MAX_JOINT; joint++) {
-        assert_double_equal(
-                config.joint[joint].abs_pos_requested,
-                message_set_abs_pos.position[joint],
-                0.01);
-        assert_double_equal(
-                config.joint[joint].abs_pos_requested,
-                message_set_abs_pos.position[joint],
-                0.01);
+        /* Stored in the units do_steps() works in: Q32.32 steps and
+         * Q16.16 steps/period. The integer conversion gives what the double
+         * maths it replaced did. */
+        assert_int_equal(
+                config.joint[joint].abs_pos_requested_q,
+                (int64_t)(message_set_abs_pos.position[joint] * 4294967296.0));
+        assert_int_equal(
+                config.joint[joint].velocity_requested_q,
+                (int32_t)((message_set_abs_pos.velocity[joint] / 1000.0) * 65536.0));
     }
 }
 
+/* Test unpacking the variable length struct Message_set_joints_pos_q. */
+static void test_unpack_set_pos_q_message(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer rx_buf = {0};
+    struct NWBuffer tx_buf = {0};
+    size_t received_msg_count = 0;
+    uint16_t expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
+
+    config.update_time_us = 1000;
+    config.joint[3].abs_pos_requested_q = 99;
+    config.joint[3].velocity_requested_q = 99;
+
+    struct Message_set_joints_pos_q message = {0};
+    message.type  = MSG_SET_JOINT_POS_Q;
+    message.count = 3;
+    for(size_t joint = 0; joint < message.count; joint++) {
+        /* (joint + 1.25) steps and -(joint + 0.5) steps per period. */
+        message.joint[joint].position = (int64_t)((joint + 1.25) * 4294967296.0);
+        message.joint[joint].velocity = -(int32_t)((joint + 0.5) * 65536.0);
+    }
+
+    size_t len = MESSAGE_SET_JOINTS_POS_Q_LEN(message.count);
+    assert_int_equal(len, 4 + 3 * 12);
+    expected_length += pack_nw_buff(&rx_buf, &message, len);
+    assert_int_equal(rx_buf.length, aligned32(len));
+
+    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, expected_length);
+
+    assert_int_equal(tx_buf.length, 0);
+    assert_int_equal(received_msg_count, 1);
+
+    for(size_t joint = 0; joint < message.count; joint++) {
+        /* Stored as sent: the wire format is what do_steps() works in. */
+        assert_int_equal(config.joint[joint].abs_pos_requested_q, message.joint[joint].position);
+        assert_int_equal(config.joint[joint].velocity_requested_q, message.joint[joint].velocity);
+    }
+    /* Joints beyond count are untouched. */
+    assert_int_equal(config.joint[3].abs_pos_requested_q, 99);
+    assert_int_equal(config.joint[3].velocity_requested_q, 99);
+}
+
+/* Both setpoint messages leave Core1 with the same command at a period other
+ * than 1000µs: MSG_SET_JOINT_ABS_POS in steps/s, MSG_SET_JOINT_POS_Q encoded
+ * the way serialize_joint_pos_q() does, steps/s over the period in µs. */
+static void test_setpoint_units_agree_at_2ms(void **state) {
+    (void) state; /* unused */
+
+    double period_us = 2000.0;
+    double position = 12.5;
+    double velocity = 1500.0;
+    config.update_time_us = 2000;
+
+    struct NWBuffer rx_buf = {0};
+    struct NWBuffer tx_buf = {0};
+    size_t received_msg_count = 0;
+    uint16_t expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
+    union MessageAny message = {0};
+    message.set_abs_pos.type = MSG_SET_JOINT_ABS_POS;
+    message.set_abs_pos.count = 1;
+    message.set_abs_pos.position[0] = position;
+    message.set_abs_pos.velocity[0] = velocity;
+    expected_length += append_message(&rx_buf, message);
+    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, expected_length);
+    assert_int_equal(received_msg_count, 1);
+    int64_t legacy_pos_q = config.joint[0].abs_pos_requested_q;
+    int32_t legacy_vel_q = config.joint[0].velocity_requested_q;
+
+    struct Message_set_joints_pos_q compact = {0};
+    compact.type  = MSG_SET_JOINT_POS_Q;
+    compact.count = 1;
+    compact.joint[0].position = (int64_t)(position * 4294967296.0);
+    compact.joint[0].velocity = (int32_t)((velocity / period_us) * 65536.0);
+    reset_nw_buf(&rx_buf);
+    received_msg_count = 0;
+    expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
+    expected_length += pack_nw_buff(&rx_buf, &compact, MESSAGE_SET_JOINTS_POS_Q_LEN(1));
+    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, expected_length);
+    assert_int_equal(received_msg_count, 1);
+
+    /* 1500 / 2000: the firmware's unit, not 3 true steps per period. */
+    assert_int_equal(legacy_vel_q, 3 * 65536 / 4);
+    assert_int_equal(config.joint[0].velocity_requested_q, legacy_vel_q);
+    assert_int_equal(config.joint[0].abs_pos_requested_q, legacy_pos_q);
+    config.update_time_us = 1000;
+}
+
+/* A count larger than the wire format allows is treated as corruption. */
+static void test_unpack_set_pos_q_bad_count(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer rx_buf = {0};
+    struct NWBuffer tx_buf = {0};
+    size_t received_msg_count = 0;
+    uint16_t expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
+
+    struct Message_set_joints_pos_q message = {0};
+    message.type  = MSG_SET_JOINT_POS_Q;
+    message.count = WIRE_MAX_JOINT + 1;
+    expected_length += pack_nw_buff(&rx_buf, &message, sizeof(message));
+
+    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, expected_length);
+
+    assert_int_equal(received_msg_count, 0);
+}
+
+/* MSG_SET_JOINT_COAST sets how many missed updates in a row Core1 counts as
+ * coasted rather than underruns, until setpoints arrive without it. */
+static void test_unpack_joint_coast(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer rx_buf = {0};
+    struct NWBuffer tx_buf = {0};
+    size_t received_msg_count = 0;
+    uint16_t expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
+
+    get_and_reset_underrun_count();
+    get_and_reset_coasted_count();
+
+    struct Message_set_joints_pos_q pos = {.type = MSG_SET_JOINT_POS_Q, .count = 2};
+    expected_length += pack_nw_buff(&rx_buf, &pos, MESSAGE_SET_JOINTS_POS_Q_LEN(2));
+    struct Message_set_joint_coast coast = {.type = MSG_SET_JOINT_COAST, .periods = 2};
+    expected_length += pack_nw_buff(&rx_buf, &coast, sizeof(coast));
+
+    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, expected_length);
+
+    assert_int_equal(received_msg_count, 2);
+    assert_int_equal(config.coast_periods, 2);
+
+    /* Three updates missed in a row: two coasted, then an underrun. */
+    count_joint_updates(1);
+    count_joint_updates(0);
+    count_joint_updates(0);
+    count_joint_updates(0);
+    assert_int_equal(get_and_reset_coasted_count(), 2);
+    assert_int_equal(get_and_reset_underrun_count(), 1);
+    /* An update starts the allowance again. */
+    count_joint_updates(1);
+    count_joint_updates(0);
+    assert_int_equal(get_and_reset_coasted_count(), 1);
+    assert_int_equal(get_and_reset_underrun_count(), 0);
+
+    /* Setpoints without it turn coasting off again. */
+    reset_nw_buf(&tx_buf);
+    received_msg_count = 0;
+    expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
+    expected_length += pack_nw_buff(&rx_buf, &pos, MESSAGE_SET_JOINTS_POS_Q_LEN(2));
+    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, expected_length);
+    assert_int_equal(config.coast_periods, 0);
+    count_joint_updates(1);
+    count_joint_updates(0);
+    assert_int_equal(get_and_reset_coasted_count(), 0);
+    assert_int_equal(get_and_reset_underrun_count(), 1);
+
+    /* More than MAX_COAST_PERIODS is treated as corruption. */
+    received_msg_count = 0;
+    coast.periods = MAX_COAST_PERIODS + 1;
+    expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
+    expected_length += pack_nw_buff(&rx_buf, &coast, sizeof(coast));
+    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, expected_length);
+    assert_int_equal(received_msg_count, 0);
+    assert_int_equal(config.coast_periods, 0);
+}
+
+/* A packet sealed with a CRC-32 trailer is accepted; a corrupted one is not. */
+static void test_unpack_crc32_sealed(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer rx_buf = {0};
+    struct NWBuffer tx_buf = {0};
+    size_t received_msg_count = 0;
+
+    struct Message_joint_enable message = {
+        .type = MSG_SET_JOINT_ENABLED, .joint = 1, .value = 1};
+    pack_nw_buff(&rx_buf, &message, sizeof(message));
+    seal_nw_buff_crc32(&rx_buf);
+    struct NWBuffer sealed = rx_buf;
+
+    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, nw_buff_wire_len(&rx_buf));
+    assert_int_equal(received_msg_count, 1);
+    assert_int_equal(config.joint[1].enabled, 1);
+
+    rx_buf = sealed;
+    rx_buf.payload[2] ^= 0x04;
+    received_msg_count = 0;
+    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, nw_buff_wire_len(&rx_buf));
+    assert_int_equal(received_msg_count, 0);
+}
+
+/* Feature negotiation only replies with REPLY_FEATURES when asked. */
+static void test_unpack_version_request_features(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer rx_buf = {0};
+    struct NWBuffer tx_buf = {0};
+    size_t received_msg_count = 0;
+    uint16_t expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
+
+    /* Legacy driver: features field is zero padding. */
+    struct Message_version_request request = {.type = MSG_VERSION_REQUEST};
+    expected_length += pack_nw_buff(&rx_buf, &request, sizeof(request));
+    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, expected_length);
+
+    assert_int_equal(received_msg_count, 1);
+    assert_int_equal(tx_buf.length, aligned32(sizeof(struct Reply_version)));
+    assert_int_equal(config.features, 0);
+    assert_int_equal(nw_buff_limit(), NW_BUF_LEN_LEGACY);
+
+    /* Driver advertising features gets the supported subset back. */
+    config.joint[1].enabled = 1;
+    reset_nw_buf(&tx_buf);
+    received_msg_count = 0;
+    expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
+    request.features = PROTOCOL_FEATURES | 0x8000;
+    expected_length += pack_nw_buff(&rx_buf, &request, sizeof(request));
+    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, expected_length);
+
+    assert_int_equal(received_msg_count, 1);
+    assert_int_equal(
+            tx_buf.length,
+            aligned32(sizeof(struct Reply_version)) + aligned32(sizeof(struct Reply_features))
+            + aligned32(sizeof(struct Reply_config_hash)));
+    struct Reply_features* reply =
+        (void*)(tx_buf.payload + aligned32(sizeof(struct Reply_version)));
+    assert_int_equal(reply->type, REPLY_FEATURES);
+    assert_int_equal(reply->features, PROTOCOL_FEATURES);
+    struct Reply_config_hash* hash_reply =
+        (void*)(tx_buf.payload + aligned32(sizeof(struct Reply_version))
+                + aligned32(sizeof(struct Reply_features)));
+    assert_int_equal(hash_reply->type, REPLY_CONFIG_HASH);
+    assert_int_equal(hash_reply->hash, config_cache_hash());
+    assert_int_equal(config.joint[1].enabled, 0);
+    assert_int_equal(config.features, PROTOCOL_FEATURES);
+    assert_int_equal(nw_buff_limit(), NW_BUF_LEN);
+
+    /* Replies larger than the legacy limit now fit. */
+    reset_nw_buf(&tx_buf);
+    uint8_t big[NW_BUF_LEN_LEGACY] = {REPLY_NONE};
+    assert_int_equal(pack_nw_buff(&tx_buf, big, sizeof(big)), sizeof(big));
+    assert_int_equal(pack_nw_buff(&tx_buf, big, sizeof(big)), sizeof(big));
+    /* CRC-32 replaces the additive checksum. */
+    assert_int_equal(tx_buf.checksum, 0);
+    assert_int_equal(seal_nw_buff_crc32(&tx_buf), NW_CRC32_LEN);
+    assert_int_equal(checkNWBuff(&tx_buf), 1);
+
+    /* Renegotiating without CRC-32 restores the sum over replies already
+     * packed. */
+    uint8_t earlier[64];
+    memset(earlier, 0x5a, sizeof(earlier));
+    reset_nw_buf(&tx_buf);
+    reset_nw_buf(&rx_buf);
+    assert_int_equal(pack_nw_buff(&tx_buf, earlier, sizeof(earlier)), sizeof(earlier));
+    assert_int_equal(tx_buf.checksum, 0);
+    nw_buff_set_crc32(false);
+    received_msg_count = 0;
+    expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
+    request.features = 0;
+    expected_length += pack_nw_buff(&rx_buf, &request, sizeof(request));
+    process_received_buffer(&rx_buf, &tx_buf, &received_msg_count, expected_length);
+    assert_int_equal(received_msg_count, 1);
+    assert_int_equal(checkNWBuff(&tx_buf), 1);
+
+    nw_buff_set_limit(NW_BUF_LEN_LEGACY);
+}
+
 /* Test unpacking the struct Message_joint_config works as intended. */
 static void test_unpack_joint_config_message(void **state) {
     (void) state; /* unused */
 
     struct NWBuffer rx_buf = {0};
     struct NWBuffer tx_buf = {0};
-    uint8_t received_msg_count = 0;
+    size_t received_msg_count = 0;
     uint16_t expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
 
     struct Message_joint_config joint_config = {0};
@@ -240,7 +545,7 @@ static void test_unpack_joint_config_message(void **state) {
     // 1 message processed.
     assert_int_equal(received_msg_count, 1);
 
-    // The update_joint_config(...) method has not been mocked
+    // stage_joint_command(...) has not been mocked
     // so this will result in the config actually changing.
     assert_int_equal(config.joint[2].enabled, 1);
     assert_int_equal(config.joint[2].io_pos_step, 1);
@@ -255,7 +560,7 @@ static void test_unpack_unknown_message_type(void **state) {
 
     struct NWBuffer rx_buf = {0};
     struct NWBuffer tx_buf = {0};
-    uint8_t received_msg_count = 0;
+    size_t received_msg_count = 0;
     uint16_t expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
 
     struct Message_joint_config joint_config = {
@@ -302,7 +607,7 @@ static void test_unpack_unknown_message_type(void **state) {
     // No messages processed.
     assert_int_equal(received_msg_count, 0);
 
-    // The update_joint_config(...) method has not been mocked
+    // stage_joint_command(...) has not been mocked
     // so this would result in the config actually changing if we had processed the
     // 2nd message.
     assert_int_not_equal(config.joint[3].enabled, 1);
@@ -321,7 +626,7 @@ static void test_unpack_one_of_each(void **state) {
 
     struct NWBuffer rx_buf = {0};
     struct NWBuffer tx_buf = {0};
-    uint8_t received_msg_count = 0;
+    size_t received_msg_count = 0;
     uint16_t expected_length = sizeof(rx_buf.length) + sizeof(rx_buf.checksum);
 
     struct Message_timing timing = {
@@ -376,7 +681,14 @@ int main(void) {
         cmocka_unit_test(test_unpack_multiple_message_stop_at_length),
         cmocka_unit_test(test_unpack_joint_enable_message),
         cmocka_unit_test(test_unpack_timing_message),
+        cmocka_unit_test(test_unpack_clock_sync_message),
         cmocka_unit_test(test_unpack_set_abs_pos_message),
+        cmocka_unit_test(test_unpack_set_pos_q_message),
+        cmocka_unit_test(test_setpoint_units_agree_at_2ms),
+        cmocka_unit_test(test_unpack_set_pos_q_bad_count),
+        cmocka_unit_test(test_unpack_joint_coast),
+        cmocka_unit_test(test_unpack_crc32_sealed),
+        cmocka_unit_test(test_unpack_version_request_features),
         cmocka_unit_test(test_unpack_joint_config_message),
         cmocka_unit_test(test_unpack_unknown_message_type),
         cmocka_unit_test(test_unpack_one_of_each)
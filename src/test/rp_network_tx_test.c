@@ -81,20 +81,22 @@ static void test_serialise_joint_movement(void **state) {
     struct Reply_joint_movement reply;
     reply.type = REPLY_JOINT_MOVEMENT;
 
+    struct JointFeedback feedback[MAX_JOINT];
+
     config.update_time_us = 1000;
     core1_loop_count = 77;
     for(size_t joint = 0; joint < MAX_JOINT; joint++) {
-        config.joint[joint].abs_pos_achieved  = 123;
+        feedback[joint].abs_pos_achieved  = 123;
+        feedback[joint].velocity_achieved = 791;
+        feedback[joint].enabled           = (joint % 2 == 0) ? 1 : 0;
         config.joint[joint].max_velocity      = 456;
         config.joint[joint].max_accel         = 789;
-        config.joint[joint].velocity_achieved = 791;
-        config.joint[joint].velocity_requested = 55.5 * (joint + 1);
-        config.joint[joint].enabled           = (joint % 2 == 0) ? 1 : 0;
-        config.joint[joint].updated_from_c1   = 1;
+        config.joint[joint].velocity_requested_q = 65536 * (joint + 1);
 
-        reply.abs_pos_achieved[joint]  = config.joint[joint].abs_pos_achieved;
-        reply.velocity_achieved[joint] = config.joint[joint].velocity_achieved;
+        reply.abs_pos_achieved[joint]  = feedback[joint].abs_pos_achieved;
+        reply.velocity_achieved[joint] = feedback[joint].velocity_achieved;
     }
+    publish_joint_feedback(feedback);
 
     assert_int_equal(tx_buf.length, initial_tx_buf_len);
     assert_int_equal(tx_buf.checksum, 0);
@@ -112,22 +114,101 @@ static void test_serialise_joint_movement(void **state) {
     for(size_t joint = 0; joint < 4; joint++) {
         assert_int_equal(reply_p->abs_pos_achieved[joint], reply.abs_pos_achieved[joint]);
         assert_int_equal(reply_p->velocity_achieved[joint], reply.velocity_achieved[joint]);
-        assert_int_equal(reply_p->enabled[joint], config.joint[joint].enabled);
-        assert_double_equal(reply_p->velocity_cmd[joint],
-                            config.joint[joint].velocity_requested, 0.01);
+        assert_int_equal(reply_p->enabled[joint], feedback[joint].enabled);
+        /* Back in the units MSG_SET_JOINT_ABS_POS carries velocity in. */
+        assert_double_equal(reply_p->velocity_cmd[joint], 1000.0 * (joint + 1), 0.01);
+    }
+}
+
+/* Without an acknowledged base the compact reply is a full keyframe; once
+ * acknowledged, only changed fields are sent. */
+static void test_serialise_joint_movement_v2(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer tx_buf = {0};
+
+    struct JointFeedback feedback[MAX_JOINT];
+
+    config.update_time_us = 1000;
+    core1_loop_count = 78;
+    for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+        feedback[joint].abs_pos_achieved   = 1000 * joint;
+        feedback[joint].velocity_achieved  = 65536;
+        feedback[joint].enabled            = (joint != 3);
+        config.joint[joint].velocity_requested_q = 12 * 65536 + 32768;
     }
+    publish_joint_feedback(feedback);
+
+    joint_movement_ack(0, false);
+    assert_true(serialise_joint_movement_v2(&tx_buf));
+
+    struct Reply_joint_movement_v2* reply_p = (void*)tx_buf.payload;
+    size_t keyframe_len = sizeof(struct Reply_joint_movement_v2) + MAX_JOINT * 12;
+    assert_int_equal(tx_buf.length, aligned32(keyframe_len));
+    assert_true(tx_buf.length < aligned32(sizeof(struct Reply_joint_movement)));
+    assert_int_equal(reply_p->type, REPLY_JOINT_MOVEMENT_V2);
+    assert_int_equal(reply_p->count, MAX_JOINT);
+    assert_int_equal(reply_p->base_id, reply_p->id);
+    assert_int_equal(reply_p->enabled, 0x7);
+    assert_int_equal(reply_p->pos_present, 0xf);
+    assert_int_equal(reply_p->pos_wide, 0xf);
+    assert_int_equal(reply_p->vel_present, 0xf);
+    assert_int_equal(reply_p->vcmd_present, 0xf);
+    assert_int_equal(reply_p->core1_tick, 78);
+    int32_t pos;
+    memcpy(&pos, tx_buf.payload + sizeof(*reply_p) + 2 * sizeof(int32_t), sizeof(pos));
+    assert_int_equal(pos, 2000);
+
+    uint16_t keyframe_id = reply_p->id;
+    joint_movement_ack(keyframe_id, true);
+
+    feedback[1].abs_pos_achieved += 5;
+    feedback[2].abs_pos_achieved += 100000;
+    feedback[3].velocity_achieved = -65536;
+    publish_joint_feedback(feedback);
+
+    reset_nw_buf(&tx_buf);
+    assert_true(serialise_joint_movement_v2(&tx_buf));
+
+    assert_int_equal(reply_p->id, (uint16_t)(keyframe_id + 1));
+    assert_int_equal(reply_p->base_id, keyframe_id);
+    assert_int_equal(reply_p->pos_present, 0x6);
+    assert_int_equal(reply_p->pos_wide, 0x4);
+    assert_int_equal(reply_p->vel_present, 0x8);
+    assert_int_equal(reply_p->vcmd_present, 0x0);
+    assert_int_equal(
+            tx_buf.length,
+            aligned32(sizeof(struct Reply_joint_movement_v2) + 2 + 4 + 4));
+
+    uint8_t* data_p = tx_buf.payload + sizeof(*reply_p);
+    int16_t narrow;
+    int32_t wide;
+    int32_t velocity;
+    memcpy(&narrow, data_p, sizeof(narrow));
+    memcpy(&wide, data_p + 2, sizeof(wide));
+    memcpy(&velocity, data_p + 6, sizeof(velocity));
+    assert_int_equal(narrow, 5);
+    assert_int_equal(wide, 100000);
+    assert_int_equal(velocity, -65536);
+
+    /* An ack for a reply the firmware no longer holds falls back to a keyframe. */
+    joint_movement_ack(keyframe_id - 100, true);
+    reset_nw_buf(&tx_buf);
+    assert_true(serialise_joint_movement_v2(&tx_buf));
+    assert_int_equal(reply_p->base_id, reply_p->id);
+    assert_int_equal(tx_buf.length, aligned32(keyframe_len));
 }
 
-/* Any overrun/underrun across joints collapses to a single occurred flag. */
+/* Any overruns/underruns since the last reply collapse to a single occurred
+ * flag each. */
 static void test_serialise_joint_metrics(void **state) {
     (void) state;
 
     struct NWBuffer tx_buf = {0};
 
-    for (size_t j = 0; j < MAX_JOINT; j++) {
-        config.joint[j].overrun_count  = j + 1;  /* 1, 2, 3, 4 — all non-zero */
-        config.joint[j].underrun_count = j + 5;  /* 5, 6, 7, 8 — all non-zero */
-    }
+    count_joint_updates(4);  /* 3 packets overrun */
+    count_joint_updates(0);
+    count_joint_updates(0);
 
     bool result = serialise_joint_metrics(&tx_buf);
     assert_true(result);
@@ -137,33 +218,28 @@ static void test_serialise_joint_metrics(void **state) {
     assert_int_equal(reply->type, REPLY_JOINT_METRICS);
     assert_int_equal(reply->overrun_occurred,  1);
     assert_int_equal(reply->underrun_occurred, 1);
-    for (size_t j = 0; j < MAX_JOINT; j++) {
-        assert_int_equal(config.joint[j].overrun_count,  0);
-        assert_int_equal(config.joint[j].underrun_count, 0);
-    }
+    assert_int_equal(get_and_reset_overrun_count(),  0);
+    assert_int_equal(get_and_reset_underrun_count(), 0);
 }
 
-/* Only joint 2 has an overrun — occurred flag is still 1. */
+/* Only an overrun — underrun flag stays 0. */
 static void test_serialise_joint_metrics_partial_events(void **state) {
     (void) state;
 
     struct NWBuffer tx_buf = {0};
-    config.joint[2].overrun_count  = 3;
-    config.joint[1].underrun_count = 7;
+    count_joint_updates(2);
+    count_joint_updates(1);
 
     bool result = serialise_joint_metrics(&tx_buf);
     assert_true(result);
 
     struct Reply_joint_metrics* reply = (void*)tx_buf.payload;
     assert_int_equal(reply->overrun_occurred,  1);
-    assert_int_equal(reply->underrun_occurred, 1);
-    for (size_t j = 0; j < MAX_JOINT; j++) {
-        assert_int_equal(config.joint[j].overrun_count,  0);
-        assert_int_equal(config.joint[j].underrun_count, 0);
-    }
+    assert_int_equal(reply->underrun_occurred, 0);
+    assert_int_equal(get_and_reset_overrun_count(),  0);
 }
 
-/* No events: all joint counts zero — occurred flags stay 0. */
+/* No events: counts zero — occurred flags stay 0. */
 static void test_serialise_joint_metrics_no_events(void **state) {
     (void) state;
 
@@ -186,10 +262,8 @@ static void test_serialise_overflow(void **state) {
         NW_BUF_LEN - sizeof(struct Reply_joint_movement) + 1;
     tx_buf.length = initial_tx_buf_len;
 
-    config.joint[0].updated_from_c1 = 1;
-    config.joint[1].updated_from_c1 = 1;
-    config.joint[2].updated_from_c1 = 1;
-    config.joint[3].updated_from_c1 = 1;
+    struct JointFeedback feedback[MAX_JOINT] = {0};
+    publish_joint_feedback(feedback);
 
     assert_int_equal(tx_buf.checksum, 0);
     
@@ -205,6 +279,7 @@ int main(void) {
         cmocka_unit_test(test_serialise_timing),
         cmocka_unit_test(test_serialise_timing_overflow),
         cmocka_unit_test(test_serialise_joint_movement),
+        cmocka_unit_test(test_serialise_joint_movement_v2),
         cmocka_unit_test(test_serialise_joint_metrics),
         cmocka_unit_test(test_serialise_joint_metrics_partial_events),
         cmocka_unit_test(test_serialise_joint_metrics_no_events),
@@ -0,0 +1,419 @@
+/* Step timing of the step_gen and step_count PIO programs, run instruction by
+ * instruction in mocks/pio_emulator.c, on their own and driven by do_steps(). */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include "../rp2040/pio.h"
+#include "../rp2040/config.h"
+#include "mocks/pio_emulator.h"
+
+extern volatile struct ConfigGlobal config;
+
+#define PIN_STEP        0
+#define PIN_DIR         1
+#define PERIOD_US       1000
+#define PERIOD_TICKS    (PERIOD_US * RP2040_CLOCK_MHZ)
+#define MAX_STEP_TIMES  8192
+
+static uint64_t step_times[MAX_STEP_TIMES];
+
+/* Rising edges of pin logged since the last clear, into step_times[]. */
+static size_t rising_edges(uint8_t pin) {
+  const struct PioEmuEdge* edges;
+  size_t count = pio_emu_edges(&edges);
+  size_t rising = 0;
+  for(size_t index = 0; index < count; index++) {
+    if(edges[index].pin == pin && edges[index].level && rising < MAX_STEP_TIMES) {
+      step_times[rising++] = edges[index].cycle;
+    }
+  }
+  return rising;
+}
+
+/* Time pin has spent high over the logged edges, from its first rising edge. */
+static uint64_t first_high_time(uint8_t pin) {
+  const struct PioEmuEdge* edges;
+  size_t count = pio_emu_edges(&edges);
+  uint64_t rose = 0;
+  for(size_t index = 0; index < count; index++) {
+    if(edges[index].pin != pin) {
+      continue;
+    }
+    if(edges[index].level) {
+      rose = edges[index].cycle;
+    } else if(rose > 0) {
+      return edges[index].cycle - rose;
+    }
+  }
+  return 0;
+}
+
+/* Load both programs as init_pio() does for a single joint. */
+static size_t gen_sm;
+static size_t count_sm;
+
+static void start_programs(void) {
+  size_t gen_offset = pio_add_program(pio0, &step_gen_program);
+  size_t count_offset = pio_add_program(pio1, &step_count_program);
+  gen_sm = pio_claim_unused_sm(pio0, true);
+  count_sm = pio_claim_unused_sm(pio1, true);
+  step_gen_program_init(pio0, gen_sm, gen_offset, PIN_STEP, PIN_DIR);
+  step_count_program_init(pio1, count_sm, count_offset, PIN_STEP, PIN_DIR);
+  pio_sm_set_enabled(pio0, gen_sm, true);
+  pio_sm_set_enabled(pio1, count_sm, true);
+}
+
+/* Last position step_count has reported, or previous if none. */
+static int32_t step_count_position(int32_t previous) {
+  while(pio_sm_get_rx_fifo_level(pio1, count_sm) > 0) {
+    previous = (int32_t)pio_sm_get_blocking(pio1, count_sm);
+  }
+  return previous;
+}
+
+/* ── Joint exchange as step_all_joints() would hold it ── */
+static struct JointCommand  command[MAX_JOINT];
+static struct JointFeedback feedback[MAX_JOINT];
+static uint32_t             updated[MAX_JOINT];
+
+/* do_steps() on Core1's copy of joint, which then counts as read. */
+static uint8_t step_joint(uint8_t joint) {
+  uint32_t was_updated = updated[joint];
+  updated[joint] = 0;
+  return do_steps(joint, &command[joint], was_updated, &feedback[joint]);
+}
+
+static int test_setup(void **state) {
+  (void)state;
+  pio_emu_reset();
+  pio_reset_for_test();
+  init_config();
+  config.update_time_us = PERIOD_US;
+  config.coast_periods = 0;
+  memset(command, 0, sizeof(command));
+  memset(feedback, 0, sizeof(feedback));
+  memset(updated, 0, sizeof(updated));
+  for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+    command[joint].io_pos_step = 2 * joint;
+    command[joint].io_pos_dir = 2 * joint + 1;
+  }
+  return 0;
+}
+
+
+/* ---- The programs on their own ---- */
+
+/* A step of length len lasts 2 * (len + STEP_PIO_LEN_OVERHEAD) cycles with the
+ * step pin high for exactly half of it, at every length calculate_step_len()
+ * can return. */
+static void test_step_gen_period_matches_overhead(void **state) {
+  static const uint32_t lengths[] = {1, 2, 10, 1000, 6641, PERIOD_TICKS / 2 - STEP_PIO_LEN_OVERHEAD};
+  for(size_t index = 0; index < sizeof(lengths) / sizeof(lengths[0]); index++) {
+    test_setup(state);
+    uint32_t len = lengths[index];
+    uint64_t step_period = 2 * ((uint64_t)len + STEP_PIO_LEN_OVERHEAD);
+    start_programs();
+    pio_sm_put(pio0, gen_sm, (len << 1) | 1);
+    pio_emu_run(5 * step_period + 100);
+
+    size_t steps = rising_edges(PIN_STEP);
+    assert_true(steps >= 4);
+    for(size_t step = 1; step < steps; step++) {
+      assert_int_equal(step_times[step] - step_times[step - 1], step_period);
+    }
+    assert_int_equal(first_high_time(PIN_STEP), len + STEP_PIO_LEN_OVERHEAD);
+  }
+}
+
+/* Length 0 holds the step pin low until another word arrives, which starts
+ * stepping within one poll of the FIFO and one low half. */
+static void test_step_gen_zero_len_idles(void **state) {
+  (void)state;
+  start_programs();
+  pio_sm_put(pio0, gen_sm, 0);
+  pio_emu_run(PERIOD_TICKS);
+  assert_int_equal(rising_edges(PIN_STEP), 0);
+
+  uint32_t len = 100;
+  uint64_t put_at = pio_emu_cycles();
+  pio_sm_put(pio0, gen_sm, len << 1);
+  pio_emu_run(PERIOD_TICKS);
+  assert_true(rising_edges(PIN_STEP) > 0);
+  assert_true(step_times[0] - put_at <= len + STEP_PIO_LEN_OVERHEAD + 7);
+}
+
+/* The direction pin follows bit 0 of each word and is set before the step
+ * that word produces. */
+static void test_step_gen_direction(void **state) {
+  (void)state;
+  uint32_t len = 50;
+  start_programs();
+  pio_sm_put(pio0, gen_sm, (len << 1) | 1);
+  pio_emu_run(500);
+  assert_true(pio_emu_gpio(PIN_DIR));
+
+  pio_sm_put(pio0, gen_sm, len << 1);
+  pio_emu_clear_edges();
+  pio_emu_run(1000);
+  assert_false(pio_emu_gpio(PIN_DIR));
+
+  const struct PioEmuEdge* edges;
+  size_t count = pio_emu_edges(&edges);
+  size_t dir_edge = count;
+  size_t step_edge = count;
+  for(size_t index = 0; index < count; index++) {
+    if(edges[index].pin == PIN_DIR && dir_edge == count) {
+      dir_edge = index;
+    }
+    if(edges[index].pin == PIN_STEP && edges[index].level && dir_edge < count
+        && step_edge == count) {
+      step_edge = index;
+    }
+  }
+  assert_true(dir_edge < count);
+  assert_true(step_edge < count);
+  /* step_count samples the direction pin a few cycles after the step edge;
+   * it must already have changed. */
+  assert_true(edges[step_edge].cycle - edges[dir_edge].cycle > 4);
+}
+
+/* Run the PIOs for steps steps of step_period, draining step_count after
+ * each so its RX FIFO never fills. */
+static int32_t run_draining(size_t steps, uint64_t step_period, int32_t position) {
+  for(size_t step = 0; step < steps; step++) {
+    pio_emu_run(step_period);
+    position = step_count_position(position);
+  }
+  return position;
+}
+
+/* step_count reports every step, up and down, to the RX FIFO. */
+static void test_step_count_follows_step_gen(void **state) {
+  (void)state;
+  uint32_t len = 200;
+  uint64_t step_period = 2 * (len + STEP_PIO_LEN_OVERHEAD);
+  start_programs();
+
+  pio_sm_put(pio0, gen_sm, (len << 1) | 1);
+  int32_t position = run_draining(50, step_period, 0);
+  pio_sm_put(pio0, gen_sm, 0);
+  position = run_draining(2, step_period, position);
+  size_t up = rising_edges(PIN_STEP);
+  assert_int_equal(position, (int32_t)up);
+
+  pio_emu_clear_edges();
+  pio_sm_put(pio0, gen_sm, len << 1);
+  position = run_draining(80, step_period, position);
+  pio_sm_put(pio0, gen_sm, 0);
+  position = run_draining(2, step_period, position);
+  size_t down = rising_edges(PIN_STEP);
+  assert_int_equal(position, (int32_t)up - (int32_t)down);
+  assert_true(position < 0);
+}
+
+/* At the shortest step step_count still sees every edge. */
+static void test_step_count_keeps_up_at_max_rate(void **state) {
+  (void)state;
+  uint64_t step_period = 2 * (1 + STEP_PIO_LEN_OVERHEAD);
+  start_programs();
+  pio_sm_put(pio0, gen_sm, (1 << 1) | 1);
+  int32_t position = run_draining(1000, step_period, 0);
+  pio_sm_put(pio0, gen_sm, 0);
+  position = run_draining(10, step_period, position);
+  size_t steps = rising_edges(PIN_STEP);
+  assert_true(steps >= 1000);
+  assert_int_equal(position, (int32_t)steps);
+}
+
+/* step_count pushes without blocking: more than a FIFO's worth of steps
+ * between drains leaves the first positions in the FIFO and drops the rest,
+ * which is why do_steps() does not trust a full FIFO. */
+static void test_step_count_full_fifo_drops_newest(void **state) {
+  (void)state;
+  uint32_t len = 100;
+  start_programs();
+  pio_sm_put(pio0, gen_sm, (len << 1) | 1);
+  pio_emu_run(20 * 2 * (len + STEP_PIO_LEN_OVERHEAD));
+  assert_true(rising_edges(PIN_STEP) >= 19);
+  assert_int_equal(pio_sm_get_rx_fifo_level(pio1, count_sm), 4);
+  assert_int_equal(step_count_position(0), 4);
+}
+
+/* The step rate plan_steps() budgets for is the one the PIO produces: for
+ * each length, the steps that complete in one servo period match max_steps. */
+static void test_step_rate_matches_plan(void **state) {
+  static const uint32_t lengths[] = {1, 9, 91, 656, 6641, 33241};
+  print_message("%8s %12s %10s\n", "len", "steps/s", "steps/period");
+  for(size_t index = 0; index < sizeof(lengths) / sizeof(lengths[0]); index++) {
+    test_setup(state);
+    uint32_t len = lengths[index];
+    start_programs();
+    pio_sm_put(pio0, gen_sm, (len << 1) | 1);
+    pio_emu_run(PERIOD_TICKS + 2 * (len + STEP_PIO_LEN_OVERHEAD));
+    size_t steps = rising_edges(PIN_STEP);
+    size_t in_period = 0;
+    uint64_t step_period = 2 * ((uint64_t)len + STEP_PIO_LEN_OVERHEAD);
+    while(in_period < steps && step_times[in_period] - step_times[0] + step_period <= PERIOD_TICKS) {
+      in_period++;
+    }
+    int32_t max_steps = PERIOD_TICKS / (2 * ((int32_t)len + STEP_PIO_LEN_OVERHEAD));
+    print_message("%8u %12.0f %10zu\n", len,
+                  RP2040_CLOCK_MHZ * 1e6 / (2.0 * (len + STEP_PIO_LEN_OVERHEAD)), in_period);
+    assert_int_equal(in_period, max_steps);
+  }
+}
+
+
+/* ---- Driven by do_steps() ---- */
+
+/* Run do_steps() for joint 0 once per servo period for periods periods, in
+ * velocity mode with the position request advancing by steps_per_period.
+ * The request is where the joint should be at the start of the period, when
+ * do_steps() reads the feedback, so a joint that keeps up has no error to
+ * correct. Returns the steps taken in each period after the first settle
+ * periods in per_period[]. */
+static void run_velocity(double steps_per_period, int periods, int settle, size_t* per_period) {
+  command[0].enabled = 1;
+  command[0].cmd_type = JOINT_CMD_VELOCITY;
+  command[0].velocity_requested_q = (int32_t)(steps_per_period * 65536.0);
+  command[0].max_velocity = 2 * steps_per_period * 1e6 / PERIOD_US;
+  command[0].max_accel = 0.0;
+  double requested = 0.0;
+  for(int period = 0; period < periods; period++) {
+    if(period == settle) {
+      pio_emu_clear_edges();
+    }
+    command[0].abs_pos_requested_q = (int64_t)(requested * 4294967296.0);
+    requested += steps_per_period;
+    updated[0] = 1;
+    step_joint(0);
+    uint64_t start = pio_emu_cycles();
+    pio_emu_run(PERIOD_TICKS);
+    if(period >= settle) {
+      size_t steps = rising_edges(PIN_STEP);
+      size_t in_period = 0;
+      for(size_t step = 0; step < steps; step++) {
+        in_period += step_times[step] >= start;
+      }
+      per_period[period - settle] = in_period;
+    }
+  }
+}
+
+/* A whole number of steps per period: exactly that many steps every period,
+ * evenly spaced with no jitter across period boundaries. */
+static void test_do_steps_whole_steps_no_jitter(void **state) {
+  (void)state;
+  size_t per_period[40];
+  run_velocity(10.0, 50, 10, per_period);
+  for(int period = 0; period < 40; period++) {
+    assert_int_equal(per_period[period], 10);
+  }
+  size_t steps = rising_edges(PIN_STEP);
+  for(size_t step = 1; step < steps; step++) {
+    assert_int_equal(step_times[step] - step_times[step - 1], PERIOD_TICKS / 10);
+  }
+  /* Fed back at the start of the last period, before its 10 steps. */
+  assert_int_equal(feedback[0].abs_pos_achieved, 490);
+}
+
+/* A fractional number of steps per period: the accumulator alternates
+ * between floor and ceil and the average is exact. Each step lasts the
+ * period of the count chosen for it, so the jitter is bounded by the
+ * difference between the two. */
+static void test_do_steps_fractional_steps(void **state) {
+  (void)state;
+  size_t per_period[40];
+  run_velocity(2.5, 50, 10, per_period);
+  size_t total = 0;
+  for(int period = 0; period < 40; period++) {
+    assert_in_range(per_period[period], 2, 3);
+    total += per_period[period];
+  }
+  assert_in_range(total, 99, 101);
+
+  size_t steps = rising_edges(PIN_STEP);
+  uint64_t shortest = UINT64_MAX;
+  uint64_t longest = 0;
+  for(size_t step = 1; step < steps; step++) {
+    uint64_t interval = step_times[step] - step_times[step - 1];
+    shortest = interval < shortest ? interval : shortest;
+    longest = interval > longest ? interval : longest;
+  }
+  assert_true(shortest >= PERIOD_TICKS / 3 - 2 * STEP_PIO_LEN_OVERHEAD);
+  assert_true(longest <= PERIOD_TICKS / 2 + 2 * STEP_PIO_LEN_OVERHEAD);
+}
+
+/* Above a FIFO's worth of steps per period the feedback is built on the
+ * last position step_count managed to push. When step_gen emits more steps
+ * than planned, here because each period runs 10% long, the feedback still
+ * stays within a period's mismatch of the steps actually taken. */
+static void test_do_steps_overflow_feedback_stays_anchored(void **state) {
+  (void)state;
+  command[0].enabled = 1;
+  command[0].cmd_type = JOINT_CMD_VELOCITY;
+  command[0].velocity_requested_q = 10 * 65536;
+  command[0].max_velocity = 20000.0;
+  command[0].max_accel = 0.0;
+  for(int period = 0; period < 300; period++) {
+    command[0].abs_pos_requested_q = (int64_t)(10 * period) << 32;
+    updated[0] = 1;
+    size_t taken = rising_edges(PIN_STEP);
+    step_joint(0);
+    assert_in_range(feedback[0].abs_pos_achieved, (int32_t)taken - 2, (int32_t)taken + 2);
+    pio_emu_run(PERIOD_TICKS + PERIOD_TICKS / 10);
+  }
+}
+
+/* A position move under an acceleration limit ends on exactly the requested
+ * step, never steps backwards, and matches what step_count reported. */
+static void test_do_steps_position_move_is_exact(void **state) {
+  (void)state;
+  command[0].enabled = 1;
+  command[0].cmd_type = JOINT_CMD_POSITION;
+  command[0].abs_pos_requested_q = (int64_t)500 << 32;
+  command[0].velocity_requested_q = 0;
+  command[0].max_velocity = 20000.0;
+  command[0].max_accel = 200000.0;
+  for(int period = 0; period < 400; period++) {
+    updated[0] = 1;
+    step_joint(0);
+    pio_emu_run(PERIOD_TICKS);
+  }
+  const struct PioEmuEdge* edges;
+  size_t count = pio_emu_edges(&edges);
+  bool forward = false;
+  for(size_t index = 0; index < count; index++) {
+    if(edges[index].pin == PIN_DIR) {
+      forward = edges[index].level;
+    } else if(edges[index].pin == PIN_STEP && edges[index].level) {
+      assert_true(forward);
+    }
+  }
+  assert_int_equal(rising_edges(PIN_STEP), 500);
+  assert_int_equal(feedback[0].abs_pos_achieved, 500);
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup(test_step_gen_period_matches_overhead, test_setup),
+    cmocka_unit_test_setup(test_step_gen_zero_len_idles,          test_setup),
+    cmocka_unit_test_setup(test_step_gen_direction,               test_setup),
+    cmocka_unit_test_setup(test_step_count_follows_step_gen,      test_setup),
+    cmocka_unit_test_setup(test_step_count_keeps_up_at_max_rate,  test_setup),
+    cmocka_unit_test_setup(test_step_count_full_fifo_drops_newest, test_setup),
+    cmocka_unit_test_setup(test_step_rate_matches_plan,           test_setup),
+    cmocka_unit_test_setup(test_do_steps_whole_steps_no_jitter,   test_setup),
+    cmocka_unit_test_setup(test_do_steps_fractional_steps,        test_setup),
+    cmocka_unit_test_setup(test_do_steps_position_move_is_exact,  test_setup),
+    cmocka_unit_test_setup(test_do_steps_overflow_feedback_stays_anchored, test_setup),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -43,16 +43,37 @@ int __wrap_pio_sm_is_tx_fifo_empty(size_t pio, size_t sm) {
     return mock_tx_fifo_empty;
 }
 
+/* Setpoints as MSG_SET_JOINT_ABS_POS carries them, converted the way
+ * unpack_joint_abs_pos() does at the 1000µs period the tests run at. */
+#define VEL_Q(v)  ((int32_t)(((v) / 1000.0) * 65536.0))
+#define POS_Q(p)  ((int64_t)((p) * 4294967296.0))
+
+/* ── Joint exchange as step_all_joints() would hold it ── */
+static struct JointCommand  command[MAX_JOINT];
+static struct JointFeedback feedback[MAX_JOINT];
+static uint32_t             updated[MAX_JOINT];
+
+/* do_steps() on Core1's copy of joint, which then counts as read. */
+static uint8_t step_joint(uint8_t joint) {
+    uint32_t was_updated = updated[joint];
+    updated[joint] = 0;
+    return do_steps(joint, &command[joint], was_updated, &feedback[joint]);
+}
+
 /* ── Setup / Teardown ── */
 static int test_setup(void **state) {
     (void)state;
     pio_reset_for_test();
     init_config();
     config.update_time_us = 1000;  /* init_config() does not reset this */
+    config.coast_periods = 0;
+    memset(command, 0, sizeof(command));
+    memset(feedback, 0, sizeof(feedback));
+    memset(updated, 0, sizeof(updated));
     for (size_t j = 0; j < MAX_JOINT; j++) {
-        config.joint[j].io_pos_step = 1;  /* valid pin (0-31) */
-        config.joint[j].io_pos_dir  = 2;  /* valid pin (0-31) */
-        config.joint[j].max_velocity = 50.0;
+        command[j].io_pos_step = 1;  /* valid pin (0-31) */
+        command[j].io_pos_dir  = 2;  /* valid pin (0-31) */
+        command[j].max_velocity = 50.0;
     }
     mock_rx_fifo_level = 0;
     mock_rx_index      = 0;
@@ -97,7 +118,7 @@ static void test_calculate_step_len_normal(void **state) {
     /* step_count=2.0 -> Q16.16=131072, period=133000, max_vel=50.0 -> Q16.16=3276800
      * 133000*65536=8716288000; 8716288000/(131072*2)=8716288000/262144=33250 exactly
      * 33250-9=33241 */
-    int32_t result = calculate_step_len(131072, 133000, 3276800);
+    int32_t result = calculate_step_len(131072, 133000, min_step_len(133000, 3276800));
     assert_int_equal(result, 33241);
 }
 
@@ -105,7 +126,7 @@ static void test_calculate_step_len_normal(void **state) {
 static void test_calculate_step_len_clamped(void **state) {
     (void)state;
     /* step_count=200.0, max_vel=50.0, both in Q16.16 */
-    int32_t result = calculate_step_len(13107200, 133000, 3276800);
+    int32_t result = calculate_step_len(13107200, 133000, min_step_len(133000, 3276800));
     /* len=323, min=1321, result=1321 */
     assert_int_equal(result, 1321);
 }
@@ -113,18 +134,18 @@ static void test_calculate_step_len_clamped(void **state) {
 /* calculate_step_len: step_count_q=0 -> 0 (division-by-zero guard) */
 static void test_calculate_step_len_below_threshold(void **state) {
     (void)state;
-    assert_int_equal(calculate_step_len(0, 133000, 3276800), 0);
+    assert_int_equal(calculate_step_len(0, 133000, min_step_len(133000, 3276800)), 0);
 }
 
 /* calculate_step_len: slow velocity -> capped at max_len (fits in one period) */
 static void test_calculate_step_len_too_slow_skip(void **state) {
     (void)state;
     /* 0.05 steps/period (sq=3276): raw len >> period_ticks, capped to max_len=66491 */
-    assert_int_equal(calculate_step_len(3276, 133000, 3276800), 66491);
+    assert_int_equal(calculate_step_len(3276, 133000, min_step_len(133000, 3276800)), 66491);
     /* 0.1 steps/period (sq=6553): same cap */
-    assert_int_equal(calculate_step_len(6553, 133000, 3276800), 66491);
+    assert_int_equal(calculate_step_len(6553, 133000, min_step_len(133000, 3276800)), 66491);
     /* sq=1 (extreme): int64 intermediate would overflow int32, capped to max_len */
-    assert_int_equal(calculate_step_len(1, 133000, 3276800), 66491);
+    assert_int_equal(calculate_step_len(1, 133000, min_step_len(133000, 3276800)), 66491);
 }
 
 /* clamp_accel: velocity unchanged -> returns same velocity */
@@ -216,21 +237,21 @@ static void test_plan_steps_skip_preserves_accumulator(void **state) {
 static void test_do_steps_zero_period(void **state) {
     (void)state;
     config.update_time_us             = 0;
-    config.joint[0].enabled           = 1;
-    config.joint[0].updated_from_c0   = 1;
-    config.joint[0].abs_pos_requested = 10.0;
+    command[0].enabled           = 1;
+    updated[0]   = 1;
+    command[0].abs_pos_requested_q = POS_Q(10.0);
     mock_tx_fifo_empty                = 1;
-    uint8_t result = do_steps(0);
+    uint8_t result = step_joint(0);
     assert_int_equal(result, 0);
 }
 
 /* do_steps: joint disabled -> puts 0 to FIFO when empty, returns 0 */
 static void test_do_steps_disabled(void **state) {
     (void)state;
-    config.joint[0].enabled         = 0;
-    config.joint[0].updated_from_c0 = 1;
+    command[0].enabled         = 0;
+    updated[0] = 1;
     mock_tx_fifo_empty               = 1;
-    uint8_t result = do_steps(0);
+    uint8_t result = step_joint(0);
     assert_int_equal(result, 0);
     assert_int_equal(last_pio_put_value, 0);
 }
@@ -243,18 +264,18 @@ static void test_do_steps_disabled(void **state) {
  * re-enable that the user sees as persistent jitter. */
 static void test_do_steps_disabled_drains_rx_fifo(void **state) {
     (void)state;
-    config.joint[0].enabled          = 0;
-    config.joint[0].updated_from_c0  = 1;
-    config.joint[0].abs_pos_achieved = 100;
+    command[0].enabled          = 0;
+    updated[0]  = 1;
+    feedback[0].abs_pos_achieved = 100;
     mock_tx_fifo_empty                = 1;
     mock_rx_fifo_level                = 1;
     mock_rx_values[0]                 = 103;  /* 3 extra steps took while stopping */
 
-    uint8_t result = do_steps(0);
+    uint8_t result = step_joint(0);
 
     assert_int_equal(result, 0);
     assert_int_equal(last_pio_put_value, 0);
-    assert_int_equal(config.joint[0].abs_pos_achieved, 103);
+    assert_int_equal(feedback[0].abs_pos_achieved, 103);
 }
 
 /* do_steps: joint disabling with non-zero velocity -> continues stepping while decelerating. */
@@ -262,22 +283,22 @@ static void test_do_steps_disabling_decelerates(void **state) {
     (void)state;
     /* Prime last_velocity_q at 10 steps/period via an enabled cycle. */
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_VELOCITY;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = 10000.0;  /* 10 steps/period at 1000µs */
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0; /* 5 steps/period/period: 5e6 × (1e-3)² = 5 */
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(10000.0);  /* 10 steps/period at 1000µs */
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0; /* 5 steps/period/period: 5e6 × (1e-3)² = 5 */
     mock_tx_fifo_empty                 = 1;
-    do_steps(0);  /* enable snap: last_velocity_q = 10 steps/period */
+    step_joint(0);  /* enable snap: last_velocity_q = 10 steps/period */
 
     /* Disable: clamp brings velocity 10 -> 5 (not zero yet) -> steps still issued. */
-    config.joint[0].enabled         = 0;
-    config.joint[0].updated_from_c0 = 1;
+    command[0].enabled         = 0;
+    updated[0] = 1;
     last_pio_put_value               = 0;
     pio_put_call_count               = 0;
     mock_tx_fifo_empty               = 1;
-    uint8_t result = do_steps(0);
+    uint8_t result = step_joint(0);
 
     assert_int_equal(result, 0);
     assert_true(last_pio_put_value != 0);  /* still decelerating, not hard-stopped */
@@ -288,22 +309,22 @@ static void test_do_steps_disabling_stops_when_zero(void **state) {
     (void)state;
     /* Prime last_velocity_q at exactly 5 steps/period (= max_accel_q). */
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_VELOCITY;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = 5000.0;   /* 5 steps/period */
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0; /* 5 steps/period/period: 5e6 × (1e-3)² = 5 */
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(5000.0);   /* 5 steps/period */
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0; /* 5 steps/period/period: 5e6 × (1e-3)² = 5 */
     mock_tx_fifo_empty                 = 1;
-    do_steps(0);  /* enable snap: last_velocity_q = 5 steps/period */
+    step_joint(0);  /* enable snap: last_velocity_q = 5 steps/period */
 
     /* Disable: clamp_accel(0, 5, 5) = 0 -> velocity_q == 0 -> hard stop. */
-    config.joint[0].enabled          = 0;
-    config.joint[0].updated_from_c0  = 1;
+    command[0].enabled          = 0;
+    updated[0]  = 1;
     last_pio_put_value                = 0xDEADBEEF;
     pio_put_call_count                = 0;
     mock_tx_fifo_empty                = 1;
-    uint8_t result = do_steps(0);
+    uint8_t result = step_joint(0);
 
     assert_int_equal(result, 0);
     assert_int_equal(last_pio_put_value, 0);  /* hard-stopped */
@@ -314,27 +335,54 @@ static void test_do_steps_network_loss_decelerates(void **state) {
     (void)state;
     /* Prime last_velocity_q at 10 steps/period via an enabled cycle. */
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_VELOCITY;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = 10000.0;
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000.0;
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(10000.0);
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000.0;
     mock_tx_fifo_empty                 = 1;
-    do_steps(0);  /* enable snap: last_velocity_q = 10 steps/period */
+    step_joint(0);  /* enable snap: last_velocity_q = 10 steps/period */
 
     /* Simulate network loss: disabled, no new packet. */
-    config.joint[0].enabled          = 0;
-    config.joint[0].updated_from_c0  = 0;  /* no new Core0 data */
+    command[0].enabled          = 0;
+    updated[0]  = 0;  /* no new Core0 data */
     last_pio_put_value               = 0;
     pio_put_call_count               = 0;
     mock_tx_fifo_empty               = 1;
-    uint8_t result = do_steps(0);
+    uint8_t result = step_joint(0);
 
     assert_int_equal(result, 0);
     assert_true(last_pio_put_value != 0);  /* decelerating, not hard-stopped */
 }
 
+/* do_steps: a missed update coasts on the last setpoint for up to
+ * coast_periods periods before decelerating as usual. */
+static void test_do_steps_coasts_missed_updates(void **state) {
+    (void)state;
+    config.update_time_us              = 1000;
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(10000.0);  /* 10 steps/period */
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 2000000.0; /* 2 steps/period/period */
+    config.coast_periods               = 1;
+    mock_tx_fifo_empty                 = 1;
+    step_joint(0);  /* enable snap: 10 steps/period */
+
+    /* First missed period: target extrapolated by one period, so the velocity
+     * is held (plus the small drift correction towards the new target). */
+    updated[0] = 0;
+    step_joint(0);
+    int32_t coast_velocity_q = feedback[0].velocity_achieved;
+    assert_in_range(coast_velocity_q, 10 * 65536, 11 * 65536);
+
+    /* Second missed period exceeds the allowance: decelerate as usual. */
+    step_joint(0);
+    assert_true(feedback[0].velocity_achieved < coast_velocity_q);
+}
+
 /* do_steps: network reconnects while joint is mid-deceleration -> acceleration limit honoured.
  *
  * Bug: on the enable 0->1 transition, last_velocity_q was unconditionally snapped to the
@@ -350,31 +398,31 @@ static void test_do_steps_network_loss_decelerates(void **state) {
 static void test_do_steps_reconnect_mid_decel_no_jitter(void **state) {
     (void)state;
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_VELOCITY;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = 10000.0;  /* 10 steps/period at 1000µs */
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 2000000.0; /* 2e6 steps/s² → 2 steps/period/period */
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(10000.0);  /* 10 steps/period at 1000µs */
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 2000000.0; /* 2e6 steps/s² → 2 steps/period/period */
     mock_tx_fifo_empty                 = 1;
-    do_steps(0);  /* tick 1: enable snap → last_velocity_q=10 */
+    step_joint(0);  /* tick 1: enable snap → last_velocity_q=10 */
 
     /* Ticks 2-4: network lost, decelerate 10→8→6→4 steps/period. */
-    config.joint[0].enabled          = 0;
-    config.joint[0].updated_from_c0  = 0;
+    command[0].enabled          = 0;
+    updated[0]  = 0;
     mock_tx_fifo_empty               = 1;
-    do_steps(0);  /* 10→8 */
-    do_steps(0);  /* 8→6 */
-    do_steps(0);  /* 6→4 */
+    step_joint(0);  /* 10→8 */
+    step_joint(0);  /* 8→6 */
+    step_joint(0);  /* 6→4 */
 
     /* Tick 5: network reconnects, LinuxCNC re-enables at velocity=10. */
-    config.joint[0].enabled          = 1;
-    config.joint[0].updated_from_c0  = 1;
-    config.joint[0].velocity_requested = 10000.0;
+    command[0].enabled          = 1;
+    updated[0]  = 1;
+    command[0].velocity_requested_q = VEL_Q(10000.0);
     last_pio_put_value               = 0;
     pio_put_call_count               = 0;
     mock_tx_fifo_empty               = 1;
-    do_steps(0);
+    step_joint(0);
 
     /* Acceleration limit must be honoured: velocity steps from 4 to at most 4+2=6,
      * not a snap to 10.  step_len for 6 steps/period = 133000/(2*6)-9 = 11074. */
@@ -390,14 +438,14 @@ static void test_do_steps_fresh_enable_snaps_to_commanded(void **state) {
     (void)state;
     /* last_velocity_q starts at 0 (pio_reset_for_test in test_setup). */
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_VELOCITY;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = 10000.0;  /* 10 steps/period */
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 2000000.0; /* 2 steps/period/period */
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(10000.0);  /* 10 steps/period */
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 2000000.0; /* 2 steps/period/period */
     mock_tx_fifo_empty                 = 1;
-    do_steps(0);
+    step_joint(0);
 
     /* Snap applied (last_velocity_q was 0): full commanded velocity immediately.
      * step_len for 10 steps/period = 133000/(2*10)-9 = 6641. */
@@ -407,10 +455,10 @@ static void test_do_steps_fresh_enable_snaps_to_commanded(void **state) {
 /* do_steps: no new core0 data (updated == 0), slow last_velocity -> writes 0 to PIO, returns 0 */
 static void test_do_steps_no_update(void **state) {
     (void)state;
-    config.joint[0].enabled         = 1;
-    config.joint[0].updated_from_c0 = 0;
+    command[0].enabled         = 1;
+    updated[0] = 0;
     mock_tx_fifo_empty               = 1;
-    uint8_t result = do_steps(0);
+    uint8_t result = step_joint(0);
     assert_int_equal(result, 0);
 }
 
@@ -419,17 +467,17 @@ static void test_do_steps_no_update(void **state) {
  * MIN_STEP_COUNT_Q so a step is issued; velocity_requested is ignored. */
 static void test_do_steps_normal_step(void **state) {
     (void)state;
-    config.joint[0].enabled            = 1;
-    config.joint[0].abs_pos_requested  = 1000.0;  /* 1000-step error */
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].velocity_requested = 5000.0;   /* ignored in position mode */
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 0.0;  /* no accel limit so first call steps */
-    config.joint[0].updated_from_c0    = 1;
+    command[0].enabled            = 1;
+    command[0].abs_pos_requested_q = POS_Q(1000.0);  /* 1000-step error */
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].velocity_requested_q = VEL_Q(5000.0);   /* ignored in position mode */
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 0.0;  /* no accel limit so first call steps */
+    updated[0]    = 1;
     mock_tx_fifo_empty                  = 1;
     mock_rx_fifo_level                  = 0;
 
-    uint8_t result = do_steps(0);
+    uint8_t result = step_joint(0);
 
     assert_true(result > 0);
     assert_true(last_pio_put_value != 0);
@@ -452,30 +500,30 @@ static void test_do_steps_accel_clamped(void **state) {
     uint32_t update_period_us = 1000;
     config.update_time_us = update_period_us;
 
-    config.joint[0].enabled            = 1;
-    config.joint[0].io_pos_step        = 1;
-    config.joint[0].io_pos_dir         = 2;
-    config.joint[0].cmd_type           = JOINT_CMD_VELOCITY;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = 5.0 * update_period_us;  /* low: snap primes to 5.0 */
-    config.joint[0].max_velocity       = 100000.0;  /* steps/s */
-    config.joint[0].max_accel          = 5000000.0;  /* 5e6 steps/s² → 5.0 steps/period/period */
+    command[0].enabled            = 1;
+    command[0].io_pos_step        = 1;
+    command[0].io_pos_dir         = 2;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(5.0 * update_period_us);  /* low: snap primes to 5.0 */
+    command[0].max_velocity       = 100000.0;  /* steps/s */
+    command[0].max_accel          = 5000000.0;  /* 5e6 steps/s² → 5.0 steps/period/period */
 
     /* First call: enable transition snaps last_velocity_q to 5.0 steps/period.
      * velocity=5.0 -> step_len=(133000/(5*2))-9=13291 */
     mock_tx_fifo_empty = 1;
     last_pio_put_value = 0;
-    do_steps(0);
+    step_joint(0);
     uint32_t first_word = last_pio_put_value;
 
     /* Second call: jump velocity to 10000 steps/s; clamp limits increase to 5.0,
      * so velocity reaches 10.0 steps/period -> step_len=(133000/(10*2))-9=6641 */
     mock_tx_fifo_empty = 1;
     last_pio_put_value = 0;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = 10000.0 * update_period_us;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(10000.0 * update_period_us);
 
-    do_steps(0);
+    step_joint(0);
     uint32_t second_word = last_pio_put_value;
 
     assert_int_equal(first_word >> 1, 13291);
@@ -486,87 +534,139 @@ static void test_do_steps_accel_clamped(void **state) {
 
 /* --- compute_velocity_cmd unit tests --- */
 
+/* compute_velocity_cmd() at 1000µs with no acceleration cap. */
+static int32_t velocity_cmd(uint8_t cmd_type, double velocity, double position,
+                            int32_t achieved, uint8_t enabled, uint32_t updated) {
+    struct JointLimits limits = {0};
+    joint_limits_refresh(&limits, 1000, 50000.0, 0.0);
+    return compute_velocity_cmd(cmd_type, VEL_Q(velocity), POS_Q(position),
+                                achieved, enabled, updated, &limits);
+}
+
 /* Velocity mode, enabled, updated: returns velocity_requested unchanged. */
 static void test_compute_velocity_cmd_velmode_passthrough(void **state) {
     (void)state;
-    double result = compute_velocity_cmd(
-        JOINT_CMD_VELOCITY, 5000.0, 0.0, 0, /*enabled=*/1, /*updated=*/1, 1000, 0.0);
-    assert_float_equal(result, 5000.0, 1e-6);
+    int32_t result = velocity_cmd(
+        JOINT_CMD_VELOCITY, 5000.0, 0.0, 0, /*enabled=*/1, /*updated=*/1);
+    assert_int_equal(result, VEL_Q(5000.0));
 }
 
 /* Velocity mode, lagging: adds gentle position correction to close the gap.
  * error=10 steps, period=1000µs: correction = 10*(1e6/1000)*0.01 = 100 steps/s. */
 static void test_compute_velocity_cmd_velmode_lag_correction(void **state) {
     (void)state;
-    double result = compute_velocity_cmd(
-        JOINT_CMD_VELOCITY, 5000.0, 10.0, 0, /*enabled=*/1, /*updated=*/1, 1000, 0.0);
-    assert_float_equal(result, 5100.0, 1e-6);
+    int32_t result = velocity_cmd(
+        JOINT_CMD_VELOCITY, 5000.0, 10.0, 0, /*enabled=*/1, /*updated=*/1);
+    assert_int_equal(result, VEL_Q(5100.0));
 }
 
 /* Velocity mode, ahead of target: reduces velocity to let position catch up.
  * error=-10 steps (10 steps ahead): correction = -100 steps/s. */
 static void test_compute_velocity_cmd_velmode_lead_correction(void **state) {
     (void)state;
-    double result = compute_velocity_cmd(
-        JOINT_CMD_VELOCITY, 5000.0, 0.0, 10, /*enabled=*/1, /*updated=*/1, 1000, 0.0);
-    assert_float_equal(result, 4900.0, 1e-6);
+    int32_t result = velocity_cmd(
+        JOINT_CMD_VELOCITY, 5000.0, 0.0, 10, /*enabled=*/1, /*updated=*/1);
+    assert_int_equal(result, VEL_Q(4900.0));
 }
 
 /* Velocity mode, sub-1-step error: dead zone suppresses correction. */
 static void test_compute_velocity_cmd_velmode_dead_zone(void **state) {
     (void)state;
-    double result = compute_velocity_cmd(
-        JOINT_CMD_VELOCITY, 5000.0, 0.5, 0, /*enabled=*/1, /*updated=*/1, 1000, 0.0);
-    assert_float_equal(result, 5000.0, 1e-6);
+    int32_t result = velocity_cmd(
+        JOINT_CMD_VELOCITY, 5000.0, 0.5, 0, /*enabled=*/1, /*updated=*/1);
+    assert_int_equal(result, VEL_Q(5000.0));
 }
 
 /* Position mode, zero error: returns vel_ff with no correction. */
 static void test_compute_velocity_cmd_posmode_at_target(void **state) {
     (void)state;
-    double result = compute_velocity_cmd(
-        JOINT_CMD_POSITION, 1000.0, 100.0, 100, /*enabled=*/1, /*updated=*/1, 1000, 0.0);
-    assert_float_equal(result, 1000.0, 1e-6);
+    int32_t result = velocity_cmd(
+        JOINT_CMD_POSITION, 1000.0, 100.0, 100, /*enabled=*/1, /*updated=*/1);
+    assert_int_equal(result, VEL_Q(1000.0));
 }
 
 /* Position mode, dead zone (|error| < 1 step): no correction applied. */
 static void test_compute_velocity_cmd_posmode_dead_zone(void **state) {
     (void)state;
-    double result = compute_velocity_cmd(
-        JOINT_CMD_POSITION, 500.0, 100.4, 100, /*enabled=*/1, /*updated=*/1, 1000, 0.0);
-    assert_float_equal(result, 500.0, 1e-6);
+    int32_t result = velocity_cmd(
+        JOINT_CMD_POSITION, 500.0, 100.4, 100, /*enabled=*/1, /*updated=*/1);
+    assert_int_equal(result, VEL_Q(500.0));
 }
 
 /* Position mode, positive error: vel_ff + Kp*error*rate.
  * error=10 steps, period=1000µs: correction = 10*(1e6/1000)*0.5 = 5000 steps/s. */
 static void test_compute_velocity_cmd_posmode_forward_correction(void **state) {
     (void)state;
-    double result = compute_velocity_cmd(
-        JOINT_CMD_POSITION, 1000.0, 110.0, 100, /*enabled=*/1, /*updated=*/1, 1000, 0.0);
-    assert_float_equal(result, 1000.0 + 5000.0, 1e-6);
+    int32_t result = velocity_cmd(
+        JOINT_CMD_POSITION, 1000.0, 110.0, 100, /*enabled=*/1, /*updated=*/1);
+    assert_int_equal(result, VEL_Q(1000.0 + 5000.0));
 }
 
 /* Position mode, negative error: vel_ff + negative correction. */
 static void test_compute_velocity_cmd_posmode_reverse_correction(void **state) {
     (void)state;
-    double result = compute_velocity_cmd(
-        JOINT_CMD_POSITION, 1000.0, 90.0, 100, /*enabled=*/1, /*updated=*/1, 1000, 0.0);
-    assert_float_equal(result, 1000.0 - 5000.0, 1e-6);
+    int32_t result = velocity_cmd(
+        JOINT_CMD_POSITION, 1000.0, 90.0, 100, /*enabled=*/1, /*updated=*/1);
+    assert_int_equal(result, VEL_Q(1000.0 - 5000.0));
 }
 
 /* Disabled: returns 0 regardless of mode and error. */
 static void test_compute_velocity_cmd_disabled_returns_zero(void **state) {
     (void)state;
-    double result = compute_velocity_cmd(
-        JOINT_CMD_POSITION, 1000.0, 200.0, 100, /*enabled=*/0, /*updated=*/1, 1000, 0.0);
-    assert_float_equal(result, 0.0, 1e-6);
+    int32_t result = velocity_cmd(
+        JOINT_CMD_POSITION, 1000.0, 200.0, 100, /*enabled=*/0, /*updated=*/1);
+    assert_int_equal(result, VEL_Q(0.0));
 }
 
 /* Underrun (updated=0): returns 0 regardless of mode. */
 static void test_compute_velocity_cmd_underrun_returns_zero(void **state) {
     (void)state;
-    double result = compute_velocity_cmd(
-        JOINT_CMD_VELOCITY, 5000.0, 0.0, 0, /*enabled=*/1, /*updated=*/0, 1000, 0.0);
-    assert_float_equal(result, 0.0, 1e-6);
+    int32_t result = velocity_cmd(
+        JOINT_CMD_VELOCITY, 5000.0, 0.0, 0, /*enabled=*/1, /*updated=*/0);
+    assert_int_equal(result, VEL_Q(0.0));
+}
+
+/* Position mode with max_accel: correction capped to sqrt(2*max_accel*|error|).
+ * error=100 steps, max_accel=1e6: cap = sqrt(2e8) ≈ 14142 steps/s, well under
+ * the Kp correction of 50000 steps/s. */
+static void test_compute_velocity_cmd_posmode_stopping_cap(void **state) {
+    (void)state;
+    struct JointLimits limits = {0};
+    joint_limits_refresh(&limits, 1000, 50000.0, 1000000.0);
+    assert_int_equal(compute_velocity_cmd(JOINT_CMD_POSITION, VEL_Q(1000.0), POS_Q(200.0), 100,
+                                          1, 1, &limits),
+                     VEL_Q(1000.0 + sqrt(2e8)));
+    assert_int_equal(compute_velocity_cmd(JOINT_CMD_POSITION, VEL_Q(1000.0), POS_Q(0.0), 100,
+                                          1, 1, &limits),
+                     VEL_Q(1000.0 - sqrt(2e8)));
+}
+
+/* Limits are only re-derived when the period or the joint's config changes. */
+static void test_joint_limits_refresh_on_change(void **state) {
+    (void)state;
+    struct JointLimits limits = {0};
+    assert_true(joint_limits_refresh(&limits, 1000, 50000.0, 5000000.0));
+    assert_int_equal(limits.period_ticks, 133000);
+    assert_int_equal(limits.max_vel_q, (int32_t)(50.0 * 65536.0 * VEL_HEADROOM));
+    assert_int_equal(limits.max_accel_q, 5 * 65536);
+    assert_int_equal(limits.pos_gain_q32, (uint64_t)1 << 31);
+    assert_false(joint_limits_refresh(&limits, 1000, 50000.0, 5000000.0));
+    assert_true(joint_limits_refresh(&limits, 1000, 50000.0, 2000000.0));
+    assert_int_equal(limits.max_accel_q, 2 * 65536);
+    assert_true(joint_limits_refresh(&limits, 500, 50000.0, 2000000.0));
+    assert_int_equal(limits.period_ticks, 66500);
+    assert_int_equal(limits.pos_gain_q32, (uint64_t)1 << 33);
+}
+
+/* isqrt64: floor of the square root across the range. */
+static void test_isqrt64(void **state) {
+    (void)state;
+    assert_int_equal(isqrt64(0), 0);
+    assert_int_equal(isqrt64(1), 1);
+    assert_int_equal(isqrt64(15), 3);
+    assert_int_equal(isqrt64(16), 4);
+    assert_int_equal(isqrt64((uint64_t)65536 * 65536 - 1), 65535);
+    assert_int_equal(isqrt64(UINT64_MAX), UINT32_MAX);
 }
 
 /* do_steps: position mode drives toward abs_pos_requested.
@@ -575,18 +675,18 @@ static void test_compute_velocity_cmd_underrun_returns_zero(void **state) {
  * Direction bit (LSB) must be 1 (positive error). */
 static void test_do_steps_position_mode_drives_forward(void **state) {
     (void)state;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_POSITION;
-    config.joint[0].abs_pos_requested  = 1000.0;
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].velocity_requested = 0.0;  /* ignored in position mode */
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 0.0;
-    config.joint[0].updated_from_c0    = 1;
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_POSITION;
+    command[0].abs_pos_requested_q = POS_Q(1000.0);
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].velocity_requested_q = VEL_Q(0.0);  /* ignored in position mode */
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 0.0;
+    updated[0]    = 1;
     mock_tx_fifo_empty                  = 1;
     mock_rx_fifo_level                  = 0;
 
-    uint8_t result = do_steps(0);
+    uint8_t result = step_joint(0);
 
     assert_true(result > 0);
     assert_true(last_pio_put_value != 0);
@@ -597,18 +697,18 @@ static void test_do_steps_position_mode_drives_forward(void **state) {
  * abs_pos_achieved=1000 > abs_pos_requested=0 => error=-1000 => reverse. */
 static void test_do_steps_position_mode_reverses(void **state) {
     (void)state;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_POSITION;
-    config.joint[0].abs_pos_requested  = 0.0;
-    config.joint[0].abs_pos_achieved   = 1000;
-    config.joint[0].velocity_requested = 0.0;
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 0.0;
-    config.joint[0].updated_from_c0    = 1;
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_POSITION;
+    command[0].abs_pos_requested_q = POS_Q(0.0);
+    feedback[0].abs_pos_achieved   = 1000;
+    command[0].velocity_requested_q = VEL_Q(0.0);
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 0.0;
+    updated[0]    = 1;
     mock_tx_fifo_empty                  = 1;
     mock_rx_fifo_level                  = 0;
 
-    do_steps(0);
+    step_joint(0);
 
     assert_int_equal(last_pio_put_value & 1, 0);  /* direction = reverse */
 }
@@ -617,18 +717,18 @@ static void test_do_steps_position_mode_reverses(void **state) {
  * vel_ff=0 (LinuxCNC vel_cmd=0 at rest), error=0 -> velocity=0. */
 static void test_do_steps_position_mode_at_target(void **state) {
     (void)state;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_POSITION;
-    config.joint[0].abs_pos_requested  = 0.0;
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].velocity_requested = 0.0;  /* vel_cmd=0: machine at rest */
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 0.0;
-    config.joint[0].updated_from_c0    = 1;
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_POSITION;
+    command[0].abs_pos_requested_q = POS_Q(0.0);
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].velocity_requested_q = VEL_Q(0.0);  /* vel_cmd=0: machine at rest */
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 0.0;
+    updated[0]    = 1;
     mock_tx_fifo_empty                  = 1;
     mock_rx_fifo_level                  = 0;
 
-    uint8_t result = do_steps(0);
+    uint8_t result = step_joint(0);
 
     assert_true(result > 0);
     assert_int_equal(last_pio_put_value, 0);  /* no steps when at target */
@@ -639,16 +739,16 @@ static void test_do_steps_no_motion(void **state) {
     (void)state;
     /* All positions at zero and velocity_requested=0 -> get_velocity returns 0.0
      * -> step_len=0 -> plan_steps returns 0 -> PIO should receive 0. */
-    config.joint[0].enabled            = 1;
-    config.joint[0].abs_pos_requested  = 0.0;
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].velocity_requested = 0.0;
-    config.joint[0].max_velocity       = 50.0;
-    config.joint[0].updated_from_c0    = 1;
+    command[0].enabled            = 1;
+    command[0].abs_pos_requested_q = POS_Q(0.0);
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].velocity_requested_q = VEL_Q(0.0);
+    command[0].max_velocity       = 50.0;
+    updated[0]    = 1;
     mock_tx_fifo_empty                  = 1;
     mock_rx_fifo_level                  = 0;
 
-    uint8_t result = do_steps(0);
+    uint8_t result = step_joint(0);
 
     assert_true(result > 0);
     assert_int_equal(last_pio_put_value, 0);
@@ -659,22 +759,22 @@ static void test_do_steps_no_motion(void **state) {
  * (see test_do_steps_underrun_while_enabled_decelerates). */
 static void test_do_steps_underrun_stops_pio(void **state) {
     (void)state;
-    config.joint[0].enabled            = 1;
-    config.joint[0].abs_pos_requested  = 10.0;
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].velocity_requested = 5000.0;
-    config.joint[0].max_velocity       = 50.0;
-    config.joint[0].max_accel          = 0.0;
-    config.joint[0].updated_from_c0    = 1;
+    command[0].enabled            = 1;
+    command[0].abs_pos_requested_q = POS_Q(10.0);
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].velocity_requested_q = VEL_Q(5000.0);
+    command[0].max_velocity       = 50.0;
+    command[0].max_accel          = 0.0;
+    updated[0]    = 1;
     mock_tx_fifo_empty                  = 1;
-    do_steps(0);   /* prime last_velocity_q to a non-zero value */
+    step_joint(0);   /* prime last_velocity_q to a non-zero value */
 
-    config.joint[0].updated_from_c0 = 0;
+    updated[0] = 0;
     pio_put_call_count               = 0;
     last_pio_put_value               = 0xDEADBEEF;
     mock_tx_fifo_empty               = 1;
 
-    uint8_t result = do_steps(0);
+    uint8_t result = step_joint(0);
 
     assert_int_equal(result, 0);
     assert_int_equal(pio_put_call_count, 1);
@@ -690,21 +790,21 @@ static void test_do_steps_underrun_while_enabled_decelerates(void **state) {
     (void)state;
     /* Prime last_velocity_q at 10 steps/period via an enabled cycle. */
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_VELOCITY;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = 10000.0;  /* 10 steps/period at 1000µs */
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0; /* 5e6 steps/s² → 5.0 steps/period/period */
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(10000.0);  /* 10 steps/period at 1000µs */
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0; /* 5e6 steps/s² → 5.0 steps/period/period */
     mock_tx_fifo_empty                 = 1;
-    do_steps(0);  /* enable snap: last_velocity_q = 10 steps/period */
+    step_joint(0);  /* enable snap: last_velocity_q = 10 steps/period */
 
     /* Underrun while still enabled (Core0 blocked on network). */
-    config.joint[0].updated_from_c0 = 0;
+    updated[0] = 0;
     last_pio_put_value               = 0;
     pio_put_call_count               = 0;
     mock_tx_fifo_empty               = 1;
-    uint8_t result = do_steps(0);
+    uint8_t result = step_joint(0);
 
     assert_int_equal(result, 0);
     assert_true(last_pio_put_value != 0);  /* still decelerating, not hard-stopped */
@@ -716,18 +816,18 @@ static void test_do_steps_underrun_while_enabled_decelerates(void **state) {
 static void test_do_steps_posmode_ff_active_tracks_at_full_speed(void **state) {
     (void)state;
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_POSITION;
-    config.joint[0].velocity_requested = 10000.0;
-    config.joint[0].abs_pos_requested  = 1.0;
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0;
-    config.joint[0].updated_from_c0    = 1;
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_POSITION;
+    command[0].velocity_requested_q = VEL_Q(10000.0);
+    command[0].abs_pos_requested_q = POS_Q(1.0);
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0;
+    updated[0]    = 1;
     mock_tx_fifo_empty                  = 1;
     mock_rx_fifo_level                  = 0;
 
-    do_steps(0);
+    step_joint(0);
 
     assert_int_equal(last_pio_put_value >> 1, 6641);
 }
@@ -737,18 +837,18 @@ static void test_do_steps_posmode_ff_active_tracks_at_full_speed(void **state) {
 static void test_do_steps_posmode_ff_large_negative_tracks_at_full_speed(void **state) {
     (void)state;
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_POSITION;
-    config.joint[0].velocity_requested = -10000.0;
-    config.joint[0].abs_pos_requested  = -1.0;
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0;
-    config.joint[0].updated_from_c0    = 1;
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_POSITION;
+    command[0].velocity_requested_q = VEL_Q(-10000.0);
+    command[0].abs_pos_requested_q = POS_Q(-1.0);
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0;
+    updated[0]    = 1;
     mock_tx_fifo_empty                 = 1;
     mock_rx_fifo_level                 = 0;
 
-    do_steps(0);
+    step_joint(0);
 
     assert_int_equal(last_pio_put_value >> 1, 6641);
 }
@@ -758,18 +858,18 @@ static void test_do_steps_posmode_ff_large_negative_tracks_at_full_speed(void **
 static void test_do_steps_posmode_ff_small_positive_tracks_normally(void **state) {
     (void)state;
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_POSITION;
-    config.joint[0].velocity_requested = 4000.0;
-    config.joint[0].abs_pos_requested  = 1.0;
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0;
-    config.joint[0].updated_from_c0    = 1;
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_POSITION;
+    command[0].velocity_requested_q = VEL_Q(4000.0);
+    command[0].abs_pos_requested_q = POS_Q(1.0);
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0;
+    updated[0]    = 1;
     mock_tx_fifo_empty                 = 1;
     mock_rx_fifo_level                 = 0;
 
-    do_steps(0);
+    step_joint(0);
 
     assert_int_equal(last_pio_put_value >> 1, 16616);
 }
@@ -778,18 +878,18 @@ static void test_do_steps_posmode_ff_small_positive_tracks_normally(void **state
 static void test_do_steps_posmode_ff_small_negative_tracks_normally(void **state) {
     (void)state;
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_POSITION;
-    config.joint[0].velocity_requested = -4000.0;
-    config.joint[0].abs_pos_requested  = -1.0;
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0;
-    config.joint[0].updated_from_c0    = 1;
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_POSITION;
+    command[0].velocity_requested_q = VEL_Q(-4000.0);
+    command[0].abs_pos_requested_q = POS_Q(-1.0);
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0;
+    updated[0]    = 1;
     mock_tx_fifo_empty                 = 1;
     mock_rx_fifo_level                 = 0;
 
-    do_steps(0);
+    step_joint(0);
 
     assert_int_equal(last_pio_put_value >> 1, 16616);
 }
@@ -804,23 +904,23 @@ static void test_do_steps_posmode_ff_small_negative_tracks_normally(void **state
 static void test_do_steps_posmode_ff_zero_clamp_accel_positive(void **state) {
     (void)state;
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_POSITION;
-    config.joint[0].velocity_requested = 10000.0;
-    config.joint[0].abs_pos_requested  = 0.0;
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0;
-    config.joint[0].updated_from_c0    = 1;
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_POSITION;
+    command[0].velocity_requested_q = VEL_Q(10000.0);
+    command[0].abs_pos_requested_q = POS_Q(0.0);
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0;
+    updated[0]    = 1;
     mock_tx_fifo_empty                 = 1;
     mock_rx_fifo_level                 = 0;
-    do_steps(0);  /* enable snap: last_velocity_q=655360 */
+    step_joint(0);  /* enable snap: last_velocity_q=655360 */
 
-    config.joint[0].velocity_requested = 0.0;
-    config.joint[0].abs_pos_requested  = 1.0;
-    config.joint[0].updated_from_c0    = 1;
+    command[0].velocity_requested_q = VEL_Q(0.0);
+    command[0].abs_pos_requested_q = POS_Q(1.0);
+    updated[0]    = 1;
     last_pio_put_value = 0;
-    do_steps(0);
+    step_joint(0);
 
     assert_int_equal(last_pio_put_value >> 1, 22157);
 }
@@ -829,23 +929,23 @@ static void test_do_steps_posmode_ff_zero_clamp_accel_positive(void **state) {
 static void test_do_steps_posmode_ff_zero_clamp_accel_negative(void **state) {
     (void)state;
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_POSITION;
-    config.joint[0].velocity_requested = -10000.0;
-    config.joint[0].abs_pos_requested  = 0.0;
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0;
-    config.joint[0].updated_from_c0    = 1;
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_POSITION;
+    command[0].velocity_requested_q = VEL_Q(-10000.0);
+    command[0].abs_pos_requested_q = POS_Q(0.0);
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0;
+    updated[0]    = 1;
     mock_tx_fifo_empty                 = 1;
     mock_rx_fifo_level                 = 0;
-    do_steps(0);  /* enable snap: last_velocity_q=-655360 */
+    step_joint(0);  /* enable snap: last_velocity_q=-655360 */
 
-    config.joint[0].velocity_requested = 0.0;
-    config.joint[0].abs_pos_requested  = -1.0;
-    config.joint[0].updated_from_c0    = 1;
+    command[0].velocity_requested_q = VEL_Q(0.0);
+    command[0].abs_pos_requested_q = POS_Q(-1.0);
+    updated[0]    = 1;
     last_pio_put_value = 0;
-    do_steps(0);
+    step_joint(0);
 
     assert_int_equal(last_pio_put_value >> 1, 22157);
 }
@@ -873,21 +973,21 @@ static void test_do_steps_position_mode_no_jitter_at_rest(void **state) {
     (void)state;
 
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_POSITION;
-    config.joint[0].velocity_requested = 0.0;     /* vel_ff=0: machine at rest */
-    config.joint[0].abs_pos_requested  = 100.5;   /* fractional: 0.5-step Kp error */
-    config.joint[0].abs_pos_achieved   = 100;
-    config.joint[0].max_velocity       = 32000.0; /* 25 mm/s * 1280 steps/mm */
-    config.joint[0].max_accel          = 480000.0; /* 375 mm/s² * 1280 steps/mm */
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_POSITION;
+    command[0].velocity_requested_q = VEL_Q(0.0);     /* vel_ff=0: machine at rest */
+    command[0].abs_pos_requested_q = POS_Q(100.5);   /* fractional: 0.5-step Kp error */
+    feedback[0].abs_pos_achieved   = 100;
+    command[0].max_velocity       = 32000.0; /* 25 mm/s * 1280 steps/mm */
+    command[0].max_accel          = 480000.0; /* 375 mm/s² * 1280 steps/mm */
     mock_rx_fifo_level                 = 0;  /* PIO counter unchanged: no steps from hardware */
     mock_tx_fifo_empty                 = 1;
 
     int steps_fired = 0;
     for (int i = 0; i < 20; i++) {
-        config.joint[0].updated_from_c0 = 1;
+        updated[0] = 1;
         last_pio_put_value = 0;
-        do_steps(0);
+        step_joint(0);
         if (last_pio_put_value != 0) {
             steps_fired++;
         }
@@ -937,23 +1037,23 @@ static int32_t pio_word_steps(uint32_t word) {
  * the position correction term stays near zero (error < 1 step). */
 static int32_t run_velocity_periods(double vel_steps_per_s, int n) {
     config.update_time_us              = 1000;
-    config.joint[0].cmd_type           = JOINT_CMD_VELOCITY;
-    config.joint[0].enabled            = 1;
-    config.joint[0].velocity_requested = vel_steps_per_s;
-    config.joint[0].max_velocity       = 32000.0;
-    config.joint[0].max_accel          = 0.0;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;
+    command[0].enabled            = 1;
+    command[0].velocity_requested_q = VEL_Q(vel_steps_per_s);
+    command[0].max_velocity       = 32000.0;
+    command[0].max_accel          = 0.0;
     mock_tx_fifo_empty                 = 1;
 
     int32_t sim_pos      = 0;
     double  pos_requested = 0.0;
     for (int i = 0; i < n; i++) {
-        config.joint[0].abs_pos_requested = pos_requested;
+        command[0].abs_pos_requested_q = POS_Q(pos_requested);
         mock_rx_values[0]  = sim_pos;
         mock_rx_fifo_level = 1;
         mock_rx_index      = 0;
-        config.joint[0].updated_from_c0 = 1;
+        updated[0] = 1;
         last_pio_put_value = 0;
-        do_steps(0);
+        step_joint(0);
         sim_pos       += pio_word_steps(last_pio_put_value);
         pos_requested += vel_steps_per_s * 1e-3;  /* advance 1ms per period */
     }
@@ -1024,23 +1124,23 @@ static void test_do_steps_velmode_reverse(void **state) {
 static void test_do_steps_velmode_lag_corrected_over_time(void **state) {
     (void)state;
     config.update_time_us              = 1000;
-    config.joint[0].cmd_type           = JOINT_CMD_VELOCITY;
-    config.joint[0].enabled            = 1;
-    config.joint[0].velocity_requested = 10000.0;
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 0.0;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;
+    command[0].enabled            = 1;
+    command[0].velocity_requested_q = VEL_Q(10000.0);
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 0.0;
     mock_tx_fifo_empty                 = 1;
 
     int32_t sim_pos      = 0;
     double  pos_requested = 10.0;  /* start with 10-step lag */
     for (int i = 0; i < 100; i++) {
-        config.joint[0].abs_pos_requested = pos_requested;
+        command[0].abs_pos_requested_q = POS_Q(pos_requested);
         mock_rx_values[0]  = sim_pos;
         mock_rx_fifo_level = 1;
         mock_rx_index      = 0;
-        config.joint[0].updated_from_c0 = 1;
+        updated[0] = 1;
         last_pio_put_value = 0;
-        do_steps(0);
+        step_joint(0);
         sim_pos       += pio_word_steps(last_pio_put_value);
         pos_requested += 10.0;  /* LinuxCNC advances pos by 10 steps/period */
     }
@@ -1062,29 +1162,29 @@ static void test_do_steps_position_mode_no_overshoot_after_correction(void **sta
     (void)state;
 
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_VELOCITY;   /* velocity mode to prime */
-    config.joint[0].velocity_requested = 490.0;                /* 32112 Q16.16 ≈ bang-bang cap */
-    config.joint[0].abs_pos_requested  = 0.0;
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].max_velocity       = 200000.0;
-    config.joint[0].max_accel          = 120000.0;             /* 750 mm/s² × 160 steps/mm */
-    config.joint[0].updated_from_c0    = 1;
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;   /* velocity mode to prime */
+    command[0].velocity_requested_q = VEL_Q(490.0);                /* 32112 Q16.16 ≈ bang-bang cap */
+    command[0].abs_pos_requested_q = POS_Q(0.0);
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].max_velocity       = 200000.0;
+    command[0].max_accel          = 120000.0;             /* 750 mm/s² × 160 steps/mm */
+    updated[0]    = 1;
     mock_tx_fifo_empty                 = 1;
     mock_rx_fifo_level                 = 0;
-    do_steps(0);  /* enable snap: last_velocity_q = 490/1000 * 65536 = 32112 */
+    step_joint(0);  /* enable snap: last_velocity_q = 490/1000 * 65536 = 32112 */
 
     /* Now at target: error=0, vel_ff=0.  Residual velocity must not fire a step. */
-    config.joint[0].cmd_type           = JOINT_CMD_POSITION;
-    config.joint[0].velocity_requested = 0.0;
-    config.joint[0].abs_pos_requested  = 1.0;
-    config.joint[0].abs_pos_achieved   = 1;
+    command[0].cmd_type           = JOINT_CMD_POSITION;
+    command[0].velocity_requested_q = VEL_Q(0.0);
+    command[0].abs_pos_requested_q = POS_Q(1.0);
+    feedback[0].abs_pos_achieved   = 1;
 
     int steps_fired = 0;
     for (int i = 0; i < 10; i++) {
-        config.joint[0].updated_from_c0 = 1;
+        updated[0] = 1;
         last_pio_put_value = 0;
-        do_steps(0);
+        step_joint(0);
         if (last_pio_put_value != 0) steps_fired++;
     }
 
@@ -1141,22 +1241,22 @@ static void test_do_steps_velocity_achieved_zero_when_stopped(void **state) {
     (void)state;
     /* Prime at 5 steps/period (= max_accel); one disable step reaches zero. */
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_VELOCITY;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = 5000.0;    /* 5 steps/period at 1000µs */
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0; /* 5 steps/period/period */
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(5000.0);    /* 5 steps/period at 1000µs */
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0; /* 5 steps/period/period */
     mock_tx_fifo_empty                 = 1;
-    do_steps(0);  /* enable snap: last_velocity_q = 5 steps/period */
+    step_joint(0);  /* enable snap: last_velocity_q = 5 steps/period */
 
     /* Disable: clamp_accel(0, 5, 5) = 0 → hard stop → velocity_achieved = 0 exactly. */
-    config.joint[0].enabled          = 0;
-    config.joint[0].updated_from_c0  = 1;
+    command[0].enabled          = 0;
+    updated[0]  = 1;
     mock_tx_fifo_empty               = 1;
-    do_steps(0);
+    step_joint(0);
 
-    assert_int_equal(config.joint[0].velocity_achieved, 0);
+    assert_int_equal(feedback[0].velocity_achieved, 0);
 }
 
 /* do_steps: velocity_achieved is non-zero while joint is still decelerating.
@@ -1167,22 +1267,22 @@ static void test_do_steps_velocity_achieved_nonzero_while_decelerating(void **st
     (void)state;
     /* Prime at 10 steps/period, max_accel=5; one disable step → 5 (still moving). */
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_VELOCITY;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = 10000.0;   /* 10 steps/period at 1000µs */
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0; /* 5 steps/period/period */
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(10000.0);   /* 10 steps/period at 1000µs */
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0; /* 5 steps/period/period */
     mock_tx_fifo_empty                 = 1;
-    do_steps(0);  /* enable snap: last_velocity_q = 10 steps/period */
+    step_joint(0);  /* enable snap: last_velocity_q = 10 steps/period */
 
     /* Disable: clamp_accel(0, 10, 5) = 5 → still decelerating → velocity_achieved != 0. */
-    config.joint[0].enabled          = 0;
-    config.joint[0].updated_from_c0  = 1;
+    command[0].enabled          = 0;
+    updated[0]  = 1;
     mock_tx_fifo_empty               = 1;
-    do_steps(0);
+    step_joint(0);
 
-    assert_true(config.joint[0].velocity_achieved != 0);
+    assert_true(feedback[0].velocity_achieved != 0);
 }
 
 /* do_steps: velocity_achieved is exact 0 after reverse-direction deceleration.
@@ -1192,22 +1292,22 @@ static void test_do_steps_velocity_achieved_nonzero_while_decelerating(void **st
 static void test_do_steps_velocity_achieved_zero_reverse(void **state) {
     (void)state;
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_VELOCITY;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = -5000.0;   /* -5 steps/period (reverse) */
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0; /* 5 steps/period/period */
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(-5000.0);   /* -5 steps/period (reverse) */
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0; /* 5 steps/period/period */
     mock_tx_fifo_empty                 = 1;
-    do_steps(0);  /* enable snap: last_velocity_q = -5 steps/period */
+    step_joint(0);  /* enable snap: last_velocity_q = -5 steps/period */
 
     /* Disable: clamp_accel(0, -5, 5) = 0 → hard stop → velocity_achieved = 0 exactly. */
-    config.joint[0].enabled          = 0;
-    config.joint[0].updated_from_c0  = 1;
+    command[0].enabled          = 0;
+    updated[0]  = 1;
     mock_tx_fifo_empty               = 1;
-    do_steps(0);
+    step_joint(0);
 
-    assert_int_equal(config.joint[0].velocity_achieved, 0);
+    assert_int_equal(feedback[0].velocity_achieved, 0);
 }
 
 /* do_steps: position-mode velocity_achieved is exact 0 when joint has fully decelerated.
@@ -1217,23 +1317,23 @@ static void test_do_steps_posmode_velocity_achieved_zero_when_stopped(void **sta
     (void)state;
     /* vel_ff=5 steps/period, zero position error → velocity_q=5; max_accel=5 → one step to zero. */
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_POSITION;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = 5000.0;   /* vel_ff = 5 steps/period at 1000µs */
-    config.joint[0].abs_pos_requested  = 0.0;       /* zero error: no Kp correction */
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0; /* 5 steps/period/period */
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_POSITION;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(5000.0);   /* vel_ff = 5 steps/period at 1000µs */
+    command[0].abs_pos_requested_q = POS_Q(0.0);       /* zero error: no Kp correction */
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0; /* 5 steps/period/period */
     mock_tx_fifo_empty                 = 1;
-    do_steps(0);  /* enable snap: last_velocity_q = 5 steps/period */
+    step_joint(0);  /* enable snap: last_velocity_q = 5 steps/period */
 
-    config.joint[0].enabled          = 0;
-    config.joint[0].updated_from_c0  = 1;
+    command[0].enabled          = 0;
+    updated[0]  = 1;
     mock_tx_fifo_empty               = 1;
-    do_steps(0);  /* clamp_accel(0, 5, ≥5) = 0 → hard stop */
+    step_joint(0);  /* clamp_accel(0, 5, ≥5) = 0 → hard stop */
 
-    assert_int_equal(config.joint[0].velocity_achieved, 0);
+    assert_int_equal(feedback[0].velocity_achieved, 0);
 }
 
 /* do_steps: position-mode velocity_achieved is non-zero while still decelerating. */
@@ -1241,23 +1341,23 @@ static void test_do_steps_posmode_velocity_achieved_nonzero_while_decelerating(v
     (void)state;
     /* vel_ff=10 steps/period, max_accel=5; one disable step → 5 (still moving). */
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_POSITION;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = 10000.0;  /* vel_ff = 10 steps/period */
-    config.joint[0].abs_pos_requested  = 0.0;
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0; /* 5 steps/period/period */
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_POSITION;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(10000.0);  /* vel_ff = 10 steps/period */
+    command[0].abs_pos_requested_q = POS_Q(0.0);
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0; /* 5 steps/period/period */
     mock_tx_fifo_empty                 = 1;
-    do_steps(0);  /* enable snap: last_velocity_q = 10 steps/period */
+    step_joint(0);  /* enable snap: last_velocity_q = 10 steps/period */
 
-    config.joint[0].enabled          = 0;
-    config.joint[0].updated_from_c0  = 1;
+    command[0].enabled          = 0;
+    updated[0]  = 1;
     mock_tx_fifo_empty               = 1;
-    do_steps(0);  /* clamp limits decel: velocity_q = 5, still moving */
+    step_joint(0);  /* clamp limits decel: velocity_q = 5, still moving */
 
-    assert_true(config.joint[0].velocity_achieved != 0);
+    assert_true(feedback[0].velocity_achieved != 0);
 }
 
 /* do_steps: position-mode velocity_achieved is exact 0 after reverse-direction deceleration. */
@@ -1265,23 +1365,23 @@ static void test_do_steps_posmode_velocity_achieved_zero_reverse(void **state) {
     (void)state;
     /* vel_ff=-5 steps/period (reverse), max_accel=5 → one step to zero. */
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_POSITION;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = -5000.0;  /* vel_ff = -5 steps/period */
-    config.joint[0].abs_pos_requested  = 0.0;
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0; /* 5 steps/period/period */
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_POSITION;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(-5000.0);  /* vel_ff = -5 steps/period */
+    command[0].abs_pos_requested_q = POS_Q(0.0);
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0; /* 5 steps/period/period */
     mock_tx_fifo_empty                 = 1;
-    do_steps(0);  /* enable snap: last_velocity_q = -5 steps/period */
+    step_joint(0);  /* enable snap: last_velocity_q = -5 steps/period */
 
-    config.joint[0].enabled          = 0;
-    config.joint[0].updated_from_c0  = 1;
+    command[0].enabled          = 0;
+    updated[0]  = 1;
     mock_tx_fifo_empty               = 1;
-    do_steps(0);  /* clamp_accel(0, -5, ≥5) = 0 → hard stop */
+    step_joint(0);  /* clamp_accel(0, -5, ≥5) = 0 → hard stop */
 
-    assert_int_equal(config.joint[0].velocity_achieved, 0);
+    assert_int_equal(feedback[0].velocity_achieved, 0);
 }
 
 /* do_steps: position-mode stopping-profile cap is inactive in velocity mode.
@@ -1295,17 +1395,17 @@ static void test_do_steps_velocity_mode_no_position_cap(void **state) {
     /* Zero position error so the gentle velocity-mode correction doesn't apply;
      * only the stopping-profile cap guard (cmd_type == JOINT_CMD_POSITION) is tested. */
     config.update_time_us              = 1000;
-    config.joint[0].enabled            = 1;
-    config.joint[0].cmd_type           = JOINT_CMD_VELOCITY;
-    config.joint[0].updated_from_c0    = 1;
-    config.joint[0].velocity_requested = 10000.0;  /* 10 steps/period at 1000µs */
-    config.joint[0].abs_pos_requested  = 0.0;
-    config.joint[0].abs_pos_achieved   = 0;
-    config.joint[0].max_velocity       = 50000.0;
-    config.joint[0].max_accel          = 5000000.0; /* 5 steps/period/period */
+    command[0].enabled            = 1;
+    command[0].cmd_type           = JOINT_CMD_VELOCITY;
+    updated[0]    = 1;
+    command[0].velocity_requested_q = VEL_Q(10000.0);  /* 10 steps/period at 1000µs */
+    command[0].abs_pos_requested_q = POS_Q(0.0);
+    feedback[0].abs_pos_achieved   = 0;
+    command[0].max_velocity       = 50000.0;
+    command[0].max_accel          = 5000000.0; /* 5 steps/period/period */
     mock_tx_fifo_empty                 = 1;
 
-    do_steps(0);  /* enable snap: last_velocity_q = 10 steps/period */
+    step_joint(0);  /* enable snap: last_velocity_q = 10 steps/period */
 
     /* Velocity mode: full 10 steps/period → step_len = 133000/(2*10)-9 = 6641.
      * If the stopping-profile cap had fired, step_len would be larger (fewer steps). */
@@ -1341,11 +1441,15 @@ int main(void) {
         cmocka_unit_test_setup(test_compute_velocity_cmd_posmode_reverse_correction, test_setup),
         cmocka_unit_test_setup(test_compute_velocity_cmd_disabled_returns_zero,      test_setup),
         cmocka_unit_test_setup(test_compute_velocity_cmd_underrun_returns_zero,      test_setup),
+        cmocka_unit_test_setup(test_compute_velocity_cmd_posmode_stopping_cap,       test_setup),
+        cmocka_unit_test_setup(test_joint_limits_refresh_on_change,                  test_setup),
+        cmocka_unit_test_setup(test_isqrt64,                                         test_setup),
         cmocka_unit_test_setup(test_do_steps_zero_period,               test_setup),
         cmocka_unit_test_setup(test_do_steps_disabled,                  test_setup),
         cmocka_unit_test_setup(test_do_steps_disabled_drains_rx_fifo,  test_setup),
         cmocka_unit_test_setup(test_do_steps_disabling_decelerates,    test_setup),
         cmocka_unit_test_setup(test_do_steps_disabling_stops_when_zero,  test_setup),
+        cmocka_unit_test_setup(test_do_steps_coasts_missed_updates, test_setup),
         cmocka_unit_test_setup(test_do_steps_network_loss_decelerates,   test_setup),
         cmocka_unit_test_setup(test_do_steps_reconnect_mid_decel_no_jitter,  test_setup),
         cmocka_unit_test_setup(test_do_steps_fresh_enable_snaps_to_commanded, test_setup),
@@ -147,9 +147,8 @@ static void test_pack_multiple(void **state) {
     assert_int_equal(*(buffer.payload + aligned32(sizeof(test_message)) * 3), 0);
 }
 
-static void test_pack_overflow(void **state) {
-    (void) state; /* unused */
-
+/* Fill the buffer to limit, then check the next message is refused. */
+static void pack_overflow_at(size_t limit) {
     struct NWBuffer buffer = {
         .length = 0,
         .checksum = 0,
@@ -160,25 +159,51 @@ static void test_pack_overflow(void **state) {
         uint8_t a;
     } test_message_small;
 
-    struct TestMessageBig {
-        uint8_t a[NW_BUF_LEN - aligned32(sizeof(test_message_small))];
-    } test_message_big;
+    uint8_t test_message_big[NW_BUF_LEN] = {0};
+    size_t big_len = limit - aligned32(sizeof(test_message_small));
 
     uint16_t return_val;
 
+    assert_int_equal(nw_buff_set_limit(limit), limit);
+
     will_return(__wrap_checksum, 1234);
-    return_val = pack_nw_buff(&buffer, (void*)&test_message_big, sizeof(test_message_big));
-    assert_int_equal(return_val, aligned32(sizeof(test_message_big)));
+    return_val = pack_nw_buff(&buffer, (void*)&test_message_big, big_len);
+    assert_int_equal(return_val, aligned32(big_len));
 
     will_return(__wrap_checksum, 1234);
     return_val = pack_nw_buff(&buffer, (void*)&test_message_small, sizeof(test_message_small));
     assert_int_equal(return_val, aligned32(sizeof(test_message_small)));
+    assert_int_equal(buffer.length, limit);
 
     // This one will fail to populate as the buffer is full.
     return_val = pack_nw_buff(&buffer, (void*)&test_message_small, sizeof(test_message_small));
     assert_int_equal(return_val, 0);
 }
 
+static void test_pack_overflow(void **state) {
+    (void) state; /* unused */
+
+    // Until FEATURE_LARGE_NW_BUF is negotiated.
+    assert_int_equal(nw_buff_limit(), NW_BUF_LEN_LEGACY);
+    pack_overflow_at(NW_BUF_LEN_LEGACY);
+
+    pack_overflow_at(NW_BUF_LEN);
+
+    nw_buff_set_limit(NW_BUF_LEN_LEGACY);
+}
+
+/* Limits outside the supported range are clamped. */
+static void test_set_limit_clamps(void **state) {
+    (void) state; /* unused */
+
+    assert_int_equal(nw_buff_set_limit(0), NW_BUF_LEN_LEGACY);
+    assert_int_equal(nw_buff_set_limit(NW_BUF_LEN + 4), NW_BUF_LEN);
+    assert_int_equal(nw_buff_limit(), NW_BUF_LEN);
+    assert_int_equal(nw_buff_set_limit(1024), 1024);
+
+    nw_buff_set_limit(NW_BUF_LEN_LEGACY);
+}
+
 /* unaligned length passes the raw-size check but the aligned size would overflow;
  * pack_nw_buff must reject it. */
 static void test_pack_overflow_aligned(void **state) {
@@ -805,6 +830,100 @@ static void test_end_to_end_multi(void **state) {
     assert_int_equal(offset, aligned32(sizeof(m0)) + aligned32(sizeof(m1)) + aligned32(sizeof(m2)) + aligned32(sizeof(m0)));
 }
 
+/* A sealed buffer passes checkNWBuff(), which strips the CRC trailer.
+ * Any corruption of the payload or trailer is rejected. */
+static void test_seal_crc32(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer buffer = {0};
+    uint8_t message[12] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+
+    mock_checksum = 1;
+    pack_nw_buff(&buffer, message, sizeof(message));
+    assert_int_equal(seal_nw_buff_crc32(&buffer), NW_CRC32_LEN);
+    assert_int_equal(buffer.length, (sizeof(message) + NW_CRC32_LEN) | NW_LENGTH_CRC32);
+    assert_int_equal(nw_buff_len(&buffer), sizeof(message) + NW_CRC32_LEN);
+    assert_int_equal(nw_buff_wire_len(&buffer), 4 + sizeof(message) + NW_CRC32_LEN);
+
+    // Sealing twice is refused.
+    assert_int_equal(seal_nw_buff_crc32(&buffer), 0);
+
+    struct NWBuffer received = buffer;
+    assert_int_equal(checkNWBuff(&received), 1);
+    assert_int_equal(received.length, sizeof(message));
+    assert_memory_equal(received.payload, message, sizeof(message));
+
+    received = buffer;
+    received.payload[5] ^= 0x10;
+    assert_int_equal(checkNWBuff(&received), 0);
+
+    received = buffer;
+    received.payload[sizeof(message) + 1] ^= 0x01;
+    assert_int_equal(checkNWBuff(&received), 0);
+
+    // Byte swap within the same parity lane fools the additive checksum but
+    // not the CRC.
+    received = buffer;
+    received.payload[0] = message[2];
+    received.payload[2] = message[0];
+    assert_int_equal(checkNWBuff(&received), 0);
+
+    // Flagged length larger than the buffer.
+    received = buffer;
+    received.length = (NW_BUF_LEN + NW_CRC32_LEN) | NW_LENGTH_CRC32;
+    assert_int_equal(checkNWBuff(&received), 0);
+    mock_checksum = 0;
+}
+
+/* No room for the trailer leaves the buffer unsealed but still valid. */
+static void seal_crc32_full_at(size_t limit) {
+    struct NWBuffer buffer = {0};
+    uint8_t message[NW_BUF_LEN] = {0};
+    message[7] = 77;
+
+    nw_buff_set_limit(limit);
+    mock_checksum = 1;
+    assert_int_equal(pack_nw_buff(&buffer, message, limit), limit);
+    assert_int_equal(seal_nw_buff_crc32(&buffer), 0);
+    assert_int_equal(buffer.length, limit);
+    assert_int_equal(checkNWBuff(&buffer), 1);
+    mock_checksum = 0;
+}
+
+static void test_seal_crc32_full(void **state) {
+    (void) state; /* unused */
+
+    seal_crc32_full_at(NW_BUF_LEN_LEGACY);
+    seal_crc32_full_at(NW_BUF_LEN);
+
+    nw_buff_set_limit(NW_BUF_LEN_LEGACY);
+}
+
+/* With CRC-32 negotiated the additive checksum is never computed, and the
+ * trailer always has room. */
+static void test_pack_crc32_mode(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer buffer = {0};
+    uint8_t message[NW_BUF_LEN] = {0};
+    message[3] = 33;
+
+    nw_buff_set_crc32(true);
+    mock_checksum = 0;  // Any call to checksum() fails: nothing is queued.
+    assert_int_equal(pack_nw_buff(&buffer, message, NW_BUF_LEN_LEGACY), 0);
+    assert_int_equal(
+        pack_nw_buff(&buffer, message, NW_BUF_LEN_LEGACY - NW_CRC32_LEN),
+        NW_BUF_LEN_LEGACY - NW_CRC32_LEN);
+    assert_int_equal(buffer.checksum, 0);
+    assert_int_equal(seal_nw_buff_crc32(&buffer), NW_CRC32_LEN);
+    assert_int_equal(nw_buff_len(&buffer), NW_BUF_LEN_LEGACY);
+
+    assert_int_equal(checkNWBuff(&buffer), 1);
+    assert_int_equal(buffer.length, NW_BUF_LEN_LEGACY - NW_CRC32_LEN);
+    assert_int_equal(buffer.payload[3], 33);
+    nw_buff_set_crc32(false);
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_NW_BUF_LEN_is_even),
@@ -812,6 +931,7 @@ int main(void) {
         cmocka_unit_test(test_pack_one_in_dirty_buffer),
         cmocka_unit_test(test_pack_multiple),
         cmocka_unit_test(test_pack_overflow),
+        cmocka_unit_test(test_set_limit_clamps),
         cmocka_unit_test(test_pack_overflow_aligned),
         cmocka_unit_test(test_unpack_one),
         cmocka_unit_test(test_unpack_null_accumilator),
@@ -821,7 +941,10 @@ int main(void) {
         cmocka_unit_test(test_unpack_invalid_length_off_by_one),
         cmocka_unit_test(test_unpack_overflow),
         cmocka_unit_test(test_end_to_end),
-        cmocka_unit_test(test_end_to_end_multi)
+        cmocka_unit_test(test_end_to_end_multi),
+        cmocka_unit_test(test_seal_crc32),
+        cmocka_unit_test(test_seal_crc32_full),
+        cmocka_unit_test(test_pack_crc32_mode)
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -5,6 +5,7 @@
 #include <cmocka.h>
 
 #include <stdio.h>
+#include <string.h>
 
 #include "buffer.h"
 
@@ -41,10 +42,57 @@ static void test_in_parts(void **state) {
     assert_int_equal(checksum_val, checksum_total);
 }
 
+/* The word-wise checksum() must match the byte-wise reference for every
+ * combination of start alignment, start parity and length. */
+static void test_wordwise_matches_bytewise(void **state) {
+    (void) state; /* unused */
+
+    uint8_t data[1100 + 8] __attribute__((aligned(4)));
+    uint32_t seed = 12345;
+    for(size_t index = 0; index < sizeof(data); index++) {
+        seed = seed * 1103515245 + 12345;
+        data[index] = seed >> 16;
+    }
+
+    for(size_t offset = 0; offset < 8; offset++) {
+        for(size_t pos_in = 0; pos_in < 8; pos_in++) {
+            for(size_t len = 0; len < 64; len++) {
+                assert_int_equal(
+                    checksum(0x1234, pos_in, pos_in + len, data + offset),
+                    checksum_bytewise(0x1234, pos_in, pos_in + len, data + offset));
+            }
+            // Long enough to need more than one lane flush.
+            assert_int_equal(
+                checksum(0, pos_in, 1100, data + offset),
+                checksum_bytewise(0, pos_in, 1100, data + offset));
+        }
+    }
+
+    // Worst case for the lane accumulators.
+    memset(data, 0xFF, sizeof(data));
+    assert_int_equal(checksum(0, 0, 1100, data), checksum_bytewise(0, 0, 1100, data));
+}
+
+/* Standard CRC-32 check value, computed whole and in parts. */
+static void test_crc32(void **state) {
+    (void) state; /* unused */
+
+    uint8_t data[] = "123456789";
+    assert_int_equal(crc32(0, 0, 9, data), 0xCBF43926);
+
+    uint32_t crc_val = crc32(0, 0, 4, data);
+    crc_val = crc32(crc_val, 4, 9, data);
+    assert_int_equal(crc_val, 0xCBF43926);
+
+    assert_int_equal(crc32(0, 0, 0, data), 0);
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_simple),
-        cmocka_unit_test(test_in_parts)
+        cmocka_unit_test(test_in_parts),
+        cmocka_unit_test(test_wordwise_matches_bytewise),
+        cmocka_unit_test(test_crc32)
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
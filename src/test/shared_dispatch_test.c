@@ -0,0 +1,192 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+
+#include <stdio.h>
+
+#include "buffer.h"
+#include "dispatch.h"
+
+#define TEST_FIXED    1
+#define TEST_VARIABLE 2
+#define TEST_FAIL     3
+#define TEST_TYPE_COUNT 4
+
+struct __attribute__((packed)) TestFixed {
+  uint8_t type;
+  uint8_t pad[3];
+  uint32_t value;
+};
+
+struct __attribute__((packed)) TestVariable {
+  uint8_t type;
+  uint8_t count;   // Number of trailing uint16_t.
+  uint16_t values[];
+};
+
+struct TestContext {
+  const void* views[8];
+  size_t view_count;
+};
+
+static bool record_view(const void* view, void* context) {
+  struct TestContext* ctx = context;
+  ctx->views[ctx->view_count++] = view;
+  return true;
+}
+
+static bool reject(const void* view, void* context) {
+  (void) view;
+  (void) context;
+  return false;
+}
+
+static size_t variable_length(const void* view) {
+  const struct TestVariable* message = view;
+  if(message->count > 8) {
+    return 0;
+  }
+  return sizeof(struct TestVariable) + message->count * sizeof(uint16_t);
+}
+
+static const struct NWDispatch test_dispatch[TEST_TYPE_COUNT] = {
+  [TEST_FIXED]    = NW_DISPATCH(struct TestFixed, record_view),
+  [TEST_VARIABLE] = NW_DISPATCH_VAR(sizeof(struct TestVariable), variable_length, record_view),
+  [TEST_FAIL]     = NW_DISPATCH(struct TestFixed, reject),
+};
+
+/* Handlers get pointers into the payload, not copies. */
+static void test_dispatch_views(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer buffer = {0};
+    struct TestFixed fixed = {.type = TEST_FIXED, .value = 1234};
+    uint8_t variable[sizeof(struct TestVariable) + 3 * sizeof(uint16_t)] = {TEST_VARIABLE, 3};
+    pack_nw_buff(&buffer, &fixed, sizeof(fixed));
+    pack_nw_buff(&buffer, variable, sizeof(variable));
+    pack_nw_buff(&buffer, &fixed, sizeof(fixed));
+
+    struct TestContext context = {0};
+    size_t offset = 0;
+    size_t handled = 0;
+    enum NWDispatchResult result = nw_dispatch(
+        &buffer, test_dispatch, TEST_TYPE_COUNT, &context, &offset, &handled);
+
+    assert_int_equal(result, NW_DISPATCH_OK);
+    assert_int_equal(handled, 3);
+    assert_int_equal(offset, buffer.length);
+    assert_true(context.views[0] == buffer.payload);
+    assert_true(context.views[1] == buffer.payload + 8);
+    assert_true(context.views[2] == buffer.payload + 8 + 8);
+    assert_int_equal(((const struct TestFixed*)context.views[2])->value, 1234);
+    for(size_t i = 0; i < context.view_count; i++) {
+        assert_int_equal((uintptr_t)context.views[i] % NW_VIEW_ALIGN, 0);
+    }
+}
+
+/* Unknown type stops dispatch with offset at the offending message. */
+static void test_dispatch_unknown_type(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer buffer = {0};
+    struct TestFixed fixed = {.type = TEST_FIXED};
+    struct TestFixed unknown = {.type = TEST_TYPE_COUNT};
+    pack_nw_buff(&buffer, &fixed, sizeof(fixed));
+    pack_nw_buff(&buffer, &unknown, sizeof(unknown));
+
+    struct TestContext context = {0};
+    size_t offset = 0;
+    size_t handled = 0;
+    assert_int_equal(
+        nw_dispatch(&buffer, test_dispatch, TEST_TYPE_COUNT, &context, &offset, &handled),
+        NW_DISPATCH_UNKNOWN_TYPE);
+    assert_int_equal(handled, 1);
+    assert_int_equal(offset, aligned32(sizeof(fixed)));
+}
+
+/* Messages that overrun the data, or whose header gives a bad length, are
+ * not passed to the handler. */
+static void test_dispatch_truncated_and_invalid(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer buffer = {0};
+    struct TestContext context = {0};
+    size_t offset = 0;
+    size_t handled = 0;
+
+    uint8_t variable[2] = {TEST_VARIABLE, 4};  // Claims 8 bytes of values; has none.
+    pack_nw_buff(&buffer, variable, sizeof(variable));
+    assert_int_equal(
+        nw_dispatch(&buffer, test_dispatch, TEST_TYPE_COUNT, &context, &offset, &handled),
+        NW_DISPATCH_TRUNCATED);
+
+    reset_nw_buf(&buffer);
+    variable[1] = 9;  // More than variable_length() allows.
+    pack_nw_buff(&buffer, variable, sizeof(variable));
+    assert_int_equal(
+        nw_dispatch(&buffer, test_dispatch, TEST_TYPE_COUNT, &context, &offset, &handled),
+        NW_DISPATCH_INVALID);
+
+    reset_nw_buf(&buffer);
+    uint8_t fixed_type = TEST_FIXED;  // Fixed message with only the type byte.
+    pack_nw_buff(&buffer, &fixed_type, sizeof(fixed_type));
+    assert_int_equal(
+        nw_dispatch(&buffer, test_dispatch, TEST_TYPE_COUNT, &context, &offset, &handled),
+        NW_DISPATCH_TRUNCATED);
+
+    assert_int_equal(handled, 0);
+    assert_int_equal(context.view_count, 0);
+    assert_int_equal(offset, 0);
+}
+
+static void test_dispatch_handler_failed(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer buffer = {0};
+    struct TestFixed message = {.type = TEST_FAIL};
+    pack_nw_buff(&buffer, &message, sizeof(message));
+
+    struct TestContext context = {0};
+    size_t offset = 0;
+    size_t handled = 0;
+    assert_int_equal(
+        nw_dispatch(&buffer, test_dispatch, TEST_TYPE_COUNT, &context, &offset, &handled),
+        NW_DISPATCH_HANDLER_FAILED);
+    assert_int_equal(handled, 0);
+    assert_int_equal(offset, 0);
+}
+
+/* A zero type byte ends the message list. */
+static void test_dispatch_zero_terminates(void **state) {
+    (void) state; /* unused */
+
+    struct NWBuffer buffer = {0};
+    struct TestFixed message = {.type = TEST_FIXED};
+    struct TestFixed none = {0};
+    pack_nw_buff(&buffer, &message, sizeof(message));
+    pack_nw_buff(&buffer, &none, sizeof(none));
+    pack_nw_buff(&buffer, &message, sizeof(message));
+
+    struct TestContext context = {0};
+    size_t offset = 0;
+    size_t handled = 0;
+    assert_int_equal(
+        nw_dispatch(&buffer, test_dispatch, TEST_TYPE_COUNT, &context, &offset, &handled),
+        NW_DISPATCH_OK);
+    assert_int_equal(handled, 1);
+    assert_int_equal(offset, aligned32(sizeof(message)));
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_dispatch_views),
+        cmocka_unit_test(test_dispatch_unknown_type),
+        cmocka_unit_test(test_dispatch_truncated_and_invalid),
+        cmocka_unit_test(test_dispatch_handler_failed),
+        cmocka_unit_test(test_dispatch_zero_terminates)
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
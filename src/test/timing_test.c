@@ -354,6 +354,48 @@ static void test_recover_clock__skips_ema_on_negative_id_diff(void **state) {
     assert_int_equal(count_before, update_period_call_count);
 }
 
+/* ---- Tick sync tests ---- */
+
+/* A target puts the tick on the grid of periods through it, at the first
+ * point after the packet, instead of at arrival + period/4. */
+static void test_recover_clock__target_sets_tick_phase(void **state) {
+    (void) state;
+    timing_init();      /* t=0, tick scheduled at 250 */
+    int32_t error_us;
+    assert_false(timing_take_phase_error(&error_us));
+
+    /* time_now=1000. 100 + 3 periods back is on the same grid as 1100. */
+    timing_set_target(100 - 3000 + 10000000);
+    recover_clock();
+    assert_int_equal(captured_alarm_time._private_us_since_boot, 1100);
+}
+
+/* The phase error is how far the free running tick was from the target,
+ * wrapped to ±period/2, and is reported once. */
+static void test_recover_clock__target_reports_phase_error(void **state) {
+    (void) state;
+    timing_init();      /* tick grid 250 + k*1000 */
+
+    timing_set_target(1240);            /* time_now=1000, tick was due at 1250 */
+    recover_clock();
+    int32_t error_us;
+    assert_true(timing_take_phase_error(&error_us));
+    assert_int_equal(error_us, 10);     /* late by 10 µs */
+    assert_false(timing_take_phase_error(&error_us));
+    assert_int_equal(captured_alarm_time._private_us_since_boot, 1240);
+
+    timing_set_target(2260 + 5000);     /* time_now=2000, grid 1240 + k*1000 */
+    recover_clock();
+    assert_true(timing_take_phase_error(&error_us));
+    assert_int_equal(error_us, -20);    /* early by 20 µs */
+    assert_int_equal(captured_alarm_time._private_us_since_boot, 2260);
+
+    /* Without a target the tick returns to arrival + period/4. */
+    recover_clock();                    /* time_now=3000 */
+    assert_false(timing_take_phase_error(&error_us));
+    assert_int_equal(captured_alarm_time._private_us_since_boot, 3250);
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test_setup(test_timing_init__registers_callback, setup),
@@ -372,6 +414,8 @@ int main(void) {
         cmocka_unit_test_setup(test_recover_clock__skips_ema_on_zero_id_diff, setup),
         cmocka_unit_test_setup(test_recover_clock__update_period_tracks_ema_not_every_packet, setup),
         cmocka_unit_test_setup(test_recover_clock__skips_ema_on_negative_id_diff, setup),
+        cmocka_unit_test_setup(test_recover_clock__target_sets_tick_phase, setup),
+        cmocka_unit_test_setup(test_recover_clock__target_reports_phase_error, setup),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,135 @@
+/* Replay the RX side of a packet capture through the driver's process_data().
+ *
+ *   replayDriver [-n passes] [-v] capture.rpc
+ *
+ * Each board's replies are unpacked into its own skeleton_t, in the order
+ * they were received, starting from the state of a freshly loaded driver.
+ * -v prints every record and the joint feedback it produced.
+ * -n replays the capture that many times and reports the unpack time, to
+ * benchmark the codec against real traffic. */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../driver/rp2040_network.c"
+
+#include "tool_pins.h"
+
+struct ReplayBoard {
+  skeleton_t data;
+  struct Message_joint_config last_joint_config[MAX_JOINT];
+  struct Message_gpio_config last_gpio_config[MAX_GPIO];
+  struct Message_spindle_config last_spindle_config[MAX_SPINDLE];
+};
+
+static struct ReplayBoard boards[MAX_DEVICES];
+
+static void reset_boards(void) {
+  memset(boards, 0, sizeof(boards));
+  for(size_t device = 0; device < MAX_DEVICES; device++) {
+    setup_pins(&boards[device].data, device);
+    select_device(device);
+    reset_version_check();
+  }
+}
+
+static void print_feedback(const skeleton_t* data) {
+  printf("   pos_fb");
+  for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+    printf(" %.0f", *data->joint_pos_fb[joint]);
+  }
+  printf("  seq_in %u\n", *data->seq_in);
+}
+
+int main(int argc, char** argv) {
+  int passes = 1;
+  bool verbose = false;
+  int option;
+  while((option = getopt(argc, argv, "n:v")) != -1) {
+    switch(option) {
+      case 'n':
+        passes = atoi(optarg);
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n passes] [-v] capture.rpc\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if(optind >= argc || passes < 1) {
+    fprintf(stderr, "usage: %s [-n passes] [-v] capture.rpc\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int fd = open(argv[optind], O_RDONLY);
+  if(fd < 0) {
+    perror(argv[optind]);
+    return EXIT_FAILURE;
+  }
+  size_t size = lseek(fd, 0, SEEK_END);
+  struct CaptureFileHeader* header = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(header == MAP_FAILED || !capture_file_valid(header, size)) {
+    fprintf(stderr, "%s: not a capture file from this version\n", argv[optind]);
+    return EXIT_FAILURE;
+  }
+
+  uint64_t first = capture_file_first(header);
+  printf("%s: %lu records, %u dropped%s\n", argv[optind],
+         (unsigned long)(header->written - first), header->dropped,
+         first > 0 ? ", oldest overwritten" : "");
+
+  size_t packets = 0;
+  size_t messages = 0;
+  size_t rejected = 0;
+  uint64_t elapsed_ns = 0;
+  for(int pass = 0; pass < passes; pass++) {
+    reset_boards();
+    packets = messages = rejected = 0;
+    uint64_t start_ns = host_time_ns();
+    for(uint64_t index = first; index < header->written; index++) {
+      const struct CaptureRecord* record = capture_file_record(header, index);
+      if(record->direction != CAPTURE_RX || record->device >= MAX_DEVICES
+          || record->length > sizeof(struct NWBuffer)) {
+        continue;
+      }
+      struct ReplayBoard* board = &boards[record->device];
+      struct NWBuffer packet;
+      memcpy(&packet, &record->packet, record->length);
+      size_t received_count = 0;
+
+      select_device(record->device);
+      process_data(&packet, &board->data, &received_count, record->length,
+                   board->last_joint_config, board->last_gpio_config,
+                   board->last_spindle_config);
+      packets++;
+      messages += received_count;
+      rejected += received_count == 0;
+
+      if(verbose && pass == 0) {
+        printf("%6lu %12.3fms dev %u seq_out %-8u len %-5u msgs %lu\n",
+               (unsigned long)index,
+               (record->time_ns - capture_file_record(header, first)->time_ns) / 1e6,
+               record->device, record->seq_out, record->length,
+               (unsigned long)received_count);
+        print_feedback(&board->data);
+      }
+    }
+    elapsed_ns += host_time_ns() - start_ns;
+  }
+
+  printf("RX packets %lu  messages %lu  rejected %lu\n",
+         (unsigned long)packets, (unsigned long)messages, (unsigned long)rejected);
+  if(packets > 0) {
+    printf("unpack %.1f ns/packet over %d pass(es)\n",
+           (double)elapsed_ns / ((double)packets * passes), passes);
+  }
+  munmap(header, size);
+  return rejected == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
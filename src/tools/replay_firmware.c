@@ -0,0 +1,127 @@
+/* Replay the TX side of a packet capture through the firmware's
+ * process_received_buffer(), as core0 would have received it.
+ *
+ *   replayFirmware [-d board] [-n passes] [-v] capture.rpc
+ *
+ * The firmware holds the state of a single RP2040, so only the packets sent
+ * to one board (-d, default 0) are replayed. Time is frozen at 0 by the host
+ * mocks, which makes a replay repeatable.
+ * -v prints every record and the bytes of reply it produced.
+ * -n replays the capture that many times and reports the unpack time, to
+ * benchmark the codec against real traffic. */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "core0.h"
+#include "../driver/rp2040_capture.h"
+
+static uint64_t wall_time_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-d board] [-n passes] [-v] capture.rpc\n", name);
+}
+
+int main(int argc, char** argv) {
+  int device = 0;
+  int passes = 1;
+  bool verbose = false;
+  int option;
+  while((option = getopt(argc, argv, "d:n:v")) != -1) {
+    switch(option) {
+      case 'd':
+        device = atoi(optarg);
+        break;
+      case 'n':
+        passes = atoi(optarg);
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if(optind >= argc || passes < 1) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int fd = open(argv[optind], O_RDONLY);
+  if(fd < 0) {
+    perror(argv[optind]);
+    return EXIT_FAILURE;
+  }
+  size_t size = lseek(fd, 0, SEEK_END);
+  struct CaptureFileHeader* header = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(header == MAP_FAILED || !capture_file_valid(header, size)) {
+    fprintf(stderr, "%s: not a capture file from this version\n", argv[optind]);
+    return EXIT_FAILURE;
+  }
+
+  uint64_t first = capture_file_first(header);
+  printf("%s: %lu records, %u dropped%s\n", argv[optind],
+         (unsigned long)(header->written - first), header->dropped,
+         first > 0 ? ", oldest overwritten" : "");
+
+  size_t packets = 0;
+  size_t messages = 0;
+  size_t rejected = 0;
+  size_t reply_bytes = 0;
+  uint64_t elapsed_ns = 0;
+  for(int pass = 0; pass < passes; pass++) {
+    packets = messages = rejected = reply_bytes = 0;
+    uint64_t start_ns = wall_time_ns();
+    for(uint64_t index = first; index < header->written; index++) {
+      const struct CaptureRecord* record = capture_file_record(header, index);
+      if(record->direction != CAPTURE_TX || record->device != device
+          || record->length > sizeof(struct NWBuffer)) {
+        continue;
+      }
+      struct NWBuffer rx_buf;
+      struct NWBuffer tx_buf;
+      memcpy(&rx_buf, &record->packet, record->length);
+      reset_nw_buf(&tx_buf);
+      size_t received_count = 0;
+
+      process_received_buffer(&rx_buf, &tx_buf, &received_count, record->length);
+      packets++;
+      messages += received_count;
+      rejected += received_count == 0;
+      reply_bytes += nw_buff_len(&tx_buf);
+
+      if(verbose && pass == 0) {
+        printf("%6lu %12.3fms seq_out %-8u len %-5u msgs %-3lu reply %u bytes\n",
+               (unsigned long)index,
+               (record->time_ns - capture_file_record(header, first)->time_ns) / 1e6,
+               record->seq_out, record->length,
+               (unsigned long)received_count, (unsigned)nw_buff_len(&tx_buf));
+      }
+    }
+    elapsed_ns += wall_time_ns() - start_ns;
+  }
+
+  printf("TX packets %lu  messages %lu  rejected %lu  reply bytes %lu\n",
+         (unsigned long)packets, (unsigned long)messages, (unsigned long)rejected,
+         (unsigned long)reply_bytes);
+  if(packets > 0) {
+    printf("unpack %.1f ns/packet over %d pass(es)\n",
+           (double)elapsed_ns / ((double)packets * passes), passes);
+  }
+  munmap(header, size);
+  return rejected == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,373 @@
+/* Host simulator of the RP2040 firmware.
+ *
+ *   rp2040Sim [-a address] [-t seconds] [-i seconds]
+ *
+ * Runs the firmware built with BUILD_TESTS as a Linux process: core0_main() on
+ * the main thread, core1_main() on a second, the tick alarm on a third, and the
+ * W5500 socket replaced by a UDP socket on address:5002 (default 127.0.0.2, so
+ * the unmodified driver on the same host can talk to it with ip=127.0.0.2).
+ * Steps are counted by the model of the PIO programs in sim_pio.c.
+ *
+ * Reports packets and bytes each way and the turnaround from a packet being
+ * received to its reply being sent, every -i seconds and on exit. -t stops
+ * after that many seconds; SIGINT stops at once.
+ *
+ * Linked with the host mocks; the calls below replace the mocks that have to
+ * behave like the hardware, using --wrap like the tests do. */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "core1.h"
+#include "buffer.h"
+#include "../test/mocks/rp_mocks.h"
+#include "../driver/rp2040_histogram.h"
+#include "sim.h"
+
+void core0_main();
+
+#define SIM_RECEIVE_POLL_MS 1
+
+static uint64_t boot_ns = 0;
+
+static uint64_t monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+uint64_t sim_time_ns(void) {
+  return monotonic_ns() - boot_ns;
+}
+
+uint64_t __wrap_time_us_64(void) {
+  return sim_time_ns() / 1000;
+}
+
+
+/* ---- Cores ---- */
+
+static pthread_t core1_thread;
+
+static void* core1_entry(void* entry) {
+  ((void(*)(void))entry)();
+  return NULL;
+}
+
+void __wrap_multicore_launch_core1(void(*entry)(void)) {
+  if(pthread_create(&core1_thread, NULL, core1_entry, (void*)entry) != 0) {
+    perror("core1");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* The SDK mutex, as a spinlock in the mock's mutex_t. */
+void __wrap_mutex_init(mutex_t *mtx) {
+  __atomic_store_n(mtx, 0, __ATOMIC_RELEASE);
+}
+
+void __wrap_mutex_enter_blocking(mutex_t *mtx) {
+  while(__atomic_exchange_n(mtx, 1, __ATOMIC_ACQUIRE)) {
+  }
+}
+
+void __wrap_mutex_exit(mutex_t *mtx) {
+  __atomic_store_n(mtx, 0, __ATOMIC_RELEASE);
+}
+
+
+/* ---- Alarm ----
+ * One alarm at a time, which is all timing.c uses: recover_clock() cancels the
+ * tick alarm before adding the next. The callback runs on the alarm thread, as
+ * it would in the timer IRQ. */
+
+static pthread_mutex_t alarm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  alarm_changed;
+static pthread_t       alarm_thread;
+static struct {
+  bool armed;
+  alarm_id_t id;
+  uint64_t at_us;
+  alarm_callback_t callback;
+  void* user_data;
+} alarm_state;
+
+static void* alarm_loop(void* arg) {
+  (void)arg;
+  pthread_mutex_lock(&alarm_lock);
+  for(;;) {
+    if(!alarm_state.armed) {
+      pthread_cond_wait(&alarm_changed, &alarm_lock);
+      continue;
+    }
+    uint64_t at_ns = boot_ns + alarm_state.at_us * 1000;
+    if(monotonic_ns() < at_ns) {
+      struct timespec until = {.tv_sec = at_ns / 1000000000, .tv_nsec = at_ns % 1000000000};
+      pthread_cond_timedwait(&alarm_changed, &alarm_lock, &until);
+      continue;
+    }
+
+    alarm_id_t id = alarm_state.id;
+    uint64_t at_us = alarm_state.at_us;
+    alarm_callback_t callback = alarm_state.callback;
+    void* user_data = alarm_state.user_data;
+    pthread_mutex_unlock(&alarm_lock);
+    int64_t again_us = callback(id, user_data);
+    pthread_mutex_lock(&alarm_lock);
+
+    /* Unless it was cancelled or replaced meanwhile: negative reschedules
+     * from when it was due, positive from now. */
+    if(alarm_state.armed && alarm_state.id == id) {
+      if(again_us < 0) {
+        alarm_state.at_us = at_us - again_us;
+      } else if(again_us > 0) {
+        alarm_state.at_us = __wrap_time_us_64() + again_us;
+      } else {
+        alarm_state.armed = false;
+      }
+    }
+  }
+  return NULL;
+}
+
+alarm_id_t __wrap_add_alarm_at(absolute_time_t time, alarm_callback_t callback,
+                               void *user_data, bool fire_if_past) {
+  (void)fire_if_past;
+  pthread_mutex_lock(&alarm_lock);
+  alarm_state.armed = true;
+  alarm_state.id++;
+  alarm_state.at_us = time._private_us_since_boot;
+  alarm_state.callback = callback;
+  alarm_state.user_data = user_data;
+  alarm_id_t id = alarm_state.id;
+  pthread_cond_signal(&alarm_changed);
+  pthread_mutex_unlock(&alarm_lock);
+  return id;
+}
+
+bool __wrap_cancel_alarm(alarm_id_t alarm_id) {
+  pthread_mutex_lock(&alarm_lock);
+  bool cancelled = alarm_state.armed && alarm_state.id == alarm_id;
+  if(cancelled) {
+    alarm_state.armed = false;
+    pthread_cond_signal(&alarm_changed);
+  }
+  pthread_mutex_unlock(&alarm_lock);
+  return cancelled;
+}
+
+static void start_alarm_thread(void) {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&alarm_changed, &attr);
+  pthread_condattr_destroy(&attr);
+  if(pthread_create(&alarm_thread, NULL, alarm_loop, NULL) != 0) {
+    perror("alarm");
+    exit(EXIT_FAILURE);
+  }
+}
+
+
+/* ---- Network ----
+ * get_UDP() and put_UDP() from network.c over a host UDP socket. */
+
+static const char* sim_address = "127.0.0.2";
+static int sim_socket = -1;
+
+struct SimStats {
+  uint64_t rx_packets;
+  uint64_t rx_bytes;
+  uint64_t tx_packets;
+  uint64_t tx_bytes;
+  struct Histogram turnaround_ns;
+};
+
+static struct SimStats interval_stats;
+static struct SimStats total_stats;
+static uint64_t last_rx_ns = 0;
+
+static volatile sig_atomic_t stop_requested = 0;
+static uint64_t stop_at_ns = 0;          // 0 = run until SIGINT.
+static uint64_t report_every_ns = 0;     // 0 = only on exit.
+static uint64_t next_report_ns = 0;
+
+static void open_socket(uint16_t port) {
+  sim_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if(sim_socket < 0) {
+    perror("socket");
+    exit(EXIT_FAILURE);
+  }
+  /* The driver binds INADDR_ANY on the same port; both need this. */
+  int option = 1;
+  setsockopt(sim_socket, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+
+  struct sockaddr_in local = {0};
+  local.sin_family = AF_INET;
+  local.sin_port = htons(port);
+  if(inet_pton(AF_INET, sim_address, &local.sin_addr) != 1) {
+    fprintf(stderr, "Bad address: %s\n", sim_address);
+    exit(EXIT_FAILURE);
+  }
+  if(bind(sim_socket, (struct sockaddr*)&local, sizeof(local)) != 0) {
+    perror(sim_address);
+    exit(EXIT_FAILURE);
+  }
+  printf("Simulated RP2040 listening on %s:%u\n", sim_address, port);
+}
+
+static void print_stats(const char* label, const struct SimStats* stats, double seconds) {
+  static const uint32_t permille[] = {500, 990};
+  uint32_t turnaround[2];
+  histogram_percentiles(&stats->turnaround_ns, permille, turnaround, 2);
+  printf("%s: rx %lu pkt %.0f pkt/s %.1f kB/s  tx %lu pkt %.1f kB/s  "
+         "turnaround p50 %.1fus p99 %.1fus max %.1fus\n",
+         label,
+         (unsigned long)stats->rx_packets, stats->rx_packets / seconds,
+         stats->rx_bytes / seconds / 1000,
+         (unsigned long)stats->tx_packets, stats->tx_bytes / seconds / 1000,
+         turnaround[0] / 1000.0, turnaround[1] / 1000.0,
+         stats->turnaround_ns.max / 1000.0);
+  fflush(stdout);
+}
+
+/* Reports due at now, and exits if it is time to stop. */
+static void poll_reports(uint64_t now) {
+  if(report_every_ns > 0 && now >= next_report_ns) {
+    print_stats("interval", &interval_stats, report_every_ns / 1e9);
+    memset(&interval_stats, 0, sizeof(interval_stats));
+    next_report_ns += report_every_ns;
+  }
+  if(stop_requested || (stop_at_ns > 0 && now >= stop_at_ns)) {
+    print_stats("total", &total_stats, now / 1e9);
+    exit(EXIT_SUCCESS);
+  }
+}
+
+int32_t get_UDP(
+    uint8_t socket_num,
+    uint16_t port,
+    struct NWBuffer* rx_buf,
+    size_t* data_received,
+    uint8_t* destip,
+    uint16_t* destport)
+{
+  (void)socket_num;
+  if(sim_socket < 0) {
+    open_socket(port);
+  }
+  poll_reports(sim_time_ns());
+
+  struct pollfd readable = {.fd = sim_socket, .events = POLLIN};
+  if(poll(&readable, 1, SIM_RECEIVE_POLL_MS) <= 0) {
+    return 0;
+  }
+  struct sockaddr_in from;
+  socklen_t from_len = sizeof(from);
+  ssize_t count = recvfrom(sim_socket, rx_buf, sizeof(*rx_buf), MSG_DONTWAIT,
+                           (struct sockaddr*)&from, &from_len);
+  if(count <= 0) {
+    return 0;
+  }
+  last_rx_ns = sim_time_ns();
+  memcpy(destip, &from.sin_addr.s_addr, 4);
+  *destport = ntohs(from.sin_port);
+  *data_received += count;
+
+  interval_stats.rx_packets++;
+  interval_stats.rx_bytes += count;
+  total_stats.rx_packets++;
+  total_stats.rx_bytes += count;
+  return count;
+}
+
+int32_t put_UDP(
+    uint8_t socket_num,
+    uint16_t port,
+    void* tx_buf,
+    size_t tx_buf_len,
+    uint8_t* destip,
+    uint16_t* destport)
+{
+  (void)socket_num; (void)port;
+  struct sockaddr_in to = {0};
+  to.sin_family = AF_INET;
+  to.sin_port = htons(*destport);
+  memcpy(&to.sin_addr.s_addr, destip, 4);
+  ssize_t count = sendto(sim_socket, tx_buf, tx_buf_len, 0, (struct sockaddr*)&to, sizeof(to));
+  if(count < 0) {
+    return -errno;
+  }
+
+  uint64_t turnaround = sim_time_ns() - last_rx_ns;
+  histogram_add(&interval_stats.turnaround_ns, (uint32_t)turnaround);
+  histogram_add(&total_stats.turnaround_ns, (uint32_t)turnaround);
+  interval_stats.tx_packets++;
+  interval_stats.tx_bytes += count;
+  total_stats.tx_packets++;
+  total_stats.tx_bytes += count;
+  return 1;
+}
+
+
+/* ---- Main ---- */
+
+static void on_sigint(int signal) {
+  (void)signal;
+  stop_requested = 1;
+}
+
+static void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-a address] [-t seconds] [-i seconds]\n", name);
+}
+
+int main(int argc, char** argv) {
+  int option;
+  while((option = getopt(argc, argv, "a:t:i:")) != -1) {
+    switch(option) {
+      case 'a':
+        sim_address = optarg;
+        break;
+      case 't':
+        stop_at_ns = (uint64_t)(atof(optarg) * 1e9);
+        break;
+      case 'i':
+        report_every_ns = (uint64_t)(atof(optarg) * 1e9);
+        next_report_ns = report_every_ns;
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if(optind != argc) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  boot_ns = monotonic_ns();
+  signal(SIGINT, on_sigint);
+  signal(SIGTERM, on_sigint);
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  start_alarm_thread();
+  sim_pio_init();
+  init_config();
+  init_core1();
+  core0_main();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,14 @@
+#ifndef SIM__H
+#define SIM__H
+
+#include <stdint.h>
+
+/* Host simulator of the RP2040 firmware. See rp2040_sim.c. */
+
+/* Nanoseconds since the simulated board booted. */
+uint64_t sim_time_ns(void);
+
+/* Give pio0 and pio1 distinct values before Core1 starts. */
+void sim_pio_init(void);
+
+#endif  // SIM__H
@@ -0,0 +1,194 @@
+/* Thin servo thread for exercising a board, real or simulated, with the
+ * driver's own networking code and no LinuxCNC.
+ *
+ *   simClient [-a address] [-n cycles] [-p period_us] [-j joints] [-v steps_per_s] [-s]
+ *
+ * Calls eth_state_update_boards() every period as write_port() would. Once the
+ * board is up and configured it enables the joints and jogs them at -v for
+ * the rest of the -n cycles, then holds them still. Prints the driver's own
+ * timing histograms at the end and exits non-zero if the board never came up
+ * or its feedback did not settle on the final command within
+ * CLIENT_SETTLE_US. That does not depend on how promptly this process is
+ * scheduled.
+ *
+ * With -s it also fails if feedback fell behind the jog for more than
+ * CLIENT_LAG_RUN cycles in a row. Cycles that woke over a period late, and the
+ * few after them, are not checked: that lag is the host's, not the board's.
+ * This is a wall clock test, so run it on an otherwise idle host.
+ *
+ * With rp2040Sim running on the same host (default address 127.0.0.2) this
+ * tests the whole stack end to end. */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../driver/rp2040_network.c"
+#include "../driver/rp2040_eth_state.c"
+
+#include "tool_pins.h"
+
+/* How far feedback may trail the command, in servo periods of travel, for
+ * the run to pass. */
+#define CLIENT_LAG_PERIODS 8
+/* Consecutive cycles allowed over that before a -s run fails. */
+#define CLIENT_LAG_RUN 3
+/* How long the held joints get to come within a step of the command. */
+#define CLIENT_SETTLE_US 3000000
+
+static void sleep_until(uint64_t at_ns) {
+  struct timespec until = {.tv_sec = at_ns / 1000000000, .tv_nsec = at_ns % 1000000000};
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) != 0) {
+  }
+}
+
+static void print_histogram(const char* name, const struct Histogram* hist) {
+  static const uint32_t permille[] = {500, 990};
+  uint32_t values[2];
+  histogram_percentiles(hist, permille, values, 2);
+  printf("  %-10s p50 %8.1fus  p99 %8.1fus  max %8.1fus\n",
+         name, values[0] / 1000.0, values[1] / 1000.0, hist->max / 1000.0);
+}
+
+static void usage(const char* name) {
+  fprintf(stderr,
+      "usage: %s [-a address] [-n cycles] [-p period_us] [-j joints] [-v steps_per_s] [-s]\n",
+      name);
+}
+
+int main(int argc, char** argv) {
+  const char* address = "127.0.0.2";
+  long cycles = 5000;
+  long period_us = 1000;
+  int joints = MAX_JOINT;
+  double velocity = 2000.0;
+  bool strict = false;
+  int option;
+  while((option = getopt(argc, argv, "a:n:p:j:v:s")) != -1) {
+    switch(option) {
+      case 'a': address = optarg; break;
+      case 'n': cycles = atol(optarg); break;
+      case 'p': period_us = atol(optarg); break;
+      case 'j': joints = atoi(optarg); break;
+      case 'v': velocity = atof(optarg); break;
+      case 's': strict = true; break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if(optind != argc || cycles < 1 || period_us < 1 || joints < 1 || joints > MAX_JOINT) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  skeleton_t data;
+  setup_pins(&data, 0);
+  for(int joint = 0; joint < joints; joint++) {
+    data.joint_gpio_step[joint] = 2 * joint;
+    data.joint_gpio_dir[joint] = 2 * joint + 1;
+    *data.joint_vel_limit[joint] = 4 * fabs(velocity) + 1000;
+    *data.joint_accel_limit[joint] = 100 * (fabs(velocity) + 1000);
+  }
+
+  if(init_eth(0, address) < 0) {
+    fprintf(stderr, "Could not open a socket to %s\n", address);
+    return EXIT_FAILURE;
+  }
+  eth_state_reset();
+
+  int board_joints[MAX_DEVICES] = {joints};
+  long enabled_at = -1;
+  double worst_lag = 0.0;
+  double allowed_lag = CLIENT_LAG_PERIODS * fabs(velocity) * period_us * 1e-6 + 2;
+  long checked = 0;
+  long lagging = 0;
+  long lag_run = 0;
+  long worst_run = 0;
+  long stalled = 0;
+  long settle_until = -1;
+  long settled_at = -1;
+  long settle_cycles = CLIENT_SETTLE_US / period_us;
+  uint64_t next_ns = host_time_ns();
+  long count;
+  for(count = 0; count < cycles + settle_cycles && settled_at < 0; count++) {
+    bool jogging = count < cycles;
+    next_ns += period_us * 1000;
+    sleep_until(next_ns);
+    if(host_time_ns() - next_ns > (uint64_t)period_us * 1000) {
+      /* Woke late, so the board was left without commands for a while.
+       * Give feedback a few periods to catch up again. */
+      settle_until = count + CLIENT_LAG_PERIODS;
+      stalled++;
+    }
+
+    data.period_ns = period_us * 1000;
+    eth_state_update_boards(&data, 1, count, (uint32_t)host_time_ns(), board_joints);
+
+    if(enabled_at < 0 && *data.eth_up && *data.config_complete) {
+      enabled_at = count;
+      printf("Board up and configured after %ld cycles\n", count);
+    }
+    if(!jogging && enabled_at < 0) {
+      break;
+    }
+    bool lagged = false;
+    bool settled = !jogging;
+    bool check = jogging && enabled_at >= 0 && count - enabled_at > 1000000 / period_us
+                 && count > settle_until;
+    for(int joint = 0; joint < joints; joint++) {
+      if(enabled_at < 0) {
+        /* As update_board_pins(): track the board until enabled. */
+        *data.joint_pos_cmd[joint] = *data.joint_pos_fb[joint];
+        continue;
+      }
+      *data.joint_enable_cmd[joint] = true;
+      *data.joint_vel_cmd[joint] = jogging ? velocity : 0.0;
+      if(jogging) {
+        *data.joint_pos_cmd[joint] += velocity * period_us * 1e-6;
+      }
+      double lag = fabs(*data.joint_pos_cmd[joint] - *data.joint_pos_fb[joint]);
+      settled &= lag <= 1.0;
+      /* Allow the acceleration ramp and one round trip to settle first. */
+      if(check) {
+        worst_lag = lag > worst_lag ? lag : worst_lag;
+        lagged |= lag > allowed_lag;
+      }
+    }
+    if(settled) {
+      settled_at = count;
+    }
+    if(check) {
+      checked++;
+      lagging += lagged;
+      lag_run = lagged ? lag_run + 1 : 0;
+      worst_run = lag_run > worst_run ? lag_run : worst_run;
+    }
+  }
+
+  printf("%ld cycles of %ldus: eth-up %d config-complete %d rx-miss-count %u\n",
+         cycles, period_us, *data.eth_up, *data.config_complete, *data.rx_miss_count);
+  printf("  joint 0 cmd %.0f fb %.0f steps, worst lag %.1f steps, %ld of %ld over %.1f\n",
+         *data.joint_pos_cmd[0], *data.joint_pos_fb[0], worst_lag,
+         lagging, checked, allowed_lag);
+  printf("  longest lagging run %ld cycles, %ld host stalls skipped\n", worst_run, stalled);
+  if(settled_at >= 0) {
+    printf("  settled within a step %ld cycles after the jog\n", settled_at - cycles);
+  } else {
+    printf("  did not settle within %ldus of the jog\n", (long)CLIENT_SETTLE_US);
+  }
+  print_histogram("send", &data.hist[HIST_SEND]);
+  print_histogram("receive", &data.hist[HIST_RECEIVE]);
+  print_histogram("unpack", &data.hist[HIST_UNPACK]);
+  print_histogram("round-trip", &data.hist[HIST_ROUND_TRIP]);
+
+  if(enabled_at < 0 || !*data.eth_up || checked == 0 || settled_at < 0
+     || (strict && worst_run > CLIENT_LAG_RUN)) {
+    printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  printf("PASS\n");
+  return EXIT_SUCCESS;
+}
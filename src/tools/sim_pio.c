@@ -0,0 +1,151 @@
+/* Behavioural model of the step_gen and step_count PIO programs in
+ * pico_stepper.pio, for the host simulator. Replaces mocks/pio_mocks.c.
+ *
+ * A step_gen SM holds the last word put to it and is advanced lazily: each
+ * time it is touched, the steps its step length would have produced at
+ * 133MHz since it was last touched are added to its position. A step_count
+ * SM reports the position of the step_gen SM driving the same step pin.
+ * All calls come from Core1.
+ *
+ * mocks/pio_emulator.c runs the real programs cycle by cycle, but is far too
+ * slow to keep up with a servo thread; this model is checked against it by
+ * the step timing tests in rp_pio_program_test.c. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pio.h"
+#include "sim.h"
+
+#define SIM_PIO_COUNT         2
+#define SIM_SM_COUNT          4
+
+struct SimStepGen {
+  bool     enabled;
+  size_t   pin_step;
+  uint32_t word;          // Last TX FIFO word: step length << 1 | direction.
+  uint64_t cycles_at;     // PIO clock when position was last brought up to date.
+  uint64_t cycles_spare;  // Part way through a step at cycles_at.
+  int32_t  position;
+};
+
+struct SimStepCount {
+  bool   enabled;
+  size_t pin_step;
+};
+
+enum SimSmProgram { SM_UNUSED, SM_STEP_GEN, SM_STEP_COUNT };
+
+static enum SimSmProgram   program[SIM_PIO_COUNT][SIM_SM_COUNT];
+static struct SimStepGen   step_gen[SIM_PIO_COUNT][SIM_SM_COUNT];
+static struct SimStepCount step_count[SIM_PIO_COUNT][SIM_SM_COUNT];
+static int                 claimed[SIM_PIO_COUNT];
+
+/* Defined by pio_mocks.h in pio.c, where both are otherwise 0. */
+extern size_t pio0;
+extern size_t pio1;
+
+void sim_pio_init(void) {
+  pio0 = 0;
+  pio1 = 1;
+}
+
+static uint64_t pio_cycles(void) {
+  return sim_time_ns() * RP2040_CLOCK_MHZ / 1000;
+}
+
+static void advance(struct SimStepGen* gen) {
+  uint64_t now = pio_cycles();
+  uint32_t step_len = gen->word >> 1;
+  if(step_len > 0 && gen->enabled) {
+    uint64_t step_period = 2 * ((uint64_t)step_len + STEP_PIO_LEN_OVERHEAD);
+    uint64_t cycles = now - gen->cycles_at + gen->cycles_spare;
+    int32_t steps = (int32_t)(cycles / step_period);
+    gen->cycles_spare = cycles % step_period;
+    gen->position += (gen->word & 1) ? steps : -steps;
+  } else {
+    gen->cycles_spare = 0;
+  }
+  gen->cycles_at = now;
+}
+
+static struct SimStepGen* gen_for_pin(size_t pin_step) {
+  for(size_t pio = 0; pio < SIM_PIO_COUNT; pio++) {
+    for(size_t sm = 0; sm < SIM_SM_COUNT; sm++) {
+      if(step_gen[pio][sm].enabled && step_gen[pio][sm].pin_step == pin_step) {
+        return &step_gen[pio][sm];
+      }
+    }
+  }
+  return NULL;
+}
+
+void step_gen_program(size_t pio) { (void)pio; }
+void step_count_program(size_t pio) { (void)pio; }
+
+size_t pio_add_program(size_t pio, const void* program) {
+  (void)pio; (void)program;
+  return 0;
+}
+
+int pio_claim_unused_sm(size_t pio, int required) {
+  (void)required;
+  return claimed[pio]++;
+}
+
+void step_gen_program_init(
+    size_t pio, size_t sm, size_t offset, size_t pin_step, size_t pin_direction
+) {
+  (void)offset; (void)pin_direction;
+  program[pio][sm] = SM_STEP_GEN;
+  step_gen[pio][sm] = (struct SimStepGen){.pin_step = pin_step, .cycles_at = pio_cycles()};
+}
+
+void step_count_program_init(
+    size_t pio, size_t sm, size_t offset, size_t pin_step, size_t pin_direction
+) {
+  (void)offset; (void)pin_direction;
+  program[pio][sm] = SM_STEP_COUNT;
+  step_count[pio][sm] = (struct SimStepCount){.pin_step = pin_step};
+}
+
+void pio_sm_set_enabled(size_t pio, size_t sm, int enabled) {
+  if(program[pio][sm] == SM_STEP_COUNT) {
+    step_count[pio][sm].enabled = enabled;
+  } else if(program[pio][sm] == SM_STEP_GEN) {
+    advance(&step_gen[pio][sm]);
+    step_gen[pio][sm].enabled = enabled;
+  }
+}
+
+int pio_sm_is_tx_fifo_full(size_t pio, size_t sm) {
+  (void)pio; (void)sm;
+  return 0;
+}
+
+/* The SM takes a new word at the start of each step, which at any useful
+ * servo period is well within one period, so the FIFO is always seen empty. */
+int pio_sm_is_tx_fifo_empty(size_t pio, size_t sm) {
+  (void)pio; (void)sm;
+  return 1;
+}
+
+void pio_sm_put(size_t pio, size_t sm, size_t word) {
+  advance(&step_gen[pio][sm]);
+  step_gen[pio][sm].word = (uint32_t)word;
+}
+
+size_t pio_sm_get_rx_fifo_level(size_t pio, size_t sm) {
+  return step_count[pio][sm].enabled ? 1 : 0;
+}
+
+size_t pio_sm_get_blocking(size_t pio, size_t sm) {
+  struct SimStepGen* gen = gen_for_pin(step_count[pio][sm].pin_step);
+  if(gen == NULL) {
+    return 0;
+  }
+  advance(gen);
+  return (size_t)(uint32_t)gen->position;
+}
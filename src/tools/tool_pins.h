@@ -0,0 +1,105 @@
+#ifndef TOOL_PINS__H
+#define TOOL_PINS__H
+
+/* HAL pin storage for host tools that run the driver code outside LinuxCNC.
+ * Include after rp2040_network.c. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Storage for every HAL pin of every board. Large enough for any hal_*_t. */
+#define PINS_PER_BOARD 1024
+static double pin_pool[MAX_DEVICES][PINS_PER_BOARD];
+
+static inline void* next_pin(size_t device, size_t* used) {
+  if(*used >= PINS_PER_BOARD) {
+    fprintf(stderr, "PINS_PER_BOARD too small\n");
+    exit(EXIT_FAILURE);
+  }
+  return &pin_pool[device][(*used)++];
+}
+
+#define PIN(field) (data->field = next_pin(device, &used))
+
+/* Point every pin of data at zeroed storage, as hal_pin_*_newf() would, and
+ * set the defaults export_board() does. */
+static inline void setup_pins(skeleton_t* data, size_t device) {
+  size_t used = 0;
+  memset(data, 0, sizeof(*data));
+  memset(pin_pool[device], 0, sizeof(pin_pool[device]));
+
+  PIN(seq_in);
+  PIN(seq_out);
+  PIN(packet_interval);
+  PIN(rx_miss_count);
+  PIN(eth_up);
+  PIN(machine_on);
+  PIN(config_complete);
+  for(size_t joint = 0; joint < MAX_JOINT; joint++) {
+    PIN(joint_enable_cmd[joint]);
+    PIN(joint_vel_limit[joint]);
+    PIN(joint_accel_limit[joint]);
+    PIN(joint_scale[joint]);
+    PIN(joint_pos_cmd[joint]);
+    PIN(joint_vel_cmd[joint]);
+    PIN(joint_pos_fb[joint]);
+    PIN(joint_vel_fb[joint]);
+    PIN(joint_pos_error_fb[joint]);
+    PIN(joint_enable_fb[joint]);
+    PIN(joint_vel_calculated[joint]);
+    PIN(joint_ferror_suggest[joint]);
+    /* Positions in steps unless the tool sets a scale. */
+    *data->joint_scale[joint] = 1.0;
+    data->joint_gpio_step[joint] = -1;
+    data->joint_gpio_dir[joint] = -1;
+    data->joint_cmd_type[joint] = JOINT_CMD_POSITION;
+  }
+  PIN(core1_period);
+  PIN(core1_tick);
+  PIN(core1_work_us);
+  PIN(core0_work_us);
+  PIN(update_overrun);
+  PIN(update_underrun);
+  PIN(periods_coasted);
+  PIN(clock_offset_us);
+  PIN(clock_drift_ppm);
+  PIN(latency_up_us);
+  PIN(latency_down_us);
+  PIN(round_trip_us);
+  PIN(tick_phase_error_us);
+  for(size_t tx_class = 0; tx_class < TX_CLASS_COUNT; tx_class++) {
+    PIN(tx_class_bytes[tx_class]);
+  }
+  PIN(feedback_mode);
+  for(size_t hist = 0; hist < HIST_COUNT; hist++) {
+    PIN(hist_p50_us[hist]);
+    PIN(hist_p99_us[hist]);
+    PIN(hist_max_us[hist]);
+  }
+  PIN(hist_reset);
+  for(size_t gpio = 0; gpio < MAX_GPIO; gpio++) {
+    PIN(gpio_data_in[gpio]);
+    PIN(gpio_data_in_not[gpio]);
+    PIN(gpio_data_out[gpio]);
+    PIN(gpio_data_out_invert[gpio]);
+    *data->gpio_data_in[gpio] = true;
+    data->gpio_type[gpio] = GPIO_TYPE_NOT_SET;
+  }
+  for(size_t bank = 0; bank < MAX_GPIO_BANK; bank++) {
+    data->gpio_confirmation_pending[bank] = true;
+  }
+  for(size_t spindle = 0; spindle < MAX_SPINDLE; spindle++) {
+    PIN(spindle_fwd[spindle]);
+    PIN(spindle_rev[spindle]);
+    PIN(spindle_speed_fb[spindle]);
+    PIN(spindle_speed_cmd[spindle]);
+    PIN(spindle_at_speed[spindle]);
+    data->spindle_vfd_type[spindle] = MODBUS_TYPE_NOT_SET;
+    data->spindle_poles[spindle] = 4.0;
+  }
+}
+
+#undef PIN
+
+#endif  // TOOL_PINS__H